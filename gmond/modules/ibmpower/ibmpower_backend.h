@@ -0,0 +1,120 @@
+/******************************************************************************
+ *
+ *  ibmpower_backend.h - interface between libibmpower and its backends
+ *
+ *  A backend fills the raw counters of an ibmpower_snapshot from one
+ *  platform interface.  Everything above it (the source cache, the rate
+ *  engine and the counter reset checks) lives in libibmpower.c and is
+ *  shared by all platforms.  This header is not installed.
+ *
+ *     procfs     Linux on Power, /proc/ppc64/lparcfg, /proc/stat and
+ *                /proc/diskstats  (ibmpower_procfs.c)
+ *     perfstat   AIX, libperfstat  (ibmpower_perfstat.c)
+ *     fixture    counters from a "key=value" file, to replay recorded or
+ *                made up values on any system  (ibmpower_fixture.c)
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.1, Oct 18, 2026
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - added open() with close-on-exec on systems without
+ *                  O_CLOEXEC
+ *                  (--> ibmpower_open_cloexec() )
+ *                - added the boot time and the times per CPU
+ *                  (--> boot_time, cpu_times() )
+ *                - added reads with a deadline
+ *                  (--> set_guard(), IBMPOWER_SAMPLE_LATE,
+ *                       IBMPOWER_SAMPLE_BUSY )
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#ifndef IBMPOWER_BACKEND_H
+#define IBMPOWER_BACKEND_H
+
+#include <stddef.h>
+
+#include "libibmpower.h"
+
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+
+/* properties of the system the rate engine depends on */
+typedef struct
+{
+   int has_lparcfg;      /* LPAR counters (PURR, pool idle time) exist */
+   int kvm_guest;
+   int purr_usable;
+   long long timebase;   /* ticks per second of purr and pool_idle_time */
+   long long boot_time;  /* epoch seconds, 0 = unknown */
+} ibmpower_system;
+
+
+typedef struct
+{
+   const char *name;
+
+/* private state of the backend, arg is backend specific, NULL on error */
+   void *(*open)( const char *arg );
+   void (*close)( void *priv );
+
+/* called at open and every few minutes to notice LPAR mobility */
+   void (*system)( void *priv, ibmpower_system *sys );
+
+/*
+ * Fill the fields of one IBMPOWER_SAMPLE_* source, setting those which
+ * are not available to -1 (or 0 for the unsigned ones).  Returns TRUE if
+ * the source could be read, IBMPOWER_SAMPLE_LATE without touching snap
+ * if its read missed the deadline and IBMPOWER_SAMPLE_BUSY, also without
+ * touching snap, if its read has not started yet.
+ */
+   int (*sample)( void *priv, unsigned int source, ibmpower_snapshot *snap );
+
+/* time stamp of a sample in seconds, NULL or < 0 means CLOCK_MONOTONIC */
+   double (*now)( void *priv );
+
+/* times of the single CPUs at the last IBMPOWER_SAMPLE_CPU, may be NULL */
+   int (*cpu_times)( void *priv, ibmpower_cpu *cpus, int max );
+
+/* read the files by guard with a deadline, NULL if there are no files */
+   void (*set_guard)( void *priv, ibmpower_guard *guard, int deadline_msec );
+} ibmpower_backend;
+
+#define IBMPOWER_SAMPLE_LATE  (-1)
+#define IBMPOWER_SAMPLE_BUSY  (-2)
+
+
+extern const ibmpower_backend ibmpower_procfs_backend;
+#if defined(AIX)
+extern const ibmpower_backend ibmpower_perfstat_backend;
+#endif
+extern const ibmpower_backend ibmpower_fixture_backend;
+
+
+/* a file read as a whole into a buffer which is kept between reads */
+typedef struct
+{
+   char *data;
+   size_t size;    /* allocated bytes */
+   size_t len;     /* bytes read, data[len] is '\0' */
+} ibmpower_buffer;
+
+char *ibmpower_read_file( const char *name, ibmpower_buffer *b );
+
+/*
+ * open() whose descriptor is not inherited by the commands the module
+ * runs, with O_CLOEXEC where the system has it and fcntl() otherwise.
+ */
+int ibmpower_open_cloexec( const char *name, int flags, int mode );
+
+
+#endif /* IBMPOWER_BACKEND_H */
@@ -0,0 +1,266 @@
+/******************************************************************************
+ *
+ *  ibmpower_fixture.c - fixture backend of libibmpower
+ *
+ *  Reads the counters from a file of "key=value" lines, for example
+ *
+ *     time=120.0
+ *     timebase=512000000
+ *     entitled_capacity=150
+ *     purr=1024000000
+ *     cpu_total=8000
+ *     cpu_idle=6000
+ *
+ *  The keys are the names of the ibmpower_snapshot fields, plus "time"
+ *  (seconds, otherwise CLOCK_MONOTONIC is used) and the system properties
+ *  "has_lparcfg", "kvm_guest", "purr_usable", "timebase" and "boot_time".
+ *  A source is valid if the file has at least one of its keys.  The file
+ *  is re-read for every sample, so a test driver or a replay tool rewrites
+ *  it between two samples.  Lines starting with '#' are ignored.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.0, Oct 18, 2026
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ibmpower_backend.h"
+
+
+enum { F_LL, F_ULL, F_INT };
+
+#define SRC_SYSTEM 0    /* not a sample source */
+
+static const struct
+{
+   const char *key;
+   unsigned int source;
+   int type;
+   size_t offset;
+} fixture_keys[] =
+{
+   { "entitled_capacity",     IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, entitled_capacity ) },
+   { "active_processors",     IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, active_processors ) },
+   { "pool_id",               IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, pool_id ) },
+   { "pool_num_procs",        IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, pool_num_procs ) },
+   { "shared_processor_mode", IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, shared_processor_mode ) },
+   { "capped",                IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, capped ) },
+   { "weight",                IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, weight ) },
+   { "purr",                  IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, purr ) },
+   { "pool_idle_time",        IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, pool_idle_time ) },
+   { "dispatches",            IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, dispatches ) },
+   { "dispersions",           IBMPOWER_SAMPLE_LPAR, F_LL,  offsetof( ibmpower_snapshot, dispersions ) },
+   { "online_cpus",           IBMPOWER_SAMPLE_CPU,  F_INT, offsetof( ibmpower_snapshot, online_cpus ) },
+   { "cpu_total",             IBMPOWER_SAMPLE_CPU,  F_ULL, offsetof( ibmpower_snapshot, cpu_total ) },
+   { "cpu_idle",              IBMPOWER_SAMPLE_CPU,  F_ULL, offsetof( ibmpower_snapshot, cpu_idle ) },
+   { "cpu_steal",             IBMPOWER_SAMPLE_CPU,  F_ULL, offsetof( ibmpower_snapshot, cpu_steal ) },
+   { "procs_running",         IBMPOWER_SAMPLE_CPU,  F_LL,  offsetof( ibmpower_snapshot, procs_running ) },
+   { "procs_blocked",         IBMPOWER_SAMPLE_CPU,  F_LL,  offsetof( ibmpower_snapshot, procs_blocked ) },
+   { "disk_ios",              IBMPOWER_SAMPLE_DISK, F_ULL, offsetof( ibmpower_snapshot, disk_ios ) },
+   { "disk_read_bytes",       IBMPOWER_SAMPLE_DISK, F_ULL, offsetof( ibmpower_snapshot, disk_read_bytes ) },
+   { "disk_write_bytes",      IBMPOWER_SAMPLE_DISK, F_ULL, offsetof( ibmpower_snapshot, disk_write_bytes ) },
+   { "disk_io_msec",          IBMPOWER_SAMPLE_DISK, F_ULL, offsetof( ibmpower_snapshot, disk_io_msec ) },
+   { "has_lparcfg",           SRC_SYSTEM,           F_INT, offsetof( ibmpower_system, has_lparcfg ) },
+   { "kvm_guest",             SRC_SYSTEM,           F_INT, offsetof( ibmpower_system, kvm_guest ) },
+   { "purr_usable",           SRC_SYSTEM,           F_INT, offsetof( ibmpower_system, purr_usable ) },
+   { "timebase",              SRC_SYSTEM,           F_LL,  offsetof( ibmpower_system, timebase ) },
+   { "boot_time",             SRC_SYSTEM,           F_LL,  offsetof( ibmpower_system, boot_time ) },
+   { NULL, 0, 0, 0 }
+};
+
+
+typedef struct
+{
+   char *file;
+   ibmpower_buffer buf;
+} my_fixture;
+
+
+
+static void
+my_store( void *base, int type, size_t offset, const char *value )
+{
+   char *p = (char *) base + offset;
+
+
+   switch (type)
+   {
+      case F_LL:  *(long long *) p = strtoll( value, (char **) NULL, 10 );           break;
+      case F_ULL: *(unsigned long long *) p = strtoull( value, (char **) NULL, 10 ); break;
+      case F_INT: *(int *) p = (int) strtol( value, (char **) NULL, 10 );            break;
+   }
+}
+
+
+
+/*
+ * Store the values of the keys of one source into base, which is an
+ * ibmpower_snapshot or an ibmpower_system.  With key set only that key
+ * is looked for and its value copied into value.  TRUE if any key of the
+ * source was found.
+ */
+static int
+my_parse( my_fixture *fx, unsigned int source, void *base, const char *key, char *value, size_t len )
+{
+   char *p, *eq, *eol;
+   size_t keylen, n;
+   int i, found = FALSE;
+
+
+   p = ibmpower_read_file( fx->file, &fx->buf );
+
+   while (p && *p)
+   {
+      eol = strchr( p, '\n' );
+      if (eol == NULL)
+         eol = p + strlen( p );
+
+      eq = memchr( p, '=', eol - p );
+
+      if ((*p != '#') && eq)
+      {
+         keylen = eq - p;
+
+         if (key)
+         {
+            if ((strlen( key ) == keylen) && (! strncmp( key, p, keylen )))
+            {
+               n = eol - (eq+1);
+               if (n > len - 1)
+                  n = len - 1;
+               memcpy( value, eq+1, n );
+               value[n] = '\0';
+               return( TRUE );
+            }
+         }
+         else
+         {
+            for (i = 0;  fixture_keys[i].key;  i++)
+               if ((fixture_keys[i].source == source) &&
+                   (strlen( fixture_keys[i].key ) == keylen) &&
+                   (! strncmp( fixture_keys[i].key, p, keylen )))
+               {
+                  my_store( base, fixture_keys[i].type, fixture_keys[i].offset, eq+1 );
+                  found = TRUE;
+                  break;
+               }
+         }
+      }
+
+      p = *eol ? eol + 1 : eol;
+   }
+
+   return( found );
+}
+
+
+
+static void *
+fixture_open( const char *arg )
+{
+   my_fixture *fx;
+
+
+   if (arg == NULL)
+      return( NULL );
+
+   fx = calloc( 1, sizeof( *fx ) );
+   if (fx == NULL)
+      return( NULL );
+
+   fx->file = strdup( arg );
+   if (fx->file == NULL)
+   {
+      free( fx );
+      return( NULL );
+   }
+
+   return( fx );
+}
+
+
+
+static void
+fixture_close( void *priv )
+{
+   my_fixture *fx = (my_fixture *) priv;
+
+
+   free( fx->buf.data );
+   free( fx->file );
+   free( fx );
+}
+
+
+
+static void
+fixture_system( void *priv, ibmpower_system *sys )
+{
+   sys->has_lparcfg = TRUE;
+   sys->kvm_guest = FALSE;
+   sys->purr_usable = TRUE;
+   sys->timebase = 512000000LL;    /* POWER timebase frequency */
+   sys->boot_time = 0LL;
+
+   my_parse( (my_fixture *) priv, SRC_SYSTEM, sys, (const char *) NULL, (char *) NULL, 0 );
+}
+
+
+
+static int
+fixture_sample( void *priv, unsigned int source, ibmpower_snapshot *snap )
+{
+   int i;
+
+
+   for (i = 0;  fixture_keys[i].key;  i++)
+   {
+      if (fixture_keys[i].source != source)
+         continue;
+
+      if (fixture_keys[i].type == F_LL)
+         *(long long *) ((char *) snap + fixture_keys[i].offset) = -1LL;
+      else if (fixture_keys[i].type == F_ULL)
+         *(unsigned long long *) ((char *) snap + fixture_keys[i].offset) = 0ULL;
+      else
+         *(int *) ((char *) snap + fixture_keys[i].offset) = 0;
+   }
+
+   return( my_parse( (my_fixture *) priv, source, snap, (const char *) NULL, (char *) NULL, 0 ) );
+}
+
+
+
+static double
+fixture_now( void *priv )
+{
+   char value[64];
+
+
+   if (! my_parse( (my_fixture *) priv, SRC_SYSTEM, NULL, "time", value, sizeof( value ) ))
+      return( -1.0 );
+
+   return( strtod( value, (char **) NULL ) );
+}
+
+
+
+const ibmpower_backend ibmpower_fixture_backend =
+{
+   "fixture",
+   fixture_open,
+   fixture_close,
+   fixture_system,
+   fixture_sample,
+   fixture_now,
+   NULL,
+   NULL
+};
@@ -0,0 +1,412 @@
+/******************************************************************************
+ *
+ *  ibmpower_guard.c - reads with a deadline for libibmpower and its users
+ *
+ *  Reads of lparcfg, /proc/stat and device-tree files have been seen to
+ *  hang during firmware updates and hypervisor maintenance.  A guard has
+ *  a reader thread, started by ibmpower_guard_open() and kept until
+ *  ibmpower_guard_close(), which runs the queued reads one after another
+ *  while every caller waits for its own read at most until its deadline.
+ *  The deadline is taken on CLOCK_MONOTONIC where the condition variable
+ *  supports it, so setting the clock does not stretch or cut it.
+ *
+ *  A read which misses its deadline keeps its thread, and a new reader
+ *  thread takes over the queue, so the other sources are not stuck behind
+ *  it.  The source of the late read is not queued again until the read has
+ *  returned, so there is at most one hung thread per source.  The thread
+ *  ends when the read returns, and the result is handed to the next
+ *  ibmpower_guard_read() of its source.  A read still queued when its
+ *  caller stops waiting has not started: it stays queued, but it is not
+ *  counted as a timeout and does not make the source stale.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.1, Oct 18, 2026
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - a read which misses its deadline hands the queue to a
+ *                  new reader thread instead of blocking the other
+ *                  sources, a read which never started is not a timeout
+ *                  (--> my_reader_start(), ibmpower_guard_read() )
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release, the guarded reads of the module with
+ *                  one persistent reader thread instead of a detached
+ *                  thread per read
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "libibmpower.h"
+
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+
+typedef struct my_reader
+{
+   struct ibmpower_guard *guard;
+   pthread_t thread;
+   ibmpower_guarded *current;     /* read the thread runs right now */
+   int late;                      /* current missed its deadline, no new reader started */
+   int detached;                  /* frees itself, not joined at the close */
+} my_reader;
+
+
+struct ibmpower_guard
+{
+   pthread_mutex_t lock;
+   pthread_cond_t work;           /* a read was queued or stop set */
+   pthread_cond_t done;           /* a read has returned */
+   clockid_t clock;               /* of the deadlines, the clock of done */
+
+/* protected by lock */
+   ibmpower_guarded *head;        /* queued reads, oldest first */
+   ibmpower_guarded *tail;
+   my_reader *reader;             /* the thread which takes reads off the queue */
+   int threads;                   /* the reader and the threads of late reads */
+   int stop;
+   int orphaned;                  /* closed while reads hung, the last thread frees us */
+   long long timeouts;
+};
+
+
+
+static void
+my_guard_free( ibmpower_guard *guard )
+{
+   pthread_cond_destroy( &guard->work );
+   pthread_cond_destroy( &guard->done );
+   pthread_mutex_destroy( &guard->lock );
+   free( guard );
+}
+
+
+
+/*
+ * Runs the queued reads until the guard is closed or, after one of its
+ * reads missed the deadline, another thread has become the reader.
+ */
+static void *
+my_reader_run( void *arg )
+{
+   my_reader *r = (my_reader *) arg;
+   ibmpower_guard *guard = r->guard;
+   ibmpower_guarded *src;
+   int ok, detached, last;
+
+
+   pthread_mutex_lock( &guard->lock );
+
+   for (;;)
+   {
+      while ((! guard->stop) && (guard->reader == r) && (guard->head == NULL))
+         pthread_cond_wait( &guard->work, &guard->lock );
+
+      if (guard->stop || (guard->reader != r))
+         break;
+
+      src = guard->head;
+      guard->head = src->next;
+      if (guard->head == NULL)
+         guard->tail = (ibmpower_guarded *) NULL;
+      src->next = (ibmpower_guarded *) NULL;
+      src->queued = FALSE;
+      src->busy = TRUE;
+      r->current = src;
+
+      pthread_mutex_unlock( &guard->lock );
+
+      ok = src->read( src->arg );
+
+      pthread_mutex_lock( &guard->lock );
+
+      r->current = (ibmpower_guarded *) NULL;
+      r->late = FALSE;
+
+/* closed meanwhile, the source is ours to release */
+      if (guard->orphaned)
+      {
+         if (src->release)
+            src->release( src->arg );
+         break;
+      }
+
+      src->ok = ok;
+      src->busy = FALSE;
+      pthread_cond_broadcast( &guard->done );
+   }
+
+   if (guard->reader == r)
+      guard->reader = (my_reader *) NULL;
+
+   guard->threads--;
+   detached = r->detached;
+   last = guard->orphaned && (guard->threads == 0);
+
+   pthread_mutex_unlock( &guard->lock );
+
+   if (detached)
+      free( r );
+
+   if (last)
+      my_guard_free( guard );
+
+   return( (void *) NULL );
+}
+
+
+
+/*
+ * Start a thread which takes over the queue, with guard->lock held.  The
+ * old reader is left to its late read and ends when that returns.
+ */
+static int
+my_reader_start( ibmpower_guard *guard )
+{
+   my_reader *r, *old = guard->reader;
+
+
+   r = calloc( 1, sizeof( *r ) );
+   if (r == NULL)
+      return( FALSE );
+
+   r->guard = guard;
+
+   if (pthread_create( &r->thread, (pthread_attr_t *) NULL, my_reader_run, r ) != 0)
+   {
+      free( r );
+      return( FALSE );
+   }
+
+   guard->threads++;
+   guard->reader = r;
+
+   if (old)
+   {
+      old->detached = TRUE;
+      pthread_detach( old->thread );
+   }
+
+   return( TRUE );
+}
+
+
+
+ibmpower_guard *
+ibmpower_guard_open( void )
+{
+   ibmpower_guard *guard;
+   pthread_condattr_t attr;
+   int ok;
+
+
+   guard = calloc( 1, sizeof( *guard ) );
+   if (guard == NULL)
+      return( (ibmpower_guard *) NULL );
+
+   pthread_mutex_init( &guard->lock, (pthread_mutexattr_t *) NULL );
+   pthread_cond_init( &guard->work, (pthread_condattr_t *) NULL );
+
+/* systems without clock selection wait on the wall clock */
+   guard->clock = CLOCK_REALTIME;
+   pthread_condattr_init( &attr );
+   if (pthread_condattr_setclock( &attr, CLOCK_MONOTONIC ) == 0)
+      guard->clock = CLOCK_MONOTONIC;
+   pthread_cond_init( &guard->done, &attr );
+   pthread_condattr_destroy( &attr );
+
+   pthread_mutex_lock( &guard->lock );
+   ok = my_reader_start( guard );
+   pthread_mutex_unlock( &guard->lock );
+
+   if (! ok)
+   {
+      my_guard_free( guard );
+      return( (ibmpower_guard *) NULL );
+   }
+
+   return( guard );
+}
+
+
+
+void
+ibmpower_guard_close( ibmpower_guard *guard )
+{
+   ibmpower_guarded *src;
+   my_reader *idle = (my_reader *) NULL;
+   int hung;
+
+
+   if (guard == NULL)
+      return;
+
+   pthread_mutex_lock( &guard->lock );
+
+   guard->stop = TRUE;
+
+   while ((src = guard->head))
+   {
+      guard->head = src->next;
+      src->next = (ibmpower_guarded *) NULL;
+      src->queued = FALSE;
+   }
+   guard->tail = (ibmpower_guarded *) NULL;
+
+/* an idle reader is joined, one in a read is left to it like the late ones */
+   if (guard->reader)
+   {
+      if (guard->reader->current == NULL)
+         idle = guard->reader;
+      else
+      {
+         guard->reader->detached = TRUE;
+         pthread_detach( guard->reader->thread );
+      }
+   }
+
+   pthread_cond_broadcast( &guard->work );
+   pthread_mutex_unlock( &guard->lock );
+
+   if (idle)
+   {
+      pthread_join( idle->thread, (void **) NULL );
+      free( idle );
+   }
+
+/* the reads which hang keep busy set, the last thread releases them and frees the guard */
+   pthread_mutex_lock( &guard->lock );
+   hung = (guard->threads > 0);
+   guard->orphaned = hung;
+   pthread_mutex_unlock( &guard->lock );
+
+   if (! hung)
+      my_guard_free( guard );
+}
+
+
+
+int
+ibmpower_guard_read( ibmpower_guard *guard, ibmpower_guarded *src, int deadline_msec )
+{
+   struct timespec ts;
+   int rc;
+
+
+/* no reader thread, read without a deadline rather than not at all */
+   if (guard == NULL)
+   {
+      if (! src->read( src->arg ))
+         return( 0 );
+      src->stale = FALSE;
+      return( 1 );
+   }
+
+   pthread_mutex_lock( &guard->lock );
+
+/* the last read still hangs or has not started yet, do not queue the source again */
+   if (src->busy || src->queued || guard->stop)
+   {
+      pthread_mutex_unlock( &guard->lock );
+      return( -1 );
+   }
+
+   if (src->late)
+   {
+/* a read which missed its deadline has returned since, use its result */
+      src->late = FALSE;
+      if (src->ok)
+      {
+         src->stale = FALSE;
+         pthread_mutex_unlock( &guard->lock );
+         return( 1 );
+      }
+   }
+
+/* the reader hangs in a late read and a new one could not be started then */
+   if ((guard->reader == NULL) || (guard->reader->late && (! my_reader_start( guard ))))
+   {
+      pthread_mutex_unlock( &guard->lock );
+      return( -1 );
+   }
+
+   src->next = (ibmpower_guarded *) NULL;
+   if (guard->tail)
+      guard->tail->next = src;
+   else
+      guard->head = src;
+   guard->tail = src;
+   src->queued = TRUE;
+   pthread_cond_broadcast( &guard->work );
+
+   clock_gettime( guard->clock, &ts );
+   ts.tv_sec += deadline_msec / 1000;
+   ts.tv_nsec += (deadline_msec % 1000) * 1000000L;
+   if (ts.tv_nsec >= 1000000000L)
+   {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+   }
+
+   rc = 0;
+   while ((src->queued || src->busy) && (rc != ETIMEDOUT))
+      rc = pthread_cond_timedwait( &guard->done, &guard->lock, &ts );
+
+   if (! (src->queued || src->busy))
+   {
+      rc = src->ok ? 1 : 0;
+      if (src->ok)
+         src->stale = FALSE;
+      pthread_mutex_unlock( &guard->lock );
+      return( rc );
+   }
+
+   src->late = TRUE;
+
+/* behind a read which is slow but not late yet, it is read later */
+   if (src->queued)
+   {
+      pthread_mutex_unlock( &guard->lock );
+      return( -1 );
+   }
+
+/* the others are not kept waiting behind this read */
+   if (guard->reader && (guard->reader->current == src) && (! my_reader_start( guard )))
+      guard->reader->late = TRUE;
+
+   src->timeouts++;
+   src->stale = TRUE;
+   guard->timeouts++;
+
+   pthread_mutex_unlock( &guard->lock );
+
+   return( -1 );
+}
+
+
+
+long long
+ibmpower_guard_timeouts( ibmpower_guard *guard )
+{
+   long long timeouts;
+
+
+   if (guard == NULL)
+      return( 0LL );
+
+   pthread_mutex_lock( &guard->lock );
+   timeouts = guard->timeouts;
+   pthread_mutex_unlock( &guard->lock );
+
+   return( timeouts );
+}
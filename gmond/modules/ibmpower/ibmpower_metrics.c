@@ -0,0 +1,199 @@
+/******************************************************************************
+ *
+ *  ibmpower_metrics.c - metric table shared by the AIX and Linux modules
+ *
+ *  The definitions of the static metrics of both modules and the index
+ *  to function dispatch of the metric handler.  Each module passes the
+ *  list of the metrics it has with their functions to
+ *  ibmpower_metrics_build(), see ibmpower_metrics.h.  The order of the
+ *  definitions is the order of the metrics in the table of the module.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.0, Oct 18, 2026
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release, moved from mod_ibmpower-aix.c and
+ *                  mod_ibmpower-linux.c
+ *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "libmetrics.h"
+
+#include "ibmpower_metrics.h"
+
+
+static const Ganglia_25metric ibmpower_metric_defs[] =
+{
+   {0, "capped",           180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is this SPLPAR running in capped mode?"},
+   {0, "cpu_ec",            15, GANGLIA_VALUE_FLOAT,        "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Ratio of physical cores used vs. entitlement"},
+   {0, "cpu_entitlement",  180, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.2f", UDP_HEADER_SIZE+8,  "Capacity entitlement in units of physical cores"},
+   {0, "cpu_in_lpar",      180, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Number of CPUs the OS sees in the system"},
+   {0, "cpu_in_machine",  1200, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Total number of physical cores in the whole system"},
+   {0, "cpu_in_pool",      180, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Number of physical cores in the shared processor pool"},
+   {0, "cpu_in_syspool",   180, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Number of physical cores in the global shared processor pool"},
+   {0, "cpu_pool_id",      180, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Shared processor pool ID of this LPAR"},
+   {0, "cpu_pool_idle",     15, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.4f", UDP_HEADER_SIZE+8,  "Number of idle cores in the shared processor pool"},
+   {0, "cpu_used",          15, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.4f", UDP_HEADER_SIZE+8,  "Number of physical cores used"},
+   {0, "disk_iops",        180, GANGLIA_VALUE_DOUBLE,     "IO/sec", "both", "%.3f", UDP_HEADER_SIZE+16, "Total number of I/O operations per second"},
+   {0, "disk_read",        180, GANGLIA_VALUE_DOUBLE,  "bytes/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Total number of bytes read I/O of the system"},
+   {0, "disk_write",       180, GANGLIA_VALUE_DOUBLE,  "bytes/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Total number of bytes write I/O of the system"},
+   {0, "fwversion",       1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Firmware Version"},
+   {0, "kernel64bit",     1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is the kernel running in 64-bit mode?"},
+   {0, "lpar",            1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is the system an LPAR or not?"},
+   {0, "lpar_name",        180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Name of the LPAR as defined on the HMC"},
+   {0, "lpar_num",        1200, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Partition ID of the LPAR as defined on the HMC"},
+   {0, "model_name",      1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Machine Model Name"},
+   {0, "oslevel",          180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Exact version of the operating system"},
+   {0, "serial_num",      1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Serial number of the hardware system"},
+   {0, "smt",              180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is SMT enabled or not?"},
+   {0, "splpar",          1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is this a shared processor LPAR or not?"},
+   {0, "weight",           180, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Capacity weight of the LPAR"},
+   {0, "kvm_guest",       1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is this a KVM guest VM or not?"},
+   {0, "cpu_type",         180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "CPU model name"},
+   {0, "cpu_dispatches",    15, GANGLIA_VALUE_FLOAT,   "dispatches/sec", "both", "%.2f", UDP_HEADER_SIZE+8, "Number of virtual processor dispatches by the hypervisor per second"},
+   {0, "cpu_dispersions",   15, GANGLIA_VALUE_FLOAT,  "dispersions/sec", "both", "%.2f", UDP_HEADER_SIZE+8, "Number of virtual processor dispatches away from the home core per second"},
+   {0, "cpu_dispersion_pct", 15, GANGLIA_VALUE_FLOAT,       "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Percentage of hypervisor dispatches which were dispersions"},
+   {0, "dispatch_wheel",  1200, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Hypervisor dispatch wheel rotation period"},
+   {0, "cpu_steal",         15, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.4f", UDP_HEADER_SIZE+8,  "Number of CPUs worth of time stolen by the hypervisor"},
+   {0, "cpu_steal_pct",     15, GANGLIA_VALUE_FLOAT,        "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Percentage of CPU time stolen by the hypervisor"},
+   {0, "cmo_enabled",     1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is Active Memory Sharing (CMO) enabled?"},
+   {0, "cmo_entitled_memory", 180, GANGLIA_VALUE_DOUBLE,   "bytes", "both", "%.0f", UDP_HEADER_SIZE+16, "I/O entitled memory of the partition"},
+   {0, "cmo_memory_weight", 180, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Memory weight of the partition in the shared memory pool"},
+   {0, "cmo_backing_memory", 180, GANGLIA_VALUE_DOUBLE,    "bytes", "both", "%.0f", UDP_HEADER_SIZE+16, "Physical memory backing the logical memory of the partition"},
+   {0, "cmo_page_size",   1200, GANGLIA_VALUE_UNSIGNED_INT, "bytes", "both", "%d",  UDP_HEADER_SIZE+8,  "Page size used by the hypervisor for memory sharing"},
+   {0, "cmo_faults",        15, GANGLIA_VALUE_FLOAT,   "faults/sec", "both", "%.2f", UDP_HEADER_SIZE+8, "Number of hypervisor page faults per second"},
+   {0, "cmo_fault_time",    15, GANGLIA_VALUE_FLOAT,    "usec/sec", "both", "%.2f", UDP_HEADER_SIZE+8,  "Time spent waiting for hypervisor page faults per second"},
+   {0, "cmo_fault_latency", 15, GANGLIA_VALUE_FLOAT,        "usec", "both", "%.2f", UDP_HEADER_SIZE+8,  "Average latency of a hypervisor page fault"},
+   {0, "vcpu_disp_same_core", 15, GANGLIA_VALUE_FLOAT,      "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Percentage of vCPU dispatches on the same core as before"},
+   {0, "vcpu_disp_same_chip", 15, GANGLIA_VALUE_FLOAT,      "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Percentage of vCPU dispatches on another core of the same chip"},
+   {0, "vcpu_disp_other_chip", 15, GANGLIA_VALUE_FLOAT,     "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Percentage of vCPU dispatches on a different chip"},
+   {0, "vcpu_disp_remote_node", 15, GANGLIA_VALUE_FLOAT,    "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Percentage of vCPU dispatches outside the home NUMA node"},
+   {0, "vcpu_disp_worst_pct", 15, GANGLIA_VALUE_FLOAT,      "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Highest percentage of different chip dispatches of a single vCPU"},
+   {0, "vcpu_disp_worst",    15, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "vCPUs with the most different chip dispatches"},
+   {0, "smt_threads",      180, GANGLIA_VALUE_UNSIGNED_INT, "threads", "both", "%d", UDP_HEADER_SIZE+8,  "Number of SMT threads per core"},
+   {0, "dlpar_cpu_events", 180, GANGLIA_VALUE_UNSIGNED_INT, "events", "positive", "%u", UDP_HEADER_SIZE+8, "Number of CPU hotplug events since gmond started"},
+   {0, "numa_nodes",       180, GANGLIA_VALUE_UNSIGNED_INT, "nodes", "both", "%d",  UDP_HEADER_SIZE+8,  "Number of online NUMA nodes"},
+   {0, "numa_cpu_nodes",   180, GANGLIA_VALUE_UNSIGNED_INT, "nodes", "both", "%d",  UDP_HEADER_SIZE+8,  "Number of NUMA nodes with CPUs of this LPAR"},
+   {0, "numa_mem_nodes",   180, GANGLIA_VALUE_UNSIGNED_INT, "nodes", "both", "%d",  UDP_HEADER_SIZE+8,  "Number of NUMA nodes with memory of this LPAR"},
+   {0, "numa_cpu_spread",  180, GANGLIA_VALUE_FLOAT,        "nodes", "both", "%.2f", UDP_HEADER_SIZE+8, "Effective number of NUMA nodes the CPUs are spread over"},
+   {0, "numa_mem_spread",  180, GANGLIA_VALUE_FLOAT,        "nodes", "both", "%.2f", UDP_HEADER_SIZE+8, "Effective number of NUMA nodes the memory is spread over"},
+   {0, "numa_cpus",        180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Number of CPUs per NUMA node"},
+   {0, "numa_memory",      180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Memory per NUMA node"},
+   {0, "occ_system_power",  15, GANGLIA_VALUE_FLOAT,        "Watts", "both", "%.1f", UDP_HEADER_SIZE+8, "Power consumption of the whole system reported by the OCC"},
+   {0, "occ_core_temp_max", 15, GANGLIA_VALUE_FLOAT,        "Celsius", "both", "%.1f", UDP_HEADER_SIZE+8, "Highest core temperature reported by the OCC"},
+   {0, "occ_freq",          15, GANGLIA_VALUE_FLOAT,        "MHz",  "both", "%.0f", UDP_HEADER_SIZE+8,  "Average core frequency"},
+   {0, "vnet_interfaces",  180, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Number of virtual Ethernet, vNIC and SR-IOV interfaces"},
+   {0, "vnet_rx_bytes",     15, GANGLIA_VALUE_DOUBLE,  "bytes/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Bytes received by all virtual network interfaces"},
+   {0, "vnet_tx_bytes",     15, GANGLIA_VALUE_DOUBLE,  "bytes/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Bytes sent by all virtual network interfaces"},
+   {0, "vnet_rx_drops",     15, GANGLIA_VALUE_DOUBLE, "packets/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Received packets dropped by all virtual network interfaces"},
+   {0, "vnet_tx_drops",     15, GANGLIA_VALUE_DOUBLE, "packets/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Sent packets dropped by all virtual network interfaces"},
+   {0, "veth_pool_buffers", 180, GANGLIA_VALUE_UNSIGNED_INT, "buffers", "both", "%d", UDP_HEADER_SIZE+8, "Buffers in the active ibmveth receive buffer pools"},
+   {0, "veth_rx_no_buffer", 15, GANGLIA_VALUE_FLOAT, "packets/sec", "both", "%.2f", UDP_HEADER_SIZE+8,  "Packets the hypervisor dropped because no ibmveth buffer was free"},
+   {0, "veth_replenish_failures", 15, GANGLIA_VALUE_FLOAT, "failures/sec", "both", "%.2f", UDP_HEADER_SIZE+8, "Failures to replenish the ibmveth receive buffer pools"},
+   {0, "vnic_tx_queue_drops", 15, GANGLIA_VALUE_FLOAT, "packets/sec", "both", "%.2f", UDP_HEADER_SIZE+8, "Packets dropped by the ibmvnic transmit queues"},
+   {0, "vscsi_hosts",      180, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Number of virtual SCSI and virtual Fibre Channel host adapters"},
+   {0, "vscsi_queue_depth", 180, GANGLIA_VALUE_UNSIGNED_INT, "commands", "both", "%d", UDP_HEADER_SIZE+8, "Command queue depth of all virtual SCSI/FC host adapters"},
+   {0, "vscsi_outstanding", 15, GANGLIA_VALUE_UNSIGNED_INT, "commands", "both", "%d", UDP_HEADER_SIZE+8,  "Commands outstanding on all virtual SCSI/FC host adapters"},
+   {0, "vscsi_busy_max_pct", 15, GANGLIA_VALUE_FLOAT,       "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Highest command queue utilization of a virtual SCSI/FC host adapter"},
+   {0, "vscsi_iops",        15, GANGLIA_VALUE_DOUBLE,     "IO/sec", "both", "%.3f", UDP_HEADER_SIZE+16, "I/O operations per second of the devices on virtual SCSI/FC host adapters"},
+   {0, "vscsi_timeouts",    15, GANGLIA_VALUE_FLOAT, "commands/sec", "both", "%.2f", UDP_HEADER_SIZE+8, "Command timeouts (aborts) on virtual SCSI/FC host adapters"},
+   {0, "vscsi_errors",      15, GANGLIA_VALUE_FLOAT, "commands/sec", "both", "%.2f", UDP_HEADER_SIZE+8, "Commands completed with an error on virtual SCSI/FC host adapters"},
+   {0, "runq_per_ec",       15, GANGLIA_VALUE_FLOAT,        "",     "both", "%.2f", UDP_HEADER_SIZE+8,  "Average number of runnable threads per core of entitlement"},
+   {0, "runq_per_vcpu",     15, GANGLIA_VALUE_FLOAT,        "",     "both", "%.2f", UDP_HEADER_SIZE+8,  "Average number of runnable threads per virtual processor"},
+   {0, "runq_blocked",      15, GANGLIA_VALUE_FLOAT,    "threads", "both", "%.2f", UDP_HEADER_SIZE+8,  "Average number of threads blocked waiting for I/O"},
+   {0, "read_timeouts",     15, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Number of procfs/device-tree reads which missed their deadline"},
+   {0, "read_stale",        15, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Number of sources serving their last value because a read hangs"},
+   {0, "disk_await",        15, GANGLIA_VALUE_FLOAT,        "ms",   "both", "%.2f", UDP_HEADER_SIZE+8,  "Average time of a disk operation including the queue"},
+   {0, "sample_interval",   15, GANGLIA_VALUE_UNSIGNED_INT, "ms",   "both", "%d",   UDP_HEADER_SIZE+8,  "Current interval of the adaptive sampler"},
+   {0, "burst_pct",         15, GANGLIA_VALUE_FLOAT,        "%",    "both", "%.1f", UDP_HEADER_SIZE+8,  "Percentage of the time sampled at the fast burst interval"},
+   {0, "bursts",            15, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Number of bursts seen by the adaptive sampler"},
+   {0, "cpu_ec_peak",       15, GANGLIA_VALUE_FLOAT,        "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Highest percentage of the entitlement used in a sample"},
+   {0, "cpu_used_peak",     15, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.4f", UDP_HEADER_SIZE+8,  "Highest number of physical cores used in a sample"},
+   {0, "cpu_pool_idle_min", 15, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.4f", UDP_HEADER_SIZE+8,  "Lowest number of idle cores in the shared pool in a sample"},
+   {0, "disk_await_peak",   15, GANGLIA_VALUE_FLOAT,        "ms",   "both", "%.2f", UDP_HEADER_SIZE+8,  "Highest disk await in a sample"},
+   {0, "hcall_rate",        15, GANGLIA_VALUE_FLOAT,        "calls/sec", "both", "%.1f", UDP_HEADER_SIZE+8, "Number of hypervisor calls per second"},
+   {0, "hcall_time",        15, GANGLIA_VALUE_FLOAT,        "ms/sec", "both", "%.2f", UDP_HEADER_SIZE+8, "Time per second spent in hypervisor calls, summed over all CPUs"},
+   {0, "hcall_top",         15, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Hypervisor calls with the most time, highest first"},
+   {0, "perf_mode",        180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+32, "Events counted by the perf counters: hardware, software or unavailable"},
+   {0, "cpi",               15, GANGLIA_VALUE_FLOAT,        "",     "both", "%.3f", UDP_HEADER_SIZE+8, "Cycles per instruction, all CPUs"},
+   {0, "ips",               15, GANGLIA_VALUE_DOUBLE,  "instr/sec", "both", "%.0f", UDP_HEADER_SIZE+16, "Instructions per second, all CPUs"},
+   {0, "cache_mpki",        15, GANGLIA_VALUE_FLOAT,        "",     "both", "%.3f", UDP_HEADER_SIZE+8, "Cache misses per 1000 instructions"},
+   {0, "cache_miss_pct",    15, GANGLIA_VALUE_FLOAT,        "%",    "both", "%.2f", UDP_HEADER_SIZE+8, "Percentage of cache references which missed"},
+   {0, "cpu_migrations",    15, GANGLIA_VALUE_FLOAT,  "migrations/sec", "both", "%.1f", UDP_HEADER_SIZE+8, "Tasks migrated between CPUs per second"},
+   {0, "irq_rate",          15, GANGLIA_VALUE_FLOAT,        "irq/sec", "both", "%.1f", UDP_HEADER_SIZE+8, "Interrupts per second, all CPUs"},
+   {0, "irq_cpu_max",       15, GANGLIA_VALUE_FLOAT,        "irq/sec", "both", "%.1f", UDP_HEADER_SIZE+8, "Device interrupts per second of the CPU with the most"},
+   {0, "irq_hot_cpu",       15, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+32, "CPU with the most device interrupts"},
+   {0, "irq_imbalance",     15, GANGLIA_VALUE_FLOAT,        "",     "both", "%.2f", UDP_HEADER_SIZE+8, "Device interrupts of the hottest CPU relative to the average CPU"},
+   {0, "cgroup_count",      15, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%u",   UDP_HEADER_SIZE+8, "Number of child cgroups read of the parents listed in param cgroups"},
+   {0, "cgroup_physc",      15, GANGLIA_VALUE_FLOAT,        "cores", "both", "%.4f", UDP_HEADER_SIZE+8, "Physical cores used by these child cgroups"},
+   {0, "cgroup_top",        15, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Child cgroups using the most physical cores, highest first"},
+   {0, NULL}
+};
+
+
+/* functions of the metrics of the table built, by metric index */
+static g_val_t (**dispatch)( void ) = NULL;
+static int ndispatch = 0;
+
+
+
+int
+ibmpower_metrics_build( apr_pool_t *p, const ibmpower_metric_func *funcs,
+                        apr_array_header_t *table )
+{
+   Ganglia_25metric *gmi;
+   int i, j, n;
+
+
+   for (n = 0;  funcs[n].name;  n++)
+      ;
+
+   dispatch = apr_pcalloc( p, (n + 1) * sizeof( dispatch[0] ) );
+   ndispatch = 0;
+
+   for (i = 0;  ibmpower_metric_defs[i].name != NULL;  i++)
+   {
+      for (j = 0;  j < n;  j++)
+         if (! strcmp( funcs[j].name, ibmpower_metric_defs[i].name ))
+            break;
+
+      if ((j == n) || (funcs[j].func == NULL))
+         continue;
+
+      gmi = (Ganglia_25metric *) apr_array_push( table );
+      *gmi = ibmpower_metric_defs[i];
+      dispatch[ndispatch++] = funcs[j].func;
+   }
+
+/* a metric of the platform the shared table does not know would never be reported */
+   for (j = 0;  j < n;  j++)
+   {
+      for (i = 0;  ibmpower_metric_defs[i].name != NULL;  i++)
+         if (! strcmp( funcs[j].name, ibmpower_metric_defs[i].name ))
+            break;
+
+      if (ibmpower_metric_defs[i].name == NULL)
+         err_msg( "ibmpower_metrics_build() has no definition of metric %s", funcs[j].name );
+   }
+
+   return( ndispatch );
+}
+
+
+
+g_val_t
+ibmpower_metrics_value( int metric_index )
+{
+   g_val_t val;
+
+
+   if ((metric_index >= 0) && (metric_index < ndispatch))
+      return( dispatch[metric_index]() );
+
+   memset( &val, 0, sizeof( val ) );
+
+   return( val );
+}
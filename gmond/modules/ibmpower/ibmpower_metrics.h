@@ -0,0 +1,54 @@
+/******************************************************************************
+ *
+ *  ibmpower_metrics.h - metric table shared by the AIX and Linux modules
+ *
+ *  ibmpower_metrics.c has the definitions of all static metrics of the
+ *  module (name, type, units, description etc.).  Each platform lists
+ *  the metrics it has together with their functions, and at init
+ *  ibmpower_metrics_build() makes the metric table of the module out of
+ *  the definitions of exactly these metrics.  A metric the platform
+ *  cannot collect is left out of its list and so is not announced to
+ *  gmond at all, instead of reporting a made up 0.  This header is not
+ *  installed.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.0, Oct 18, 2026
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release, the metric tables and the handler
+ *                  switches of mod_ibmpower-aix.c and mod_ibmpower-linux.c
+ *
+ ******************************************************************************/
+
+#ifndef IBMPOWER_METRICS_H
+#define IBMPOWER_METRICS_H
+
+#include <gm_metric.h>
+
+#include <apr_tables.h>
+
+
+/* a metric of the platform and its function */
+typedef struct
+{
+   const char *name;
+   g_val_t (*func)( void );
+} ibmpower_metric_func;
+
+
+/*
+ * Append the definitions of the metrics in funcs (terminated by a NULL
+ * name) to table, an array of Ganglia_25metric, in the order of the
+ * definitions, and remember their functions for ibmpower_metrics_value().
+ * The table is not terminated, so run time metrics can follow.  Returns
+ * the number of metrics appended, a name without a definition is
+ * reported and skipped.
+ */
+int ibmpower_metrics_build( apr_pool_t *p, const ibmpower_metric_func *funcs,
+                            apr_array_header_t *table );
+
+/* value of the metric at index metric_index of the table built, 0 beyond it */
+g_val_t ibmpower_metrics_value( int metric_index );
+
+#endif /* IBMPOWER_METRICS_H */
@@ -0,0 +1,255 @@
+/******************************************************************************
+ *
+ *  ibmpower_perfstat.c - perfstat backend of libibmpower for AIX
+ *
+ *  Fills the snapshot from perfstat_partition_total(), perfstat_cpu_total()
+ *  and perfstat_disk_total().  The PURR is the sum of the PURR based user,
+ *  system, idle and wait ticks, which advance with the timebase like the
+ *  purr of lparcfg on Linux, and the pool idle time is converted from
+ *  nanoseconds to timebase ticks.  Dispatches and dispersions are not
+ *  available from perfstat.
+ *
+ *  The partition snapshot is shared with the AIX module, see
+ *  ibmpower_perfstat.h.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.1, Oct 18, 2026
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - one perfstat_partition_total() snapshot per collection
+ *                  round for the backend and the module
+ *                  (--> ibmpower_partition_total() )
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#include "ibmpower_backend.h"
+
+#if defined(AIX)
+
+#include <stdlib.h>
+#include <time.h>
+#include <sys/systemcfg.h>
+#include <libperfstat.h>
+
+#include "ibmpower_perfstat.h"
+
+
+#if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+#define HAVE_PARTITION_TOTAL 1
+#endif
+
+
+typedef struct
+{
+   long long timebase;
+} my_perfstat;
+
+
+
+#if defined(HAVE_PARTITION_TOTAL)
+static struct
+{
+   double time;    /* when the snapshot was taken, 0 = never */
+   int valid;
+   perfstat_partition_total_t data;
+} partition_total = { 0.0, FALSE };
+
+
+perfstat_partition_total_t *
+ibmpower_partition_total( double *time )
+{
+   struct timespec ts;
+   double now;
+
+
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+   now = (double) ts.tv_sec + ts.tv_nsec / 1000000000.0;
+
+   if ((partition_total.time == 0.0) ||
+       (now - partition_total.time >= IBMPOWER_PERFSTAT_MAX_AGE) ||
+       (now < partition_total.time))
+   {
+      partition_total.valid = (perfstat_partition_total( NULL, &partition_total.data,
+                                  sizeof( perfstat_partition_total_t ), 1 ) != -1);
+      partition_total.time = now;
+   }
+
+   if (time)
+      *time = partition_total.time;
+
+   return( partition_total.valid ? &partition_total.data : (perfstat_partition_total_t *) NULL );
+}
+#endif
+
+
+
+static void *
+perfstat_open( const char *arg )
+{
+   my_perfstat *ps;
+
+
+   (void) arg;
+
+   ps = calloc( 1, sizeof( *ps ) );
+   if (ps == NULL)
+      return( NULL );
+
+/* Xint/Xfrac converts timebase ticks into nanoseconds */
+   if (_system_configuration.Xint > 0)
+      ps->timebase = (long long) (1000000000.0 * _system_configuration.Xfrac /
+                                  _system_configuration.Xint);
+   else
+      ps->timebase = -1LL;
+
+   return( ps );
+}
+
+
+
+static void
+perfstat_close( void *priv )
+{
+   free( priv );
+}
+
+
+
+static void
+perfstat_system( void *priv, ibmpower_system *sys )
+{
+   my_perfstat *ps = (my_perfstat *) priv;
+
+
+   sys->has_lparcfg = FALSE;
+   sys->kvm_guest = FALSE;
+   sys->purr_usable = TRUE;
+   sys->timebase = ps->timebase;
+   sys->boot_time = 0LL;
+
+#if defined(HAVE_PARTITION_TOTAL)
+   sys->has_lparcfg = (__LPAR() != 0);
+#endif
+}
+
+
+
+static int
+my_sample_partition( my_perfstat *ps, ibmpower_snapshot *s )
+{
+#if defined(HAVE_PARTITION_TOTAL)
+   perfstat_partition_total_t *p;
+#endif
+
+
+   s->entitled_capacity = s->active_processors = s->pool_id = -1LL;
+   s->pool_num_procs = s->shared_processor_mode = s->capped = s->weight = -1LL;
+   s->purr = s->pool_idle_time = s->dispatches = s->dispersions = -1LL;
+
+#if defined(HAVE_PARTITION_TOTAL)
+   if ((p = ibmpower_partition_total( (double *) NULL )) == NULL)
+      return( FALSE );
+
+   s->entitled_capacity = p->entitled_proc_capacity;
+   s->active_processors = p->online_cpus;
+   s->pool_id = p->pool_id;
+   s->pool_num_procs = p->phys_cpus_pool;
+   s->shared_processor_mode = p->type.b.shared_enabled ? 1LL : 0LL;
+   s->capped = p->type.b.capped ? 1LL : 0LL;
+   s->weight = p->var_proc_capacity_weight;
+   s->purr = p->puser + p->psys + p->pidle + p->pwait;
+
+/* only there with "Allow performance information collection" */
+   if (p->type.b.shared_enabled && (ps->timebase > 0LL) && (p->pool_idle_time > 0))
+      s->pool_idle_time = (long long) ((double) p->pool_idle_time / 1000000000.0 * ps->timebase);
+
+   return( TRUE );
+#else
+   return( FALSE );
+#endif
+}
+
+
+
+static int
+my_sample_cpu( ibmpower_snapshot *s )
+{
+   perfstat_cpu_total_t c;
+
+
+   s->online_cpus = 0;
+   s->cpu_total = s->cpu_idle = s->cpu_steal = 0ULL;
+   s->procs_running = s->procs_blocked = -1LL;
+
+   if (perfstat_cpu_total( NULL, &c, sizeof( perfstat_cpu_total_t ), 1 ) == -1)
+      return( FALSE );
+
+   s->online_cpus = c.ncpus;
+   s->cpu_total = c.user + c.sys + c.idle + c.wait;
+   s->cpu_idle = c.idle;
+
+   return( TRUE );
+}
+
+
+
+static int
+my_sample_disk( ibmpower_snapshot *s )
+{
+   perfstat_disk_total_t d;
+
+
+/* the service times of perfstat_disk_total_t are not summed, no await */
+   s->disk_ios = s->disk_read_bytes = s->disk_write_bytes = s->disk_io_msec = 0ULL;
+
+   if (perfstat_disk_total( NULL, &d, sizeof( perfstat_disk_total_t ), 1 ) == -1)
+      return( FALSE );
+
+   s->disk_ios = d.xfers;
+
+/* the block counts are in units of 512 bytes */
+   s->disk_read_bytes = d.rblks * 512ULL;
+   s->disk_write_bytes = d.wblks * 512ULL;
+
+   return( TRUE );
+}
+
+
+
+static int
+perfstat_sample( void *priv, unsigned int source, ibmpower_snapshot *snap )
+{
+   switch (source)
+   {
+      case IBMPOWER_SAMPLE_LPAR: return( my_sample_partition( (my_perfstat *) priv, snap ) );
+      case IBMPOWER_SAMPLE_CPU:  return( my_sample_cpu( snap ) );
+      case IBMPOWER_SAMPLE_DISK: return( my_sample_disk( snap ) );
+   }
+
+   return( FALSE );
+}
+
+
+
+const ibmpower_backend ibmpower_perfstat_backend =
+{
+   "perfstat",
+   perfstat_open,
+   perfstat_close,
+   perfstat_system,
+   perfstat_sample,
+   NULL,
+   NULL,
+   NULL
+};
+
+#else
+
+/* ISO C does not allow an empty translation unit */
+typedef int ibmpower_perfstat_unused;
+
+#endif /* AIX */
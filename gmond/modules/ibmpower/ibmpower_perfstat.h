@@ -0,0 +1,43 @@
+/******************************************************************************
+ *
+ *  ibmpower_perfstat.h - perfstat snapshots of libibmpower for the AIX module
+ *
+ *  The perfstat backend keeps one perfstat_partition_total() snapshot
+ *  which it re-uses while it is younger than IBMPOWER_PERFSTAT_MAX_AGE
+ *  seconds.  The AIX module reads the fields the ibmpower_snapshot does
+ *  not carry (SMT, AMS, the LPAR name) from the same snapshot, so one
+ *  collection round calls into the perfstat kernel extension once for
+ *  the partition, however many metrics and contexts ask.  This header
+ *  is not installed.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.0, Oct 18, 2026
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release, moved from mod_ibmpower-aix.c
+ *
+ ******************************************************************************/
+
+#ifndef IBMPOWER_PERFSTAT_H
+#define IBMPOWER_PERFSTAT_H
+
+#if defined(AIX)
+
+#include <libperfstat.h>
+
+
+#define IBMPOWER_PERFSTAT_MAX_AGE (1.0)
+
+
+/*
+ * The current snapshot or NULL if perfstat_partition_total() failed.
+ * *time is set to the CLOCK_MONOTONIC seconds the snapshot was taken,
+ * the same for every caller within IBMPOWER_PERFSTAT_MAX_AGE, so rates
+ * divide by the time between two snapshots.  Not thread safe.
+ */
+perfstat_partition_total_t *ibmpower_partition_total( double *time );
+
+#endif /* AIX */
+
+#endif /* IBMPOWER_PERFSTAT_H */
@@ -0,0 +1,956 @@
+/******************************************************************************
+ *
+ *  ibmpower_procfs.c - procfs backend of libibmpower for Linux on Power
+ *
+ *  Reads the LPAR counters from /proc/ppc64/lparcfg, the CPU times and the
+ *  run queue from /proc/stat and the disk counters from /proc/diskstats.
+ *  The files are read into a buffer of the backend, so different contexts
+ *  can be used from different threads.  The argument of
+ *  ibmpower_open_backend( "procfs", root ) is a directory the files are
+ *  read below instead of /, e.g. a copy of /proc taken on another system.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.1, Oct 18, 2026
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - keep the times of the single CPUs of /proc/stat and
+ *                  read the boot time from it
+ *                  (--> procfs_cpu_times(), my_read_boot_time() )
+ *                - the number scanner moved to libibmpower.h
+ *                  (--> ibmpower_parse_ull() )
+ *                - the argument of the open is a directory the proc files
+ *                  are read below, for benchmarks and tests
+ *                  (--> my_file_new() )
+ *                - read the files through the guard of the context, a
+ *                  file which misses its deadline keeps its last values,
+ *                  one whose read has not started yet is not stale
+ *                  (--> my_read(), procfs_set_guard() )
+ *                - the device and name tables double their buckets once
+ *                  they hold more entries than buckets
+ *                  (--> my_disk_grow(), my_name_grow() )
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release, the collectors of libibmpower.c
+ *                  behind the backend interface
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ibmpower_backend.h"
+
+
+/* initial buckets, doubled once there are more entries than buckets */
+#define DISK_HASH_SIZE      256        /* power of 2 */
+#define NAME_HASH_SIZE      64         /* power of 2 */
+
+
+enum { F_LPARCFG, F_STAT, F_DISKSTATS, F_CPUINFO, F_COUNT };
+
+static const char *const proc_files[F_COUNT] =
+{
+   "/proc/ppc64/lparcfg", "/proc/stat", "/proc/diskstats", "/proc/cpuinfo"
+};
+
+
+/* device names are interned, the state of a device compares them by pointer */
+typedef struct my_name
+{
+   struct my_name *next;
+   unsigned int hash;
+   size_t len;
+   char str[1];
+} my_name;
+
+
+/* counters of one /proc/diskstats device at the last pass */
+typedef struct my_disk
+{
+   struct my_disk *next;
+   unsigned int dev;              /* major << 20 | minor */
+   const my_name *name;
+   unsigned int seen;             /* pass the device was last listed in */
+   unsigned long long ios;
+   unsigned long long rsect;
+   unsigned long long wsect;
+   unsigned long long msec;       /* time spent on reads and writes */
+} my_disk;
+
+
+/*
+ * One of proc_files[] below the root of the open.  A file whose read
+ * still hangs when the context is closed is freed by the reader thread.
+ */
+typedef struct
+{
+   ibmpower_guarded src;
+   ibmpower_buffer result;        /* belongs to the reader thread while src.busy */
+   char path[1];
+} my_file;
+
+
+typedef struct
+{
+   my_file *file[F_COUNT];
+   ibmpower_guard *guard;         /* NULL = read without a deadline */
+   int deadline_msec;
+
+   int has_lparcfg;
+   long long timebase;
+
+   ibmpower_buffer buf;           /* file contents, re-used for every read */
+
+   ibmpower_cpu *cpus;            /* cpuN lines of the last read of /proc/stat */
+   int cpus_size;                 /* entries of cpus */
+   int cpus_end;                  /* highest online CPU + 1 */
+
+   my_disk **disks;                   /* keyed by major:minor */
+   unsigned int disk_mask;            /* buckets - 1 */
+   unsigned int ndisks;
+   my_name **names;
+   unsigned int name_mask;
+   unsigned int nnames;
+   unsigned int disk_pass;
+   unsigned long long disk_ios;       /* sums of the per device increments */
+   unsigned long long disk_rsect;
+   unsigned long long disk_wsect;
+   unsigned long long disk_msec;
+} my_procfs;
+
+
+
+/* runs in the reader thread of the guard */
+static int
+my_file_read( void *arg )
+{
+   my_file *f = (my_file *) arg;
+
+
+   return( ibmpower_read_file( f->path, &f->result ) != NULL );
+}
+
+
+
+static void
+my_file_free( void *arg )
+{
+   my_file *f = (my_file *) arg;
+
+
+   free( f->result.data );
+   free( f );
+}
+
+
+
+/* name below root, a root of NULL or "" is / */
+static my_file *
+my_file_new( const char *root, const char *name )
+{
+   my_file *f;
+   size_t len;
+
+
+   if (root == NULL)
+      root = "";
+
+   len = strlen( root ) + strlen( name );
+   f = calloc( 1, sizeof( *f ) + len );
+   if (f == NULL)
+      return( (my_file *) NULL );
+
+   snprintf( f->path, len + 1, "%s%s", root, name );
+   f->src.name = f->path;
+   f->src.read = my_file_read;
+   f->src.arg = f;
+   f->src.release = my_file_free;
+
+   return( f );
+}
+
+
+
+/*
+ * Contents of one of proc_files[] in pf->buf.  Through the guard the file
+ * is read into a buffer of its own, which is then swapped with pf->buf.
+ * NULL on error, late is set to IBMPOWER_SAMPLE_LATE if the read missed
+ * its deadline or to IBMPOWER_SAMPLE_BUSY if it has not started yet.
+ */
+static char *
+my_read( my_procfs *pf, int file, int *late )
+{
+   my_file *f = pf->file[file];
+   ibmpower_buffer tmp;
+   int rc;
+
+
+   *late = FALSE;
+
+   if (pf->guard == NULL)
+      return( ibmpower_read_file( f->path, &pf->buf ) );
+
+   rc = ibmpower_guard_read( pf->guard, &f->src, pf->deadline_msec );
+   if (rc <= 0)
+   {
+      if (rc < 0)
+         *late = f->src.stale ? IBMPOWER_SAMPLE_LATE : IBMPOWER_SAMPLE_BUSY;
+      return( (char *) NULL );
+   }
+
+   tmp = pf->buf;
+   pf->buf = f->result;
+   f->result = tmp;
+
+   return( pf->buf.data );
+}
+
+
+
+/* value of "key=" at the start of a line of lparcfg, copied into buf */
+static int
+my_lparcfg_string( my_procfs *pf, const char *key, char *buf, size_t len, int *late )
+{
+   char *p, *q;
+   size_t keylen = strlen( key ), n;
+
+
+   p = my_read( pf, F_LPARCFG, late );
+
+   while (p)
+   {
+      if (! strncmp( p, key, keylen ))
+      {
+         p += keylen;
+         q = strchr( p, '\n' );
+         n = q ? (size_t) (q - p) : strlen( p );
+         if (n > len - 1)
+            n = len - 1;
+         memcpy( buf, p, n );
+         buf[n] = '\0';
+         return( TRUE );
+      }
+
+      p = strchr( p, '\n' );
+      if (p)
+         p++;
+   }
+
+   return( FALSE );
+}
+
+
+
+static long long
+my_read_timebase( my_procfs *pf )
+{
+   char *p;
+   int late;
+
+
+   p = my_read( pf, F_CPUINFO, &late );
+   if (p)
+      p = strstr( p, "timebase" );
+   if (p)
+      p = strchr( p, ':' );
+
+   return( p ? strtoll( p+1, (char **) NULL, 10 ) : -1LL );
+}
+
+
+
+static long long
+my_read_boot_time( my_procfs *pf, int *late )
+{
+   char *p;
+
+
+   p = my_read( pf, F_STAT, late );
+   if (p)
+      p = strstr( p, "\nbtime " );
+
+   return( p ? strtoll( p+7, (char **) NULL, 10 ) : 0LL );
+}
+
+
+
+/* model checks of CheckPURRusability() in the module */
+static void
+procfs_system( void *priv, ibmpower_system *sys )
+{
+   my_procfs *pf = (my_procfs *) priv;
+   long long boot_time;
+   char type[64];
+   int found = FALSE, late;
+
+
+/* a read which misses its deadline keeps what was found the last time */
+   boot_time = my_read_boot_time( pf, &late );
+   if (late)
+      return;
+
+   if (pf->has_lparcfg)
+   {
+      found = my_lparcfg_string( pf, "system_type=", type, sizeof( type ), &late );
+      if (late)
+         return;
+   }
+
+   sys->has_lparcfg = pf->has_lparcfg;
+   sys->timebase = pf->timebase;
+   sys->kvm_guest = FALSE;
+   sys->purr_usable = TRUE;
+   sys->boot_time = boot_time;
+
+   if (! found)
+      return;
+
+   if (! strcmp( type, "IBM pSeries (emulated by qemu)" ))
+      sys->kvm_guest = TRUE;
+
+   if ((! strncmp( type, "IBM,8842-21X", 12 )) ||
+       (! strncmp( type, "IBM,8842-41X", 12 )) ||
+       (! strncmp( type, "IBM,8844-31",  11 )) ||
+       (! strncmp( type, "IBM,8844-41",  11 )) ||
+       (! strncmp( type, "IBM,8844-51",  11 )))
+      sys->purr_usable = FALSE;
+}
+
+
+
+/*
+ * lparcfg is "key=value" per line.  The keys of interest are looked up in
+ * one pass over the file instead of one strstr() per key.
+ */
+static const struct
+{
+   const char *key;
+   size_t offset;
+} lparcfg_keys[] =
+{
+   { "partition_entitled_capacity", offsetof( ibmpower_snapshot, entitled_capacity ) },
+   { "partition_active_processors", offsetof( ibmpower_snapshot, active_processors ) },
+   { "pool",                        offsetof( ibmpower_snapshot, pool_id ) },
+   { "pool_num_procs",              offsetof( ibmpower_snapshot, pool_num_procs ) },
+   { "shared_processor_mode",       offsetof( ibmpower_snapshot, shared_processor_mode ) },
+   { "capped",                      offsetof( ibmpower_snapshot, capped ) },
+   { "unallocated_capacity_weight", offsetof( ibmpower_snapshot, weight ) },
+   { "purr",                        offsetof( ibmpower_snapshot, purr ) },
+   { "pool_idle_time",              offsetof( ibmpower_snapshot, pool_idle_time ) },
+   { "dispatches",                  offsetof( ibmpower_snapshot, dispatches ) },
+   { "dispatch_dispersions",        offsetof( ibmpower_snapshot, dispersions ) },
+   { NULL, 0 }
+};
+
+
+static int
+my_sample_lparcfg( my_procfs *pf, ibmpower_snapshot *s )
+{
+   char *p = (char *) NULL, *eq;
+   size_t keylen;
+   int i, late = FALSE;
+
+
+   if (pf->has_lparcfg)
+      p = my_read( pf, F_LPARCFG, &late );
+
+   if (late)
+      return( late );
+
+   for (i = 0;  lparcfg_keys[i].key;  i++)
+      *(long long *) ((char *) s + lparcfg_keys[i].offset) = -1LL;
+
+   if (p == NULL)
+      return( FALSE );
+
+   while (p && *p)
+   {
+      eq = strchr( p, '=' );
+      if (eq == NULL)
+         break;
+
+/* lines without '=' (e.g. the "lparcfg 1.9" header) */
+      if (memchr( p, '\n', eq - p ))
+      {
+         p = strchr( p, '\n' ) + 1;
+         continue;
+      }
+
+      keylen = eq - p;
+
+      for (i = 0;  lparcfg_keys[i].key;  i++)
+         if ((strlen( lparcfg_keys[i].key ) == keylen) &&
+             (! strncmp( lparcfg_keys[i].key, p, keylen )))
+         {
+            *(long long *) ((char *) s + lparcfg_keys[i].offset) = strtoll( eq+1, (char **) NULL, 10 );
+            break;
+         }
+
+      p = strchr( eq, '\n' );
+      if (p)
+         p++;
+   }
+
+   return( TRUE );
+}
+
+
+
+/* user nice system idle iowait irq softirq steal - guest is part of user */
+static const char *
+my_parse_cpu_line( const char *p, ibmpower_cpu *c )
+{
+   unsigned long long v;
+   int i;
+
+
+   c->total = c->idle = c->steal = 0ULL;
+
+   for (i = 0;  i < 8;  i++)
+   {
+      v = ibmpower_parse_ull( &p );
+
+      c->total += v;
+
+      if (i == 3)
+         c->idle = v;
+      else if (i == 7)
+         c->steal = v;
+   }
+
+   return( p );
+}
+
+
+
+/* the entry of CPU n, the array grows with the highest CPU number */
+static ibmpower_cpu *
+my_cpu_entry( my_procfs *pf, int n )
+{
+   ibmpower_cpu *c;
+   int size;
+
+
+   if ((n < 0) || (n >= 65536))
+      return( (ibmpower_cpu *) NULL );
+
+   if (n >= pf->cpus_size)
+   {
+      size = pf->cpus_size ? pf->cpus_size : 64;
+      while (size <= n)
+         size *= 2;
+
+      c = realloc( pf->cpus, size * sizeof( *c ) );
+      if (c == NULL)
+         return( (ibmpower_cpu *) NULL );
+
+      memset( c + pf->cpus_size, 0, (size - pf->cpus_size) * sizeof( *c ) );
+      pf->cpus = c;
+      pf->cpus_size = size;
+   }
+
+   return( &pf->cpus[n] );
+}
+
+
+
+static int
+my_sample_stat( my_procfs *pf, ibmpower_snapshot *s )
+{
+   ibmpower_cpu all, *c;
+   const char *p;
+   char *q;
+   int i, n, late;
+
+
+   p = my_read( pf, F_STAT, &late );
+   if (late)
+      return( late );
+
+   s->online_cpus = 0;
+   s->cpu_total = s->cpu_idle = s->cpu_steal = 0ULL;
+   s->procs_running = s->procs_blocked = -1LL;
+
+   for (i = 0;  i < pf->cpus_end;  i++)
+      pf->cpus[i].online = FALSE;
+   pf->cpus_end = 0;
+
+   if (p == NULL)
+      return( FALSE );
+
+/* the "cpu" lines always come first in /proc/stat */
+   while (p && (strncmp( p, "cpu", 3 ) == 0))
+   {
+      if (p[3] == ' ')
+      {
+         p = my_parse_cpu_line( p+3, &all );
+
+         s->cpu_total = all.total;
+         s->cpu_idle = all.idle;
+         s->cpu_steal = all.steal;
+      }
+      else
+      {
+         s->online_cpus++;
+
+         p += 3;
+         n = (int) ibmpower_parse_ull( &p );
+
+         if ((c = my_cpu_entry( pf, n )))
+         {
+            p = my_parse_cpu_line( p, c );
+            c->online = TRUE;
+            if (n >= pf->cpus_end)
+               pf->cpus_end = n + 1;
+         }
+      }
+
+      p = strchr( p, '\n' );
+      if (p)
+         p++;
+   }
+
+   if (p && (q = strstr( p, "procs_running " )))
+   {
+      p = q + 14;
+      s->procs_running = ibmpower_parse_ull( &p );
+
+      if ((q = strstr( p, "procs_blocked " )))
+      {
+         p = q + 14;
+         s->procs_blocked = ibmpower_parse_ull( &p );
+      }
+   }
+
+   return( TRUE );
+}
+
+
+
+static int
+procfs_cpu_times( void *priv, ibmpower_cpu *cpus, int max )
+{
+   my_procfs *pf = (my_procfs *) priv;
+   int i;
+
+
+   for (i = 0;  i < max;  i++)
+   {
+      if (i < pf->cpus_end)
+         cpus[i] = pf->cpus[i];
+      else
+         memset( &cpus[i], 0, sizeof( cpus[i] ) );
+   }
+
+   return( pf->cpus_end );
+}
+
+
+
+/* major:minor of /proc/diskstats are mostly multiples of 16, mix them */
+static unsigned int
+my_disk_hash( unsigned int dev )
+{
+   dev *= 2654435761U;
+
+   return( dev ^ (dev >> 15) );
+}
+
+
+
+/*
+ * Double the buckets of the name or device table once it holds more
+ * entries than buckets, so a system with tens of thousands of devices
+ * does not walk long chains for every line.  Without memory the table
+ * keeps its size and the chains get longer.
+ */
+static void
+my_name_grow( my_procfs *pf )
+{
+   my_name **t, *n, *next;
+   unsigned int i, mask;
+
+
+   mask = pf->name_mask * 2 + 1;
+   t = calloc( mask + 1, sizeof( *t ) );
+   if (t == NULL)
+      return;
+
+   for (i = 0;  i <= pf->name_mask;  i++)
+   {
+      for (n = pf->names[i];  n;  n = next)
+      {
+         next = n->next;
+         n->next = t[n->hash & mask];
+         t[n->hash & mask] = n;
+      }
+   }
+
+   free( pf->names );
+   pf->names = t;
+   pf->name_mask = mask;
+}
+
+
+
+static void
+my_disk_grow( my_procfs *pf )
+{
+   my_disk **t, *d, *next;
+   unsigned int i, mask;
+
+
+   mask = pf->disk_mask * 2 + 1;
+   t = calloc( mask + 1, sizeof( *t ) );
+   if (t == NULL)
+      return;
+
+   for (i = 0;  i <= pf->disk_mask;  i++)
+   {
+      for (d = pf->disks[i];  d;  d = next)
+      {
+         next = d->next;
+         d->next = t[my_disk_hash( d->dev ) & mask];
+         t[my_disk_hash( d->dev ) & mask] = d;
+      }
+   }
+
+   free( pf->disks );
+   pf->disks = t;
+   pf->disk_mask = mask;
+}
+
+
+
+static const my_name *
+my_intern_name( my_procfs *pf, const char *str, size_t len )
+{
+   my_name *n;
+   unsigned int h = 2166136261U;    /* FNV-1a */
+   size_t i;
+
+
+   for (i = 0;  i < len;  i++)
+      h = (h ^ (unsigned char) str[i]) * 16777619U;
+
+   for (n = pf->names[h & pf->name_mask];  n;  n = n->next)
+      if ((n->hash == h) && (n->len == len) && (! memcmp( n->str, str, len )))
+         return( n );
+
+   n = malloc( sizeof( *n ) + len );
+   if (n == NULL)
+      return( (my_name *) NULL );
+
+   n->hash = h;
+   n->len = len;
+   memcpy( n->str, str, len );
+   n->str[len] = '\0';
+
+   n->next = pf->names[h & pf->name_mask];
+   pf->names[h & pf->name_mask] = n;
+
+   if (++pf->nnames > pf->name_mask + 1)
+      my_name_grow( pf );
+
+   return( n );
+}
+
+
+
+/*
+ * Add the increments of one device since the last pass to the sums.  A
+ * device seen for the first time, a major:minor re-used by another
+ * device and counters going backwards only set the baseline, so that
+ * a path failover or an unmapped LUN does not make the sums drop.
+ */
+static void
+my_disk_update( my_procfs *pf, unsigned int dev, const char *name, size_t namelen,
+                unsigned long long ios, unsigned long long rsect, unsigned long long wsect,
+                unsigned long long msec )
+{
+   my_disk *d, **head;
+
+
+   if (pf->ndisks > pf->disk_mask)
+      my_disk_grow( pf );
+
+   head = &pf->disks[my_disk_hash( dev ) & pf->disk_mask];
+
+   for (d = *head;  d;  d = d->next)
+      if (d->dev == dev)
+         break;
+
+   if (d == NULL)
+   {
+      d = calloc( 1, sizeof( *d ) );
+      if (d == NULL)
+         return;
+
+      d->dev = dev;
+      d->next = *head;
+      *head = d;
+      pf->ndisks++;
+   }
+   else if ((d->name->len == namelen) && (! memcmp( d->name->str, name, namelen )) &&
+            (ios >= d->ios) && (rsect >= d->rsect) && (wsect >= d->wsect) && (msec >= d->msec))
+   {
+      pf->disk_ios += ios - d->ios;
+      pf->disk_rsect += rsect - d->rsect;
+      pf->disk_wsect += wsect - d->wsect;
+      pf->disk_msec += msec - d->msec;
+   }
+
+   if ((d->name == NULL) || (d->name->len != namelen) || memcmp( d->name->str, name, namelen ))
+   {
+      d->name = my_intern_name( pf, name, namelen );
+      if (d->name == NULL)
+      {
+/* keep the entry, it is retired without a name at the end of the pass */
+         d->seen = pf->disk_pass - 1;
+         return;
+      }
+   }
+
+   d->seen = pf->disk_pass;
+   d->ios = ios;
+   d->rsect = rsect;
+   d->wsect = wsect;
+   d->msec = msec;
+}
+
+
+
+/* drop the state of the devices which were not listed in this pass */
+static void
+my_disk_retire( my_procfs *pf )
+{
+   my_disk *d, **pp;
+   unsigned int i;
+
+
+   for (i = 0;  i <= pf->disk_mask;  i++)
+   {
+      pp = &pf->disks[i];
+      while ((d = *pp))
+      {
+         if (d->seen != pf->disk_pass)
+         {
+            *pp = d->next;
+            free( d );
+            pf->ndisks--;
+         }
+         else
+            pp = &d->next;
+      }
+   }
+}
+
+
+
+/*
+ * One pass for the sums the three get_diskstats_*() functions used to
+ * make.  The sums only grow: they are the increments of every device
+ * summed up, not the totals of the devices listed right now.
+ */
+#define DISK_FIELDS 11    /* reads, merges, sectors, ms, writes, ... */
+
+static int
+my_sample_diskstats( my_procfs *pf, ibmpower_snapshot *s )
+{
+   const char *p, *end, *eol, *name, *q;
+   unsigned long long f[DISK_FIELDS];
+   unsigned int major, minor;
+   size_t namelen;
+   int n, late;
+
+
+   p = my_read( pf, F_DISKSTATS, &late );
+   if (late)
+      return( late );
+
+   s->disk_ios = s->disk_read_bytes = s->disk_write_bytes = s->disk_io_msec = 0ULL;
+
+   if (p == NULL)
+      return( FALSE );
+
+   end = p + pf->buf.len;
+   pf->disk_pass++;
+
+   for (;  (p < end) && (eol = memchr( p, '\n', end - p ));  p = eol + 1)
+   {
+      major = (unsigned int) ibmpower_parse_ull( &p );
+      minor = (unsigned int) ibmpower_parse_ull( &p );
+
+      name = ibmpower_skip_blanks( p );
+      for (q = name;  (q < eol) && (*q != ' ') && (*q != '\t');  q++)
+         ;
+      namelen = q - name;
+
+      for (n = 0;  n < DISK_FIELDS;  n++)
+      {
+         q = ibmpower_skip_blanks( q );
+         if (q >= eol)
+            break;
+         f[n] = ibmpower_parse_ull( &q );
+      }
+
+      if (n == 4)  /* skip partitions of a disk (old 4 field format) */
+         continue;
+
+      if (n < 7)
+         continue;
+
+/* read and write milliseconds, missing before the kernel had them */
+      if (n < 8)
+         f[3] = f[7] = 0ULL;
+
+      if ((namelen >= 3) && (! memcmp( name, "dm-", 3 )))
+         continue;
+
+      if ((namelen >= 2) && (! memcmp( name, "md", 2 )))
+         continue;
+
+      my_disk_update( pf, (major << 20) | (minor & 0xfffff), name, namelen,
+                      f[0] + f[4], f[2], f[6], f[3] + f[7] );
+   }
+
+   my_disk_retire( pf );
+
+   s->disk_ios = pf->disk_ios;
+
+/* the sector counts are in units of 512 bytes */
+   s->disk_read_bytes = pf->disk_rsect * 512ULL;
+   s->disk_write_bytes = pf->disk_wsect * 512ULL;
+   s->disk_io_msec = pf->disk_msec;
+
+   return( TRUE );
+}
+
+
+
+static int
+procfs_sample( void *priv, unsigned int source, ibmpower_snapshot *snap )
+{
+   my_procfs *pf = (my_procfs *) priv;
+
+
+   switch (source)
+   {
+      case IBMPOWER_SAMPLE_LPAR: return( my_sample_lparcfg( pf, snap ) );
+      case IBMPOWER_SAMPLE_CPU:  return( my_sample_stat( pf, snap ) );
+      case IBMPOWER_SAMPLE_DISK: return( my_sample_diskstats( pf, snap ) );
+   }
+
+   return( FALSE );
+}
+
+
+
+static void
+procfs_close( void *priv )
+{
+   my_procfs *pf = (my_procfs *) priv;
+   my_disk *d;
+   my_name *n;
+   unsigned int u;
+   int i;
+
+
+   for (u = 0;  pf->disks && (u <= pf->disk_mask);  u++)
+   {
+      while ((d = pf->disks[u]))
+      {
+         pf->disks[u] = d->next;
+         free( d );
+      }
+   }
+
+   for (u = 0;  pf->names && (u <= pf->name_mask);  u++)
+   {
+      while ((n = pf->names[u]))
+      {
+         pf->names[u] = n->next;
+         free( n );
+      }
+   }
+
+/* ibmpower_close() has closed the guard, a file whose read hangs is its */
+   for (i = 0;  i < F_COUNT;  i++)
+      if (pf->file[i] && (! pf->file[i]->src.busy))
+         my_file_free( pf->file[i] );
+
+   free( pf->disks );
+   free( pf->names );
+   free( pf->cpus );
+   free( pf->buf.data );
+   free( pf );
+}
+
+
+
+static void *
+procfs_open( const char *arg )
+{
+   my_procfs *pf;
+   int i;
+
+
+   pf = calloc( 1, sizeof( *pf ) );
+   if (pf == NULL)
+      return( NULL );
+
+   pf->disks = calloc( DISK_HASH_SIZE, sizeof( pf->disks[0] ) );
+   pf->names = calloc( NAME_HASH_SIZE, sizeof( pf->names[0] ) );
+   if ((pf->disks == NULL) || (pf->names == NULL))
+   {
+      procfs_close( pf );
+      return( NULL );
+   }
+   pf->disk_mask = DISK_HASH_SIZE - 1;
+   pf->name_mask = NAME_HASH_SIZE - 1;
+
+   for (i = 0;  i < F_COUNT;  i++)
+   {
+      pf->file[i] = my_file_new( arg, proc_files[i] );
+      if (pf->file[i] == NULL)
+      {
+         procfs_close( pf );
+         return( NULL );
+      }
+   }
+
+   pf->has_lparcfg = (access( pf->file[F_LPARCFG]->path, R_OK ) == 0);
+   pf->timebase = my_read_timebase( pf );
+
+   return( pf );
+}
+
+
+
+static void
+procfs_set_guard( void *priv, ibmpower_guard *guard, int deadline_msec )
+{
+   my_procfs *pf = (my_procfs *) priv;
+
+
+   pf->guard = guard;
+   pf->deadline_msec = deadline_msec;
+}
+
+
+
+const ibmpower_backend ibmpower_procfs_backend =
+{
+   "procfs",
+   procfs_open,
+   procfs_close,
+   procfs_system,
+   procfs_sample,
+   NULL,
+   procfs_cpu_times,
+   procfs_set_guard
+};
@@ -0,0 +1,426 @@
+/******************************************************************************
+ *
+ *  ibmpower_recorder.c - flight recorder of libibmpower
+ *
+ *  A ring of fixed size records in a file which is mapped into memory.
+ *  Every record holds the increments of one interval (core seconds used,
+ *  pool idle core seconds, disk operations and bytes) plus the entitlement
+ *  and the steal percentage, so the file covers a fixed time span and the
+ *  rates of any second in it can be recomputed.
+ *
+ *  File layout (native byte order, the dump tool runs on the same host):
+ *
+ *     page 0       my_recorder_header
+ *     page 1...    records slots of my_record
+ *
+ *  There is one writer per file, enforced by a lock at open: flock(), on
+ *  AIX an fcntl() lock, which only keeps other processes out.  Writing a
+ *  record is a few stores into the mapping: the slot's sequence number is
+ *  cleared, the fields are written and the sequence number is set again,
+ *  then the header's record count is advanced.  A reader copies a slot and
+ *  accepts it only if the sequence number is the expected one before and
+ *  after the copy.  No locks and no system calls are needed in steady state,
+ *  the kernel writes the dirty pages back, so the file survives a restart
+ *  (or a crash) of the writer.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.1, Oct 18, 2026
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - builds on AIX, which has neither flock() nor O_CLOEXEC
+ *                  at all levels
+ *                  (--> my_lock_writer(), ibmpower_open_cloexec() )
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#if ! defined(AIX)
+#include <sys/file.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libibmpower.h"
+#include "ibmpower_backend.h"
+
+
+#define RECORDER_MAGIC      "IBMPWRFR"
+#define RECORDER_VERSION    1
+#define RECORDER_BYTE_ORDER 0x01020304u
+#define HEADER_SIZE         4096
+
+#define MAX_INTERVAL_MSEC   65535    /* longer intervals are not recorded */
+
+
+typedef struct
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t byte_order;
+   uint32_t record_size;
+   uint32_t records;             /* slots of the ring */
+   volatile uint64_t next;       /* records ever written */
+} my_recorder_header;
+
+
+/* 36 bytes per interval */
+typedef struct
+{
+   volatile uint32_t seq;        /* record number + 1 (low 32 bits), 0 while written */
+   uint32_t time;                /* wall clock at the end of the interval */
+   uint16_t interval_msec;
+   uint16_t entitlement;         /* 1/100 cores */
+   uint32_t used_usec;           /* core microseconds used (PURR increment) */
+   uint32_t pool_idle_usec;      /* core microseconds idle in the shared pool */
+   uint16_t steal;               /* 1/100 % of the CPU time */
+   uint16_t valid;               /* IBMPOWER_SAMPLE_* */
+   uint32_t disk_ios;
+   uint32_t disk_read_kb;
+   uint32_t disk_write_kb;
+} my_record;
+
+
+struct ibmpower_recorder
+{
+   int fd;
+   int writable;
+   size_t size;
+   my_recorder_header *h;
+   my_record *ring;
+};
+
+
+
+/* full barrier, available from gcc and xlc */
+#define my_barrier() __sync_synchronize()
+
+
+
+static uint32_t
+my_u32( double v )
+{
+   if (v <= 0.0)
+      return( 0 );
+   if (v >= 4294967295.0)
+      return( 4294967295u );
+
+   return( (uint32_t) (v + 0.5) );
+}
+
+
+
+static uint16_t
+my_u16( double v )
+{
+   if (v <= 0.0)
+      return( 0 );
+   if (v >= 65535.0)
+      return( 65535 );
+
+   return( (uint16_t) (v + 0.5) );
+}
+
+
+
+static int
+my_header_ok( const my_recorder_header *h, uint32_t records )
+{
+   return( (! memcmp( h->magic, RECORDER_MAGIC, sizeof( h->magic ) )) &&
+           (h->version == RECORDER_VERSION) &&
+           (h->byte_order == RECORDER_BYTE_ORDER) &&
+           (h->record_size == sizeof( my_record )) &&
+           (h->records > 0) &&
+           ((records == 0) || (h->records == records)) );
+}
+
+
+
+static ibmpower_recorder *
+my_recorder_map( int fd, size_t size, int writable )
+{
+   ibmpower_recorder *rec;
+   void *m;
+
+
+   m = mmap( NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0 );
+   if (m == MAP_FAILED)
+      return( (ibmpower_recorder *) NULL );
+
+   rec = calloc( 1, sizeof( *rec ) );
+   if (rec == NULL)
+   {
+      munmap( m, size );
+      errno = ENOMEM;
+      return( (ibmpower_recorder *) NULL );
+   }
+
+   rec->fd = fd;
+   rec->writable = writable;
+   rec->size = size;
+   rec->h = (my_recorder_header *) m;
+   rec->ring = (my_record *) ((char *) m + HEADER_SIZE);
+
+   return( rec );
+}
+
+
+
+/* 0 if fd is the only writer */
+static int
+my_lock_writer( int fd )
+{
+#if defined(AIX)
+   struct flock l;
+
+
+/* a record lock is dropped when the process closes any fd of the file */
+   memset( &l, 0, sizeof( l ) );
+   l.l_type = F_WRLCK;
+   l.l_whence = SEEK_SET;
+
+   return( fcntl( fd, F_SETLK, &l ) );
+#else
+   return( flock( fd, LOCK_EX | LOCK_NB ) );
+#endif
+}
+
+
+
+ibmpower_recorder *
+ibmpower_recorder_open( const char *file, unsigned int records )
+{
+   ibmpower_recorder *rec;
+   my_recorder_header h;
+   struct stat st;
+   size_t size;
+   int fd, keep = FALSE;
+
+
+   if (records == 0)
+   {
+      errno = EINVAL;
+      return( (ibmpower_recorder *) NULL );
+   }
+
+   size = HEADER_SIZE + (size_t) records * sizeof( my_record );
+
+   fd = ibmpower_open_cloexec( file, O_RDWR | O_CREAT, 0644 );
+   if (fd < 0)
+      return( (ibmpower_recorder *) NULL );
+
+   if (my_lock_writer( fd ) != 0)
+   {
+      close( fd );
+      errno = EBUSY;
+      return( (ibmpower_recorder *) NULL );
+   }
+
+/* continue the ring of the last run if it has the same size */
+   if ((fstat( fd, &st ) == 0) && ((size_t) st.st_size == size) &&
+       (pread( fd, &h, sizeof( h ), 0 ) == (ssize_t) sizeof( h )))
+      keep = my_header_ok( &h, records );
+
+   if (! keep)
+   {
+      if ((ftruncate( fd, 0 ) != 0) || (ftruncate( fd, (off_t) size ) != 0))
+      {
+         close( fd );
+         return( (ibmpower_recorder *) NULL );
+      }
+   }
+
+   rec = my_recorder_map( fd, size, TRUE );
+   if (rec == NULL)
+   {
+      close( fd );
+      return( (ibmpower_recorder *) NULL );
+   }
+
+   if (! keep)
+   {
+      rec->h->version = RECORDER_VERSION;
+      rec->h->byte_order = RECORDER_BYTE_ORDER;
+      rec->h->record_size = sizeof( my_record );
+      rec->h->records = records;
+      rec->h->next = 0;
+      my_barrier();
+      memcpy( rec->h->magic, RECORDER_MAGIC, sizeof( rec->h->magic ) );
+   }
+
+   return( rec );
+}
+
+
+
+ibmpower_recorder *
+ibmpower_recorder_map( const char *file )
+{
+   ibmpower_recorder *rec;
+   my_recorder_header h;
+   struct stat st;
+   int fd;
+
+
+   fd = ibmpower_open_cloexec( file, O_RDONLY, 0 );
+   if (fd < 0)
+      return( (ibmpower_recorder *) NULL );
+
+   if ((fstat( fd, &st ) != 0) ||
+       (pread( fd, &h, sizeof( h ), 0 ) != (ssize_t) sizeof( h )) ||
+       (! my_header_ok( &h, 0 )) ||
+       ((size_t) st.st_size < HEADER_SIZE + (size_t) h.records * sizeof( my_record )))
+   {
+      close( fd );
+      errno = EINVAL;
+      return( (ibmpower_recorder *) NULL );
+   }
+
+   rec = my_recorder_map( fd, HEADER_SIZE + (size_t) h.records * sizeof( my_record ), FALSE );
+   if (rec == NULL)
+      close( fd );
+
+   return( rec );
+}
+
+
+
+void
+ibmpower_recorder_close( ibmpower_recorder *rec )
+{
+   if (rec == NULL)
+      return;
+
+   if (rec->writable)
+      msync( rec->h, rec->size, MS_ASYNC );
+
+   munmap( rec->h, rec->size );
+   close( rec->fd );
+   free( rec );
+}
+
+
+
+void
+ibmpower_recorder_write( ibmpower_recorder *rec, const ibmpower_rates *r )
+{
+   my_recorder_header *h = rec->h;
+   my_record *slot, x;
+   struct timespec ts;
+   uint64_t n;
+
+
+/* the first update only primes the rates */
+   if ((r->interval <= 0.0) || (r->interval * 1000.0 > MAX_INTERVAL_MSEC))
+      return;
+
+/* clock_gettime() is served by the vDSO on Linux */
+   clock_gettime( CLOCK_REALTIME, &ts );
+
+   x.time = (uint32_t) ts.tv_sec;
+   x.interval_msec = my_u16( r->interval * 1000.0 );
+   x.entitlement = my_u16( r->entitlement * 100.0 );
+   x.used_usec = my_u32( r->physc * r->interval * 1000000.0 );
+   x.pool_idle_usec = my_u32( r->pool_idle * r->interval * 1000000.0 );
+   x.steal = my_u16( r->steal_pct * 100.0 );
+   x.valid = (uint16_t) r->last.valid;
+   x.disk_ios = my_u32( r->disk_iops * r->interval );
+   x.disk_read_kb = my_u32( r->disk_read * r->interval / 1024.0 );
+   x.disk_write_kb = my_u32( r->disk_write * r->interval / 1024.0 );
+
+   n = h->next;
+   slot = &rec->ring[n % h->records];
+
+   slot->seq = 0;
+   my_barrier();
+
+   slot->time = x.time;
+   slot->interval_msec = x.interval_msec;
+   slot->entitlement = x.entitlement;
+   slot->used_usec = x.used_usec;
+   slot->pool_idle_usec = x.pool_idle_usec;
+   slot->steal = x.steal;
+   slot->valid = x.valid;
+   slot->disk_ios = x.disk_ios;
+   slot->disk_read_kb = x.disk_read_kb;
+   slot->disk_write_kb = x.disk_write_kb;
+   my_barrier();
+
+   slot->seq = (uint32_t) (n + 1);
+   my_barrier();
+
+   h->next = n + 1;
+}
+
+
+
+void
+ibmpower_recorder_range( const ibmpower_recorder *rec, unsigned long long *first,
+                         unsigned long long *next )
+{
+   uint64_t n;
+
+
+   n = rec->h->next;
+   my_barrier();
+
+   *next = n;
+   *first = (n > rec->h->records) ? n - rec->h->records : 0;
+}
+
+
+
+int
+ibmpower_recorder_read( const ibmpower_recorder *rec, unsigned long long n, ibmpower_record *out )
+{
+   const my_record *slot;
+   my_record x;
+   uint32_t seq;
+   double t;
+
+
+   slot = &rec->ring[n % rec->h->records];
+
+   seq = slot->seq;
+   my_barrier();
+   memcpy( &x, (const void *) slot, sizeof( x ) );
+   my_barrier();
+
+/* overwritten, being written or never written */
+   if ((seq != (uint32_t) (n + 1)) || (slot->seq != seq) || (x.interval_msec == 0))
+      return( -1 );
+
+   t = x.interval_msec / 1000.0;
+
+   out->time = x.time;
+   out->interval = t;
+   out->valid = x.valid;
+   out->entitlement = x.entitlement / 100.0;
+   out->physc = x.used_usec / 1000000.0 / t;
+   out->entc_pct = (out->entitlement > 0.0) ? 100.0 * out->physc / out->entitlement : 0.0;
+   out->pool_idle = x.pool_idle_usec / 1000000.0 / t;
+   out->steal_pct = x.steal / 100.0;
+   out->disk_iops = x.disk_ios / t;
+   out->disk_read = x.disk_read_kb * 1024.0 / t;
+   out->disk_write = x.disk_write_kb * 1024.0 / t;
+
+   return( 0 );
+}
+
+
+
+unsigned int
+ibmpower_recorder_records( const ibmpower_recorder *rec )
+{
+   return( rec->h->records );
+}
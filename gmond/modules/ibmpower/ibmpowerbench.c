@@ -0,0 +1,454 @@
+/******************************************************************************
+ *
+ *  ibmpowerbench - time the procfs parsers of libibmpower
+ *
+ *  Writes a synthetic /proc/ppc64/lparcfg, /proc/stat and /proc/diskstats
+ *  of the given number of lines each below a temporary directory, opens
+ *  the procfs backend on that directory and prints the time one
+ *  ibmpower_sample() of every source takes.  Next to it is the time of
+ *  the parsers libibmpower had before the in place scanner on the same
+ *  files: /proc/stat with strtoull() and every /proc/diskstats line
+ *  copied with strncpy() and split by sscanf().  The files look like those of
+ *  a large LPAR: lparcfg with the keys of interest spread between
+ *  unrelated ones, one cpuN line per CPU in stat, and whole disks mixed
+ *  with partitions, dm and md devices in diskstats.  Not installed.
+ *
+ *  Usage: ibmpowerbench [-k] [-l lines] [-n samples] [dir]
+ *
+ *  Without dir a directory is created in /tmp.
+ *
+ *     -k   keep the files
+ *     -l   lines per file (default 20000)
+ *     -n   samples per source (default 200)
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.1, Oct 18, 2026
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - time the old strtoull() and strncpy() + sscanf()
+ *                  parsers of stat and diskstats side by side
+ *                  (--> old_sample_stat(), old_sample_diskstats() )
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "libibmpower.h"
+
+
+#define DEFAULT_LINES    20000
+#define DEFAULT_SAMPLES  200
+
+
+
+static void
+usage( const char *prog )
+{
+   fprintf( stderr, "usage: %s [-k] [-l lines] [-n samples] [dir]\n"
+                    "   -k   keep the files\n"
+                    "   -l   lines per file (default %d)\n"
+                    "   -n   samples per source (default %d)\n", prog,
+                    DEFAULT_LINES, DEFAULT_SAMPLES );
+   exit( 2 );
+}
+
+
+
+static double
+now( void )
+{
+   struct timespec ts;
+
+
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+
+   return( (double) ts.tv_sec + ts.tv_nsec / 1000000000.0 );
+}
+
+
+
+static FILE *
+create( const char *dir, const char *name, char *path, size_t len )
+{
+   FILE *f;
+
+
+   if (snprintf( path, len, "%s%s", dir, name ) >= (int) len)
+   {
+      fprintf( stderr, "path too long: %s%s\n", dir, name );
+      return( (FILE *) NULL );
+   }
+
+   f = fopen( path, "w" );
+   if (f == NULL)
+      perror( path );
+
+   return( f );
+}
+
+
+
+static int
+write_files( const char *dir, int lines )
+{
+   static const char *keys[] =
+   {
+      "partition_entitled_capacity=1250", "partition_active_processors=16",
+      "pool=0", "pool_num_procs=64", "shared_processor_mode=1", "capped=0",
+      "unallocated_capacity_weight=128", "purr=123456789012345",
+      "pool_idle_time=98765432109876", "dispatches=1234567",
+      "dispatch_dispersions=12345", NULL
+   };
+   char path[4096];
+   FILE *f;
+   int i, k;
+
+
+   for (i = 0;  i < 2;  i++)
+   {
+      snprintf( path, sizeof( path ), "%s%s", dir, i ? "/proc/ppc64" : "/proc" );
+      if ((mkdir( path, 0755 ) != 0) && (access( path, F_OK ) != 0))
+      {
+         perror( path );
+         return( -1 );
+      }
+   }
+
+   if ((f = create( dir, "/proc/cpuinfo", path, sizeof( path ) )) == NULL)
+      return( -1 );
+   fprintf( f, "processor\t: 0\ncpu\t\t: POWER10\ntimebase\t: 512000000\n" );
+   fclose( f );
+
+/* the keys of interest spread over the file, the rest unrelated keys */
+   if ((f = create( dir, "/proc/ppc64/lparcfg", path, sizeof( path ) )) == NULL)
+      return( -1 );
+   fprintf( f, "lparcfg 1.9\n" );
+   for (i = 1, k = 0;  i < lines;  i++)
+   {
+      if (keys[k] && (i % (lines / 12 + 1) == 0))
+         fprintf( f, "%s\n", keys[k++] );
+      else
+         fprintf( f, "synthetic_key_%d=%d\n", i, i * 7 );
+   }
+   fclose( f );
+
+   if ((f = create( dir, "/proc/stat", path, sizeof( path ) )) == NULL)
+      return( -1 );
+   fprintf( f, "cpu  %d %d %d %d %d %d %d %d 0 0\n", 10 * lines, lines, 5 * lines,
+            100 * lines, lines, 0, lines, lines / 10 );
+   for (i = 0;  i < lines - 8;  i++)
+      fprintf( f, "cpu%d 10 1 5 100 1 0 1 %d 0 0\n", i, i % 7 );
+   fprintf( f, "intr 123456789 0 0 0\nctxt 987654321\nbtime 1792312316\n"
+               "processes 123456\nprocs_running 17\nprocs_blocked 2\n"
+               "softirq 1234 0 0 0 0 0 0 0 0 0 0\n" );
+   fclose( f );
+
+/* a whole disk, one partition of it and every 16th an md or dm device */
+   if ((f = create( dir, "/proc/diskstats", path, sizeof( path ) )) == NULL)
+      return( -1 );
+   for (i = 0;  i < lines;  i++)
+   {
+      if (i % 16 == 15)
+         fprintf( f, " 253 %7d dm-%d 1000 0 8000 100 500 0 4000 50 0 150 150\n", i, i );
+      else if (i % 2)
+         fprintf( f, "   8 %7d sd%d1 900 0 7200 90 450 0 3600 45 0 135 135\n", i, i );
+      else
+         fprintf( f, "   8 %7d sd%d %d 0 %d 100 500 0 4000 50 0 150 150\n", i, i, 1000 + i, 8000 + i );
+   }
+   fclose( f );
+
+   return( 0 );
+}
+
+
+
+/* the whole file into buf, like my_read_file() of libibmpower used to */
+static char *
+old_read_file( const char *dir, const char *name, char **buf, size_t *size )
+{
+   char path[4096], *p;
+   size_t len = 0;
+   ssize_t n;
+   int fd;
+
+
+   snprintf( path, sizeof( path ), "%s%s", dir, name );
+
+   fd = open( path, O_RDONLY );
+   if (fd < 0)
+      return( (char *) NULL );
+
+   for (;;)
+   {
+      if (len + 1 >= *size)
+      {
+         p = realloc( *buf, *size ? 2 * *size : 8192 );
+         if (p == NULL)
+         {
+            close( fd );
+            return( (char *) NULL );
+         }
+         *buf = p;
+         *size = *size ? 2 * *size : 8192;
+      }
+
+      n = read( fd, *buf + len, *size - len - 1 );
+      if (n <= 0)
+         break;
+      len += n;
+   }
+
+   close( fd );
+
+   if (n < 0)
+      return( (char *) NULL );
+
+   (*buf)[len] = '\0';
+
+   return( *buf );
+}
+
+
+
+/* /proc/stat as libibmpower parsed it before the in place scanner */
+static int
+old_sample_stat( const char *dir, ibmpower_snapshot *s, char **buf, size_t *size )
+{
+   unsigned long long v;
+   char *p;
+   int i;
+
+
+   s->online_cpus = 0;
+   s->cpu_total = s->cpu_idle = s->cpu_steal = 0ULL;
+   s->procs_running = s->procs_blocked = -1LL;
+
+   p = old_read_file( dir, "/proc/stat", buf, size );
+   if (p == NULL)
+      return( 0 );
+
+   while (p && (strncmp( p, "cpu", 3 ) == 0))
+   {
+      if (p[3] == ' ')
+      {
+         p += 3;
+         for (i = 0;  i < 8;  i++)
+         {
+            v = strtoull( p, &p, 10 );
+
+            s->cpu_total += v;
+
+            if (i == 3)
+               s->cpu_idle = v;
+            else if (i == 7)
+               s->cpu_steal = v;
+         }
+      }
+      else
+         s->online_cpus++;
+
+      p = strchr( p, '\n' );
+      if (p)
+         p++;
+   }
+
+   if (p && (p = strstr( p, "procs_running " )))
+   {
+      s->procs_running = strtoll( p+14, &p, 10 );
+
+      if ((p = strstr( p, "procs_blocked " )))
+         s->procs_blocked = strtoll( p+14, (char **) NULL, 10 );
+   }
+
+   return( 1 );
+}
+
+
+
+/* /proc/diskstats line by line through strncpy() and sscanf(), the totals */
+static int
+old_sample_diskstats( const char *dir, ibmpower_snapshot *s, char **buf, size_t *size )
+{
+   unsigned long reads, rmerge, rsect, rmsec, writes, wmerge, wsect, wmsec, inflight, io_time, f11;
+   int major, minor, ret;
+   char line[1024], name[32], *p, *q;
+   size_t len;
+
+
+   s->disk_ios = s->disk_read_bytes = s->disk_write_bytes = 0ULL;
+
+   p = old_read_file( dir, "/proc/diskstats", buf, size );
+   if (p == NULL)
+      return( 0 );
+
+   while ((q = strchr( p, '\n' )))
+   {
+      reads = writes = rsect = wsect = 0;
+
+      len = q-p;
+      if (len > sizeof( line ) - 1)
+         len = sizeof( line ) - 1;
+      strncpy( line, p, len );
+      line[len] = '\0';
+
+      ret = sscanf( line, "%d %d %31s %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu",
+                    &major, &minor, name, &reads, &rmerge, &rsect, &rmsec,
+                    &writes, &wmerge, &wsect, &wmsec, &inflight, &io_time, &f11 );
+
+      p = q+1;
+
+      if (ret == 7)  /* skip partitions of a disk */
+         continue;
+
+      if (strncmp( name, "dm-", 3 ) == 0)
+         continue;
+
+      if (strncmp( name, "md", 2 ) == 0)
+         continue;
+
+      s->disk_ios += reads + writes;
+      s->disk_read_bytes += (unsigned long long) rsect * 512ULL;
+      s->disk_write_bytes += (unsigned long long) wsect * 512ULL;
+   }
+
+   return( 1 );
+}
+
+
+
+static void
+remove_files( const char *dir )
+{
+   static const char *names[] =
+   {
+      "/proc/cpuinfo", "/proc/ppc64/lparcfg", "/proc/stat", "/proc/diskstats",
+      "/proc/ppc64", "/proc", NULL
+   };
+   char path[4096];
+   int i;
+
+
+   for (i = 0;  names[i];  i++)
+   {
+      snprintf( path, sizeof( path ), "%s%s", dir, names[i] );
+      remove( path );
+   }
+}
+
+
+
+int
+main( int argc, char *argv[] )
+{
+   static const struct
+   {
+      const char *name;
+      unsigned int source;
+      int (*old)( const char *, ibmpower_snapshot *, char **, size_t * );
+   } sources[] =
+   {
+      { "lparcfg",   IBMPOWER_SAMPLE_LPAR, NULL },
+      { "stat",      IBMPOWER_SAMPLE_CPU,  old_sample_stat },
+      { "diskstats", IBMPOWER_SAMPLE_DISK, old_sample_diskstats },
+      { NULL, 0, NULL }
+   };
+   char tmpdir[] = "/tmp/ibmpowerbench.XXXXXX";
+   const char *dir;
+   ibmpower_ctx *ctx;
+   ibmpower_snapshot snap, old;
+   double start, elapsed;
+   char *buf = NULL;
+   size_t size = 0;
+   int c, i, n, keep = 0, lines = DEFAULT_LINES, samples = DEFAULT_SAMPLES;
+
+
+   while ((c = getopt( argc, argv, "kl:n:" )) != -1)
+   {
+      switch (c)
+      {
+         case 'k': keep = 1;                   break;
+         case 'l': lines = atoi( optarg );     break;
+         case 'n': samples = atoi( optarg );   break;
+         default:  usage( argv[0] );
+      }
+   }
+
+   if ((optind < argc - 1) || (lines < 16) || (samples < 1))
+      usage( argv[0] );
+
+   if (optind < argc)
+      dir = argv[optind];
+   else if ((dir = mkdtemp( tmpdir )) == NULL)
+   {
+      perror( tmpdir );
+      return( 1 );
+   }
+
+   if (write_files( dir, lines ) != 0)
+      return( 1 );
+
+   ctx = ibmpower_open_backend( "procfs", dir );
+   if (ctx == NULL)
+   {
+      fprintf( stderr, "cannot open the procfs backend on %s\n", dir );
+      return( 1 );
+   }
+
+   printf( "%d lines per file, %d samples per source, files in %s\n", lines, samples, dir );
+   printf( "%-10s %12s %12s\n", "source", "usec/sample", "old parser" );
+
+   memset( &old, 0, sizeof( old ) );
+
+   for (i = 0;  sources[i].name;  i++)
+   {
+      start = now();
+      for (n = 0;  n < samples;  n++)
+         ibmpower_sample( ctx, sources[i].source, &snap );
+      elapsed = now() - start;
+
+      printf( "%-10s %12.1f", sources[i].name, 1000000.0 * elapsed / samples );
+
+      if (sources[i].old == NULL)
+      {
+         printf( " %12s\n", "-" );
+         continue;
+      }
+
+      start = now();
+      for (n = 0;  n < samples;  n++)
+         sources[i].old( dir, &old, &buf, &size );
+      elapsed = now() - start;
+
+      printf( " %12.1f\n", 1000000.0 * elapsed / samples );
+   }
+
+/* a parser which lost its place shows up as wrong totals */
+   printf( "\nentitlement %lld, online CPUs %d, procs_running %lld\n",
+           snap.entitled_capacity, snap.online_cpus, snap.procs_running );
+   printf( "old parser: online CPUs %d, procs_running %lld\n",
+           old.online_cpus, old.procs_running );
+
+   free( buf );
+   ibmpower_close( ctx );
+
+   if (! keep)
+   {
+      remove_files( dir );
+      if (dir == tmpdir)
+         rmdir( dir );
+   }
+
+   return( 0 );
+}
@@ -0,0 +1,228 @@
+/******************************************************************************
+ *
+ *  ibmpowerdump - print the flight recorder file of the ibmpower module
+ *
+ *  Prints the entitlement, physical cores used, %entc, shared pool idle,
+ *  steal and disk rates of every interval kept in the ring file written by
+ *  the module (param flight_recorder) or any other libibmpower writer.
+ *  The file is only read, the writer may keep running.
+ *
+ *  Usage: ibmpowerdump [-j | -c] [-H] [-s start] [-e end] [-n last] file
+ *
+ *     -j   one JSON object per record
+ *     -c   CSV with a header line
+ *     -H   no header
+ *     -s   first record to print, by time
+ *     -e   last record to print, by time
+ *     -n   print only the last records
+ *
+ *  A time is seconds since the epoch, "YYYY-MM-DD HH:MM[:SS]" or
+ *  "HH:MM[:SS]", the latter being the last such time of day in the past.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.0, Oct 18, 2026
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "libibmpower.h"
+
+
+enum { FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV };
+
+
+
+static void
+usage( const char *prog )
+{
+   fprintf( stderr, "usage: %s [-j | -c] [-H] [-s start] [-e end] [-n last] file\n"
+                    "   -j   print one JSON object per record\n"
+                    "   -c   print CSV\n"
+                    "   -H   do not print a header\n"
+                    "   -s   start time, seconds since the epoch, \"YYYY-MM-DD HH:MM[:SS]\"\n"
+                    "        or \"HH:MM[:SS]\"\n"
+                    "   -e   end time\n"
+                    "   -n   print only the last records\n", prog );
+   exit( 2 );
+}
+
+
+
+static time_t
+parse_time( const char *s, const char *prog )
+{
+   static const char *formats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M",
+                                    "%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M", NULL };
+   struct tm tm;
+   time_t now, t;
+   char *end;
+   int i;
+
+
+   t = (time_t) strtoll( s, &end, 10 );
+   if ((end != s) && (*end == '\0'))
+      return( t );
+
+   for (i = 0;  formats[i];  i++)
+   {
+      memset( &tm, 0, sizeof( tm ) );
+      end = strptime( s, formats[i], &tm );
+      if (end && (*end == '\0'))
+      {
+         tm.tm_isdst = -1;
+         return( mktime( &tm ) );
+      }
+   }
+
+/* time of day, today or yesterday */
+   now = time( NULL );
+   localtime_r( &now, &tm );
+   tm.tm_sec = 0;
+
+   end = strptime( s, "%H:%M:%S", &tm );
+   if ((end == NULL) || (*end != '\0'))
+      end = strptime( s, "%H:%M", &tm );
+   if ((end == NULL) || (*end != '\0'))
+   {
+      fprintf( stderr, "%s: cannot parse time \"%s\"\n", prog, s );
+      exit( 2 );
+   }
+
+   tm.tm_isdst = -1;
+   t = mktime( &tm );
+   if (t > now)
+   {
+      tm.tm_mday--;
+      tm.tm_isdst = -1;
+      t = mktime( &tm );
+   }
+
+   return( t );
+}
+
+
+
+static void
+print_header( int format )
+{
+   if (format == FORMAT_CSV)
+      printf( "time,interval,ent,physc,entc_pct,app,steal_pct,disk_iops,disk_read_kbps,disk_write_kbps\n" );
+   else if (format == FORMAT_TEXT)
+   {
+      printf( "time                interval    ent  physc  %%entc    app %%steal     iops   read KB/s  write KB/s\n" );
+      printf( "------------------- -------- ------ ------ ------ ------ ------ -------- ----------- -----------\n" );
+   }
+}
+
+
+
+static void
+print_record( int format, const ibmpower_record *r )
+{
+   time_t t = (time_t) r->time;
+   struct tm tm;
+   char stamp[32];
+
+
+   localtime_r( &t, &tm );
+
+   if (format == FORMAT_TEXT)
+   {
+      strftime( stamp, sizeof( stamp ), "%Y-%m-%d %H:%M:%S", &tm );
+      printf( "%s %8.3f %6.2f %6.2f %6.1f %6.2f %6.1f %8.1f %11.1f %11.1f\n",
+              stamp, r->interval, r->entitlement, r->physc, r->entc_pct, r->pool_idle,
+              r->steal_pct, r->disk_iops, r->disk_read / 1024.0, r->disk_write / 1024.0 );
+      return;
+   }
+
+   strftime( stamp, sizeof( stamp ), "%Y-%m-%dT%H:%M:%S", &tm );
+
+   if (format == FORMAT_CSV)
+      printf( "%s,%.3f,%.2f,%.4f,%.2f,%.4f,%.2f,%.3f,%.2f,%.2f\n",
+              stamp, r->interval, r->entitlement, r->physc, r->entc_pct, r->pool_idle,
+              r->steal_pct, r->disk_iops, r->disk_read / 1024.0, r->disk_write / 1024.0 );
+   else
+      printf( "{\"time\":\"%s\",\"interval\":%.3f,\"ent\":%.2f,\"physc\":%.4f,\"entc_pct\":%.2f,"
+              "\"app\":%.4f,\"steal_pct\":%.2f,\"disk_iops\":%.3f,\"disk_read_bytes_per_sec\":%.2f,"
+              "\"disk_write_bytes_per_sec\":%.2f}\n",
+              stamp, r->interval, r->entitlement, r->physc, r->entc_pct, r->pool_idle,
+              r->steal_pct, r->disk_iops, r->disk_read, r->disk_write );
+}
+
+
+
+int
+main( int argc, char *argv[] )
+{
+   ibmpower_recorder *rec;
+   ibmpower_record r;
+   unsigned long long first, next, n;
+   int format = FORMAT_TEXT, header = 1, c;
+   time_t start = 0, end = 0;
+   long long last = 0;
+   double prev = 0.0;
+
+
+   while ((c = getopt( argc, argv, "jcHs:e:n:" )) != -1)
+   {
+      switch (c)
+      {
+         case 'j': format = FORMAT_JSON;                  break;
+         case 'c': format = FORMAT_CSV;                   break;
+         case 'H': header = 0;                            break;
+         case 's': start = parse_time( optarg, argv[0] ); break;
+         case 'e': end = parse_time( optarg, argv[0] );   break;
+         case 'n': last = atoll( optarg );                break;
+         default:  usage( argv[0] );
+      }
+   }
+
+   if ((optind != argc - 1) || (last < 0))
+      usage( argv[0] );
+
+   rec = ibmpower_recorder_map( argv[optind] );
+   if (rec == NULL)
+   {
+      perror( argv[optind] );
+      return( 1 );
+   }
+
+   ibmpower_recorder_range( rec, &first, &next );
+   if ((last > 0) && (next - first > (unsigned long long) last))
+      first = next - last;
+
+   if (header && (format != FORMAT_JSON))
+      print_header( format );
+
+   for (n = first;  n < next;  n++)
+   {
+/* the writer overwrote it while we were reading the older ones */
+      if (ibmpower_recorder_read( rec, n, &r ) != 0)
+         continue;
+
+      if ((start && (r.time < start)) || (end && (r.time > end)))
+         continue;
+
+/* mark the time the writer was not running */
+      if ((format == FORMAT_TEXT) && (prev > 0.0) && (r.time - prev > r.interval + 1.0))
+         printf( "--- %.0f seconds not recorded ---\n", r.time - r.interval - prev );
+      prev = r.time;
+
+      print_record( format, &r );
+   }
+
+   ibmpower_recorder_close( rec );
+
+   return( 0 );
+}
@@ -0,0 +1,210 @@
+/******************************************************************************
+ *
+ *  ibmpowerstat - lparstat-like report of the ibmpower metrics
+ *
+ *  Prints the entitlement, physical cores used, %entc, shared pool idle,
+ *  hypervisor dispatch and disk rates of a Linux on Power LPAR every
+ *  interval seconds.  The values come from libibmpower, i.e. they are
+ *  computed exactly like the ibmpower gmond module computes them, at the
+ *  cost of reading three procfs files per interval.
+ *
+ *  Usage: ibmpowerstat [-j | -c] [-H] [-F file] [interval [count]]
+ *
+ *     -j   one JSON object per interval
+ *     -c   CSV with a header line
+ *     -H   no header
+ *     -F   read the counters from a fixture file (see libibmpower.h)
+ *          instead of the system
+ *
+ *  Without an interval one report over one second is printed, with an
+ *  interval but no count reports are printed until interrupted.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.1, Oct 18, 2026
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - added -F to replay a fixture file
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "libibmpower.h"
+
+
+#define HEADER_EVERY 20    /* repeat the text header every that many lines */
+
+enum { FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV };
+
+
+
+static void
+usage( const char *prog )
+{
+   fprintf( stderr, "usage: %s [-j | -c] [-H] [-F file] [interval [count]]\n"
+                    "   -j   print one JSON object per interval\n"
+                    "   -c   print CSV\n"
+                    "   -H   do not print a header\n"
+                    "   -F   read the counters from a fixture file\n", prog );
+   exit( 2 );
+}
+
+
+
+static void
+print_config( const ibmpower_snapshot *snap, const ibmpower_rates *r, ibmpower_ctx *ctx )
+{
+   const char *type;
+
+
+   if (ibmpower_kvm_guest( ctx ))
+      type = "KVM guest";
+   else if (! ibmpower_has_lparcfg( ctx ))
+      type = "PowerNV";
+   else if (snap->shared_processor_mode > 0LL)
+      type = snap->capped > 0LL ? "Shared capped" : "Shared uncapped";
+   else
+      type = "Dedicated";
+
+   printf( "\nSystem configuration: type=%s lcpu=%d ent=%.2f", type, snap->online_cpus, r->entitlement );
+   if (snap->active_processors >= 0LL)
+      printf( " vcpu=%lld", snap->active_processors );
+   if (snap->pool_num_procs >= 0LL)
+      printf( " psize=%lld", snap->pool_num_procs );
+   printf( "\n\n" );
+}
+
+
+
+static void
+print_header( int format )
+{
+   if (format == FORMAT_CSV)
+      printf( "time,ent,physc,entc_pct,app,steal_pct,disp_per_sec,dispersions_per_sec,dispersion_pct,"
+              "disk_iops,disk_read_kbps,disk_write_kbps\n" );
+   else if (format == FORMAT_TEXT)
+   {
+      printf( "   ent  physc  %%entc    app %%steal   disp/s  dspr/s %%dspr     iops   read KB/s  write KB/s\n" );
+      printf( "------ ------ ------ ------ ------ -------- ------- ----- -------- ----------- -----------\n" );
+   }
+}
+
+
+
+static void
+print_rates( int format, const ibmpower_rates *r )
+{
+   time_t now;
+   struct tm tm;
+   char stamp[32];
+
+
+   if (format == FORMAT_TEXT)
+   {
+      printf( "%6.2f %6.2f %6.1f %6.2f %6.1f %8.1f %7.1f %5.1f %8.1f %11.1f %11.1f\n",
+              r->entitlement, r->physc, r->entc_pct, r->pool_idle, r->steal_pct,
+              r->dispatches, r->dispersions, r->dispersion_pct,
+              r->disk_iops, r->disk_read / 1024.0, r->disk_write / 1024.0 );
+      return;
+   }
+
+   now = time( NULL );
+   localtime_r( &now, &tm );
+   strftime( stamp, sizeof( stamp ), "%Y-%m-%dT%H:%M:%S", &tm );
+
+   if (format == FORMAT_CSV)
+      printf( "%s,%.2f,%.4f,%.2f,%.4f,%.2f,%.2f,%.2f,%.2f,%.3f,%.2f,%.2f\n",
+              stamp, r->entitlement, r->physc, r->entc_pct, r->pool_idle, r->steal_pct,
+              r->dispatches, r->dispersions, r->dispersion_pct,
+              r->disk_iops, r->disk_read / 1024.0, r->disk_write / 1024.0 );
+   else
+      printf( "{\"time\":\"%s\",\"interval\":%.3f,\"ent\":%.2f,\"physc\":%.4f,\"entc_pct\":%.2f,"
+              "\"app\":%.4f,\"steal_pct\":%.2f,\"disp_per_sec\":%.2f,\"dispersions_per_sec\":%.2f,"
+              "\"dispersion_pct\":%.2f,\"disk_iops\":%.3f,\"disk_read_bytes_per_sec\":%.2f,"
+              "\"disk_write_bytes_per_sec\":%.2f}\n",
+              stamp, r->interval, r->entitlement, r->physc, r->entc_pct,
+              r->pool_idle, r->steal_pct, r->dispatches, r->dispersions,
+              r->dispersion_pct, r->disk_iops, r->disk_read, r->disk_write );
+}
+
+
+
+int
+main( int argc, char *argv[] )
+{
+   ibmpower_ctx *ctx;
+   ibmpower_snapshot snap;
+   ibmpower_rates rates = IBMPOWER_RATES_INIT;
+   int format = FORMAT_TEXT, header = 1, interval = 1, count = 1, lines = 0;
+   const char *fixture = NULL;
+   int c, n;
+
+
+   while ((c = getopt( argc, argv, "jcHF:" )) != -1)
+   {
+      switch (c)
+      {
+         case 'j': format = FORMAT_JSON; break;
+         case 'c': format = FORMAT_CSV;  break;
+         case 'H': header = 0;           break;
+         case 'F': fixture = optarg;     break;
+         default:  usage( argv[0] );
+      }
+   }
+
+   if (optind < argc)
+   {
+      interval = atoi( argv[optind++] );
+      count = -1;
+   }
+   if (optind < argc)
+      count = atoi( argv[optind++] );
+   if ((optind < argc) || (interval <= 0) || (count == 0))
+      usage( argv[0] );
+
+   if (fixture)
+      ctx = ibmpower_open_backend( "fixture", fixture );
+   else
+      ctx = ibmpower_open();
+   if (ctx == NULL)
+   {
+      perror( "ibmpower_open" );
+      return( 1 );
+   }
+
+/* the first snapshot only primes the rates */
+   ibmpower_sample( ctx, IBMPOWER_SAMPLE_ALL, &snap );
+   ibmpower_rates_update( ctx, &rates, &snap );
+
+   for (n = 0;  (count < 0) || (n < count);  n++)
+   {
+      sleep( interval );
+
+      ibmpower_sample( ctx, IBMPOWER_SAMPLE_ALL, &snap );
+      ibmpower_rates_update( ctx, &rates, &snap );
+
+      if ((n == 0) && header && (format == FORMAT_TEXT))
+         print_config( &snap, &rates, ctx );
+
+      if (header && (format != FORMAT_JSON) &&
+          ((n == 0) || ((format == FORMAT_TEXT) && (lines % HEADER_EVERY == 0))))
+         print_header( format );
+
+      print_rates( format, &rates );
+      lines++;
+
+      fflush( stdout );
+   }
+
+   ibmpower_close( ctx );
+
+   return( 0 );
+}
@@ -0,0 +1,625 @@
+/******************************************************************************
+ *
+ *  libibmpower - collection core of the ibmpower gmond module
+ *
+ *  See libibmpower.h for the interface.  The raw counters come from a
+ *  platform backend (see ibmpower_backend.h), the source cache and the
+ *  rate engine in here are the same for all of them.  All state belongs
+ *  to the context, so different contexts can be used from different
+ *  threads.  Nothing in here depends on gmond, APR or libmetrics.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.3, Oct 18, 2026
+ *
+ *  Version 1.3:  Oct 18, 2026
+ *                - close-on-exec without O_CLOEXEC on older AIX levels
+ *                  (--> ibmpower_open_cloexec() )
+ *                - a source whose read misses the deadline of the guard
+ *                  keeps its last values, as does one whose read has not
+ *                  started, without being stale
+ *                  (--> ibmpower_set_read_timeout(), ibmpower_stale() )
+ *                - pass the times per CPU and the boot time of the backend
+ *                  through (--> ibmpower_cpu_times(), ibmpower_boot_time() )
+ *                - every source keeps the time it was read, rates are
+ *                  divided by the time between two reads of their own
+ *                  source and not by the time between two samples
+ *                  (--> my_src_time() )
+ *                - the rate and ratio of single counters for the module,
+ *                  with the reset rule of the rate engine
+ *                  (--> ibmpower_counter_rate(), ibmpower_ratio_update() )
+ *
+ *  Version 1.2:  Oct 18, 2026
+ *                - added the disk await from the read and write times of
+ *                  /proc/diskstats
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - moved the procfs collectors into ibmpower_procfs.c
+ *                  behind a backend interface, added the perfstat and
+ *                  fixture backends
+ *                  (--> ibmpower_open_backend() )
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release, the LPAR, CPU and disk counters and
+ *                  the rate logic of cpu_used_func(), cpu_pool_idle_func(),
+ *                  cpu_dispatches_func() and the get_diskstats_*()
+ *                  functions split off mod_ibmpower-linux.c
+ *                - replaced strncpy()+sscanf() of /proc/diskstats and
+ *                  strtoull() of /proc/stat by an in place scanner
+ *                - keep per device disk state keyed by major:minor, the
+ *                  disk sums no longer drop when a path or LUN goes away
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "libibmpower.h"
+#include "ibmpower_backend.h"
+
+
+#define LIB_BUFFSIZE        131072
+#define SYSTEM_CHECK_INTERVAL (180.0)   /* LPAR mobility check, seconds */
+#define MAX_PHYSC           (256.0)
+#define MAX_POOL_IDLE       (256.0)
+
+enum { SRC_LPAR, SRC_CPU, SRC_DISK, SRC_COUNT };
+
+
+/* the first one is the default of the platform */
+static const ibmpower_backend *const backends[] =
+{
+#if defined(AIX)
+   &ibmpower_perfstat_backend,
+#endif
+   &ibmpower_procfs_backend,
+   &ibmpower_fixture_backend,
+   (const ibmpower_backend *) NULL
+};
+
+
+struct ibmpower_ctx
+{
+   const ibmpower_backend *backend;
+   void *priv;                    /* state of the backend */
+   ibmpower_system sys;
+   ibmpower_guard *guard;         /* reads with a deadline, NULL = without */
+   unsigned int stale;            /* sources whose last read missed it */
+
+   double max_age;
+   double last_system_check;
+
+   ibmpower_snapshot cache;       /* last values and read times of every source */
+};
+
+
+
+static double
+my_time_now( void )
+{
+   struct timespec ts;
+
+
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+
+   return( (double) ts.tv_sec + ts.tv_nsec / 1000000000.0 );
+}
+
+
+
+/* the clock of the backend if it has one */
+static double
+my_sample_time( const ibmpower_ctx *ctx )
+{
+   double now = -1.0;
+
+
+   if (ctx->backend->now)
+      now = ctx->backend->now( ctx->priv );
+
+   return( (now >= 0.0) ? now : my_time_now() );
+}
+
+
+
+int
+ibmpower_open_cloexec( const char *name, int flags, int mode )
+{
+   int fd;
+
+
+#if defined(O_CLOEXEC)
+   fd = open( name, flags | O_CLOEXEC, mode );
+#else
+/* older AIX levels, a fork() of another thread in between inherits fd */
+   fd = open( name, flags, mode );
+   if (fd >= 0)
+      fcntl( fd, F_SETFD, FD_CLOEXEC );
+#endif
+
+   return( fd );
+}
+
+
+
+char *
+ibmpower_read_file( const char *name, ibmpower_buffer *b )
+{
+   int fd;
+   ssize_t rval;
+   size_t size;
+   char *p;
+
+
+   fd = ibmpower_open_cloexec( name, O_RDONLY, 0 );
+   if (fd < 0)
+      return( (char *) NULL );
+
+   b->len = 0;
+
+   for (;;)
+   {
+      if (b->size - b->len < 2)
+      {
+         size = b->size ? 2 * b->size : LIB_BUFFSIZE;
+         p = realloc( b->data, size );
+         if (p == NULL)
+         {
+            close( fd );
+            errno = ENOMEM;
+            return( (char *) NULL );
+         }
+         b->data = p;
+         b->size = size;
+      }
+
+      rval = read( fd, b->data + b->len, b->size - b->len - 1 );
+      if (rval <= 0)
+         break;
+
+      b->len += rval;
+   }
+
+   close( fd );
+
+   if (rval < 0)
+      return( (char *) NULL );
+
+   b->data[b->len] = '\0';
+
+   return( b->data );
+}
+
+
+
+ibmpower_ctx *
+ibmpower_open_backend( const char *name, const char *arg )
+{
+   ibmpower_ctx *ctx;
+   int i;
+
+
+   for (i = 0;  backends[i];  i++)
+      if ((name == NULL) || (! strcmp( name, backends[i]->name )))
+         break;
+
+   if (backends[i] == NULL)
+   {
+      errno = ENOENT;
+      return( (ibmpower_ctx *) NULL );
+   }
+
+   ctx = calloc( 1, sizeof( *ctx ) );
+   if (ctx == NULL)
+      return( (ibmpower_ctx *) NULL );
+
+   ctx->backend = backends[i];
+   ctx->priv = ctx->backend->open( arg );
+   if (ctx->priv == NULL)
+   {
+      free( ctx );
+      return( (ibmpower_ctx *) NULL );
+   }
+
+   ctx->backend->system( ctx->priv, &ctx->sys );
+   ctx->last_system_check = my_sample_time( ctx );
+
+   return( ctx );
+}
+
+
+
+ibmpower_ctx *
+ibmpower_open( void )
+{
+   return( ibmpower_open_backend( (const char *) NULL, (const char *) NULL ) );
+}
+
+
+
+void
+ibmpower_close( ibmpower_ctx *ctx )
+{
+   if (ctx == NULL)
+      return;
+
+/* first, so the backend knows which of its reads still hangs */
+   ibmpower_guard_close( ctx->guard );
+   ctx->backend->close( ctx->priv );
+   free( ctx );
+}
+
+
+
+const char *
+ibmpower_backend_name( const ibmpower_ctx *ctx )
+{
+   return( ctx->backend->name );
+}
+
+
+
+void
+ibmpower_set_max_age( ibmpower_ctx *ctx, double max_age )
+{
+   ctx->max_age = max_age;
+}
+
+
+
+int
+ibmpower_has_lparcfg( const ibmpower_ctx *ctx )
+{
+   return( ctx->sys.has_lparcfg );
+}
+
+
+
+int
+ibmpower_kvm_guest( const ibmpower_ctx *ctx )
+{
+   return( ctx->sys.kvm_guest );
+}
+
+
+
+int
+ibmpower_purr_usable( const ibmpower_ctx *ctx )
+{
+   return( ctx->sys.purr_usable );
+}
+
+
+
+long long
+ibmpower_timebase( const ibmpower_ctx *ctx )
+{
+   return( ctx->sys.timebase );
+}
+
+
+
+long long
+ibmpower_boot_time( const ibmpower_ctx *ctx )
+{
+   return( ctx->sys.boot_time );
+}
+
+
+
+int
+ibmpower_cpu_times( ibmpower_ctx *ctx, ibmpower_cpu *cpus, int max )
+{
+   if (ctx->backend->cpu_times == NULL)
+      return( -1 );
+
+   return( ctx->backend->cpu_times( ctx->priv, cpus, max ) );
+}
+
+
+
+int
+ibmpower_set_read_timeout( ibmpower_ctx *ctx, int msec )
+{
+   if (ctx->backend->set_guard == NULL)
+      return( -1 );
+
+   if (msec <= 0)
+   {
+      ctx->backend->set_guard( ctx->priv, (ibmpower_guard *) NULL, 0 );
+      ibmpower_guard_close( ctx->guard );
+      ctx->guard = (ibmpower_guard *) NULL;
+      return( 0 );
+   }
+
+   if (ctx->guard == NULL)
+   {
+      ctx->guard = ibmpower_guard_open();
+      if (ctx->guard == NULL)
+         return( -1 );
+   }
+
+   ctx->backend->set_guard( ctx->priv, ctx->guard, msec );
+
+   return( 0 );
+}
+
+
+
+long long
+ibmpower_read_timeouts( const ibmpower_ctx *ctx )
+{
+   return( ibmpower_guard_timeouts( ctx->guard ) );
+}
+
+
+
+unsigned int
+ibmpower_stale( const ibmpower_ctx *ctx )
+{
+   return( ctx->stale );
+}
+
+
+
+/* the time stamp of a source in a snapshot, 0 = never read */
+static double *
+my_src_time( ibmpower_snapshot *snap, int src )
+{
+   switch (src)
+   {
+      case SRC_LPAR: return( &snap->lpar_time );
+      case SRC_CPU:  return( &snap->cpu_time );
+      default:       return( &snap->disk_time );
+   }
+}
+
+
+
+int
+ibmpower_sample( ibmpower_ctx *ctx, unsigned int what, ibmpower_snapshot *snap )
+{
+   double now, *src_time;
+   int i, rc;
+
+
+   now = my_sample_time( ctx );
+
+   for (i = 0;  i < SRC_COUNT;  i++)
+   {
+      if (! (what & (1u << i)))
+         continue;
+
+      src_time = my_src_time( &ctx->cache, i );
+
+/* a source taken from the cache keeps the time it was really read */
+      if ((*src_time > 0.0) && (now - *src_time < ctx->max_age))
+         continue;
+
+      rc = ctx->backend->sample( ctx->priv, 1u << i, &ctx->cache );
+
+/* a read which missed its deadline leaves the last values and time */
+      if (rc == IBMPOWER_SAMPLE_LATE)
+      {
+         ctx->stale |= 1u << i;
+         continue;
+      }
+
+/* so does one which has not started, the source is not stale for it */
+      if (rc == IBMPOWER_SAMPLE_BUSY)
+         continue;
+
+      ctx->stale &= ~(1u << i);
+
+      if (rc)
+         ctx->cache.valid |= 1u << i;
+      else
+         ctx->cache.valid &= ~(1u << i);
+
+      *src_time = now;
+   }
+
+   *snap = ctx->cache;
+   snap->time = now;
+   snap->valid &= what;
+
+   return( snap->valid ? 0 : -1 );
+}
+
+
+
+/* counter increase per second, the last rate if the counter went backwards */
+static double
+my_rate( long long cur, long long prev, double delta_t, double last )
+{
+   if ((cur < 0LL) || (prev < 0LL))
+      return( 0.0 );
+
+   if (cur < prev)
+      return( last );
+
+   return( (double) (cur - prev) / delta_t );
+}
+
+
+
+void
+ibmpower_rates_update( ibmpower_ctx *ctx, ibmpower_rates *r, const ibmpower_snapshot *snap )
+{
+   const ibmpower_snapshot *prev = &r->last;
+   long long total_diff, idle_diff, steal_diff;
+   double delta_t, dt_lpar, dt_disk, idle, physc;
+   unsigned int both;
+
+
+/* check every 180 seconds if we are still on the same system --> LPAR Mobility */
+   if (snap->time - ctx->last_system_check >= SYSTEM_CHECK_INTERVAL)
+   {
+      ctx->backend->system( ctx->priv, &ctx->sys );
+      ctx->last_system_check = snap->time;
+   }
+
+   delta_t = snap->time - prev->time;
+
+   if ((! r->primed) || (delta_t <= 0.0))
+   {
+      memset( r, 0, sizeof( *r ) );
+      r->last = *snap;
+      r->primed = TRUE;
+      return;
+   }
+
+   both = snap->valid & prev->valid;
+   r->interval = delta_t;
+
+/*
+ * A source re-used from the cache carries the time it was read, so every
+ * rate is divided by the time between the two reads of its own source.
+ * If a source has not been read again since, its rates stay as they are.
+ */
+   dt_lpar = snap->lpar_time - prev->lpar_time;
+   dt_disk = snap->disk_time - prev->disk_time;
+
+   if (dt_lpar <= 0.0)
+      both &= ~IBMPOWER_SAMPLE_LPAR;
+   if (snap->cpu_time <= prev->cpu_time)
+      both &= ~IBMPOWER_SAMPLE_CPU;
+   if (dt_disk <= 0.0)
+      both &= ~IBMPOWER_SAMPLE_DISK;
+
+/* CPU time fractions of the interval, CPUs going offline make them invalid */
+   total_diff = snap->cpu_total - prev->cpu_total;
+   idle_diff = snap->cpu_idle - prev->cpu_idle;
+   steal_diff = snap->cpu_steal - prev->cpu_steal;
+
+   if (! ((both & IBMPOWER_SAMPLE_CPU) && (snap->online_cpus == prev->online_cpus) &&
+          (total_diff > 0LL) && (idle_diff >= 0LL) && (steal_diff >= 0LL)))
+      total_diff = 0LL;
+
+   if (total_diff > 0LL)
+      r->steal_pct = 100.0 * steal_diff / total_diff;
+
+/* physical cores used, as cpu_used_func() did it */
+   physc = r->physc;
+
+   if ((snap->valid & IBMPOWER_SAMPLE_LPAR) && (snap->purr >= 0LL) && ctx->sys.purr_usable &&
+       (! ctx->sys.kvm_guest))
+   {
+      if ((both & IBMPOWER_SAMPLE_LPAR) && (ctx->sys.timebase > 0LL) &&
+          (prev->purr >= 0LL) && (snap->purr >= prev->purr))
+         physc = (double) (snap->purr - prev->purr) / (double) ctx->sys.timebase / dt_lpar;
+   }
+   else if (ctx->sys.kvm_guest || (! ctx->sys.has_lparcfg))
+   {
+/* KVM guest or PowerNV host so time stolen by the hypervisor is not used */
+      if (total_diff > 0LL)
+         physc = snap->online_cpus * (1.0 - (double) (idle_diff + steal_diff) / total_diff);
+   }
+   else /* dedicated LPAR/standalone system */
+   {
+      if ((total_diff > 0LL) && (snap->active_processors > 0LL))
+      {
+         idle = (double) idle_diff / total_diff;
+         physc = snap->active_processors * (1.0 - idle);
+      }
+      else if (both & IBMPOWER_SAMPLE_CPU)
+         physc = 0.0;
+   }
+
+/* sanity check to prevent against accidental huge value */
+   if (physc >= MAX_PHYSC)
+      physc = 0.0;
+
+   r->physc = physc;
+
+   if (snap->entitled_capacity >= 0LL)
+      r->entitlement = snap->entitled_capacity / 100.0;
+   else
+      r->entitlement = snap->online_cpus;
+
+   r->entc_pct = (r->entitlement != 0.0) ? 100.0 * r->physc / r->entitlement : 100.0;
+
+   if (both & IBMPOWER_SAMPLE_LPAR)
+   {
+      if (ctx->sys.timebase > 0LL)
+         r->pool_idle = my_rate( snap->pool_idle_time, prev->pool_idle_time, dt_lpar,
+                                 r->pool_idle * ctx->sys.timebase ) / ctx->sys.timebase;
+      else
+         r->pool_idle = 0.0;
+
+/* prevent against huge value when suddenly performance data collection */
+/* is enabled or disabled for this LPAR */
+      if (r->pool_idle > MAX_POOL_IDLE)
+         r->pool_idle = 0.0;
+
+      r->dispatches = my_rate( snap->dispatches, prev->dispatches, dt_lpar, r->dispatches );
+      r->dispersions = my_rate( snap->dispersions, prev->dispersions, dt_lpar, r->dispersions );
+
+      if ((snap->dispatches > prev->dispatches) && (snap->dispersions >= prev->dispersions))
+         r->dispersion_pct = 100.0 * (snap->dispersions - prev->dispersions) /
+                                     (snap->dispatches - prev->dispatches);
+      else if (snap->dispatches == prev->dispatches)
+         r->dispersion_pct = 0.0;
+
+      if (r->dispersion_pct > 100.0)
+         r->dispersion_pct = 100.0;
+   }
+
+   if (both & IBMPOWER_SAMPLE_DISK)
+   {
+      r->disk_iops = my_rate( snap->disk_ios, prev->disk_ios, dt_disk, r->disk_iops );
+      r->disk_read = my_rate( snap->disk_read_bytes, prev->disk_read_bytes, dt_disk, r->disk_read );
+      r->disk_write = my_rate( snap->disk_write_bytes, prev->disk_write_bytes, dt_disk, r->disk_write );
+
+      if ((snap->disk_ios > prev->disk_ios) && (snap->disk_io_msec >= prev->disk_io_msec))
+         r->disk_await = (double) (snap->disk_io_msec - prev->disk_io_msec) /
+                                  (snap->disk_ios - prev->disk_ios);
+      else if (snap->disk_ios == prev->disk_ios)
+         r->disk_await = 0.0;
+   }
+
+   r->last = *snap;
+}
+
+
+
+double
+ibmpower_counter_rate( ibmpower_counter *c, long long value, double now )
+{
+   double delta_t = now - c->time;
+
+
+/* a second call within the same clock tick repeats the rate */
+   if (c->primed && (delta_t <= 0.0))
+      return( c->rate );
+
+   c->rate = c->primed ? my_rate( value, c->value, delta_t, c->rate ) : 0.0;
+   c->value = value;
+   c->time = now;
+   c->primed = TRUE;
+
+   return( c->rate );
+}
+
+
+
+double
+ibmpower_ratio_update( ibmpower_ratio *r, long long num, long long den )
+{
+   if ((! r->primed) || (num < 0LL) || (den < 0LL) || (r->num < 0LL) || (r->den < 0LL))
+      r->ratio = 0.0;
+   else if ((num >= r->num) && (den >= r->den))
+      r->ratio = (den > r->den) ? (double) (num - r->num) / (double) (den - r->den) : 0.0;
+/* else a counter went backwards, the last ratio is kept */
+
+   r->num = num;
+   r->den = den;
+   r->primed = TRUE;
+
+   return( r->ratio );
+}
@@ -0,0 +1,401 @@
+/******************************************************************************
+ *
+ *  libibmpower - collection core of the ibmpower gmond module
+ *
+ *  The library reads the raw LPAR, CPU and disk counters of Linux on Power
+ *  into a snapshot and turns two snapshots into the rates the ibmpower
+ *  module reports (physc, %entc, pool idle, dispatches, disk rates etc.).
+ *  It has no dependencies on gmond, APR or libmetrics, so the same code is
+ *  used by modibmpower.so, the ibmpowerstat command and other agents.
+ *
+ *  Usage:
+ *
+ *     ibmpower_ctx *ctx = ibmpower_open();
+ *     ibmpower_snapshot snap;
+ *     ibmpower_rates rates = IBMPOWER_RATES_INIT;
+ *
+ *     for (;;)
+ *     {
+ *        ibmpower_sample( ctx, IBMPOWER_SAMPLE_ALL, &snap );
+ *        ibmpower_rates_update( ctx, &rates, &snap );
+ *        ... use rates.physc etc. ...
+ *        sleep( interval );
+ *     }
+ *
+ *     ibmpower_close( ctx );
+ *
+ *  The counters come from the backend of the platform: "procfs" on Linux,
+ *  "perfstat" on AIX.  ibmpower_open_backend( "fixture", file ) reads them
+ *  from a file of "key=value" lines instead, named like the fields of
+ *  ibmpower_snapshot plus "time", "has_lparcfg", "kvm_guest",
+ *  "purr_usable", "timebase" and "boot_time".  The file is re-read for every sample,
+ *  so recorded or made up counters can be fed to the rate engine on any
+ *  system.
+ *
+ *  A flight recorder keeps one record per sample interval in a ring file
+ *  mapped into memory, see ibmpower_recorder_open().
+ *
+ *  Callers allocate ibmpower_snapshot and ibmpower_rates themselves and
+ *  ibmpower_rates embeds a snapshot, so a new field changes the size of
+ *  both.  New fields are added at the end of a structure, and
+ *  IBMPOWER_API_VERSION and the libtool version are incremented, so
+ *  programs built against an older version must be rebuilt.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.5, Oct 18, 2026
+ *
+ *  Version 1.5:  Oct 18, 2026
+ *                - added the rate and ratio of single counters, the
+ *                  module has no rate logic of its own any more (API 6)
+ *                  (--> ibmpower_counter_rate(), ibmpower_ratio_update() )
+ *
+ *  Version 1.4:  Oct 18, 2026
+ *                - added the read time of every source to the snapshot,
+ *                  the rates of a source re-used from the cache are no
+ *                  longer divided by the wrong interval
+ *                  (--> lpar_time, cpu_time, disk_time )
+ *                - added the times of the single CPUs and the boot time,
+ *                  the module no longer parses /proc/stat itself
+ *                  (--> ibmpower_cpu_times(), ibmpower_boot_time() )
+ *                - the number scanner of the procfs backend is shared
+ *                  with the module
+ *                  (--> ibmpower_parse_ull() )
+ *                - the procfs backend reads below the directory given to
+ *                  ibmpower_open_backend()
+ *                - added reads with a deadline by a reader thread, also
+ *                  for the files of the procfs backend
+ *                  (--> ibmpower_guard_*(), ibmpower_set_read_timeout() )
+ *                - the snapshot grew, which changes the size of
+ *                  ibmpower_snapshot and ibmpower_rates (API 5), programs
+ *                  built for version 1.3 must be rebuilt
+ *                - the embedded snapshot moved to the end of
+ *                  ibmpower_rates, so the rate fields keep their offsets
+ *                  when the snapshot grows
+ *                  (--> last, IBMPOWER_RATES_INIT )
+ *
+ *  Version 1.3:  Oct 18, 2026
+ *                - added the disk await
+ *                  (--> disk_io_msec, disk_await )
+ *                - ibmpower_rates holds a snapshot, so its layout changed
+ *                  and programs built for version 1.2 must be rebuilt
+ *
+ *  Version 1.2:  Oct 18, 2026
+ *                - added the flight recorder
+ *                  (--> ibmpower_recorder_*() )
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - added backends
+ *                  (--> ibmpower_open_backend(), ibmpower_backend_name() )
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release, split off mod_ibmpower-linux.c
+ *
+ ******************************************************************************/
+
+#ifndef LIBIBMPOWER_H
+#define LIBIBMPOWER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define IBMPOWER_API_VERSION 6
+
+
+/* sources read by ibmpower_sample() */
+#define IBMPOWER_SAMPLE_LPAR  0x01    /* /proc/ppc64/lparcfg */
+#define IBMPOWER_SAMPLE_CPU   0x02    /* /proc/stat */
+#define IBMPOWER_SAMPLE_DISK  0x04    /* /proc/diskstats */
+#define IBMPOWER_SAMPLE_ALL   (IBMPOWER_SAMPLE_LPAR | IBMPOWER_SAMPLE_CPU | IBMPOWER_SAMPLE_DISK)
+
+
+typedef struct ibmpower_ctx ibmpower_ctx;
+
+
+/* raw counters, a value of -1 means not available */
+typedef struct
+{
+   double time;                      /* CLOCK_MONOTONIC seconds of the sample */
+   unsigned int valid;               /* IBMPOWER_SAMPLE_* sources read */
+
+/* IBMPOWER_SAMPLE_LPAR */
+   long long entitled_capacity;      /* in 1/100 of a core */
+   long long active_processors;      /* virtual processors */
+   long long pool_id;
+   long long pool_num_procs;
+   long long shared_processor_mode;
+   long long capped;
+   long long weight;                 /* unallocated_capacity_weight */
+   long long purr;                   /* timebase ticks */
+   long long pool_idle_time;         /* timebase ticks */
+   long long dispatches;
+   long long dispersions;
+
+/* IBMPOWER_SAMPLE_CPU, jiffies summed over all CPUs */
+   int online_cpus;
+   unsigned long long cpu_total;
+   unsigned long long cpu_idle;
+   unsigned long long cpu_steal;
+   long long procs_running;
+   long long procs_blocked;
+
+/*
+ * IBMPOWER_SAMPLE_DISK, whole disks without md and dm devices.  These are
+ * the increments of the single devices summed up since ibmpower_open(),
+ * so they do not drop when a device or path goes away.
+ */
+   unsigned long long disk_ios;
+   unsigned long long disk_read_bytes;
+   unsigned long long disk_write_bytes;
+   unsigned long long disk_io_msec;  /* ms spent on reads and writes, 0 on AIX */
+
+/*
+ * When each source was read, on the clock of time.  A source re-used
+ * from the cache (ibmpower_set_max_age()) keeps its older time, and
+ * ibmpower_rates_update() divides by the time between two reads of the
+ * same source.
+ */
+   double lpar_time;
+   double cpu_time;
+   double disk_time;
+} ibmpower_snapshot;
+
+
+/*
+ * Rates between the previous and the current snapshot.  A counter going
+ * backwards (reset, wrap, LPAR mobility) repeats the last good value.
+ * Keep one ibmpower_rates per consumer and interval.
+ */
+typedef struct
+{
+   int primed;
+   double interval;                  /* seconds between the snapshots */
+
+   double physc;                     /* physical cores used */
+   double entc_pct;                  /* physc in % of the entitlement */
+   double entitlement;               /* cores */
+   double pool_idle;                 /* idle cores in the shared pool */
+   double steal_pct;                 /* % of CPU time stolen by the hypervisor */
+   double dispatches;                /* per second */
+   double dispersions;               /* per second */
+   double dispersion_pct;            /* % of the dispatches */
+   double disk_iops;
+   double disk_read;                 /* bytes per second */
+   double disk_write;                /* bytes per second */
+   double disk_await;                /* ms per disk operation */
+
+/* last so a growing snapshot does not move the rates */
+   ibmpower_snapshot last;
+} ibmpower_rates;
+
+#define IBMPOWER_RATES_INIT { 0 }
+
+
+ibmpower_ctx *ibmpower_open( void );
+void ibmpower_close( ibmpower_ctx *ctx );
+
+/*
+ * backend "procfs", "perfstat" or "fixture", NULL is the platform default.
+ * arg is the file of "fixture" and the directory the files of "procfs"
+ * are read below (NULL is /).
+ */
+ibmpower_ctx *ibmpower_open_backend( const char *backend, const char *arg );
+const char *ibmpower_backend_name( const ibmpower_ctx *ctx );
+
+/* re-use sources read less than max_age seconds ago (default 0.0) */
+void ibmpower_set_max_age( ibmpower_ctx *ctx, double max_age );
+
+int ibmpower_sample( ibmpower_ctx *ctx, unsigned int what, ibmpower_snapshot *snap );
+void ibmpower_rates_update( ibmpower_ctx *ctx, ibmpower_rates *r, const ibmpower_snapshot *snap );
+
+/* properties of the system, determined by ibmpower_open() */
+int ibmpower_has_lparcfg( const ibmpower_ctx *ctx );
+int ibmpower_kvm_guest( const ibmpower_ctx *ctx );
+int ibmpower_purr_usable( const ibmpower_ctx *ctx );
+long long ibmpower_timebase( const ibmpower_ctx *ctx );
+long long ibmpower_boot_time( const ibmpower_ctx *ctx );    /* epoch seconds, 0 = unknown */
+
+
+/*
+ * Rate of a single counter outside the snapshot, e.g. an adapter or
+ * lparcfg statistic of one metric, with the rules of
+ * ibmpower_rates_update(): 0 on the first call or for a counter of -1,
+ * the last rate if the counter went backwards.
+ */
+typedef struct
+{
+   int primed;
+   long long value;
+   double time;
+   double rate;
+} ibmpower_counter;
+
+#define IBMPOWER_COUNTER_INIT { 0 }
+
+/* increase of value per second since the last call, now in seconds */
+double ibmpower_counter_rate( ibmpower_counter *c, long long value, double now );
+
+/* ratio of the increases of two counters, e.g. fault time per fault */
+typedef struct
+{
+   int primed;
+   long long num;
+   long long den;
+   double ratio;
+} ibmpower_ratio;
+
+#define IBMPOWER_RATIO_INIT { 0 }
+
+/* increase of num divided by the increase of den since the last call, 0 if den did not grow */
+double ibmpower_ratio_update( ibmpower_ratio *r, long long num, long long den );
+
+
+/* jiffies of a single CPU */
+typedef struct
+{
+   int online;
+   unsigned long long total;
+   unsigned long long idle;
+   unsigned long long steal;
+} ibmpower_cpu;
+
+/*
+ * Copy the jiffies of CPU 0 .. max-1 from the last read of
+ * IBMPOWER_SAMPLE_CPU into cpus, entries of offline CPUs have online 0.
+ * Returns the highest online CPU + 1, which can be larger than max, or
+ * -1 if the backend has no times per CPU.
+ */
+int ibmpower_cpu_times( ibmpower_ctx *ctx, ibmpower_cpu *cpus, int max );
+
+
+/*
+ * In place scanner for the procfs tables.  Skips blanks and parses an
+ * unsigned decimal number without the locale, base and overflow handling
+ * of strtoull() or the format interpretation of sscanf(), *pp is left on
+ * the first character after it.
+ */
+static inline const char *
+ibmpower_skip_blanks( const char *p )
+{
+   while ((*p == ' ') || (*p == '\t'))
+      p++;
+
+   return( p );
+}
+
+
+static inline unsigned long long
+ibmpower_parse_ull( const char **pp )
+{
+   const char *p = ibmpower_skip_blanks( *pp );
+   unsigned long long v = 0ULL;
+   unsigned int d;
+
+
+   while ((d = (unsigned int) (*p - '0')) < 10)
+   {
+      v = 10ULL * v + d;
+      p++;
+   }
+
+   *pp = p;
+
+   return( v );
+}
+
+
+/*
+ * Reads with a deadline, see ibmpower_guard.c.  A source is read by
+ * src->read( src->arg ) in the reader thread of the guard, which returns
+ * TRUE on success.  ibmpower_guard_read() returns 1 if the source has
+ * been read, 0 if the read failed and -1 if it missed the deadline or
+ * an earlier read of it still hangs.  Only a read which started and
+ * missed the deadline sets stale and counts in timeouts, a read which
+ * could not start in time returns -1 and leaves both alone.  They are
+ * only changed by ibmpower_guard_read(), so its caller can look at them.
+ * After ibmpower_guard_close() busy is only set in a source whose read
+ * still hangs.  That source and its arg belong to the reader thread,
+ * which calls src->release( src->arg ) (if not NULL) when the read has
+ * returned.  A NULL guard reads without a deadline.
+ */
+typedef struct ibmpower_guard ibmpower_guard;
+
+typedef struct ibmpower_guarded
+{
+   const char *name;
+   int (*read)( void *arg );
+   void *arg;
+   void (*release)( void *arg );
+
+/* state kept by the guard, all 0 initially */
+   struct ibmpower_guarded *next;
+   int queued;
+   int busy;
+   int late;                         /* missed its deadline, result not used yet */
+   int ok;
+   int stale;                        /* the last read missed its deadline */
+   long long timeouts;
+} ibmpower_guarded;
+
+ibmpower_guard *ibmpower_guard_open( void );
+void ibmpower_guard_close( ibmpower_guard *guard );
+int ibmpower_guard_read( ibmpower_guard *guard, ibmpower_guarded *src, int deadline_msec );
+long long ibmpower_guard_timeouts( ibmpower_guard *guard );
+
+/*
+ * Read the files of the backend with a deadline of msec, 0 = without.
+ * A source which misses it keeps its last values and read time and is
+ * marked in ibmpower_stale().  Returns -1 if the backend has no files or
+ * the reader thread cannot be started.
+ */
+int ibmpower_set_read_timeout( ibmpower_ctx *ctx, int msec );
+long long ibmpower_read_timeouts( const ibmpower_ctx *ctx );
+unsigned int ibmpower_stale( const ibmpower_ctx *ctx );    /* IBMPOWER_SAMPLE_* */
+
+
+/*
+ * Flight recorder.  ibmpower_recorder_open() creates the ring file with
+ * room for the given number of records, or continues the ring already in
+ * it if it has the same size.  ibmpower_recorder_write() appends the
+ * increments of the interval of r (after ibmpower_rates_update()), it
+ * takes no locks and makes no system calls.  There can be one writer per
+ * file and any number of readers, which open it by ibmpower_recorder_map().
+ * The records ibmpower_recorder_read() can return are numbered from
+ * first to next - 1 (ibmpower_recorder_range()), it returns -1 if a record
+ * has just been overwritten.
+ */
+typedef struct ibmpower_recorder ibmpower_recorder;
+
+typedef struct
+{
+   double time;                      /* wall clock seconds at the end of the interval */
+   double interval;                  /* seconds */
+   unsigned int valid;               /* IBMPOWER_SAMPLE_* sources read */
+
+   double entitlement;               /* cores */
+   double physc;
+   double entc_pct;
+   double pool_idle;
+   double steal_pct;
+   double disk_iops;
+   double disk_read;                 /* bytes per second */
+   double disk_write;                /* bytes per second */
+} ibmpower_record;
+
+ibmpower_recorder *ibmpower_recorder_open( const char *file, unsigned int records );
+ibmpower_recorder *ibmpower_recorder_map( const char *file );
+void ibmpower_recorder_close( ibmpower_recorder *rec );
+void ibmpower_recorder_write( ibmpower_recorder *rec, const ibmpower_rates *r );
+unsigned int ibmpower_recorder_records( const ibmpower_recorder *rec );
+void ibmpower_recorder_range( const ibmpower_recorder *rec, unsigned long long *first,
+                              unsigned long long *next );
+int ibmpower_recorder_read( const ibmpower_recorder *rec, unsigned long long n, ibmpower_record *out );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBIBMPOWER_H */
@@ -15,12 +15,38 @@
  *
  *  Written by Michael Perzl (michael@perzl.org)
  *
- *  Version 1.6, Oct 26, 2017
+ *  Version 1.7, Oct 18, 2026
  *
  *  based on Ganglia V3.0.7 AIX Ganglia libmetrics code written by:
  *         Michael Perzl (michael@perzl.org)
  *     and Nigel Griffiths (nigelargriffiths@hotmail.com)
  *
+ *  Version 1.7:  Oct 18, 2026
+ *                - added Active Memory Sharing metrics
+ *                  (--> cmo_*_func() )
+ *                - added numeric SMT metric
+ *                  (--> smt_threads_func() )
+ *                - added run queue metrics normalized by entitlement and
+ *                  virtual processors
+ *                  (--> runq_*_func() )
+ *                - share one perfstat_partition_total() snapshot per
+ *                  collection round with the perfstat backend of
+ *                  libibmpower
+ *                  (--> my_partition_total() )
+ *                - the CPU, pool idle and disk rates come from the
+ *                  perfstat backend of libibmpower, shared with Linux
+ *                  (--> cpu_used_func(), cpu_pool_idle_func(),
+ *                       disk_iops_func(), disk_read_func(),
+ *                       disk_write_func() )
+ *                - the AMS and run queue rates come from the counter
+ *                  rate of libibmpower, with the same reset rule as the
+ *                  other rates
+ *                  (--> cmo_fault*_func(), runq_average() )
+ *                - the metric definitions and the index to function
+ *                  dispatch are shared with Linux, the Linux-only
+ *                  metrics are left out instead of reporting 0
+ *                  (--> ibmpower_metric_funcs[], ibmpower_metrics_build() )
+ *
  *  Version 1.6:  Oct 26, 2017
  *                - added defines for AIX 7.2
  *                - added KVM Guest detection
@@ -79,6 +105,7 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <time.h>
 
@@ -100,6 +127,17 @@
 #include <libperfstat.h>
 
 #include "libmetrics.h"
+#include "libibmpower.h"
+#include "ibmpower_perfstat.h"
+#include "ibmpower_metrics.h"
+
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
 
 
 static int isVIOserver;
@@ -107,19 +145,65 @@ static int isVIOserver;
 static time_t boottime;
 
 
+
+/*
+ * gmond asks for the metrics of a collection round one after the other
+ * within a few milliseconds, so instead of calling into the perfstat
+ * kernel extension for every metric all functions share the
+ * perfstat_partition_total() snapshot of libibmpower, which its
+ * perfstat backend samples from too.  The rate functions divide by the
+ * time between two snapshots (partition_time).  The disk counters come
+ * from the libibmpower source cache.
+ */
+#if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+static double partition_time;
+
+
+static perfstat_partition_total_t *
+my_partition_total( void )
+{
+   return( ibmpower_partition_total( &partition_time ) );
+}
+#endif
+
+
+
+/*
+ * The rates of cpu_used, cpu_pool_idle and the disk metrics come from
+ * the rate engine of libibmpower, the same as on Linux.  Every metric
+ * keeps its own ibmpower_rates, so its rate covers the time since it
+ * was last collected.
+ */
+static ibmpower_ctx *core = NULL;
+
+
+static void
+my_core_update( ibmpower_rates *r, unsigned int what )
+{
+   ibmpower_snapshot snap;
+
+
+   if (core == NULL)
+      return;
+
+   ibmpower_sample( core, what, &snap );
+   ibmpower_rates_update( core, r, &snap );
+}
+
+
 g_val_t
 capped_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1 ) == -1)
+   if ((p = my_partition_total()) == NULL)
       strcpy( val.str, "libperfstat returned an error" );
    else
-      if ( __LPAR() && p.type.b.shared_enabled )
-         strcpy ( val.str, p.type.b.capped ? "yes" : "no" );
+      if ( __LPAR() && p->type.b.shared_enabled )
+         strcpy ( val.str, p->type.b.capped ? "yes" : "no" );
       else
          strcpy( val.str, "No SPLPAR-capable system" );
 #else
@@ -149,22 +233,22 @@ cpu_entitlement_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1 ) == -1)
+   if ((p = my_partition_total()) == NULL)
       val.f = 0.0;
    else
-      if (p.type.b.shared_enabled
+      if (p->type.b.shared_enabled
 #ifdef DONATE_ENABLED
-           || p.type.b.donate_enabled
+           || p->type.b.donate_enabled
 #endif
          )
       {
-         val.f = p.entitled_proc_capacity / 100.0;
+         val.f = p->entitled_proc_capacity / 100.0;
       }
       else /* dedicated LPAR/standalone system so fake entitled as number of online CPUs */
-         val.f = p.online_cpus;
+         val.f = p->online_cpus;
 #else
    perfstat_cpu_total_t c;
 
@@ -185,13 +269,13 @@ cpu_in_lpar_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1 ) == -1)
+   if ((p = my_partition_total()) == NULL)
       val.int32 = -1;
    else
-      val.int32 = p.online_cpus;
+      val.int32 = p->online_cpus;
 #else
    perfstat_cpu_total_t c;
 
@@ -212,13 +296,13 @@ cpu_in_machine_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1 ) == -1)
+   if ((p = my_partition_total()) == NULL)
       val.int32 = -1;
    else
-      val.int32 = p.online_phys_cpus_sys;
+      val.int32 = p->online_phys_cpus_sys;
 #else
    perfstat_cpu_total_t c;
 
@@ -239,13 +323,13 @@ cpu_in_pool_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1 ) == -1)
+   if ((p = my_partition_total()) == NULL)
       val.int32 = -1;
    else
-      val.int32 = p.phys_cpus_pool;
+      val.int32 = p->phys_cpus_pool;
 #else
    perfstat_cpu_total_t c;
 
@@ -266,21 +350,21 @@ cpu_in_syspool_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1 ) == -1)
+   if ((p = my_partition_total()) == NULL)
       val.int32 = -1;
    else
 #if defined(POWER6_POOLS)
    {
-      val.int32 = p.shcpus_in_sys;
+      val.int32 = p->shcpus_in_sys;
 
-      if ((val.int32 == 0) && (p.phys_cpus_pool > 0))
-         val.int32 = p.phys_cpus_pool;
+      if ((val.int32 == 0) && (p->phys_cpus_pool > 0))
+         val.int32 = p->phys_cpus_pool;
    }
 #else
-      val.int32 = p.phys_cpus_pool;
+      val.int32 = p->phys_cpus_pool;
 #endif
 #else
    perfstat_cpu_total_t c;
@@ -302,15 +386,15 @@ cpu_pool_id_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
    if ( __LPAR() )
    {
-      if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1) == -1)
+      if ((p = my_partition_total()) == NULL)
          val.int32 = -1;
       else
-         val.int32 = p.pool_id;
+         val.int32 = p->pool_id;
    }
    else
       val.int32 = -1;
@@ -323,218 +407,87 @@ cpu_pool_id_func( void )
 
 
 
-#define MAX_CPU_POOL_IDLE (256.0)
+static ibmpower_rates pool_idle_rates = IBMPOWER_RATES_INIT;
 
 g_val_t
 cpu_pool_idle_func( void )
 {
    g_val_t val;
-#if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
-   lpar_info_format2_t f2;
-   static uint64_t saved_pool_idle_time = 0LL;
-   longlong_t diff;
-   static double last_time = 0.0;
-   static float last_val = 0.0;
-   double now, delta_t;
-   struct timeval timeValue;
-   struct timezone timeZone;
 
 
-   gettimeofday( &timeValue, &timeZone );
-
-   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
- 
-   lpar_get_info( LPAR_INFO_FORMAT2, &f2, sizeof( lpar_info_format2_t ) );
-
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1 ) == -1)
-      val.f = 0.0;
-   else
-   {
-      delta_t = now - last_time;
+/* 0 without "Allow performance information collection" */
+   my_core_update( &pool_idle_rates, IBMPOWER_SAMPLE_LPAR );
 
-      if ( p.type.b.shared_enabled )
-      {
-         if ( (delta_t > 0.0) && (f2.lpar_flags & LPAR_INFO2_AUTH_PIC) )
-         {
-            diff = f2.pool_idle_time - saved_pool_idle_time;
-
-            if (diff >= 0LL)
-               val.f = (double) diff / delta_t / 1000.0 / 1000.0 / 1000.0;
-            else
-               val.f = last_val;
-         }
-         else
-            val.f = 0.0;
-
-         saved_pool_idle_time = f2.pool_idle_time;
-      }
-      else
-         val.f = 0.0;
-   }
-
-/* prevent against huge value when suddenly performance data collection */
-/* is enabled or disabled for this LPAR */
-   if (val.f > MAX_CPU_POOL_IDLE)
-      val.f = 0.0;
-
-   last_time = now;
-   last_val = val.f;
-#else
-   val.f = 0.0;
-#endif
+   val.f = pool_idle_rates.pool_idle;
 
    return( val );
 }
 
 
 
+static ibmpower_rates cpu_used_rates = IBMPOWER_RATES_INIT;
+
 g_val_t
 cpu_used_func( void )
 {
    g_val_t val;
 
 
-   val = cpu_physc_func();
+/* the PURR ticks of the partition over the timebase ticks, as lparstat does */
+   my_core_update( &cpu_used_rates, IBMPOWER_SAMPLE_LPAR | IBMPOWER_SAMPLE_CPU );
+
+   val.f = cpu_used_rates.physc;
 
    return( val );
 }
 
 
 
+static ibmpower_rates disk_iops_rates = IBMPOWER_RATES_INIT;
+
 g_val_t
 disk_iops_func( void )
 {
    g_val_t val;
-   static perfstat_disk_total_t d1, d2;
-   static double last_time = 0.0;
-   static double last_val = 0.0;
-   longlong_t diff = 0LL;
-   double now, delta_t;
-   struct timeval timeValue;
-   struct timezone timeZone;
-
-
-   gettimeofday( &timeValue, &timeZone );
-
-   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
-
-   if (perfstat_disk_total( NULL, &d2, sizeof( perfstat_disk_total_t ), 1 ) == -1)
-      val.d = 0.0;
-   else
-   {
-      delta_t = now - last_time;
 
-      if ( delta_t > 0.0 )
-      {
-         diff = d2.xfers - d1.xfers;
-
-         if (diff >= 0LL)
-            val.d = diff / delta_t;
-         else
-            val.d = last_val;
-      }
-      else
-         val.d = 0.0;
 
-      d1 = d2;
-   }
+   my_core_update( &disk_iops_rates, IBMPOWER_SAMPLE_DISK );
 
-   last_time = now;
-   last_val = val.d;
+   val.d = disk_iops_rates.disk_iops;
 
    return( val );
 }
 
 
 
+static ibmpower_rates disk_read_rates = IBMPOWER_RATES_INIT;
+
 g_val_t
 disk_read_func( void )
 {
    g_val_t val;
-   static perfstat_disk_total_t d1, d2;
-   static double last_time = 0.0;
-   static double last_val = 0.0;
-   longlong_t diff = 0LL;
-   double now, delta_t;
-   struct timeval timeValue;
-   struct timezone timeZone;
 
 
-   gettimeofday( &timeValue, &timeZone );
+   my_core_update( &disk_read_rates, IBMPOWER_SAMPLE_DISK );
 
-   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
-   if (perfstat_disk_total( NULL, &d2, sizeof( perfstat_disk_total_t ), 1 ) == -1)
-      val.d = 0.0;
-   else
-   {
-      delta_t = now - last_time;
-
-      if ( delta_t > 0.0 )
-      {
-         diff = d2.rblks - d1.rblks;
-
-         if (diff >= 0LL)
-/* the result is returned in number of 512 byte blocks */
-            val.d = (diff * 512.0) / delta_t;
-         else
-            val.d = last_val;
-      }
-      else
-         val.d = 0.0;
-
-      d1 = d2;
-   }
-
-   last_time = now;
-   last_val = val.d;
+   val.d = disk_read_rates.disk_read;
 
    return( val );
 }
 
 
 
+static ibmpower_rates disk_write_rates = IBMPOWER_RATES_INIT;
+
 g_val_t
 disk_write_func( void )
 {
    g_val_t val;
-   static perfstat_disk_total_t d1, d2;
-   static double last_time = 0.0;
-   static double last_val = 0.0;
-   longlong_t diff = 0LL;
-   double now, delta_t;
-   struct timeval timeValue;
-   struct timezone timeZone;
-
-
-   gettimeofday( &timeValue, &timeZone );
-
-   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
-
-   if (perfstat_disk_total( NULL, &d2, sizeof( perfstat_disk_total_t ), 1 ) == -1)
-      val.d = 0.0;
-   else
-   {
-      delta_t = now - last_time;
 
-      if ( delta_t > 0.0 )
-      {
-         diff = d2.wblks - d1.wblks;
-
-         if (diff >= 0LL)
-/* the result is returned in number of 512 byte blocks */
-            val.d = (diff * 512.0) / delta_t;
-         else
-            val.d = last_val;
-      }
-      else
-         val.d = 0.0;
 
-      d1 = d2;
-   }
+   my_core_update( &disk_write_rates, IBMPOWER_SAMPLE_DISK );
 
-   last_time = now;
-   last_val = val.d;
+   val.d = disk_write_rates.disk_write;
 
    return( val );
 }
@@ -605,15 +558,15 @@ lpar_name_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
    if ( __LPAR() )
    {
-      if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1) == -1)
+      if ((p = my_partition_total()) == NULL)
          strcpy( val.str, "libperfstat returned an error" );
       else
-         strcpy( val.str, p.name );
+         strcpy( val.str, p->name );
    }
    else
       strcpy( val.str, "No LPAR system" );
@@ -663,13 +616,13 @@ lpar_num_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t ), 1) == -1)
+   if ((p = my_partition_total()) == NULL)
       val.int32 = -1;
    else
-      val.int32 = p.lpar_id;
+      val.int32 = p->lpar_id;
 #else
    FILE *f;
    char s[MAX_G_STRING_SIZE];
@@ -859,17 +812,17 @@ smt_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
    FILE *f;
    char  buf[512];
    int   l;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t), 1 ) == -1)
+   if ((p = my_partition_total()) == NULL)
       strcpy( val.str, "libperfstat returned an error" );
    else
    {
-      if (p.type.b.smt_capable)  /* system is SMT capable */
+      if (p->type.b.smt_capable)  /* system is SMT capable */
       {
          strcpy( val.str, "undefined" );
 
@@ -914,18 +867,36 @@ smt_func( void )
 
 
 
+g_val_t
+smt_threads_func( void )
+{
+   g_val_t val;
+   char *p;
+
+
+   val = smt_func();
+
+   p = strstr( val.str, "SMT=" );
+
+   val.int32 = p ? atoi( p+4 ) : -1;
+
+   return( val );
+}
+
+
+
 g_val_t
 splpar_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t), 1) == -1)
+   if ((p = my_partition_total()) == NULL)
       strcpy( val.str, "libperfstat returned an error" );
    else
-      strcpy( val.str, p.type.b.shared_enabled ? "yes" : "no" );
+      strcpy( val.str, p->type.b.shared_enabled ? "yes" : "no" );
 #else
    strcpy( val.str, "No SPLPAR-capable system" );
 #endif
@@ -940,14 +911,14 @@ weight_func( void )
 {
    g_val_t val;
 #if defined(_AIX53) || defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
-   perfstat_partition_total_t p;
+   perfstat_partition_total_t *p;
 
 
-   if (perfstat_partition_total( NULL, &p, sizeof( perfstat_partition_total_t), 1 ) == -1)
+   if ((p = my_partition_total()) == NULL)
       val.int32 = -1;
    else
-      if ( p.type.b.shared_enabled )
-         val.int32 = p.var_proc_capacity_weight;
+      if ( p->type.b.shared_enabled )
+         val.int32 = p->var_proc_capacity_weight;
       else
          val.int32 = -1;
 #else
@@ -980,6 +951,264 @@ cpu_type_func( void )
 
 
 
+/*
+ * Active Memory Sharing metrics (the Linux kernel calls it Cooperative
+ * Memory Overcommitment, hence the names).
+ */
+g_val_t
+cmo_enabled_func( void )
+{
+   g_val_t val;
+#if defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+   perfstat_partition_total_t *p;
+
+
+   if ((p = my_partition_total()) == NULL)
+      strcpy( val.str, "libperfstat returned an error" );
+   else
+      if ( p->type.b.ams_capable )
+         strcpy( val.str, p->type.b.ams_enabled ? "yes" : "no" );
+      else
+         strcpy( val.str, "No CMO-capable system" );
+#else
+   strcpy( val.str, "No CMO-capable system" );
+#endif
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_entitled_memory_func( void )
+{
+   g_val_t val;
+#if defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+   perfstat_partition_total_t *p;
+
+
+   if ((p = my_partition_total()) == NULL)
+      val.d = 0.0;
+   else
+      val.d = p->type.b.ams_enabled ? (double) p->iome : 0.0;
+#else
+   val.d = 0.0;
+#endif
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_memory_weight_func( void )
+{
+   g_val_t val;
+#if defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+   perfstat_partition_total_t *p;
+
+
+   if ((p = my_partition_total()) == NULL)
+      val.int32 = -1;
+   else
+      val.int32 = p->type.b.ams_enabled ? p->var_mem_weight : -1;
+#else
+   val.int32 = -1;
+#endif
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_backing_memory_func( void )
+{
+   g_val_t val;
+#if defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+   perfstat_partition_total_t *p;
+
+
+   if ((p = my_partition_total()) == NULL)
+      val.d = 0.0;
+   else
+      val.d = p->type.b.ams_enabled ? (double) p->pmem : 0.0;
+#else
+   val.d = 0.0;
+#endif
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_page_size_func( void )
+{
+   g_val_t val;
+#if defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+   perfstat_partition_total_t *p;
+
+
+/* the hypervisor shares memory in 4k pages */
+   if ((p = my_partition_total()) == NULL)
+      val.int32 = -1;
+   else
+      val.int32 = p->type.b.ams_enabled ? 4096 : -1;
+#else
+   val.int32 = -1;
+#endif
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_faults_func( void )
+{
+   g_val_t val;
+#if defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+   perfstat_partition_total_t *p;
+   static ibmpower_counter hpi = IBMPOWER_COUNTER_INIT;
+
+
+   if (((p = my_partition_total()) == NULL) || (! p->type.b.ams_enabled))
+      val.f = 0.0;
+   else
+      val.f = ibmpower_counter_rate( &hpi, (long long) p->hpi, partition_time );
+#else
+   val.f = 0.0;
+#endif
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_fault_time_func( void )
+{
+   g_val_t val;
+#if defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+   perfstat_partition_total_t *p;
+   static ibmpower_counter hpit = IBMPOWER_COUNTER_INIT;
+
+
+/* the hypervisor page-in time is returned in nano-seconds */
+   if (((p = my_partition_total()) == NULL) || (! p->type.b.ams_enabled))
+      val.f = 0.0;
+   else
+      val.f = ibmpower_counter_rate( &hpit, (long long) p->hpit, partition_time ) / 1000.0;
+#else
+   val.f = 0.0;
+#endif
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_fault_latency_func( void )
+{
+   g_val_t val;
+#if defined(_AIX61) || defined(_AIX71) || defined(_AIX72)
+   perfstat_partition_total_t *p;
+   static ibmpower_ratio latency = IBMPOWER_RATIO_INIT;
+
+
+   if ((p = my_partition_total()) == NULL)
+      val.f = 0.0;
+   else
+      val.f = ibmpower_ratio_update( &latency, (long long) p->hpit, (long long) p->hpi ) / 1000.0;
+#else
+   val.f = 0.0;
+#endif
+
+   return( val );
+}
+
+
+
+/*
+ * The AIX kernel adds the length of the run queue (runque) and of the
+ * queue of threads waiting for I/O or paging (swpque) to these counters
+ * once per second, so their increase over the collection interval divided
+ * by the interval is the average queue length sampled every second.
+ */
+static float
+runq_average( ibmpower_counter *c, int blocked )
+{
+   perfstat_cpu_total_t cpu;
+   double now;
+   struct timeval timeValue;
+   struct timezone timeZone;
+
+
+   gettimeofday( &timeValue, &timeZone );
+
+   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
+
+   if (perfstat_cpu_total( NULL, &cpu, sizeof( perfstat_cpu_total_t ), 1 ) == -1)
+      return( 0.0 );
+
+   return( ibmpower_counter_rate( c, (long long) (blocked ? cpu.swpque : cpu.runque), now ) );
+}
+
+
+
+g_val_t
+runq_per_ec_func( void )
+{
+   static ibmpower_counter s = IBMPOWER_COUNTER_INIT;
+   g_val_t val;
+   float running, ec;
+
+
+   running = runq_average( &s, FALSE );
+   ec = cpu_entitlement_func().f;
+
+   val.f = (ec > 0.0) ? running / ec : 0.0;
+
+   return( val );
+}
+
+
+
+g_val_t
+runq_per_vcpu_func( void )
+{
+   static ibmpower_counter s = IBMPOWER_COUNTER_INIT;
+   g_val_t val;
+   float running;
+   int vcpus;
+
+
+   running = runq_average( &s, FALSE );
+   vcpus = cpu_in_lpar_func().int32;
+
+   val.f = (vcpus > 0) ? running / vcpus : 0.0;
+
+   return( val );
+}
+
+
+
+g_val_t
+runq_blocked_func( void )
+{
+   static ibmpower_counter s = IBMPOWER_COUNTER_INIT;
+   g_val_t val;
+
+
+   val.f = runq_average( &s, TRUE );
+
+   return( val );
+}
+
+
+
 static time_t
 boottime_func_CALLED_ONCE( void )
 {
@@ -1014,6 +1243,56 @@ boottime_func_CALLED_ONCE( void )
 
 
 
+/*
+ * The static metrics of AIX and their functions.  The definitions are
+ * shared with Linux in ibmpower_metrics.c, which also gives the order.
+ * The metrics only Linux has are not listed, so gmond does not get them.
+ */
+static const ibmpower_metric_func ibmpower_metric_funcs[] =
+{
+   { "capped",              capped_func },
+   { "cpu_ec",              cpu_ec_func },
+   { "cpu_entitlement",     cpu_entitlement_func },
+   { "cpu_in_lpar",         cpu_in_lpar_func },
+   { "cpu_in_machine",      cpu_in_machine_func },
+   { "cpu_in_pool",         cpu_in_pool_func },
+   { "cpu_in_syspool",      cpu_in_syspool_func },
+   { "cpu_pool_id",         cpu_pool_id_func },
+   { "cpu_pool_idle",       cpu_pool_idle_func },
+   { "cpu_used",            cpu_used_func },
+   { "disk_iops",           disk_iops_func },
+   { "disk_read",           disk_read_func },
+   { "disk_write",          disk_write_func },
+   { "fwversion",           fwversion_func },
+   { "kernel64bit",         kernel64bit_func },
+   { "lpar",                lpar_func },
+   { "lpar_name",           lpar_name_func },
+   { "lpar_num",            lpar_num_func },
+   { "model_name",          model_name_func },
+   { "oslevel",             oslevel_func },
+   { "serial_num",          serial_num_func },
+   { "smt",                 smt_func },
+   { "splpar",              splpar_func },
+   { "weight",              weight_func },
+   { "kvm_guest",           kvm_guest_func },
+   { "cpu_type",            cpu_type_func },
+   { "cmo_enabled",         cmo_enabled_func },
+   { "cmo_entitled_memory", cmo_entitled_memory_func },
+   { "cmo_memory_weight",   cmo_memory_weight_func },
+   { "cmo_backing_memory",  cmo_backing_memory_func },
+   { "cmo_page_size",       cmo_page_size_func },
+   { "cmo_faults",          cmo_faults_func },
+   { "cmo_fault_time",      cmo_fault_time_func },
+   { "cmo_fault_latency",   cmo_fault_latency_func },
+   { "smt_threads",         smt_threads_func },
+   { "runq_per_ec",         runq_per_ec_func },
+   { "runq_per_vcpu",       runq_per_vcpu_func },
+   { "runq_blocked",        runq_blocked_func },
+   { NULL, NULL }
+};
+
+
+
 /*
  * Declare ourselves so the configuration routines can find and know us.
  * We'll fill it in at the end of the module.
@@ -1023,11 +1302,21 @@ extern mmodule ibmpower_module;
 
 static int ibmpower_metric_init ( apr_pool_t *p )
 {
+   apr_array_header_t *metric_info;
+   Ganglia_25metric *gmi;
    int i;
    FILE *f;
    g_val_t val;
 
 
+   metric_info = apr_array_make( p, 64, sizeof( Ganglia_25metric ) );
+   ibmpower_metrics_build( p, ibmpower_metric_funcs, metric_info );
+
+   gmi = (Ganglia_25metric *) apr_array_push( metric_info );
+   memset( gmi, 0, sizeof( *gmi ) );
+
+   ibmpower_module.metrics_info = (Ganglia_25metric *) metric_info->elts;
+
    for (i = 0;  ibmpower_module.metrics_info[i].name != NULL;  i++)
    {
       /* Initialize the metadata storage for each of the metrics and then
@@ -1054,8 +1343,23 @@ static int ibmpower_metric_init ( apr_pool_t *p )
 /* initialize the routines which require a time interval */
 
    boottime = boottime_func_CALLED_ONCE();
+
+/* without a context cpu_used, cpu_pool_idle and the disk metrics stay 0 */
+   core = ibmpower_open();
+   if (core)
+      ibmpower_set_max_age( core, 1.0 );
+
+   val = disk_iops_func();
+   val = disk_read_func();
+   val = disk_write_func();
    val = cpu_pool_idle_func();
    val = cpu_used_func();
+   val = cmo_faults_func();
+   val = runq_per_ec_func();
+   val = runq_per_vcpu_func();
+   val = runq_blocked_func();
+   val = cmo_fault_time_func();
+   val = cmo_fault_latency_func();
    val = disk_iops_func();
    val = disk_read_func();
    val = disk_write_func();
@@ -1067,81 +1371,22 @@ static int ibmpower_metric_init ( apr_pool_t *p )
 
 static void ibmpower_metric_cleanup ( void )
 {
+   ibmpower_close( core );
+   core = NULL;
 }
 
 
 
 static g_val_t ibmpower_metric_handler ( int metric_index )
 {
-   g_val_t val;
-
-/* The metric_index corresponds to the order in which
-   the metrics appear in the metric_info array
-*/
-   switch (metric_index)
-   {
-      case 0:  return( capped_func() );
-      case 1:  return( cpu_ec_func() );
-      case 2:  return( cpu_entitlement_func() );
-      case 3:  return( cpu_in_lpar_func() );
-      case 4:  return( cpu_in_machine_func() );
-      case 5:  return( cpu_in_pool_func() );
-      case 6:  return( cpu_in_syspool_func() );
-      case 7:  return( cpu_pool_id_func() );
-      case 8:  return( cpu_pool_idle_func() );
-      case 9:  return( cpu_used_func() );
-      case 10: return( disk_iops_func() );
-      case 11: return( disk_read_func() );
-      case 12: return( disk_write_func() );
-      case 13: return( fwversion_func() );
-      case 14: return( kernel64bit_func() );
-      case 15: return( lpar_func() );
-      case 16: return( lpar_name_func() );
-      case 17: return( lpar_num_func() );
-      case 18: return( model_name_func() );
-      case 19: return( oslevel_func() );
-      case 20: return( serial_num_func() );
-      case 21: return( smt_func() );
-      case 22: return( splpar_func() );
-      case 23: return( weight_func() );
-      case 24: return( kvm_guest_func() );
-      case 25: return( cpu_type_func() );
-      default: val.uint32 = 0; /* default fallback */
-   }
-
-   return( val );
+   return( ibmpower_metrics_value( metric_index ) );
 }
 
 
 
-static Ganglia_25metric ibmpower_metric_info[] = 
+/* until ibmpower_metric_init() has built the table */
+static Ganglia_25metric ibmpower_metric_info[] =
 {
-   {0, "capped",           180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is this SPLPAR running in capped mode?"},
-   {0, "cpu_ec",            15, GANGLIA_VALUE_FLOAT,        "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Ratio of physical cores used vs. entitlement"},
-   {0, "cpu_entitlement",  180, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.2f", UDP_HEADER_SIZE+8,  "Capacity entitlement in units of physical cores"},
-   {0, "cpu_in_lpar",      180, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Number of CPUs the OS sees in the system"},
-   {0, "cpu_in_machine",  1200, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Total number of physical cores in the whole system"},
-   {0, "cpu_in_pool",      180, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Number of physical cores in the shared processor pool"},
-   {0, "cpu_in_syspool",   180, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Number of physical cores in the global shared processor pool"},
-   {0, "cpu_pool_id",      180, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Shared processor pool ID of this LPAR"},
-   {0, "cpu_pool_idle",     15, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.4f", UDP_HEADER_SIZE+8,  "Number of idle cores in the shared processor pool"},
-   {0, "cpu_used",          15, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.4f", UDP_HEADER_SIZE+8,  "Number of physical cores used"},
-   {0, "disk_iops",        180, GANGLIA_VALUE_DOUBLE,     "IO/sec", "both", "%.3f", UDP_HEADER_SIZE+16, "Total number of I/O operations per second"},
-   {0, "disk_read",        180, GANGLIA_VALUE_DOUBLE,  "bytes/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Total number of bytes read I/O of the system"},
-   {0, "disk_write",       180, GANGLIA_VALUE_DOUBLE,  "bytes/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Total number of bytes write I/O of the system"},
-   {0, "fwversion",       1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Firmware Version"},
-   {0, "kernel64bit",     1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is the kernel running in 64-bit mode?"},
-   {0, "lpar",            1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is the system an LPAR or not?"},
-   {0, "lpar_name",        180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Name of the LPAR as defined on the HMC"},
-   {0, "lpar_num",        1200, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Partition ID of the LPAR as defined on the HMC"},
-   {0, "model_name",      1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Machine Model Name"},
-   {0, "oslevel",          180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Exact AIX version string"},
-   {0, "serial_num",      1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Serial number of the hardware system"},
-   {0, "smt",              180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is SMT enabled or not?"},
-   {0, "splpar",          1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is this a shared processor LPAR or not?"},
-   {0, "weight",           180, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Capacity weight of the LPAR"},
-   {0, "kvm_guest",       1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is this a KVM guest VM or not?"},
-   {0, "cpu_type",         180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "CPU model name"},
    {0, NULL}
 };
 
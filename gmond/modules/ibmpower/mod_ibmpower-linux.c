@@ -17,12 +17,96 @@
  *
  *  Written by Michael Perzl (michael@perzl.org)
  *
- *  Version 0.7, Oct 26, 2017
+ *  Version 0.8, Oct 18, 2026
  *
  *  As long as I have not figured out how to obtain the number of cores
  *  contained in the global shared processor pool this will not be called
  *  version 1.x.
  *
+ *  Version 0.8:  Oct 18, 2026
+ *                - added CPU steal time metrics, optionally per CPU
+ *                  (--> cpu_steal_func(), cpu_steal_pct_func() )
+ *                - made cpu_used_func() steal-aware for KVM guests and
+ *                  PowerNV hosts
+ *                - added Active Memory Sharing (CMO) metrics
+ *                  (--> cmo_*_func() )
+ *                - added optional per-vCPU dispatch affinity statistics
+ *                  (--> vcpu_disp_*_func() )
+ *                - determine SMT from sysfs instead of /proc/stat and
+ *                  added numeric SMT metric
+ *                  (--> smt_func(), smt_threads_func() )
+ *                - replaced counting "cpu" in /proc/stat by a CPU topology
+ *                  cache which is only refreshed on DLPAR/SMT uevents
+ *                  (--> dlpar_cpu_events_func() )
+ *                - added NUMA placement metrics
+ *                  (--> numa_*_func() )
+ *                - added OCC power, temperature and frequency sensors for
+ *                  PowerNV hosts
+ *                  (--> occ_*_func() )
+ *                - added virtual Ethernet, vNIC and SR-IOV adapter metrics
+ *                  (--> vnet_*_func(), veth_*_func(), vnic_*_func() )
+ *                - added virtual SCSI and virtual Fibre Channel host
+ *                  adapter metrics, also per host adapter
+ *                  (--> vscsi_*_func() )
+ *                - added run queue metrics normalized by entitlement and
+ *                  virtual processors, sampled by a helper thread
+ *                  (--> runq_*_func() )
+ *                - added optional OpenMetrics endpoint on the loopback
+ *                  interface serving the last collected values
+ *                  (--> om_*() )
+ *                - moved the LPAR, CPU and disk counters and their rate
+ *                  logic into the libibmpower core library, this module
+ *                  is an adapter over it for those metrics
+ *                  (--> cpu_used_func(), cpu_pool_idle_func(),
+ *                       cpu_dispatches_func(), disk_*_func() )
+ *                - steal time, also per CPU, the number of online CPUs
+ *                  and the boot time from libibmpower, the module has no
+ *                  /proc/stat parser of its own any more
+ *                  (--> cpu_steal_*_func(), my_online_cpus() )
+ *                - read procfs and device-tree sources by a thread with a
+ *                  deadline, serving the last value if a read hangs, by
+ *                  the reader thread of an ibmpower_guard, a read which
+ *                  hangs keeps its thread and the others get a new one;
+ *                  the core context reads lparcfg, stat and diskstats the
+ *                  same way, the module also vcpudispatch_stats
+ *                  (--> my_guarded_read(), guard_init(), read_timeouts_func(),
+ *                       read_stale_func() )
+ *                - added hypervisor dispatch metrics
+ *                  (--> cpu_dispatches_func(), cpu_dispersions_func(),
+ *                       cpu_dispersion_pct_func(), dispatch_wheel_func() )
+ *                - added optional flight recorder of 1 second samples in
+ *                  a ring file which survives restarts
+ *                  (--> fr_*() )
+ *                - added disk await and an optional adaptive sampler which
+ *                  samples faster during bursts, with burst summary metrics
+ *                  (--> disk_await_func(), adapt_*(), sample_interval_func(),
+ *                       burst_pct_func(), bursts_func(), *_peak_func(),
+ *                       cpu_pool_idle_min_func() )
+ *                - added optional hypervisor call statistics from the
+ *                  hcall instrumentation in debugfs
+ *                  (--> hcall_*_func() )
+ *                - added optional hardware counter metrics from per CPU
+ *                  perf_event_open() groups, with a software event fallback
+ *                  (--> perf_*(), cpi_func(), ips_func(), cache_*_func(),
+ *                       cpu_migrations_func() )
+ *                - added optional interrupt load per CPU from /proc/interrupts
+ *                  (--> irq_*_func() )
+ *                - added physical cores used per cgroup, the cgroup's share
+ *                  of the logical CPU time scaled by the PURR based cores
+ *                  (--> cgroup_*() )
+ *                - the snapshot and the buffer of the OpenMetrics endpoint
+ *                  are set up apart from its socket, so make check can
+ *                  render them
+ *                  (--> om_prepare() )
+ *                - the metric definitions and the index to function
+ *                  dispatch are shared with AIX, the module only lists
+ *                  its metrics and their functions
+ *                  (--> ibmpower_metric_funcs[], ibmpower_metrics_build() )
+ *                - the rates of the AMS, virtual adapter, run queue and
+ *                  burst metrics come from the counter rate of
+ *                  libibmpower instead of a second rate engine
+ *                  (--> ibmpower_counter_rate(), ibmpower_ratio_update() )
+ *
  *  Version 0.7:  Oct 26, 2017
  *                - added KVM Guest detection
  *                  (--> lots of changes )
@@ -79,39 +163,46 @@
 
 #include <gm_metric.h>
 
+#include <apr_tables.h>
+#include <apr_strings.h>
 
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <linux/ethtool.h>
+#include <linux/netlink.h>
+#include <linux/perf_event.h>
+#include <linux/sockios.h>
+#include <strings.h>
 #include <time.h>
 
 #include "gm_file.h"
 #include "libmetrics.h"
 
+#include "libibmpower.h"
+#include "ibmpower_metrics.h"
+
 
 #ifndef BUFFSIZE
 #define BUFFSIZE 131072
 #endif
 
-
-typedef struct
-{
-   uint32_t last_read;
-   uint32_t thresh;
-   char *name;
-   char *buffer[BUFFSIZE];
-} my_timely_file;
-
-
-static my_timely_file proc_cpuinfo = { 0, 1, "/proc/cpuinfo", {0} };
-static my_timely_file proc_diskstats = { 0, 1, "/proc/diskstats", {0} };
-static my_timely_file proc_stat = { 0, 1, "/proc/stat", {0} };
-static my_timely_file proc_ppc64_lparcfg = { 0, 1, "/proc/ppc64/lparcfg", {0} };
-
 static time_t boottime = 0;
 
-static int purrUsable = FALSE;
-
 static float last_cpu_used = 0.0;
 
 static int LPARcfgExists = FALSE;   /* /proc/ppc64/lparcfg exists? */
@@ -145,926 +236,969 @@ my_fileexists( char *fName )
 
 
 
+/*
+ * slurpfile() only grows its buffer on the very first read, so files which
+ * grow with the number of CPUs (e.g. /proc/powerpc/vcpudispatch_stats) and
+ * the my_timely_file sources are read with this helper instead.  The
+ * buffer is kept between calls.
+ */
+typedef struct
+{
+   char *data;
+   size_t size;    /* allocated bytes */
+   size_t len;     /* bytes read, data[len] is '\0' */
+} my_buffer;
+
+
 static char *
-my_update_file( my_timely_file *tf )
+my_read_file( const char *name, my_buffer *b )
 {
-   int now, rval;
+   int fd;
+   ssize_t rval;
+   char *p;
 
 
-   now = time( NULL );
-   if (now - tf->last_read > tf->thresh)
+   fd = open( name, O_RDONLY );
+   if (fd < 0)
+      return( (char *) NULL );
+
+   b->len = 0;
+
+   for (;;)
    {
-      rval = slurpfile( tf->name, tf->buffer, BUFFSIZE );
-      if (rval == SYNAPSE_FAILURE)
+      if (b->size - b->len < 2)
       {
-         err_msg( "my_update_file() got an error from slurpfile() reading %s",
-	          tf->name );
-         return( (char *) NULL );
+         p = realloc( b->data, b->size ? 2 * b->size : BUFFSIZE );
+         if (p == NULL)
+         {
+            err_msg( "my_read_file() could not grow the buffer for %s", name );
+            close( fd );
+            return( (char *) NULL );
+         }
+         b->data = p;
+         b->size = b->size ? 2 * b->size : BUFFSIZE;
       }
-      else
-         tf->last_read = now;
-   }
-
-   return( tf->buffer[0] );
-}
-
 
+      rval = read( fd, b->data + b->len, b->size - b->len - 1 );
+      if (rval <= 0)
+         break;
 
-static time_t
-boottime_func_CALLED_ONCE( void )
-{
-   char   *p;
-   time_t  boottime;
-
+      b->len += rval;
+   }
 
-   p = my_update_file( &proc_stat ); 
+   close( fd );
 
-   p = strstr( p, "btime" );
-   if (p)
-   { 
-      p = skip_token( p );
-      boottime = strtod( p, (char **) NULL );
+   if (rval < 0)
+   {
+      err_msg( "my_read_file() got an error reading %s", name );
+      return( (char *) NULL );
    }
-   else
-      boottime = 0;
 
-   return( boottime );
-}
+   b->data[b->len] = '\0';
 
+   return( b->data );
+}
 
 
-g_val_t
-model_name_func( void );
 
-static void
-CheckPURRusability( void )
+/*
+ * Read a file which is kept open from its start, for the large procfs and
+ * debugfs files read every round.  pread() saves the open() and close().
+ */
+static char *
+my_pread_file( int fd, my_buffer *b )
 {
-   g_val_t val;
+   ssize_t rval;
+   size_t size;
+   char *p;
 
 
-   purrUsable = TRUE;
+   b->len = 0;
 
-   val = model_name_func();
+   for (;;)
+   {
+      if (b->size - b->len < 2)
+      {
+         size = b->size ? 2 * b->size : BUFFSIZE;
+         p = realloc( b->data, size );
+         if (p == NULL)
+            return( (char *) NULL );
+         b->data = p;
+         b->size = size;
+      }
 
-   if ((! strncmp( val.str, "IBM,8842-21X", 12 )) ||
-       (! strncmp( val.str, "IBM,8842-41X", 12 )) ||
-       (! strncmp( val.str, "IBM,8844-31",  11 )) ||
-       (! strncmp( val.str, "IBM,8844-41",  11 )) ||
-       (! strncmp( val.str, "IBM,8844-51",  11 )))
-      purrUsable = FALSE;
-}
+      rval = pread( fd, b->data + b->len, b->size - b->len - 1, (off_t) b->len );
+      if (rval <= 0)
+         break;
 
+      b->len += rval;
+   }
 
+   if (rval < 0)
+      return( (char *) NULL );
 
-g_val_t
-capped_func( void )
-{
-   g_val_t val;
-   char *p;
-   int i;
+   b->data[b->len] = '\0';
 
+   return( b->data );
+}
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "capped=" );
-   else
-      p = (char *) NULL;
 
-   if (p)
-      i = strtol( p+7, (char **) NULL, 10 );
-   else
-      i = -1;
 
-   strcpy( val.str, i == -1 ? "No SPLPAR-capable system" : (i == 1 ? "yes" : "no" ) ); 
-   return( val );
-}
+/*
+ * Reads with a deadline.  Reads of device-tree files and lparcfg have been
+ * seen to hang during firmware updates and hypervisor maintenance, which
+ * froze all of gmond.  A guarded source is therefore read by the reader
+ * thread of an ibmpower_guard of libibmpower, like the files of the core
+ * context, while the caller waits at most deadline_msec (module
+ * parameter read_timeout_msec overrides the defaults below).  If
+ * the read does not complete in time the last good value is served and
+ * the source is marked stale; no new read of it is queued until the hung
+ * one returns, and the reads of the other sources go to a new reader
+ * thread.  The number of missed deadlines is the read_timeouts metric.
+ */
+#define READ_DEADLINE_PROCFS   1000    /* msec */
+#define READ_DEADLINE_DT       2000
+#define READ_DEADLINE_POPEN    5000
 
+static int read_timeout_msec = 0;    /* param read_timeout_msec, 0 = defaults */
 
+static ibmpower_guard *guard = NULL;    /* NULL = read without a deadline */
 
-g_val_t
-cpu_entitlement_func( void )
+typedef struct
 {
-   g_val_t  val;
-   char    *p;
-   int      cpus;
+   const char *name;                            /* for the messages */
+   int (*read)( void *arg, my_buffer *b );      /* runs in the reader thread */
+   void *arg;
+   int deadline_msec;
 
+   ibmpower_guarded state;          /* of the guard, state.arg is the source */
+   my_buffer result;                /* belongs to the reader thread while state.busy */
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "partition_entitled_capacity=" );
-   else
-      p = (char *) NULL;
-
-   if (p)
-      val.f = (float) strtol( p+28, (char **) NULL, 10 ) / 100.0;
-   else
-   {
-/* find out the number of CPUs in the system/LPAR */
+   char last[MAX_G_STRING_SIZE];    /* last good value of a string source */
+} my_guarded_source;
 
-      p = my_update_file( &proc_stat );
 
-/* Skip initial "cpu" token and find first real cpu "cpu0" */
-      p = strstr( p+3, "cpu");
 
-      cpus = 1;
-      while ((p = strstr( p+3, "cpu" )))
-         cpus++;
+static int
+my_guard_run( void *arg )
+{
+   my_guarded_source *g = (my_guarded_source *) arg;
 
-      val.f = cpus;
-   }
 
-   return( val );
+   return( g->read( g->arg, &g->result ) );
 }
 
 
 
-g_val_t
-cpu_in_lpar_func( void )
+/* by the reader thread if the read still hung at guard_cleanup() */
+static void
+my_guard_release( void *arg )
 {
-   g_val_t  val;
-   char    *p;
-   int      cpus;
+   my_guarded_source *g = (my_guarded_source *) arg;
 
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "partition_active_processors=" );
-   else
-      p = (char *) NULL;
+   free( g->result.data );
+   g->result.data = NULL;
+   g->result.size = g->result.len = 0;
+}
 
-   if (p)
-      val.int32 = strtol( p+28, (char **) NULL, 10 );
-   else
-   {
-/* find out the number of CPUs in the system/LPAR */
 
-      p = my_update_file( &proc_stat );
 
-/* Skip initial "cpu" token and find first real cpu "cpu0" */
-      p = strstr( p+3, "cpu");
+/* TRUE if g->result holds a new value, FALSE on error or timeout */
+static int
+my_guarded_read( my_guarded_source *g )
+{
+   int msec, rc, was_stale;
 
-      cpus = 1;
-      while ((p = strstr( p+3, "cpu" )))
-         cpus++;
 
-      val.int32 = cpus;
+   if (g->state.read == NULL)
+   {
+      g->state.name = g->name;
+      g->state.read = my_guard_run;
+      g->state.arg = g;
+      g->state.release = my_guard_release;
    }
 
-   return( val );
+   msec = (read_timeout_msec > 0) ? read_timeout_msec : g->deadline_msec;
+   was_stale = g->state.stale;
+
+   rc = ibmpower_guard_read( guard, &g->state, msec );
+
+   if ((rc < 0) && (! was_stale) && g->state.stale)
+      err_msg( "reading %s did not complete within %d ms, serving the last value", g->name, msec );
+   else if ((rc > 0) && was_stale)
+      err_msg( "reading %s completed again after %lld timeouts", g->name, g->state.timeouts );
+
+   return( rc > 0 );
 }
 
 
 
-g_val_t
-cpu_in_machine_func( void )
+/* store a string read by a reader thread in its result buffer */
+static int
+my_guard_set_string( my_buffer *b, const char *str )
 {
-   g_val_t  val;
-   char    *p;
-   int      cpus;
-
+   char *p;
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "system_potential_processors=" );
-   else
-      p = (char *) NULL;
 
-   if (p)
-      val.int32 = strtol( p+28, (char **) NULL, 10 );
-   else
+   if (b->size < MAX_G_STRING_SIZE)
    {
-/* find out the number of CPUs in the system/LPAR */
+      p = realloc( b->data, MAX_G_STRING_SIZE );
+      if (p == NULL)
+         return( FALSE );
+      b->data = p;
+      b->size = MAX_G_STRING_SIZE;
+   }
+
+   strncpy( b->data, str, MAX_G_STRING_SIZE - 1 );
+   b->data[MAX_G_STRING_SIZE - 1] = '\0';
+   b->len = strlen( b->data );
 
-      p = my_update_file( &proc_stat );
+   return( TRUE );
+}
 
-/* Skip initial "cpu" token and find first real cpu "cpu0" */
-      p = strstr( p+3, "cpu");
 
-      cpus = 1;
-      while ((p = strstr( p+3, "cpu" )))
-         cpus++;
 
-      val.int32 = cpus;
-   }
+/* current or last good value of a string source */
+static void
+my_guarded_string( my_guarded_source *g, char *str )
+{
+   if (my_guarded_read( g ))
+      strcpy( g->last, g->result.data );
+   else if (g->last[0] == '\0')
+      snprintf( g->last, sizeof( g->last ), "Reading %s timed out", g->name );
 
-   return( val );
+   strcpy( str, g->last );
 }
 
 
 
-g_val_t
-cpu_in_pool_func( void )
+static int
+my_guard_read_file( void *arg, my_buffer *b )
 {
-   g_val_t  val;
-   char    *p;
-   int      cpus;
+   return( my_read_file( (const char *) arg, b ) != NULL );
+}
 
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "pool_num_procs=" );
-   else
-      p = (char *) NULL;
 
-   if (p)
-      val.int32 = strtol( p+15, (char **) NULL, 10 );
-   else
-   {
-/* find out the number of CPUs in the system/LPAR */
+typedef struct
+{
+   uint32_t last_read;
+   uint32_t thresh;
+   char *name;
+   my_buffer buf;
+   my_guarded_source src;
+} my_timely_file;
 
-      p = my_update_file( &proc_stat );
+#define MY_TIMELY_FILE( name ) \
+   { 0, 1, name, { NULL, 0, 0 }, { name, my_guard_read_file, name, READ_DEADLINE_PROCFS } }
 
-/* Skip initial "cpu" token and find first real cpu "cpu0" */
-      p = strstr( p+3, "cpu");
 
-      cpus = 1;
-      while ((p = strstr( p+3, "cpu" )))
-         cpus++;
+static my_timely_file proc_cpuinfo = MY_TIMELY_FILE( "/proc/cpuinfo" );
+static my_timely_file proc_ppc64_lparcfg = MY_TIMELY_FILE( "/proc/ppc64/lparcfg" );
 
-      val.int32 = cpus;
-   }
 
-   return( val );
-}
 
+/*
+ * Contents of the file, re-read after thresh seconds.  A read which fails
+ * or misses its deadline leaves the last contents and last_read alone.
+ * NULL until the first read succeeded, so only use it through
+ * my_lparcfg_find() and my_cpuinfo_string().
+ */
+static char *
+my_update_file( my_timely_file *tf )
+{
+   my_buffer tmp;
+   int now;
 
 
-g_val_t
-cpu_in_syspool_func( void )
-{
-   g_val_t  val;
-   char    *p;
-   int      cpus;
+   now = time( NULL );
+   if (now - tf->last_read > tf->thresh)
+   {
+      if (my_guarded_read( &tf->src ))
+      {
+         tmp = tf->buf;
+         tf->buf = tf->src.result;
+         tf->src.result = tmp;
+         tf->last_read = now;
+      }
+      else if (! tf->src.state.stale)
+         err_msg( "my_update_file() got an error reading %s", tf->name );
+   }
 
+   return( tf->buf.data );
+}
 
-/* this is still not implemented for multiple shared processor pools */
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "pool_num_procs=" );
-   else
-      p = (char *) NULL;
 
-   if (p)
-      val.int32 = strtol( p+15, (char **) NULL, 10 );
-   else
-   {
-/* find out the number of CPUs in the system/LPAR */
 
-      p = my_update_file( &proc_stat );
+static void
+my_write_file( const char *name, const char *value )
+{
+   int fd;
 
-/* Skip initial "cpu" token and find first real cpu "cpu0" */
-      p = strstr( p+3, "cpu");
 
-      cpus = 1;
-      while ((p = strstr( p+3, "cpu" )))
-         cpus++;
+   fd = open( name, O_WRONLY );
 
-      val.int32 = cpus;
-   }
+   if (fd < 0 || write( fd, value, strlen( value ) ) < 0)
+      err_msg( "my_write_file() could not write '%s' to %s", value, name );
 
-   return( val );
+   if (fd >= 0)
+      close( fd );
 }
 
 
 
-g_val_t
-cpu_pool_id_func( void )
+/* read the first line of a small (sysfs) file without the newline */
+static int
+my_read_line( const char *name, char *buf, int len )
 {
-   g_val_t val;
-   int pool_id;
+   FILE *f;
    char *p;
 
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "pool=" );
-   else
-      p = (char *) NULL;
+   f = fopen( name, "r" );
+   if (f == NULL)
+      return( FALSE );
 
-   if (p)
-      pool_id = strtol( p+5, (char **) NULL, 10 );
-   else
-      pool_id = -1;
+   p = fgets( buf, len, f );
+   fclose( f );
 
-   val.int32 = pool_id;
+   if (p == NULL)
+      return( FALSE );
 
-   return( val );
-}
+   p = strchr( buf, '\n' );
+   if (p)
+      *p = '\0';
 
+   return( TRUE );
+}
 
 
-#define MAX_CPU_POOL_IDLE (256.0)
 
-g_val_t
-cpu_pool_idle_func( void )
+/* snprintf() of a file name, FALSE if it did not fit into buf */
+static int
+my_path( char *buf, size_t size, const char *fmt, ... )
 {
-   g_val_t val;
-   static long long pool_idle_saved = 0LL;
-   long long pool_idle, pool_idle_diff, timebase;
-   static double last_time = 0.0;
-   static float last_val  = 0.0;
-   double now, delta_t;
-   struct timeval timeValue;
-   struct timezone timeZone;
-   char *p;
+   va_list ap;
+   int len;
 
 
-   gettimeofday( &timeValue, &timeZone );
+   va_start( ap, fmt );
+   len = vsnprintf( buf, size, fmt, ap );
+   va_end( ap );
 
-   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
+   return( (len >= 0) && ((size_t) len < size) );
+}
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "pool_idle_time=" );
-   else
-      p = (char *) NULL;
 
-   if (p)
-   {
-      delta_t = now - last_time;
 
-      pool_idle = strtoll( p+15, (char **) NULL, 10 );
+/*
+ * Number of entries in a sysfs CPU/node list like "0-3,8,10-11".  If map
+ * is given, map[n] is set for every n < max in the list.
+ */
+static int
+my_parse_cpu_list( const char *list, char *map, int max )
+{
+   const char *p = list;
+   char *q;
+   long first, last, n;
+   int count = 0;
+
 
-      p = strstr( my_update_file( &proc_cpuinfo ), "timebase" );
+   if (map)
+      memset( map, 0, max );
+
+   while (*p)
+   {
+      first = strtol( p, &q, 10 );
+      if (q == p)
+         break;
 
-      if ((delta_t > 0.0) && (p))
+      last = first;
+      if (*q == '-')
       {
-         p = strchr( p, ':' );
-         p = skip_whitespace( p+1 );
+         p = q + 1;
+         last = strtol( p, &q, 10 );
+      }
 
-         timebase = strtoll( p, (char **) NULL, 10 );
+      if (last >= first)
+         count += last - first + 1;
 
-         pool_idle_diff = pool_idle - pool_idle_saved;
+      if (map)
+         for (n = first;  (n <= last) && (n < max);  n++)
+            if (n >= 0)
+               map[n] = TRUE;
 
-         if ((timebase > 0LL) && (pool_idle_diff >= 0LL))
-            val.f = (double) (pool_idle_diff) / (double) timebase / delta_t;
-         else
-            val.f = last_val;
-      }
-      else
-         val.f = 0.0;
+      if (*q != ',')
+         break;
 
-      pool_idle_saved = pool_idle;
+      p = q + 1;
    }
-   else
-      val.f = 0.0;
 
-/* prevent against huge value when suddenly performance data collection */
-/* is enabled or disabled for this LPAR */
-   if (val.f > MAX_CPU_POOL_IDLE)
-      val.f = 0.0;
+   return( count );
+}
 
-   last_time = now;
-   last_val = val.f;
 
-   return( val );
+
+static int
+my_count_cpu_list( const char *list )
+{
+   return( my_parse_cpu_list( list, (char *) NULL, 0 ) );
 }
 
 
 
-g_val_t
-cpu_used_func( void )
+/* highest number of a sysfs CPU list + 1, 0 if it is empty */
+static int
+my_cpu_list_end( const char *list )
 {
-   g_val_t val;
-   static long long purr_saved = 0LL;
-   long long purr, purr_diff, timebase;
-   static double last_time = 0.0;
-   static double last_system_check_time = 0.0;
-   static float last_val = 0.0;
-   double now, delta_t;
-   struct timeval timeValue;
-   struct timezone timeZone;
-   char *p;
-   int cpus;
+   const char *p = list;
+   char *q;
+   long n;
+   int end = 0;
 
 
-   gettimeofday( &timeValue, &timeZone );
+   while (*p)
+   {
+      n = strtol( p, &q, 10 );
+      if ((q == p) || (n < 0L) || (n >= INT_MAX))
+         break;
 
-   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
+      if (n + 1 > end)
+         end = (int) n + 1;
 
-/* check every 180 seconds if we are still on the same system --> LPAR Mobility */
-   if (now - last_system_check_time >= 180.0)
-   {
-      CheckPURRusability();
-      last_system_check_time = now;
+      if ((*q != ',') && (*q != '-'))
+         break;
+
+      p = q + 1;
    }
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "purr=" );
-   else
-      p = (char *) NULL;
+   return( end );
+}
 
-   if (p && purrUsable)
-   {
-      delta_t = now - last_time;
 
-      purr = strtoll( p+5, (char **) NULL, 10 );
 
-      p = strstr( my_update_file( &proc_cpuinfo ), "timebase" );
+/*
+ * Number of CPU ids the kernel can ever hand out, highest possible CPU
+ * + 1.  The per CPU state is sized by it and not by the online CPUs,
+ * because DLPAR can add CPUs up to the possible ones at any time.  It is
+ * fixed at boot, so it is read once.
+ */
+static int possible_cpus = 0;
 
-      if ((delta_t > 0.0) && (p))
-      {
-         p = strchr( p, ':' );
-         p = skip_whitespace( p+1 );
+static int
+my_possible_cpus( void )
+{
+   char buf[4096];
+   long n;
 
-         timebase = strtoll( p, (char **) NULL, 10 );
 
-         purr_diff = purr - purr_saved;
+   if (possible_cpus > 0)
+      return( possible_cpus );
 
-         if ((timebase > 0LL) && (purr_diff >= 0LL))
-            val.f = (double) (purr_diff) / (double) timebase / delta_t;
-         else
-            val.f = last_val;
-      }
-      else
-         val.f = 0.0;
+   if (my_read_line( "/sys/devices/system/cpu/possible", buf, sizeof( buf ) ))
+      possible_cpus = my_cpu_list_end( buf );
 
-      purr_saved = purr;
-   }
-   else /* dedicated LPAR/standalone system so calculate cpu_used with cpu_idle_func() */
+   if (possible_cpus <= 0)
    {
-/* find out number of CPUs in the system/LPAR via /proc/ppc64/lparcfg */
-/* --> partition_active_processors should always exist */
-      if (LPARcfgExists)
-         p = strstr( my_update_file( &proc_ppc64_lparcfg ), "partition_active_processors=" );
-      else
-         p = (char *) NULL;
+      n = sysconf( _SC_NPROCESSORS_CONF );
+      possible_cpus = (n > 0L) ? (int) n : 1;
+   }
 
-      if (p)
-      {
-         cpus = strtol( p+28, (char **) NULL, 10 );
+   return( possible_cpus );
+}
 
-         val = cpu_idle_func();
-         val.f = (float) cpus * (100.0 - val.f) / 100.0;
-      }
-      else
-         val.f = 0.0;
-   }
 
-/* sanity check to prevent against accidental huge value */
-   if (val.f >= 256.0)
-      val.f = 0.0;
 
-   last_time = now;
-   last_val = val.f;
+/* ibmpower_parse_ull() of libibmpower on the writable buffers of the module */
+static inline unsigned long long
+my_parse_ull( char **pp )
+{
+   const char *p = *pp;
+   unsigned long long v;
 
-/* save value for cpu_ec_func */
-   last_cpu_used = val.f;
 
-   return( val );
+   v = ibmpower_parse_ull( &p );
+   *pp = (char *) p;
+
+   return( v );
 }
 
 
 
-g_val_t
-cpu_ec_func( void )
+/* find the value of "key=" at the start of a line of /proc/ppc64/lparcfg */
+static char *
+my_lparcfg_find( const char *key )
 {
-   g_val_t ent, val;
+   char *buf, *p;
+   size_t len;
 
 
-   ent = cpu_entitlement_func();
+   if (! LPARcfgExists)
+      return( (char *) NULL );
 
-   if (ent.f != 0.0)
-      val.f = 100.0 * (last_cpu_used / ent.f);
-   else
-      val.f = 100.0;
+   buf = my_update_file( &proc_ppc64_lparcfg );
+   if (buf == NULL)
+      return( (char *) NULL );
 
-   return( val );
+   len = strlen( key );
+
+   for (p = strstr( buf, key );  p;  p = strstr( p+len, key ))
+      if ((p == buf) || (p[-1] == '\n'))
+         return( p+len );
+
+   return( (char *) NULL );
 }
 
 
 
-struct dsk_stat {
-        char          dk_name[32];
-        int           dk_major;
-        int           dk_minor;
-        long          dk_noinfo;
-        unsigned long dk_reads;
-        unsigned long dk_rmerge;
-        unsigned long dk_rmsec;
-        unsigned long dk_rkb;
-        unsigned long dk_writes;
-        unsigned long dk_wmerge;
-        unsigned long dk_wmsec;
-        unsigned long dk_wkb;
-        unsigned long dk_xfers;
-        unsigned long dk_bsize;
-        unsigned long dk_time;
-        unsigned long dk_inflight;
-        unsigned long dk_11;
-        unsigned long dk_partition;
-        unsigned long dk_blocks; /* in /proc/partitions only */
-        unsigned long dk_use;
-        unsigned long dk_aveq;
-};
+static long long
+my_lparcfg_value( const char *key, long long notfound )
+{
+   char *p;
+
+
+   p = my_lparcfg_find( key );
+
+   return( p ? strtoll( p, (char **) NULL, 10 ) : notfound );
+}
 
 
 
+/* copy the rest of the line at p into str, at most len-1 characters */
 static void
-get_diskstats_iops( double *iops )
+my_copy_line( char *str, size_t len, const char *p )
 {
-   char *p, *q;
-   char buf[1024];
-   int  ret;
-   long long total_iops, diff;
-   static long long saved_iops = 0LL;
-   struct dsk_stat dk;
-   static double last_time = 0.0;
-   static double last_val = 0.0;
-   double now, delta_t;
-   struct timeval timeValue;
-   struct timezone timeZone;
+   size_t n;
 
 
-   gettimeofday( &timeValue, &timeZone );
+   n = strcspn( p, "\n" );
+   if (n > len - 1)
+      n = len - 1;
 
-   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
+   memcpy( str, p, n );
+   str[n] = '\0';
+}
 
 
-   p = my_update_file( &proc_diskstats );
 
-   if (p)
-   {
-      total_iops = 0LL;
+/* value of "key=" in lparcfg as a string, FALSE if it was not read or has no key */
+static int
+my_lparcfg_string( const char *key, char *str, size_t len )
+{
+   char *p;
 
-      while ((q = strchr( p, '\n' )))
-      {
-         /* zero the data ready for reading */
-         dk.dk_reads = dk.dk_writes = 0;
-
-         strncpy( buf, p, q-p );
-         buf[q-p] = '\0';
-
-         ret = sscanf( buf, "%d %d %s %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu",
-                       &dk.dk_major,
-                       &dk.dk_minor,
-                       &dk.dk_name[0],
-                       &dk.dk_reads,
-                       &dk.dk_rmerge,
-                       &dk.dk_rkb,
-                       &dk.dk_rmsec,
-                       &dk.dk_writes,
-                       &dk.dk_wmerge,
-                       &dk.dk_wkb,
-                       &dk.dk_wmsec,
-                       &dk.dk_inflight,
-                       &dk.dk_time,
-                       &dk.dk_11 );
-
-         p = q+1;
-
-         if (ret == 7)  /* skip partitions of a disk */
-           continue;
-
-         if (strncmp(dk.dk_name, "dm-", 3) == 0)
-           continue;
-
-         if (strncmp(dk.dk_name, "md", 2) == 0)
-           continue;
-
-#ifdef MPERZL_DEBUG
-fprintf(stderr, "dk_name = %5s, dk_reads = %10ld, dk_writes = %10ld\n", dk.dk_name, dk.dk_reads, dk.dk_writes);
-#endif
 
-         total_iops += dk.dk_reads + dk.dk_writes;
-      }
+   p = my_lparcfg_find( key );
+   if (p == NULL)
+      return( FALSE );
 
-#ifdef MPERZL_DEBUG
-fprintf(stderr, "total_iops = %" PRIi64 "\n", total_iops);
-fprintf(stderr, "saved_iops = %" PRIi64 "\n", saved_iops);
-#endif
+   my_copy_line( str, len, p );
 
-      delta_t = now - last_time;
+   return( TRUE );
+}
 
-      if (delta_t > 0)
-      {
-         diff = total_iops - saved_iops;
 
-         if (diff > 0LL)
-            *iops = diff / delta_t;
-         else
-            *iops = 0.0;
-      }
-      else
-         *iops = 0.0;
 
-      saved_iops = total_iops;
-   }
-   else
-   {
-      *iops = 0.0;
-   }
+/*
+ * Value after the ':' of the first line of /proc/cpuinfo with key in it.
+ * FALSE while the file has not been read yet, e.g. its read hangs.
+ */
+static int
+my_cpuinfo_string( const char *key, char *str, size_t len )
+{
+   char *buf, *p;
+
+
+   buf = my_update_file( &proc_cpuinfo );
+   if (buf == NULL)
+      return( FALSE );
+
+   p = strstr( buf, key );
+   if (p)
+      p = strchr( p, ':' );
+   if (p == NULL)
+      return( FALSE );
 
-   last_time = now;
-   last_val = *iops;
+   my_copy_line( str, len, skip_whitespace( p+1 ) );
+
+   return( TRUE );
 }
 
 
 
-static void
-get_diskstats_read( double *read )
+/* seconds since boot with micro-second resolution */
+static double
+my_time_now( void )
 {
-   char *p, *q;
-   char buf[1024];
-   int  ret;
-   long long total_read, diff;
-   static long long saved_read = 0LL;
-   struct dsk_stat dk;
-   static double last_time = 0.0;
-   static double last_val = 0.0;
-   double now, delta_t;
    struct timeval timeValue;
    struct timezone timeZone;
 
 
    gettimeofday( &timeValue, &timeZone );
 
-   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
-
-
-   p = my_update_file( &proc_diskstats );
+   return( (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0) );
+}
 
-   if (p)
-   {
-      total_read  = 0;
 
-      while ((q = strchr( p, '\n' )))
-      {
-         /* zero the data ready for reading */
-         dk.dk_rkb = 0;
-
-         strncpy( buf, p, q-p );
-         buf[q-p] = '\0';
-
-         ret = sscanf( buf, "%d %d %s %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu",
-                       &dk.dk_major,
-                       &dk.dk_minor,
-                       &dk.dk_name[0],
-                       &dk.dk_reads,
-                       &dk.dk_rmerge,
-                       &dk.dk_rkb,
-                       &dk.dk_rmsec,
-                       &dk.dk_writes,
-                       &dk.dk_wmerge,
-                       &dk.dk_wkb,
-                       &dk.dk_wmsec,
-                       &dk.dk_inflight,
-                       &dk.dk_time,
-                       &dk.dk_11 );
-
-         p = q+1;
-
-         if (ret == 7)  /* skip partitions of a disk */
-            continue;
 
-         if (strncmp(dk.dk_name, "md", 2) == 0)
-            continue;
+/*
+ * CPU topology cache.  The online CPUs and the thread siblings of every
+ * online CPU are only re-read from sysfs when a kernel uevent of the cpu
+ * or memory subsystem reports a CPU being added, removed, onlined or
+ * offlined (DLPAR, ppc64_cpu --smt, LPAR mobility) or memory hotplug.
+ * Checking for events is a single non-blocking recvfrom().  If the socket
+ * overflowed, events were lost and the topology is re-read as well.
+ * Without the uevent socket the topology is re-read every
+ * TOPO_RECHECK_INTERVAL seconds.
+ */
+#define TOPO_RECHECK_INTERVAL (60.0)
+#define TOPO_UEVENT_RCVBUF    (1024 * 1024)   /* a DLPAR of many CPUs is a burst */
 
-         if (strncmp(dk.dk_name, "dm-", 3) == 0)
-            continue;
+static struct
+{
+   int valid;
+   int online_cpus;           /* number of online logical CPUs */
+   int ncpus;                 /* entries of online[] and threads[] */
+   char *online;              /* [ncpus] */
+   unsigned char *threads;    /* [ncpus] online siblings of the core, 0 = unknown */
+   int uevent_fd;
+   unsigned int generation;   /* incremented on every rescan */
+   unsigned int events;       /* CPU uevents and overflows seen since startup */
+   unsigned int overflows;    /* uevent socket overflows since startup */
+   double last_scan;
+} cpu_topo = { FALSE, 0, 0, NULL, NULL, -1, 0, 0, 0, 0.0 };
 
-#ifdef MPERZL_DEBUG
-printf("dk_rkb = %ld   dk_wkb = %ld\n", dk.dk_rkb, dk.dk_wkb);
-#endif
 
-         dk.dk_rkb /= 2; /* sectors = 512 bytes */
 
-         total_read  += dk.dk_rkb;
-      }
+static void
+cpu_topo_open_uevents( void )
+{
+   struct sockaddr_nl addr;
+   int fd, size;
 
-#ifdef MPERZL_DEBUG
-printf("total_read  = %" PRIi64 "\n", total_read);
-printf("saved_read  = %" PRIi64 "\n", saved_read);
-#endif
 
-      delta_t = now - last_time;
+   fd = socket( AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT );
+   if (fd < 0)
+   {
+      err_msg( "cpu_topo_open_uevents() cannot open uevent socket, polling sysfs instead" );
+      return;
+   }
 
-      if (delta_t > 0)
-      {
-         diff = total_read - saved_read;
+/*
+ * Every device on the system sends uevents to this socket, and between
+ * two collections they queue up.  SO_RCVBUFFORCE may go beyond rmem_max
+ * but needs CAP_NET_ADMIN, SO_RCVBUF is capped at rmem_max.
+ */
+   size = TOPO_UEVENT_RCVBUF;
+   if (setsockopt( fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof( size ) ) < 0)
+      setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof( size ) );
 
-         if (diff > 0LL)
-            *read = diff / delta_t;
-         else
-            *read = 0.0;
-      }
-      else
-         *read = 0.0;
+   memset( &addr, 0, sizeof( addr ) );
+   addr.nl_family = AF_NETLINK;
+   addr.nl_pid = 0;
+   addr.nl_groups = 1;    /* kernel uevents */
 
-      saved_read  = total_read;
-   }
-   else
+   if (bind( fd, (struct sockaddr *) &addr, sizeof( addr ) ) < 0)
    {
-      *read  = 0.0;
+      err_msg( "cpu_topo_open_uevents() cannot bind uevent socket, polling sysfs instead" );
+      close( fd );
+      return;
    }
 
-   last_time = now;
-   last_val = *read;
+   cpu_topo.uevent_fd = fd;
 }
 
 
 
-static void
-get_diskstats_write( double *write )
+/* value of "key=" in the NUL separated "key=value" strings of a uevent */
+static const char *
+my_uevent_value( const char *msg, size_t len, const char *key )
 {
-   char *p, *q;
-   char buf[1024];
-   int  ret;
-   long long total_write, diff;
-   static long long saved_write = 0LL;
-   struct dsk_stat dk;
-   static double last_time = 0.0;
-   static double last_val = 0.0;
-   double now, delta_t;
-   struct timeval timeValue;
-   struct timezone timeZone;
+   const char *p, *end = msg + len;
+   size_t klen = strlen( key );
 
 
-   gettimeofday( &timeValue, &timeZone );
+   for (p = msg;  p < end;  p += strlen( p ) + 1)
+      if ((strncmp( p, key, klen ) == 0) && (p[klen] == '='))
+         return( p + klen + 1 );
+
+   return( (const char *) NULL );
+}
 
-   now = (double) (timeValue.tv_sec - boottime) + (timeValue.tv_usec / 1000000.0);
 
 
-   p = my_update_file( &proc_diskstats );
+/* drain the uevent socket, returns TRUE if the CPU topology may have changed */
+static int
+cpu_topo_check_uevents( void )
+{
+   struct sockaddr_nl from;
+   socklen_t fromlen;
+   char buf[4096];
+   const char *subsystem, *devpath;
+   ssize_t len;
+   int changed = FALSE;
 
-   if (p)
+
+   for (;;)
    {
-      total_write = 0;
+      fromlen = sizeof( from );
+      len = recvfrom( cpu_topo.uevent_fd, buf, sizeof( buf ) - 1, MSG_DONTWAIT,
+                      (struct sockaddr *) &from, &fromlen );
 
-      while ((q = strchr( p, '\n' )))
+      if (len < 0)
       {
-         /* zero the data ready for reading */
-         dk.dk_wkb = 0;
-
-         strncpy( buf, p, q-p );
-         buf[q-p] = '\0';
-
-         ret = sscanf( buf, "%d %d %s %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu",
-                       &dk.dk_major,
-                       &dk.dk_minor,
-                       &dk.dk_name[0],
-                       &dk.dk_reads,
-                       &dk.dk_rmerge,
-                       &dk.dk_rkb,
-                       &dk.dk_rmsec,
-                       &dk.dk_writes,
-                       &dk.dk_wmerge,
-                       &dk.dk_wkb,
-                       &dk.dk_wmsec,
-                       &dk.dk_inflight,
-                       &dk.dk_time,
-                       &dk.dk_11 );
-
-         p = q+1;
-
-         if (ret == 7)  /* skip partitions of a disk */
+/* events were dropped, so we do not know what happened: rescan */
+         if (errno == ENOBUFS)
+         {
+            if (cpu_topo.overflows++ == 0)
+               err_msg( "cpu_topo_check_uevents() lost uevents, re-reading the CPU topology" );
+            cpu_topo.events++;
+            changed = TRUE;
             continue;
+         }
+         break;
+      }
 
-         if (strncmp(dk.dk_name, "md", 2) == 0)
-            continue;
+/* only trust messages from the kernel */
+      if ((len == 0) || (from.nl_pid != 0))
+         continue;
 
-         if (strncmp(dk.dk_name, "dm-", 3) == 0)
-            continue;
+      buf[len] = '\0';
+
+/* "<action>@<devpath>" and then SUBSYSTEM=, DEVPATH= etc. */
+      subsystem = my_uevent_value( buf, len, "SUBSYSTEM" );
+      devpath = my_uevent_value( buf, len, "DEVPATH" );
+      if ((subsystem == NULL) || (devpath == NULL))
+         continue;
+
+/* the cpu subsystem also has cpufreq, cpuidle etc., only cpuN counts */
+      if (! strcmp( subsystem, "cpu" ))
+      {
+         if ((strncmp( devpath, "/devices/system/cpu/cpu", 23 ) == 0) &&
+             (devpath[23] >= '0') && (devpath[23] <= '9'))
+         {
+            cpu_topo.events++;
+            changed = TRUE;
+         }
+      }
+      else if (! strcmp( subsystem, "memory" ))
+         changed = TRUE;
+   }
+
+   return( changed );
+}
 
-#ifdef MPERZL_DEBUG
-printf("dk_rkb = %ld   dk_wkb = %ld\n", dk.dk_rkb, dk.dk_wkb);
-#endif
 
-         dk.dk_wkb /= 2; /* sectors = 512 bytes */
 
-         total_write += dk.dk_wkb;
+static void
+cpu_topo_scan( void )
+{
+   char buf[4096], path[128];
+   int cpu, n;
+
+
+   if (cpu_topo.online == NULL)
+   {
+      cpu_topo.ncpus = my_possible_cpus();
+      cpu_topo.online = calloc( cpu_topo.ncpus, 1 );
+      cpu_topo.threads = calloc( cpu_topo.ncpus, 1 );
+
+      if ((cpu_topo.online == NULL) || (cpu_topo.threads == NULL))
+      {
+         free( cpu_topo.online );
+         free( cpu_topo.threads );
+         cpu_topo.online = NULL;
+         cpu_topo.threads = NULL;
+         cpu_topo.ncpus = 0;
       }
+   }
 
-#ifdef MPERZL_DEBUG
-printf("total_write = %" PRIi64 "\n", total_write);
-printf("saved_write = %" PRIi64 "\n", saved_write);
-#endif
+   cpu_topo.valid = FALSE;
 
-      delta_t = now - last_time;
+   if ((cpu_topo.online != NULL) &&
+       my_read_line( "/sys/devices/system/cpu/online", buf, sizeof( buf ) ))
+   {
+      cpu_topo.online_cpus = my_parse_cpu_list( buf, cpu_topo.online, cpu_topo.ncpus );
+      cpu_topo.valid = cpu_topo.online_cpus > 0;
 
-      if (delta_t > 0)
+      for (cpu = 0;  cpu < cpu_topo.ncpus;  cpu++)
       {
-         diff = total_write - saved_write;
+         cpu_topo.threads[cpu] = 0;
 
-         if (diff > 0LL)
-            *write = diff / delta_t;
-         else
-            *write = 0.0;
-      }
-      else
-         *write = 0.0;
+         if (! cpu_topo.online[cpu])
+            continue;
 
-      saved_write = total_write;
+         snprintf( path, sizeof( path ),
+                   "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu );
+
+         if (my_read_line( path, buf, sizeof( buf ) ))
+         {
+            n = my_count_cpu_list( buf );
+            cpu_topo.threads[cpu] = (n > 0) && (n <= UCHAR_MAX) ? n : 0;
+         }
+      }
    }
-   else
+
+   cpu_topo.generation++;
+   cpu_topo.last_scan = my_time_now();
+}
+
+
+
+static void
+cpu_topo_cleanup( void )
+{
+   if (cpu_topo.uevent_fd >= 0)
+      close( cpu_topo.uevent_fd );
+
+   cpu_topo.uevent_fd = -1;
+
+   free( cpu_topo.online );
+   free( cpu_topo.threads );
+   cpu_topo.online = NULL;
+   cpu_topo.threads = NULL;
+   cpu_topo.ncpus = 0;
+   cpu_topo.valid = FALSE;
+}
+
+
+
+static void
+cpu_topo_update( void )
+{
+   if (! cpu_topo.valid)
+      cpu_topo_scan();
+   else if (cpu_topo.uevent_fd >= 0)
    {
-      *write = 0.0;
+      if (cpu_topo_check_uevents())
+         cpu_topo_scan();
    }
+   else if (my_time_now() - cpu_topo.last_scan >= TOPO_RECHECK_INTERVAL)
+      cpu_topo_scan();
+}
+
+
+
+/*
+ * TRUE if the CPU is online.  All CPUs count as online if the topology
+ * could not be read, the callers then find out themselves.
+ */
+static int
+my_cpu_online( int cpu )
+{
+   cpu_topo_update();
+
+   if (! cpu_topo.valid)
+      return( TRUE );
 
-   last_time = now;
-   last_val = *write;
+   return( (cpu >= 0) && (cpu < cpu_topo.ncpus) && cpu_topo.online[cpu] );
 }
 
 
 
-g_val_t
-disk_iops_func( void )
+/*
+ * The rates of the LPAR, CPU and disk counters come from libibmpower.  Every
+ * metric keeps its own ibmpower_rates, so its rate covers the time since it
+ * was last collected.  The library context re-uses counters read less than
+ * a second ago, like the my_timely_file buffers.
+ */
+static ibmpower_ctx *core = NULL;
+
+
+static void
+my_core_update( ibmpower_rates *r, unsigned int what )
 {
-   g_val_t val;
-   double disk_iops;
+   ibmpower_snapshot snap;
 
- 
-   get_diskstats_iops( &disk_iops );
 
-   val.d = disk_iops;
+   if (core == NULL)
+      return;
 
-   return( val );
+   ibmpower_sample( core, what, &snap );
+   ibmpower_rates_update( core, r, &snap );
 }
 
 
 
-g_val_t
-disk_read_func( void )
+/* number of online logical CPUs, falls back to the cpuN lines libibmpower counts */
+static int
+my_online_cpus( void )
 {
-   g_val_t val;
-   double disk_read;
+   ibmpower_snapshot snap;
 
- 
-   get_diskstats_read( &disk_read );
 
-   val.d = disk_read * 1024.0;
+   cpu_topo_update();
 
-   return( val );
+   if (cpu_topo.valid)
+      return( cpu_topo.online_cpus );
+
+   if (core && (ibmpower_sample( core, IBMPOWER_SAMPLE_CPU, &snap ) == 0))
+      return( snap.online_cpus );
+
+   return( 0 );
 }
 
 
 
 g_val_t
-disk_write_func( void )
+capped_func( void )
 {
    g_val_t val;
-   double disk_write;
+   char *p;
+   int i;
+
 
- 
-   get_diskstats_write( &disk_write );
+   p = my_lparcfg_find( "capped=" );
 
-   val.d = disk_write * 1024.0;
+   if (p)
+      i = strtol( p, (char **) NULL, 10 );
+   else
+      i = -1;
 
+   strcpy( val.str, i == -1 ? "No SPLPAR-capable system" : (i == 1 ? "yes" : "no" ) ); 
    return( val );
 }
 
 
 
 g_val_t
-fwversion_func( void )
+cpu_entitlement_func( void )
 {
-   FILE    *f;
    g_val_t  val;
-   char     buf1[MAX_G_STRING_SIZE],
-            buf2[MAX_G_STRING_SIZE];
-
-
-   strcpy( val.str, "Firmware version not detected!" );
+   char    *p;
 
-   f = fopen( "/proc/device-tree/openprom/ibm,fw-vernum_encoded", "r" );
 
-   if (f)
-   {
-      if (fread( val.str, 1, MAX_G_STRING_SIZE, f ) > 0)
-         val.str[MAX_G_STRING_SIZE - 1] = '\0';  /* truncate to MAX_G_STRING_SIZE */
+   p = my_lparcfg_find( "partition_entitled_capacity=" );
 
-      fclose( f );
-   }
+   if (p)
+      val.f = (float) strtol( p, (char **) NULL, 10 ) / 100.0;
    else
    {
-      memset( buf1, '\0', MAX_G_STRING_SIZE );
-      memset( buf2, '\0', MAX_G_STRING_SIZE );
+/* find out the number of CPUs in the system/LPAR */
+      val.f = my_online_cpus();
+   }
 
-      f = popen( "cat /proc/device-tree/ibm,opal/firmware/ml-version | awk '{ print $2 }'", "r" );
-      if (f)
-      {
-         if (fgets( buf1, MAX_G_STRING_SIZE, f ) > 0)
-         {
-            buf1[MAX_G_STRING_SIZE - 1] = '\0';  /* truncate to MAX_G_STRING_SIZE */
-            buf1[strlen( buf1 ) - 1] = '\0';  /* replace \n */
-         }
+   return( val );
+}
 
-         pclose( f );
-      }
 
-      f = popen( "cat /proc/device-tree/ibm,opal/firmware/mi-version | awk '{ print $2 }'", "r" );
-      if (f)
-      {
-         if (fgets( buf2, MAX_G_STRING_SIZE, f ) > 0)
-         {
-            buf2[MAX_G_STRING_SIZE - 1] = '\0';  /* truncate to MAX_G_STRING_SIZE */
-            buf2[strlen( buf2 ) - 1] = '\0';  /* replace \n */
-         }
 
-         pclose( f );
-      }
+g_val_t
+cpu_in_lpar_func( void )
+{
+   g_val_t  val;
+   char    *p;
 
-      if ((strlen( buf1 ) > 1) &&
-          (strlen( buf2 ) > 1) &&
-          (strlen( buf1 ) + strlen( buf2 ) < MAX_G_STRING_SIZE - 3))
-      {
-         strcpy( val.str, buf1 );
-         strcat( val.str, " (" );
-         strcat( val.str, buf2 );
-         strcat( val.str, ")" );
-      }
+
+   p = my_lparcfg_find( "partition_active_processors=" );
+
+   if (p)
+      val.int32 = strtol( p, (char **) NULL, 10 );
+   else
+   {
+/* find out the number of CPUs in the system/LPAR */
+      val.int32 = my_online_cpus();
    }
 
    return( val );
@@ -1072,54 +1206,66 @@ fwversion_func( void )
 
 
 
-static int LinuxVersion = 0;    /* 1 = /etc/SuSE-release */
-                                /* 2 = /etc/redhat-release */
-                                /* 3 = /etc/os-release */
-                                /* 4 = /etc/debian_version */
+g_val_t
+cpu_in_machine_func( void )
+{
+   g_val_t  val;
+   char    *p;
+
+
+   p = my_lparcfg_find( "system_potential_processors=" );
+
+   if (p)
+      val.int32 = strtol( p, (char **) NULL, 10 );
+   else
+   {
+/* find out the number of CPUs in the system/LPAR */
+      val.int32 = my_online_cpus();
+   }
+
+   return( val );
+}
 
 
 
-/* find 64bit kernel or not */
 g_val_t
-kernel64bit_func( void )
+cpu_in_pool_func( void )
 {
    g_val_t  val;
-   FILE    *f;
-   char     buf[128];
-   int      kernel64bit=0, i;
+   char    *p;
 
 
-   if ((LinuxVersion == 1) || (LinuxVersion == 2))
-      f = popen( "uname -i 2>/dev/null", "r" );
-   else
-      if ((LinuxVersion == 3) || (LinuxVersion == 4))  /* Debian has no "uname -i" */
-         f = popen( "uname -m 2>/dev/null", "r" );
-      else
-         f = popen( "uname -r 2>/dev/null", "r" );
+   p = my_lparcfg_find( "pool_num_procs=" );
 
-   if (f == NULL)
-      strcpy( val.str, "popen() of 'uname -[i,m,r]' failed" );
+   if (p)
+      val.int32 = strtol( p, (char **) NULL, 10 );
    else
    {
-      if (fread( buf, 1, 128, f ) > 0)
-      {
-         buf[127] = '\0';
+/* find out the number of CPUs in the system/LPAR */
+      val.int32 = my_online_cpus();
+   }
 
-         for (i = 0;  buf[i] != '\0';  i++)
-         {
-            if (buf[i] == '6' && buf[i+1] == '4')
-            {
-               kernel64bit++;
-               break;
-            }
-         }
+   return( val );
+}
 
-         strcpy( val.str, kernel64bit ? "yes" : "no" );
-      }
-      else
-         strcpy( val.str, "popen() of 'uname -[i,m,r]' failed" );
 
-      pclose( f );
+
+g_val_t
+cpu_in_syspool_func( void )
+{
+   g_val_t  val;
+   char    *p;
+
+
+/* this is still not implemented for multiple shared processor pools */
+   p = my_lparcfg_find( "pool_num_procs=" );
+
+   if (p)
+      val.int32 = strtol( p, (char **) NULL, 10 );
+   else
+   {
+/* find out the number of CPUs in the system/LPAR */
+      val.int32 = my_online_cpus();
    }
 
    return( val );
@@ -1128,672 +1274,6590 @@ kernel64bit_func( void )
 
 
 g_val_t
-lpar_func( void )
+cpu_pool_id_func( void )
 {
    g_val_t val;
+   int pool_id;
    char *p;
-   int capped, shared_processor_mode, partition_id;
-   long DisWheRotPer;
-   long long purr;
 
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "shared_processor_mode=" );
-   else
-      p = (char *) NULL;
-   if (p)
-      shared_processor_mode = strtol( p+22, (char **) NULL, 10 );
-   else
-      shared_processor_mode = -1;
+   p = my_lparcfg_find( "pool=" );
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "capped=" );
-   else
-      p = (char *) NULL;
    if (p)
-      capped = strtol( p+7, (char **) NULL, 10 );
+      pool_id = strtol( p, (char **) NULL, 10 );
    else
-      capped = -1;
+      pool_id = -1;
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "partition_id=" );
-   else
-      p = (char *) NULL;
-   if (p)
-      partition_id = strtol( p+13, (char **) NULL, 10 );
-   else
-      partition_id = -1;
+   val.int32 = pool_id;
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "DisWheRotPer=" );
-   else
-      p = (char *) NULL;
-   if (p)
-      DisWheRotPer = strtol( p+13, (char **) NULL, 10 );
-   else
-      DisWheRotPer = -1;
+   return( val );
+}
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "purr=" );
-   else
-      p = (char *) NULL;
-   if (p)
-      purr = strtoll( p+5, (char **) NULL, 10 );
-   else
-      purr = -1;
 
 
-   if (shared_processor_mode > 0 ||
-       capped >= 0 ||
-       partition_id > 0 ||
-       DisWheRotPer > 0 ||
-       purr > 0)
-      strcpy( val.str, "yes" );
-   else
-      strcpy( val.str, "no" );
+static ibmpower_rates pool_idle_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+cpu_pool_idle_func( void )
+{
+   g_val_t val;
+
+
+   my_core_update( &pool_idle_rates, IBMPOWER_SAMPLE_LPAR );
 
+   val.f = pool_idle_rates.pool_idle;
 
    return( val );
 }
 
 
 
+static ibmpower_rates cpu_used_rates = IBMPOWER_RATES_INIT;
+
 g_val_t
-lpar_name_func( void )
+cpu_used_func( void )
 {
    g_val_t val;
-   FILE *f;
-   char buf[128];
 
 
-   f = fopen( "/proc/device-tree/ibm,partition-name", "r" );
+   my_core_update( &cpu_used_rates, IBMPOWER_SAMPLE_LPAR | IBMPOWER_SAMPLE_CPU );
 
-   if (f)
-   {
-      if (fgets( buf, 128, f ) )
-      {
-         if (strlen( buf ) > MAX_G_STRING_SIZE - 1)
-            buf[MAX_G_STRING_SIZE - 1] = '\0';
+   val.f = cpu_used_rates.physc;
 
-         strcpy( val.str, buf );
-      }
-      else
-         strcpy( val.str, "Can't find out LPAR name!" );
+/* save value for cpu_ec_func */
+   last_cpu_used = val.f;
 
-      fclose( f );
-   }
+   return( val );
+}
+
+
+
+g_val_t
+cpu_ec_func( void )
+{
+   g_val_t ent, val;
+
+
+   ent = cpu_entitlement_func();
+
+   if (ent.f != 0.0)
+      val.f = 100.0 * (last_cpu_used / ent.f);
    else
-      strcpy( val.str, "No LPAR system" );
+      val.f = 100.0;
 
    return( val );
 }
 
 
 
+static ibmpower_rates disk_iops_rates = IBMPOWER_RATES_INIT;
+
 g_val_t
-lpar_num_func( void )
+disk_iops_func( void )
 {
    g_val_t val;
-   char *p;
 
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "partition_id=" );
-   else
-      p = (char *) NULL;
+   my_core_update( &disk_iops_rates, IBMPOWER_SAMPLE_DISK );
 
-   if (p)
-      val.int32 = strtol( p+13, (char **) NULL, 10 );
-   else
-      val.int32 = -1;
+   val.d = disk_iops_rates.disk_iops;
 
    return( val );
 }
 
 
 
+static ibmpower_rates disk_read_rates = IBMPOWER_RATES_INIT;
+
 g_val_t
-model_name_func( void )
+disk_read_func( void )
 {
    g_val_t val;
-   FILE *f;
-   char *p;
-   int len;
 
 
-   if (LPARcfgExists)
-   {
-      if (KVM_Guest)
-      {
-         f = fopen( "/proc/device-tree/host-model", "r" );
+   my_core_update( &disk_read_rates, IBMPOWER_SAMPLE_DISK );
 
-         if (f)
-         {
-            if (fread( val.str, 1, MAX_G_STRING_SIZE, f ) > 0)
-            {
-               val.str[MAX_G_STRING_SIZE - 1] = '\0';  /* truncate to MAX_G_STRING_SIZE */
-               val.str[strlen( val.str )] = '\0';
-            }
+   val.d = disk_read_rates.disk_read;
 
-            fclose( f );
-         }
-         else
-            strcpy( val.str, "KVM Guest" );
-      }
-      else
-      {
-         p = strstr( my_update_file( &proc_ppc64_lparcfg ), "system_type=" );
+   return( val );
+}
 
-         if (p)
-         {
-            len = strchr( p+12, '\n' ) - (p+12);
-            if (len > MAX_G_STRING_SIZE - 1)
-               len = MAX_G_STRING_SIZE - 1;
-            strncpy( val.str, p+12, len );
-            val.str[len] = '\0';
-         }
-         else
-            strcpy( val.str, "Can't find out model name" );
-      }
-   }
-   else
-   {
-      p = strstr( my_update_file( &proc_cpuinfo ), "model" );
 
-      if (p)
-      {
-         p = strchr( p, ':' );
-         p = skip_whitespace( p+1 );
-
-         len = strchr( p, '\n' ) - p;
-         if (len > MAX_G_STRING_SIZE - 1)
-            len = MAX_G_STRING_SIZE - 1;
-         strncpy( val.str, p, len );
-         val.str[len] = '\0';
-      }
-      else
-         strcpy( val.str, "Can't find out model name" );
-   }
+
+static ibmpower_rates disk_write_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+disk_write_func( void )
+{
+   g_val_t val;
+
+
+   my_core_update( &disk_write_rates, IBMPOWER_SAMPLE_DISK );
+
+   val.d = disk_write_rates.disk_write;
 
    return( val );
 }
 
 
 
-/* find OS version just once */
-static g_val_t
-oslevel_func_CALLED_ONCE( void )
+static ibmpower_rates disk_await_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+disk_await_func( void )
+{
+   g_val_t val;
+
+
+   my_core_update( &disk_await_rates, IBMPOWER_SAMPLE_DISK );
+
+   val.f = disk_await_rates.disk_await;
+
+   return( val );
+}
+
+
+
+static int
+fwversion_read( void *arg, my_buffer *b )
 {
+   FILE    *f;
    g_val_t  val;
-   FILE    *f, *f2;
-   char     buf[256], *p, *q;
-   int      i;
+   char     buf1[MAX_G_STRING_SIZE],
+            buf2[MAX_G_STRING_SIZE];
 
 
-   f = fopen( "/etc/SuSE-release", "r" );
-   if (f) LinuxVersion = 1;
-   if (! LinuxVersion)
-   {
-      f = fopen( "/etc/redhat-release", "r" );
-      if (f) LinuxVersion = 2;
-   }
-   if (! LinuxVersion)
+   strcpy( val.str, "Firmware version not detected!" );
+
+   f = fopen( "/proc/device-tree/openprom/ibm,fw-vernum_encoded", "r" );
+
+   if (f)
    {
-      f = fopen( "/etc/os-release", "r" );
-      if (f) LinuxVersion = 3;
+      if (fread( val.str, 1, MAX_G_STRING_SIZE, f ) > 0)
+         val.str[MAX_G_STRING_SIZE - 1] = '\0';  /* truncate to MAX_G_STRING_SIZE */
+
+      fclose( f );
    }
-   if (! LinuxVersion)
+   else
    {
-      f = fopen( "/etc/debian_version", "r" );
-      if (f) LinuxVersion = 4;
+      memset( buf1, '\0', MAX_G_STRING_SIZE );
+      memset( buf2, '\0', MAX_G_STRING_SIZE );
+
+      f = popen( "cat /proc/device-tree/ibm,opal/firmware/ml-version | awk '{ print $2 }'", "r" );
+      if (f)
+      {
+         if (fgets( buf1, MAX_G_STRING_SIZE, f ) > 0)
+         {
+            buf1[MAX_G_STRING_SIZE - 1] = '\0';  /* truncate to MAX_G_STRING_SIZE */
+            buf1[strlen( buf1 ) - 1] = '\0';  /* replace \n */
+         }
+
+         pclose( f );
+      }
+
+      f = popen( "cat /proc/device-tree/ibm,opal/firmware/mi-version | awk '{ print $2 }'", "r" );
+      if (f)
+      {
+         if (fgets( buf2, MAX_G_STRING_SIZE, f ) > 0)
+         {
+            buf2[MAX_G_STRING_SIZE - 1] = '\0';  /* truncate to MAX_G_STRING_SIZE */
+            buf2[strlen( buf2 ) - 1] = '\0';  /* replace \n */
+         }
+
+         pclose( f );
+      }
+
+      if ((strlen( buf1 ) > 1) &&
+          (strlen( buf2 ) > 1) &&
+          (strlen( buf1 ) + strlen( buf2 ) < MAX_G_STRING_SIZE - 3))
+      {
+         strcpy( val.str, buf1 );
+         strcat( val.str, " (" );
+         strcat( val.str, buf2 );
+         strcat( val.str, ")" );
+      }
    }
+
+   return( my_guard_set_string( b, val.str ) );
+}
+
+
+
+static my_guarded_source fwversion_src = { "the firmware version", fwversion_read, NULL, READ_DEADLINE_POPEN };
+
+g_val_t
+fwversion_func( void )
+{
+   g_val_t val;
+
+
+   my_guarded_string( &fwversion_src, val.str );
+
+   return( val );
+}
+
+
+
+static int LinuxVersion = 0;    /* 1 = /etc/SuSE-release */
+                                /* 2 = /etc/redhat-release */
+                                /* 3 = /etc/os-release */
+                                /* 4 = /etc/debian_version */
+
+
+
+/* find 64bit kernel or not */
+static int
+kernel64bit_read( void *arg, my_buffer *b )
+{
+   g_val_t  val;
+   FILE    *f;
+   char     buf[128];
+   int      kernel64bit=0, i;
+
+
+   if ((LinuxVersion == 1) || (LinuxVersion == 2))
+      f = popen( "uname -i 2>/dev/null", "r" );
+   else
+      if ((LinuxVersion == 3) || (LinuxVersion == 4))  /* Debian has no "uname -i" */
+         f = popen( "uname -m 2>/dev/null", "r" );
+      else
+         f = popen( "uname -r 2>/dev/null", "r" );
+
    if (f == NULL)
-      strcpy( val.str, "No known Linux release found" );
+      strcpy( val.str, "popen() of 'uname -[i,m,r]' failed" );
    else
    {
-      if (fread( buf, 1, 256, f) > 0)
+      if (fread( buf, 1, 128, f ) > 0)
       {
-         if (LinuxVersion == 1)
+         buf[127] = '\0';
+
+         for (i = 0;  buf[i] != '\0';  i++)
          {
-            if ((! strncmp( buf, "SUSE LINUX Enterprise Server", 28 )) ||
-                (! strncmp( buf, "SUSE Linux Enterprise Server", 28 )))
+            if (buf[i] == '6' && buf[i+1] == '4')
             {
-               strcpy( val.str, "SLES " );
+               kernel64bit++;
+               break;
+            }
+         }
 
-               p = strchr( buf, '\n' );
-               if (p) p = strchr( p+1, '=' );
-               if (p) p = skip_whitespace( p+1 );
-               if (p) q = strchr( p, '\n' );
+         strcpy( val.str, kernel64bit ? "yes" : "no" );
+      }
+      else
+         strcpy( val.str, "popen() of 'uname -[i,m,r]' failed" );
 
-               if (p && q) strncat( val.str, p, q-p );
-               strcat( val.str, " SP " );
+      pclose( f );
+   }
 
-               if (q) p = strchr( q+1, '=' );
-               if (p) p = skip_whitespace( p+1 );
-               if (p) q = strchr( p, '\n' );
+   return( my_guard_set_string( b, val.str ) );
+}
 
-               if (p && q) strncat( val.str, p, q-p );
-            }
-            else
-            {
-               p = strchr( buf, '\n' );
 
-               i = p-buf;
-               if ((i < 0) || (i >= MAX_G_STRING_SIZE))
-                  i = MAX_G_STRING_SIZE - 1;
 
-               strncpy( val.str, buf, i );
-               val.str[i] = '\0';
-            }
-         }
-         else if (LinuxVersion == 2)
-         {
-            if (! strncmp( buf, "Red Hat Enterprise Linux AS release", 35 ))
-            {
-               strcpy( val.str, "Red Hat Enterprise Linux " );
+static my_guarded_source kernel64bit_src = { "uname", kernel64bit_read, NULL, READ_DEADLINE_POPEN };
 
-               p = skip_whitespace( buf+35 );
-               if (p) q = strchr( p, ' ' );
+g_val_t
+kernel64bit_func( void )
+{
+   g_val_t val;
 
-               if (p && q) strncat( val.str, p, q-p );
 
-               if (q) p = strstr( q+1, "Update " );
+   my_guarded_string( &kernel64bit_src, val.str );
 
-               if (p)
-               {
-                  strcat( val.str, " Update " );
+   return( val );
+}
 
-                  p = skip_whitespace( p+7 );
-                  if (p) q = strchr( p, ')' );
 
-                  if (p && q) strncat( val.str, p, q-p );
-               }
-            }
-            else
-            if (! strncmp( buf, "Red Hat Enterprise Linux Server release", 39 ))
-            {
-               strcpy( val.str, "Red Hat Enterprise Linux " );
 
-               p = skip_whitespace( buf+39 );
-               if (p) q = strchr( p, ' ' );
+g_val_t
+lpar_func( void )
+{
+   g_val_t val;
+   char *p;
+   int capped, shared_processor_mode, partition_id;
+   long DisWheRotPer;
+   long long purr;
 
-               if (p && q) strncat( val.str, p, q-p );
-            }
-            else
-            {
-               p = strchr( buf, '\n' );
 
-               i = p-buf;
-               if ((i < 0) || (i >= MAX_G_STRING_SIZE))
-                  i = MAX_G_STRING_SIZE - 1;
+   p = my_lparcfg_find( "shared_processor_mode=" );
+   if (p)
+      shared_processor_mode = strtol( p, (char **) NULL, 10 );
+   else
+      shared_processor_mode = -1;
 
-               strncpy( val.str, buf, i );
-               val.str[i] = '\0';
-            }
-         }
-         else if (LinuxVersion == 3)
-         {
-            f2 = popen( "cat /etc/os-release | egrep '^NAME=|^VERSION=' | sed 's/NAME=//g' | sed 's/\"//g' | sed 's/VERSION=//g' 2>/dev/null", "r" );
+   p = my_lparcfg_find( "capped=" );
+   if (p)
+      capped = strtol( p, (char **) NULL, 10 );
+   else
+      capped = -1;
 
-            if (f2)
-            {
-               if (fread( buf, 1, 256, f2) > 0)
-               {
-                  p = strchr( buf, '\n' );
-                  i = p-buf;
-                  if ((i < 0) || (i >= MAX_G_STRING_SIZE))
-                     i = MAX_G_STRING_SIZE - 1;
-                  buf[i] = ' ';
+   p = my_lparcfg_find( "partition_id=" );
+   if (p)
+      partition_id = strtol( p, (char **) NULL, 10 );
+   else
+      partition_id = -1;
 
-                  p = strchr( p+1, '\n' );
-                  i = p-buf;
-                  if ((i < 0) || (i >= MAX_G_STRING_SIZE))
-                     i = MAX_G_STRING_SIZE - 1;
+   p = my_lparcfg_find( "DisWheRotPer=" );
+   if (p)
+      DisWheRotPer = strtol( p, (char **) NULL, 10 );
+   else
+      DisWheRotPer = -1;
 
-                  strncpy( val.str, buf, i );
-                  val.str[i] = '\0';
-                  
-                  pclose( f2 );
-               }
-            }
-            else
-               strcpy( val.str, "Couldn't read /etc/os-release" );
-         }
-         else if (LinuxVersion == 4)
-         {
-            p = strchr( buf, '\n' );
+   p = my_lparcfg_find( "purr=" );
+   if (p)
+      purr = strtoll( p, (char **) NULL, 10 );
+   else
+      purr = -1;
 
-            i = p-buf;
-            if ((i < 0) || (i >= MAX_G_STRING_SIZE))
-               i = MAX_G_STRING_SIZE - 1;
 
-            strncpy( val.str, buf, i );
-            val.str[i] = '\0';
-         }
-      }
-      else
-         strcpy( val.str, "No known Linux release found" );
+   if (shared_processor_mode > 0 ||
+       capped >= 0 ||
+       partition_id > 0 ||
+       DisWheRotPer > 0 ||
+       purr > 0)
+      strcpy( val.str, "yes" );
+   else
+      strcpy( val.str, "no" );
 
-      fclose( f );
-   }
 
    return( val );
 }
 
 
 
-g_val_t
-oslevel_func( void )
-{
-   static g_val_t val;
-   static int firstTime = TRUE;
+static int
+lpar_name_read( void *arg, my_buffer *b )
+{
+   g_val_t val;
+   FILE *f;
+   char buf[128];
+
+
+   f = fopen( "/proc/device-tree/ibm,partition-name", "r" );
+
+   if (f)
+   {
+      if (fgets( buf, 128, f ) )
+      {
+         if (strlen( buf ) > MAX_G_STRING_SIZE - 1)
+            buf[MAX_G_STRING_SIZE - 1] = '\0';
+
+         strcpy( val.str, buf );
+      }
+      else
+         strcpy( val.str, "Can't find out LPAR name!" );
+
+      fclose( f );
+   }
+   else
+      strcpy( val.str, "No LPAR system" );
+
+   return( my_guard_set_string( b, val.str ) );
+}
+
+
+
+static my_guarded_source lpar_name_src = { "/proc/device-tree/ibm,partition-name", lpar_name_read, NULL, READ_DEADLINE_DT };
+
+g_val_t
+lpar_name_func( void )
+{
+   g_val_t val;
+
+
+   my_guarded_string( &lpar_name_src, val.str );
+
+   return( val );
+}
+
+
+
+g_val_t
+lpar_num_func( void )
+{
+   g_val_t val;
+   char *p;
+
+
+   p = my_lparcfg_find( "partition_id=" );
+
+   if (p)
+      val.int32 = strtol( p, (char **) NULL, 10 );
+   else
+      val.int32 = -1;
+
+   return( val );
+}
+
+
+
+g_val_t
+model_name_func( void )
+{
+   g_val_t val;
+   FILE *f;
+
+
+   if (LPARcfgExists)
+   {
+      if (KVM_Guest)
+      {
+         f = fopen( "/proc/device-tree/host-model", "r" );
+
+         if (f)
+         {
+            if (fread( val.str, 1, MAX_G_STRING_SIZE, f ) > 0)
+            {
+               val.str[MAX_G_STRING_SIZE - 1] = '\0';  /* truncate to MAX_G_STRING_SIZE */
+               val.str[strlen( val.str )] = '\0';
+            }
+
+            fclose( f );
+         }
+         else
+            strcpy( val.str, "KVM Guest" );
+      }
+      else if (! my_lparcfg_string( "system_type=", val.str, MAX_G_STRING_SIZE ))
+         strcpy( val.str, "Can't find out model name" );
+   }
+   else if (! my_cpuinfo_string( "model", val.str, MAX_G_STRING_SIZE ))
+      strcpy( val.str, "Can't find out model name" );
+
+   return( val );
+}
+
+
+
+/* find OS version just once */
+static g_val_t
+oslevel_func_CALLED_ONCE( void )
+{
+   g_val_t  val;
+   FILE    *f, *f2;
+   char     buf[256], *p, *q;
+   int      i;
+
+
+   f = fopen( "/etc/SuSE-release", "r" );
+   if (f) LinuxVersion = 1;
+   if (! LinuxVersion)
+   {
+      f = fopen( "/etc/redhat-release", "r" );
+      if (f) LinuxVersion = 2;
+   }
+   if (! LinuxVersion)
+   {
+      f = fopen( "/etc/os-release", "r" );
+      if (f) LinuxVersion = 3;
+   }
+   if (! LinuxVersion)
+   {
+      f = fopen( "/etc/debian_version", "r" );
+      if (f) LinuxVersion = 4;
+   }
+   if (f == NULL)
+      strcpy( val.str, "No known Linux release found" );
+   else
+   {
+      if (fread( buf, 1, 256, f) > 0)
+      {
+         if (LinuxVersion == 1)
+         {
+            if ((! strncmp( buf, "SUSE LINUX Enterprise Server", 28 )) ||
+                (! strncmp( buf, "SUSE Linux Enterprise Server", 28 )))
+            {
+               strcpy( val.str, "SLES " );
+
+               p = strchr( buf, '\n' );
+               if (p) p = strchr( p+1, '=' );
+               if (p) p = skip_whitespace( p+1 );
+               if (p) q = strchr( p, '\n' );
+
+               if (p && q) strncat( val.str, p, q-p );
+               strcat( val.str, " SP " );
+
+               if (q) p = strchr( q+1, '=' );
+               if (p) p = skip_whitespace( p+1 );
+               if (p) q = strchr( p, '\n' );
+
+               if (p && q) strncat( val.str, p, q-p );
+            }
+            else
+            {
+               p = strchr( buf, '\n' );
+
+               i = p-buf;
+               if ((i < 0) || (i >= MAX_G_STRING_SIZE))
+                  i = MAX_G_STRING_SIZE - 1;
+
+               strncpy( val.str, buf, i );
+               val.str[i] = '\0';
+            }
+         }
+         else if (LinuxVersion == 2)
+         {
+            if (! strncmp( buf, "Red Hat Enterprise Linux AS release", 35 ))
+            {
+               strcpy( val.str, "Red Hat Enterprise Linux " );
+
+               p = skip_whitespace( buf+35 );
+               if (p) q = strchr( p, ' ' );
+
+               if (p && q) strncat( val.str, p, q-p );
+
+               if (q) p = strstr( q+1, "Update " );
+
+               if (p)
+               {
+                  strcat( val.str, " Update " );
+
+                  p = skip_whitespace( p+7 );
+                  if (p) q = strchr( p, ')' );
+
+                  if (p && q) strncat( val.str, p, q-p );
+               }
+            }
+            else
+            if (! strncmp( buf, "Red Hat Enterprise Linux Server release", 39 ))
+            {
+               strcpy( val.str, "Red Hat Enterprise Linux " );
+
+               p = skip_whitespace( buf+39 );
+               if (p) q = strchr( p, ' ' );
+
+               if (p && q) strncat( val.str, p, q-p );
+            }
+            else
+            {
+               p = strchr( buf, '\n' );
+
+               i = p-buf;
+               if ((i < 0) || (i >= MAX_G_STRING_SIZE))
+                  i = MAX_G_STRING_SIZE - 1;
+
+               strncpy( val.str, buf, i );
+               val.str[i] = '\0';
+            }
+         }
+         else if (LinuxVersion == 3)
+         {
+            f2 = popen( "cat /etc/os-release | egrep '^NAME=|^VERSION=' | sed 's/NAME=//g' | sed 's/\"//g' | sed 's/VERSION=//g' 2>/dev/null", "r" );
+
+            if (f2)
+            {
+               if (fread( buf, 1, 256, f2) > 0)
+               {
+                  p = strchr( buf, '\n' );
+                  i = p-buf;
+                  if ((i < 0) || (i >= MAX_G_STRING_SIZE))
+                     i = MAX_G_STRING_SIZE - 1;
+                  buf[i] = ' ';
+
+                  p = strchr( p+1, '\n' );
+                  i = p-buf;
+                  if ((i < 0) || (i >= MAX_G_STRING_SIZE))
+                     i = MAX_G_STRING_SIZE - 1;
+
+                  strncpy( val.str, buf, i );
+                  val.str[i] = '\0';
+                  
+                  pclose( f2 );
+               }
+            }
+            else
+               strcpy( val.str, "Couldn't read /etc/os-release" );
+         }
+         else if (LinuxVersion == 4)
+         {
+            p = strchr( buf, '\n' );
+
+            i = p-buf;
+            if ((i < 0) || (i >= MAX_G_STRING_SIZE))
+               i = MAX_G_STRING_SIZE - 1;
+
+            strncpy( val.str, buf, i );
+            val.str[i] = '\0';
+         }
+      }
+      else
+         strcpy( val.str, "No known Linux release found" );
+
+      fclose( f );
+   }
+
+   return( val );
+}
+
+
+
+g_val_t
+oslevel_func( void )
+{
+   static g_val_t val;
+   static int firstTime = TRUE;
+
+
+   if (firstTime)
+   {
+      val = oslevel_func_CALLED_ONCE();
+      firstTime = FALSE;
+   }
+
+   return( val );
+}
+
+
+
+static int
+serial_num_read( void *arg, my_buffer *b )
+{
+   g_val_t val;
+   FILE *f;
+   char  buf[128],
+         *p;
+   int len;
+
+
+   strcpy( val.str, "serial number not found" );
+
+   if (KVM_Guest)
+   {
+      f = fopen( "/proc/device-tree/host-serial", "r" );
+
+      if (f)
+      {
+         if (fgets( buf, 128, f ) )
+         {
+            if (strlen( buf ) > MAX_G_STRING_SIZE - 1)
+               buf[MAX_G_STRING_SIZE - 1] = '\0';
+
+            strcpy( val.str, buf );
+         }
+
+         fclose( f );
+      }
+   }
+   else
+   {
+      f = fopen( "/proc/device-tree/system-id", "r" );
+
+      if (f)
+      {
+         if (fgets( buf, 128, f ) )
+         {
+            if (strlen( buf ) > MAX_G_STRING_SIZE - 1)
+               buf[MAX_G_STRING_SIZE - 1] = '\0';
+
+            strcpy( val.str, buf );
+         }
+
+         fclose( f );
+      }
+      else
+         if (LPARcfgExists)
+         {
+/* my_update_file() is not thread safe, use the result buffer */
+            p = my_read_file( "/proc/ppc64/lparcfg", b );
+            if (p)
+               p = strstr( p, "serial_number=" );
+
+            if (p)
+            {
+               len = strchr( p+14, '\n' ) - (p+14);
+               if (len > MAX_G_STRING_SIZE - 1)
+                  len = MAX_G_STRING_SIZE - 1;
+               strncpy( val.str, p+14, len );
+               val.str[len] = '\0';
+            }
+         }
+   }
+
+   return( my_guard_set_string( b, val.str ) );
+}
+
+
+
+static my_guarded_source serial_num_src = { "the serial number", serial_num_read, NULL, READ_DEADLINE_DT };
+
+g_val_t
+serial_num_func( void )
+{
+   g_val_t val;
+
+
+   my_guarded_string( &serial_num_src, val.str );
+
+   return( val );
+}
+
+
+
+/* read by vcpu_disp_update() */
+static my_guarded_source vcpu_disp_src =
+   { "/proc/powerpc/vcpudispatch_stats", my_guard_read_file,
+     "/proc/powerpc/vcpudispatch_stats", READ_DEADLINE_PROCFS };
+
+
+
+static my_guarded_source *guarded_sources[] =
+{
+   &proc_cpuinfo.src, &proc_ppc64_lparcfg.src,
+   &fwversion_src, &kernel64bit_src, &lpar_name_src, &serial_num_src,
+   &vcpu_disp_src,
+   (my_guarded_source *) NULL
+};
+
+
+
+/* the sources of the module and the files of the core context */
+g_val_t
+read_timeouts_func( void )
+{
+   g_val_t val;
+
+
+   val.uint32 = (uint32_t) ibmpower_guard_timeouts( guard );
+   if (core)
+      val.uint32 += (uint32_t) ibmpower_read_timeouts( core );
+
+   return( val );
+}
+
+
+
+g_val_t
+read_stale_func( void )
+{
+   g_val_t val;
+   unsigned int stale;
+   int i;
+
+
+   val.uint32 = 0;
+
+   for (i = 0;  guarded_sources[i];  i++)
+      if (guarded_sources[i]->state.stale)
+         val.uint32++;
+
+   for (stale = core ? ibmpower_stale( core ) : 0;  stale;  stale &= stale - 1)
+      val.uint32++;
+
+   return( val );
+}
+
+
+
+static void
+guard_init( void )
+{
+   guard = ibmpower_guard_open();
+   if (guard == NULL)
+      err_msg( "guard_init() cannot start the reader thread, reading without a deadline" );
+}
+
+
+
+/*
+ * The reader thread is joined, or left with the read which still hangs.
+ * That source keeps state.busy and the thread frees its buffer.
+ */
+static void
+guard_cleanup( void )
+{
+   my_guarded_source *g;
+   int i;
+
+
+   ibmpower_guard_close( guard );
+   guard = NULL;
+
+   for (i = 0;  (g = guarded_sources[i]);  i++)
+      if (! g->state.busy)
+         my_guard_release( g );
+
+   free( proc_cpuinfo.buf.data );
+   free( proc_ppc64_lparcfg.buf.data );
+   proc_cpuinfo.buf.data = proc_ppc64_lparcfg.buf.data = NULL;
+   proc_cpuinfo.buf.size = proc_ppc64_lparcfg.buf.size = 0;
+   proc_cpuinfo.last_read = proc_ppc64_lparcfg.last_read = 0;
+}
+
+
+
+/*
+ * SMT mode from sysfs: either the kernel reports the number of threads per
+ * core in smt/control, or it is the number of online siblings of the first
+ * online CPU.  This stays correct if single threads are offlined and is
+ * cached until the CPU topology cache sees a hotplug event.
+ */
+static int smt_threads = -1;
+
+static int
+get_smt_threads( void )
+{
+   char buf[256];
+   int cpu;
+
+
+   if (! my_read_line( "/sys/devices/system/cpu/smt/control", buf, sizeof( buf ) ))
+      strcpy( buf, "" );
+
+   if ((buf[0] >= '1') && (buf[0] <= '9'))
+      return( strtol( buf, (char **) NULL, 10 ) );
+
+   if ((! strcmp( buf, "off" )) || (! strcmp( buf, "forceoff" )))
+      return( 1 );
+
+/* the siblings of the first online CPU from the topology cache */
+   if (! cpu_topo.valid)
+      return( -1 );
+
+   for (cpu = 0;  cpu < cpu_topo.ncpus;  cpu++)
+      if (cpu_topo.online[cpu])
+         return( cpu_topo.threads[cpu] > 0 ? cpu_topo.threads[cpu] : -1 );
+
+   return( -1 );
+}
+
+
+
+static int
+my_smt_threads( void )
+{
+   static unsigned int generation = 0;
+
+
+   cpu_topo_update();
+
+   if ((smt_threads < 0) || (generation != cpu_topo.generation))
+   {
+      smt_threads = get_smt_threads();
+      generation = cpu_topo.generation;
+   }
+
+   return( smt_threads );
+}
+
+
+
+g_val_t
+smt_func( void )
+{
+   g_val_t val;
+   int threads;
+
+
+   threads = my_smt_threads();
+
+   if (threads > 1)
+      snprintf( val.str, MAX_G_STRING_SIZE, "yes (SMT=%d)", threads );
+   else if (threads == 1)
+      strcpy( val.str, "no (SMT=1)" );
+   else
+      strcpy( val.str, "No SMT-capable system" );
+
+   return( val );
+}
+
+
+
+g_val_t
+smt_threads_func( void )
+{
+   g_val_t val;
+
+
+   val.int32 = my_smt_threads();
+
+   return( val );
+}
+
+
+
+g_val_t
+splpar_func( void )
+{
+   g_val_t val;
+   char *p;
+
+
+   p = my_lparcfg_find( "shared_processor_mode=" );
+
+   if (p)
+      strcpy( val.str, strtol( p, (char **) NULL, 10 ) == 1 ? "yes" : "no" );
+   else
+      strcpy( val.str, "No SPLPAR-capable system" );
+
+   return( val );
+}
+
+
+
+g_val_t
+weight_func( void )
+{
+   g_val_t val;
+   char *p;
+
+
+/* capacity_weight= follows unallocated_capacity_weight= in lparcfg */
+   p = my_lparcfg_find( "unallocated_capacity_weight=" );
+
+   if (p)
+   {
+      p = my_lparcfg_find( "capacity_weight=" );
+
+      if (p)
+         val.int32 = strtol( p, (char **) NULL, 10 );
+      else
+         val.int32 = -1;
+   }
+   else
+      val.int32 = -1;
+
+   return( val );
+}
+
+
+
+g_val_t
+kvm_guest_func( void )
+{
+   g_val_t val;
+
+
+   if (KVM_Guest)
+      strcpy( val.str, "yes" );    
+   else
+      strcpy( val.str, "no" );    
+
+   return( val );
+}
+
+
+
+g_val_t
+cpu_type_func( void )
+{
+   g_val_t  val;
+
+
+   if (! my_cpuinfo_string( KVM_Guest ? "model" : "cpu", val.str, MAX_G_STRING_SIZE ))
+      strcpy( val.str, "Unknown" );
+
+   return( val );
+}
+
+
+
+/*
+ * The hypervisor dispatch counters in /proc/ppc64/lparcfg are the sums of
+ * the 32-bit per-CPU lppaca yield and dispersion counts, so they may step
+ * backwards when a single CPU counter wraps.
+ */
+static ibmpower_rates dispatch_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+cpu_dispatches_func( void )
+{
+   g_val_t val;
+
+
+   my_core_update( &dispatch_rates, IBMPOWER_SAMPLE_LPAR );
+
+   val.f = dispatch_rates.dispatches;
+
+   return( val );
+}
+
+
+
+static ibmpower_rates dispersion_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+cpu_dispersions_func( void )
+{
+   g_val_t val;
+
+
+   my_core_update( &dispersion_rates, IBMPOWER_SAMPLE_LPAR );
+
+   val.f = dispersion_rates.dispersions;
+
+   return( val );
+}
+
+
+
+/* percentage of hypervisor dispatches which moved a vCPU away from its home */
+static ibmpower_rates dispersion_pct_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+cpu_dispersion_pct_func( void )
+{
+   g_val_t val;
+
+
+   my_core_update( &dispersion_pct_rates, IBMPOWER_SAMPLE_LPAR );
+
+   val.f = dispersion_pct_rates.dispersion_pct;
+
+   return( val );
+}
+
+
+
+g_val_t
+dispatch_wheel_func( void )
+{
+   g_val_t val;
+   long long period;
+   static int logged = FALSE;
+
+
+   period = my_lparcfg_value( "DisWheRotPer=", -1LL );
+
+/* the metric is unsigned, so a missing key must not show up as 4294967295 */
+   if (period < 0LL)
+   {
+      if (! logged)
+         err_msg( "dispatch_wheel_func() found no DisWheRotPer in /proc/ppc64/lparcfg, reporting 0" );
+      logged = TRUE;
+      period = 0LL;
+   }
+
+   val.uint32 = (uint32_t) period;
+
+   return( val );
+}
+
+
+
+static ibmpower_rates steal_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+cpu_steal_func( void )
+{
+   g_val_t val;
+
+
+   my_core_update( &steal_rates, IBMPOWER_SAMPLE_CPU );
+
+   val.f = steal_rates.last.online_cpus * steal_rates.steal_pct / 100.0;
+
+   return( val );
+}
+
+
+
+static ibmpower_rates steal_pct_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+cpu_steal_pct_func( void )
+{
+   g_val_t val;
+
+
+   my_core_update( &steal_pct_rates, IBMPOWER_SAMPLE_CPU );
+
+   val.f = steal_pct_rates.steal_pct;
+
+   return( val );
+}
+
+
+
+/*
+ * Steal time percentage of a single CPU, only with "per_cpu_steal".  The
+ * jiffies of all CPUs are copied from libibmpower once per read of
+ * /proc/stat, every CPU metric keeps its own previous values.
+ */
+typedef struct
+{
+   int primed;
+   ibmpower_cpu prev;
+   float last_val;
+} my_steal_window;
+
+static ibmpower_cpu *steal_cpus = (ibmpower_cpu *) NULL;
+static my_steal_window *steal_windows = (my_steal_window *) NULL;
+static int steal_ncpus = 0;
+static double steal_cpus_time = 0.0;     /* cpu_time of the copy in steal_cpus */
+
+
+static void
+my_steal_cpus_update( void )
+{
+   ibmpower_snapshot snap;
+
+
+   if ((core == NULL) || (ibmpower_sample( core, IBMPOWER_SAMPLE_CPU, &snap ) != 0))
+      return;
+
+   if (snap.cpu_time == steal_cpus_time)
+      return;
+
+   ibmpower_cpu_times( core, steal_cpus, steal_ncpus );
+   steal_cpus_time = snap.cpu_time;
+}
+
+
+
+static g_val_t
+cpu_steal_cpu_func( int cpu )
+{
+   g_val_t val;
+   my_steal_window *w;
+   const ibmpower_cpu *c;
+   long long total_diff, steal_diff;
+
+
+   val.f = 0.0;
+
+   if ((cpu < 0) || (cpu >= steal_ncpus))
+      return( val );
+
+   my_steal_cpus_update();
+
+   w = &steal_windows[cpu];
+   c = &steal_cpus[cpu];
+
+   if (! c->online)
+   {
+      w->primed = FALSE;
+      return( val );
+   }
+
+   total_diff = c->total - w->prev.total;
+   steal_diff = c->steal - w->prev.steal;
+
+/* a CPU not read again since the last call keeps its last value */
+   if (w->primed && (total_diff > 0LL) && (steal_diff >= 0LL))
+      w->last_val = 100.0 * steal_diff / total_diff;
+   else if (! (w->primed && (total_diff == 0LL)))
+      w->last_val = 0.0;
+
+   w->prev = *c;
+   w->primed = TRUE;
+
+   val.f = w->last_val;
+
+   return( val );
+}
+
+
+
+/*
+ * Cooperative Memory Overcommitment (Active Memory Sharing) values.  The
+ * cmo_* counters are only printed by the kernel if cmo_enabled=1.
+ */
+g_val_t
+cmo_enabled_func( void )
+{
+   g_val_t val;
+   long long i;
+
+
+   i = my_lparcfg_value( "cmo_enabled=", -1LL );
+
+   strcpy( val.str, i == -1LL ? "No CMO-capable system" : (i == 1LL ? "yes" : "no") );
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_entitled_memory_func( void )
+{
+   g_val_t val;
+
+
+   val.d = (double) my_lparcfg_value( "entitled_memory=", 0LL );
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_memory_weight_func( void )
+{
+   g_val_t val;
+
+
+   val.int32 = my_lparcfg_value( "entitled_memory_weight=", -1LL );
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_backing_memory_func( void )
+{
+   g_val_t val;
+
+
+   val.d = (double) my_lparcfg_value( "backing_memory=", 0LL );
+
+   return( val );
+}
+
+
+
+g_val_t
+cmo_page_size_func( void )
+{
+   g_val_t val;
+
+
+   val.int32 = my_lparcfg_value( "cmo_page_size=", -1LL );
+
+   return( val );
+}
+
+
+
+static ibmpower_counter cmo_fault_rate = IBMPOWER_COUNTER_INIT;
+
+g_val_t
+cmo_faults_func( void )
+{
+   g_val_t val;
+   long long faults;
+
+
+   faults = my_lparcfg_value( "cmo_faults=", -1LL );
+
+   if (faults >= 0LL)
+      val.f = ibmpower_counter_rate( &cmo_fault_rate, faults, my_time_now() );
+   else
+      val.f = 0.0;
+
+   return( val );
+}
+
+
+
+/* micro-seconds per second spent waiting for hypervisor page faults */
+static ibmpower_counter cmo_fault_time_rate = IBMPOWER_COUNTER_INIT;
+
+g_val_t
+cmo_fault_time_func( void )
+{
+   g_val_t val;
+   long long fault_time;
+
+
+   fault_time = my_lparcfg_value( "cmo_fault_time_usec=", -1LL );
+
+   if (fault_time >= 0LL)
+      val.f = ibmpower_counter_rate( &cmo_fault_time_rate, fault_time, my_time_now() );
+   else
+      val.f = 0.0;
+
+   return( val );
+}
+
+
+
+/* average latency of a hypervisor page fault during the last interval */
+static ibmpower_ratio cmo_fault_latency_ratio = IBMPOWER_RATIO_INIT;
+
+g_val_t
+cmo_fault_latency_func( void )
+{
+   g_val_t val;
+   long long faults, fault_time;
+
+
+   faults = my_lparcfg_value( "cmo_faults=", -1LL );
+   fault_time = my_lparcfg_value( "cmo_fault_time_usec=", -1LL );
+
+   if ((faults >= 0LL) && (fault_time >= 0LL))
+      val.f = ibmpower_ratio_update( &cmo_fault_latency_ratio, fault_time, faults );
+   else
+      val.f = 0.0;
+
+   return( val );
+}
+
+
+
+/*
+ * Per-vCPU dispatch affinity from /proc/powerpc/vcpudispatch_stats.  The
+ * kernel only counts after "1" has been written to the file, so this is
+ * optional ("param vcpudispatch_stats") and switched off again at cleanup.
+ * Each line is "cpuN total same_cpu same_chip diff_chip far_chip
+ * numa_home numa_remote numa_far".
+ */
+#define VCPU_DISP_FILE       "/proc/powerpc/vcpudispatch_stats"
+#define VCPU_DISP_FIELDS     8
+#define VCPU_DISP_MIN_DISP   10    /* ignore idle vCPUs for the worst list */
+#define VCPU_DISP_WORST      3
+
+enum { VD_TOTAL, VD_SAME_CPU, VD_SAME_CHIP, VD_DIFF_CHIP, VD_FAR_CHIP,
+       VD_NUMA_HOME, VD_NUMA_REMOTE, VD_NUMA_FAR };
+
+static int vcpu_disp_enabled = FALSE;     /* param vcpudispatch_stats */
+static int vcpu_disp_switched_on = FALSE; /* we wrote "1" at init */
+
+/*
+ * The file is re-read at most once a second.  The increments of every
+ * vCPU are added up since startup, skipping a vCPU whose counters went
+ * backwards because it was offline in between.  Every metric keeps its
+ * own copy of the sums it saw last, so each one covers its own collection
+ * interval.
+ */
+enum { VD_ACC_TOTAL, VD_ACC_OFF_CHIP, VD_ACC_FIELDS };
+
+typedef struct
+{
+   int primed;
+   unsigned long long prev[VCPU_DISP_FIELDS];
+} my_vcpu_disp_window;
+
+static struct
+{
+   time_t last_read;
+   int ncpus;                                        /* my_possible_cpus() */
+   char *seen;                                       /* [ncpus] */
+   unsigned long long (*raw)[VCPU_DISP_FIELDS];      /* [ncpus] last line */
+   unsigned long long (*acc)[VD_ACC_FIELDS];         /* [ncpus] since startup */
+   unsigned long long (*worst_base)[VD_ACC_FIELDS];  /* [ncpus] acc at the last worst_pct */
+   unsigned long long sum[VCPU_DISP_FIELDS];         /* increments of all vCPUs */
+
+/* list of the last vcpu_disp_worst_pct_func() */
+   char worst[MAX_G_STRING_SIZE];
+} vcpu_disp;
+
+
+
+static void
+vcpu_disp_init( void )
+{
+   my_buffer b = { NULL, 0, 0 };
+   char *p;
+
+
+   if (! vcpu_disp_enabled)
+      return;
+
+   vcpu_disp.ncpus = my_possible_cpus();
+   vcpu_disp.seen = calloc( vcpu_disp.ncpus, 1 );
+   vcpu_disp.raw = calloc( vcpu_disp.ncpus, sizeof( vcpu_disp.raw[0] ) );
+   vcpu_disp.acc = calloc( vcpu_disp.ncpus, sizeof( vcpu_disp.acc[0] ) );
+   vcpu_disp.worst_base = calloc( vcpu_disp.ncpus, sizeof( vcpu_disp.worst_base[0] ) );
+
+   if ((vcpu_disp.seen == NULL) || (vcpu_disp.raw == NULL) || (vcpu_disp.acc == NULL) ||
+       (vcpu_disp.worst_base == NULL))
+   {
+      err_msg( "vcpu_disp_init() is out of memory, disabling it" );
+      vcpu_disp_enabled = FALSE;
+      return;
+   }
+
+   p = my_read_file( VCPU_DISP_FILE, &b );
+
+   if (p == NULL)
+   {
+      err_msg( "vcpu_disp_init() cannot read %s, disabling it", VCPU_DISP_FILE );
+      vcpu_disp_enabled = FALSE;
+   }
+   else if (strncmp( p, "off", 3 ) == 0)
+   {
+      my_write_file( VCPU_DISP_FILE, "1" );
+      vcpu_disp_switched_on = TRUE;
+   }
+
+   free( b.data );
+}
+
+
+
+static void
+vcpu_disp_cleanup( void )
+{
+   if (vcpu_disp_switched_on)
+      my_write_file( VCPU_DISP_FILE, "0" );
+
+   vcpu_disp_switched_on = FALSE;
+
+   free( vcpu_disp.seen );
+   free( vcpu_disp.raw );
+   free( vcpu_disp.acc );
+   free( vcpu_disp.worst_base );
+   vcpu_disp.seen = NULL;
+   vcpu_disp.raw = NULL;
+   vcpu_disp.acc = vcpu_disp.worst_base = NULL;
+   vcpu_disp.ncpus = 0;
+}
+
+
+
+/*
+ * Parse one "cpuN total same_cpu ..." line.  Returns FALSE for anything
+ * else, like the "off" the kernel prints if someone switched the
+ * statistics off, a CPU number beyond the possible CPUs, a missing or
+ * non-numeric field, or trailing garbage.
+ */
+static int
+vcpu_disp_parse_line( char *p, int *cpu, unsigned long long *cur )
+{
+   unsigned long long n;
+   int i;
+
+
+   if ((strncmp( p, "cpu", 3 ) != 0) || ((unsigned) (p[3] - '0') >= 10))
+      return( FALSE );
+
+   p += 3;
+   n = my_parse_ull( &p );
+   if (n >= (unsigned long long) vcpu_disp.ncpus)
+      return( FALSE );
+
+   for (i = 0;  i < VCPU_DISP_FIELDS;  i++)
+   {
+      if ((*p != ' ') && (*p != '\t'))
+         return( FALSE );
+
+      cur[i] = my_parse_ull( &p );
+
+/* my_parse_ull() only skipped blanks */
+      if ((unsigned) (p[-1] - '0') >= 10)
+         return( FALSE );
+   }
+
+   while ((*p == ' ') || (*p == '\t'))
+      p++;
+
+   if ((*p != '\n') && (*p != '\0'))
+      return( FALSE );
+
+   *cpu = (int) n;
+
+   return( TRUE );
+}
+
+
+
+static void
+vcpu_disp_update( void )
+{
+   unsigned long long cur[VCPU_DISP_FIELDS], d[VCPU_DISP_FIELDS];
+   char *p, *line;
+   time_t now;
+   int cpu, i, reset;
+
+
+   now = time( NULL );
+   if (now == vcpu_disp.last_read)
+      return;
+   vcpu_disp.last_read = now;
+
+/* a read which fails or misses its deadline leaves raw alone, the next one catches up */
+   p = my_guarded_read( &vcpu_disp_src ) ? vcpu_disp_src.result.data : (char *) NULL;
+
+   for (line = p;  line && *line;  line = p)
+   {
+      p = strchr( line, '\n' );
+      if (p)
+         p++;
+
+      if (! vcpu_disp_parse_line( line, &cpu, cur ))
+         continue;
+
+      for (i = 0, reset = FALSE;  i < VCPU_DISP_FIELDS;  i++)
+      {
+         d[i] = cur[i] - vcpu_disp.raw[cpu][i];
+         if (cur[i] < vcpu_disp.raw[cpu][i])
+            reset = TRUE;
+      }
+
+/* a vCPU which was offline in between starts over from zero */
+      if (vcpu_disp.seen[cpu] && (! reset))
+      {
+         for (i = 0;  i < VCPU_DISP_FIELDS;  i++)
+            vcpu_disp.sum[i] += d[i];
+
+         vcpu_disp.acc[cpu][VD_ACC_TOTAL] += d[VD_TOTAL];
+         vcpu_disp.acc[cpu][VD_ACC_OFF_CHIP] += d[VD_DIFF_CHIP] + d[VD_FAR_CHIP];
+      }
+
+      memcpy( vcpu_disp.raw[cpu], cur, sizeof( cur ) );
+      vcpu_disp.seen[cpu] = TRUE;
+   }
+}
+
+
+
+/* percentage of the dispatches since the last call for w in fields a and b */
+static float
+vcpu_disp_pct( my_vcpu_disp_window *w, int a, int b )
+{
+   unsigned long long d[VCPU_DISP_FIELDS];
+   int i, primed;
+
+
+   if (! vcpu_disp_enabled)
+      return( 0.0 );
+
+   vcpu_disp_update();
+
+   for (i = 0;  i < VCPU_DISP_FIELDS;  i++)
+   {
+      d[i] = vcpu_disp.sum[i] - w->prev[i];
+      w->prev[i] = vcpu_disp.sum[i];
+   }
+
+   primed = w->primed;
+   w->primed = TRUE;
+
+   if ((! primed) || (d[VD_TOTAL] == 0ULL))
+      return( 0.0 );
+
+   return( 100.0 * (d[a] + (b >= 0 ? d[b] : 0ULL)) / (double) d[VD_TOTAL] );
+}
+
+
+
+g_val_t
+vcpu_disp_same_core_func( void )
+{
+   g_val_t val;
+   static my_vcpu_disp_window window;
+
+
+   val.f = vcpu_disp_pct( &window, VD_SAME_CPU, -1 );
+
+   return( val );
+}
+
+
+
+g_val_t
+vcpu_disp_same_chip_func( void )
+{
+   g_val_t val;
+   static my_vcpu_disp_window window;
+
+
+   val.f = vcpu_disp_pct( &window, VD_SAME_CHIP, -1 );
+
+   return( val );
+}
+
+
+
+g_val_t
+vcpu_disp_other_chip_func( void )
+{
+   g_val_t val;
+   static my_vcpu_disp_window window;
+
+
+   val.f = vcpu_disp_pct( &window, VD_DIFF_CHIP, VD_FAR_CHIP );
+
+   return( val );
+}
+
+
+
+g_val_t
+vcpu_disp_remote_node_func( void )
+{
+   g_val_t val;
+   static my_vcpu_disp_window window;
+
+
+   val.f = vcpu_disp_pct( &window, VD_NUMA_REMOTE, VD_NUMA_FAR );
+
+   return( val );
+}
+
+
+
+/*
+ * The worst vCPUs since the last call, which also makes the list that
+ * vcpu_disp_worst_func() returns.  vcpu_disp_worst_pct comes right
+ * before vcpu_disp_worst in the collection group.
+ */
+g_val_t
+vcpu_disp_worst_pct_func( void )
+{
+   g_val_t val;
+   static int primed = FALSE;
+   unsigned long long total, off_chip;
+   float worst_pct[VCPU_DISP_WORST], pct;
+   int worst_cpu[VCPU_DISP_WORST];
+   int cpu, i, j, len;
+
+
+   val.f = 0.0;
+
+   if (! vcpu_disp_enabled)
+      return( val );
+
+   vcpu_disp_update();
+
+   for (i = 0;  i < VCPU_DISP_WORST;  i++)
+   {
+      worst_pct[i] = -1.0;
+      worst_cpu[i] = -1;
+   }
+
+   for (cpu = 0;  cpu < vcpu_disp.ncpus;  cpu++)
+   {
+      total = vcpu_disp.acc[cpu][VD_ACC_TOTAL] - vcpu_disp.worst_base[cpu][VD_ACC_TOTAL];
+      off_chip = vcpu_disp.acc[cpu][VD_ACC_OFF_CHIP] - vcpu_disp.worst_base[cpu][VD_ACC_OFF_CHIP];
+      memcpy( vcpu_disp.worst_base[cpu], vcpu_disp.acc[cpu], sizeof( vcpu_disp.acc[0] ) );
+
+      if ((! primed) || (total < VCPU_DISP_MIN_DISP))
+         continue;
+
+      pct = 100.0 * off_chip / (double) total;
+
+      for (i = 0;  i < VCPU_DISP_WORST;  i++)
+      {
+         if (pct > worst_pct[i])
+         {
+            for (j = VCPU_DISP_WORST - 1;  j > i;  j--)
+            {
+               worst_pct[j] = worst_pct[j-1];
+               worst_cpu[j] = worst_cpu[j-1];
+            }
+            worst_pct[i] = pct;
+            worst_cpu[i] = cpu;
+            break;
+         }
+      }
+   }
+
+   primed = TRUE;
+
+   strcpy( vcpu_disp.worst, "" );
+   for (i = 0, len = 0;  (i < VCPU_DISP_WORST) && (worst_cpu[i] >= 0);  i++)
+      len += snprintf( vcpu_disp.worst + len, MAX_G_STRING_SIZE - len, "%scpu%d=%.1f%%",
+                       i ? " " : "", worst_cpu[i], worst_pct[i] );
+
+   val.f = worst_pct[0] > 0.0 ? worst_pct[0] : 0.0;
+
+   return( val );
+}
+
+
+
+g_val_t
+vcpu_disp_worst_func( void )
+{
+   g_val_t val;
+
+
+   if (vcpu_disp_enabled)
+      strcpy( val.str, vcpu_disp.worst[0] ? vcpu_disp.worst : "none" );
+   else
+      strcpy( val.str, "vcpudispatch_stats not enabled" );
+
+   return( val );
+}
+
+
+
+/*
+ * Hypervisor call statistics from /sys/kernel/debug/powerpc/hcall_inst/cpuN
+ * (kernels with CONFIG_HCALL_STATS and debugfs mounted, gmond must be able
+ * to read it).  Each file has a line "opcode calls tb_total [purr_total]"
+ * for every hcall the CPU has made.  Reading them is optional
+ * ("param hcall_stats") and done at most once per second for all the
+ * hcall metrics.
+ *
+ * There is a file for every possible CPU, so only the online CPUs are
+ * read.  The files are kept open and re-read with pread() into one buffer
+ * and parsed in place.  The last counters of every CPU are kept as a
+ * short list in opcode order, like the file, and the increments are
+ * summed up per opcode, so a CPU going offline does not change the sums.
+ */
+#define HCALL_DIR         "/sys/kernel/debug/powerpc/hcall_inst"
+#define HCALL_SLOTS       1024    /* opcode / 4 */
+#define HCALL_TOP         5       /* default of param hcall_top */
+#define HCALL_TOP_MAX     16
+
+static int hcall_enabled = FALSE;     /* param hcall_stats */
+static int hcall_top = HCALL_TOP;     /* param hcall_top */
+
+typedef struct
+{
+   unsigned short slot;
+   unsigned long long calls;
+   unsigned long long tb;
+} my_hcall_count;
+
+typedef struct
+{
+   int fd;                   /* -1 = not open */
+   int primed;
+   int n, size;
+   my_hcall_count *counts;   /* ascending slot */
+} my_hcall_cpu;
+
+static struct
+{
+   time_t last_read;
+   int ncpus;                /* highest cpuN + 1 */
+   my_hcall_cpu *cpus;
+   my_buffer buf;
+   int primed;
+
+/* increments summed up since startup */
+   unsigned long long calls[HCALL_SLOTS];
+   unsigned long long tb[HCALL_SLOTS];
+   unsigned long long prev_calls[HCALL_SLOTS];
+   unsigned long long prev_tb[HCALL_SLOTS];
+   double prev_time;
+
+/* results of the last round */
+   float rate;                       /* calls per second */
+   float time_msec;                  /* ms per second */
+   int top_slot[HCALL_TOP_MAX];      /* -1 = none */
+   float top_msec[HCALL_TOP_MAX];
+   char top_names[MAX_G_STRING_SIZE];
+} hcall;
+
+
+static const struct
+{
+   unsigned short opcode;
+   const char *name;
+} hcall_names[] =
+{
+   { 0x04, "H_REMOVE" },           { 0x08, "H_ENTER" },
+   { 0x0c, "H_READ" },             { 0x10, "H_CLEAR_MOD" },
+   { 0x14, "H_CLEAR_REF" },        { 0x18, "H_PROTECT" },
+   { 0x1c, "H_GET_TCE" },          { 0x20, "H_PUT_TCE" },
+   { 0x24, "H_SET_SPRG0" },        { 0x28, "H_SET_DABR" },
+   { 0x2c, "H_PAGE_INIT" },        { 0x3c, "H_LOGICAL_CI_LOAD" },
+   { 0x40, "H_LOGICAL_CI_STORE" }, { 0x54, "H_GET_TERM_CHAR" },
+   { 0x58, "H_PUT_TERM_CHAR" },    { 0x64, "H_EOI" },
+   { 0x68, "H_CPPR" },             { 0x6c, "H_IPI" },
+   { 0x70, "H_IPOLL" },            { 0x74, "H_XIRR" },
+   { 0x7c, "H_PERFMON" },          { 0xdc, "H_REGISTER_VPA" },
+   { 0xe0, "H_CEDE" },             { 0xe4, "H_CONFER" },
+   { 0xe8, "H_PROD" },             { 0xec, "H_GET_PPP" },
+   { 0xf0, "H_SET_PPP" },          { 0xf4, "H_PURR" },
+   { 0xf8, "H_PIC" },              { 0xfc, "H_REG_CRQ" },
+   { 0x100, "H_FREE_CRQ" },        { 0x104, "H_VIO_SIGNAL" },
+   { 0x108, "H_SEND_CRQ" },        { 0x110, "H_COPY_RDMA" },
+   { 0x114, "H_REGISTER_LOGICAL_LAN" },   { 0x118, "H_FREE_LOGICAL_LAN" },
+   { 0x11c, "H_ADD_LOGICAL_LAN_BUFFER" }, { 0x120, "H_SEND_LOGICAL_LAN" },
+   { 0x124, "H_BULK_REMOVE" },     { 0x130, "H_MULTICAST_CTRL" },
+   { 0x134, "H_SET_XDABR" },       { 0x138, "H_STUFF_TCE" },
+   { 0x13c, "H_PUT_TCE_INDIRECT" },       { 0x14c, "H_CHANGE_LOGICAL_LAN_MAC" },
+   { 0x150, "H_VTERM_PARTNER_INFO" },     { 0x154, "H_REGISTER_VTERM" },
+   { 0x158, "H_FREE_VTERM" },      { 0x1d8, "H_POLL_PENDING" },
+   { 0x2b0, "H_ENABLE_CRQ" },      { 0x2b8, "H_GET_EM_PARMS" },
+   { 0x2d0, "H_SET_MPP" },         { 0x2d4, "H_GET_MPP" },
+   { 0x2dc, "H_REG_SUB_CRQ" },     { 0x2e4, "H_SEND_SUB_CRQ" },
+   { 0x2e8, "H_SEND_SUB_CRQ_INDIRECT" },  { 0x2ec, "H_HOME_NODE_ASSOCIATIVITY" },
+   { 0x2f4, "H_BEST_ENERGY" },     { 0x2fc, "H_XIRR_X" },
+   { 0x300, "H_RANDOM" },          { 0x304, "H_COP" },
+   { 0x314, "H_GET_MPP_X" },       { 0x31c, "H_SET_MODE" },
+   { 0, NULL }
+};
+
+
+
+static const char *
+my_hcall_name( int slot, char *buf, size_t len )
+{
+   int i;
+
+
+   for (i = 0;  hcall_names[i].name;  i++)
+      if (hcall_names[i].opcode == (slot << 2))
+         return( hcall_names[i].name );
+
+   snprintf( buf, len, "H_0x%x", slot << 2 );
+
+   return( buf );
+}
+
+
+
+static void
+hcall_init( void )
+{
+   DIR *dir;
+   struct dirent *de;
+   int cpu, i;
+
+
+   if (! hcall_enabled)
+      return;
+
+   if (hcall_top < 1)
+      hcall_top = 1;
+   if (hcall_top > HCALL_TOP_MAX)
+      hcall_top = HCALL_TOP_MAX;
+
+   for (i = 0;  i < HCALL_TOP_MAX;  i++)
+      hcall.top_slot[i] = -1;
+
+   dir = opendir( HCALL_DIR );
+   if (dir == NULL)
+   {
+      err_msg( "hcall_init() cannot read %s, disabling it", HCALL_DIR );
+      hcall_enabled = FALSE;
+      return;
+   }
+
+   while ((de = readdir( dir )))
+   {
+      if (strncmp( de->d_name, "cpu", 3 ) != 0)
+         continue;
+
+      cpu = atoi( de->d_name + 3 );
+      if ((cpu >= 0) && (cpu < my_possible_cpus()) && (cpu >= hcall.ncpus))
+         hcall.ncpus = cpu + 1;
+   }
+
+   closedir( dir );
+
+   hcall.cpus = calloc( hcall.ncpus, sizeof( my_hcall_cpu ) );
+   if (hcall.cpus == NULL)
+   {
+      hcall_enabled = FALSE;
+      return;
+   }
+
+   for (cpu = 0;  cpu < hcall.ncpus;  cpu++)
+      hcall.cpus[cpu].fd = -1;
+}
+
+
+
+static void
+hcall_cleanup( void )
+{
+   int cpu;
+
+
+   for (cpu = 0;  cpu < hcall.ncpus;  cpu++)
+   {
+      if (hcall.cpus[cpu].fd >= 0)
+         close( hcall.cpus[cpu].fd );
+      free( hcall.cpus[cpu].counts );
+   }
+
+   free( hcall.cpus );
+   hcall.cpus = NULL;
+   hcall.ncpus = 0;
+
+   free( hcall.buf.data );
+   hcall.buf.data = NULL;
+   hcall.buf.size = hcall.buf.len = 0;
+}
+
+
+
+/* read one cpuN file into hcall.buf, the file stays open */
+static char *
+hcall_read_cpu( int cpu )
+{
+   my_hcall_cpu *c = &hcall.cpus[cpu];
+   char name[64], *buf;
+
+
+   if (c->fd < 0)
+   {
+      snprintf( name, sizeof( name ), HCALL_DIR "/cpu%d", cpu );
+      c->fd = open( name, O_RDONLY | O_CLOEXEC );
+      if (c->fd < 0)
+         return( (char *) NULL );
+   }
+
+   buf = my_pread_file( c->fd, &hcall.buf );
+   if (buf == NULL)
+   {
+      close( c->fd );
+      c->fd = -1;
+   }
+
+   return( buf );
+}
+
+
+
+/* the entry of slot in the list of c, starting the search at *pos */
+static my_hcall_count *
+hcall_cpu_entry( my_hcall_cpu *c, int *pos, int slot )
+{
+   my_hcall_count *e;
+   int i = *pos;
+
+
+   while ((i < c->n) && (c->counts[i].slot < slot))
+      i++;
+
+   if ((i == c->n) || (c->counts[i].slot != slot))
+   {
+/* a new hcall on this CPU, insert it in order */
+      if (c->n == c->size)
+      {
+         e = realloc( c->counts, (c->size + 16) * sizeof( *e ) );
+         if (e == NULL)
+            return( (my_hcall_count *) NULL );
+         c->counts = e;
+         c->size += 16;
+      }
+
+      memmove( &c->counts[i+1], &c->counts[i], (c->n - i) * sizeof( *e ) );
+      c->n++;
+
+      e = &c->counts[i];
+      e->slot = slot;
+      e->calls = e->tb = 0ULL;
+   }
+
+   *pos = i + 1;
+
+   return( &c->counts[i] );
+}
+
+
+
+static void
+hcall_parse_cpu( int cpu, char *p )
+{
+   my_hcall_cpu *c = &hcall.cpus[cpu];
+   my_hcall_count *e;
+   unsigned long long opcode, calls, tb;
+   int pos = 0, slot;
+
+
+   while (p && *p)
+   {
+      opcode = my_parse_ull( &p );
+      calls = my_parse_ull( &p );
+      tb = my_parse_ull( &p );
+
+      p = strchr( p, '\n' );
+      if (p == NULL)
+         break;
+      p++;
+
+      slot = (int) (opcode >> 2);
+      if ((slot <= 0) || (slot >= HCALL_SLOTS))
+         continue;
+
+      e = hcall_cpu_entry( c, &pos, slot );
+      if (e == NULL)
+         continue;
+
+/* a new entry of a CPU read before counts from zero */
+      if (c->primed && (calls >= e->calls) && (tb >= e->tb))
+      {
+         hcall.calls[slot] += calls - e->calls;
+         hcall.tb[slot] += tb - e->tb;
+      }
+
+      e->calls = calls;
+      e->tb = tb;
+   }
+
+   c->primed = TRUE;
+}
+
+
+
+static void
+hcall_update( void )
+{
+   unsigned long long calls, tb;
+   long long timebase;
+   double now, delta_t, msec;
+   char name[16], *p;
+   const char *hname;
+   time_t t;
+   int cpu, slot, i, j, len;
+
+
+   t = time( NULL );
+   if (t == hcall.last_read)
+      return;
+   hcall.last_read = t;
+
+   now = my_time_now();
+
+   for (cpu = 0;  cpu < hcall.ncpus;  cpu++)
+   {
+      if (! my_cpu_online( cpu ))
+         continue;
+
+      p = hcall_read_cpu( cpu );
+      if (p)
+         hcall_parse_cpu( cpu, p );
+   }
+
+   delta_t = now - hcall.prev_time;
+   hcall.prev_time = now;
+
+   if ((! hcall.primed) || (delta_t <= 0.0))
+   {
+      memcpy( hcall.prev_calls, hcall.calls, sizeof( hcall.calls ) );
+      memcpy( hcall.prev_tb, hcall.tb, sizeof( hcall.tb ) );
+      hcall.primed = TRUE;
+      return;
+   }
+
+   timebase = core ? ibmpower_timebase( core ) : -1LL;
+   if (timebase <= 0LL)
+      timebase = 512000000LL;
+
+   calls = tb = 0ULL;
+   for (i = 0;  i < hcall_top;  i++)
+   {
+      hcall.top_slot[i] = -1;
+      hcall.top_msec[i] = 0.0;
+   }
+
+   for (slot = 1;  slot < HCALL_SLOTS;  slot++)
+   {
+      calls += hcall.calls[slot] - hcall.prev_calls[slot];
+
+      if (hcall.tb[slot] == hcall.prev_tb[slot])
+         continue;
+
+      tb += hcall.tb[slot] - hcall.prev_tb[slot];
+
+      msec = 1000.0 * (hcall.tb[slot] - hcall.prev_tb[slot]) / timebase / delta_t;
+
+      for (i = 0;  i < hcall_top;  i++)
+      {
+         if ((hcall.top_slot[i] < 0) || (msec > hcall.top_msec[i]))
+         {
+            for (j = hcall_top - 1;  j > i;  j--)
+            {
+               hcall.top_slot[j] = hcall.top_slot[j-1];
+               hcall.top_msec[j] = hcall.top_msec[j-1];
+            }
+            hcall.top_slot[i] = slot;
+            hcall.top_msec[i] = msec;
+            break;
+         }
+      }
+   }
+
+   memcpy( hcall.prev_calls, hcall.calls, sizeof( hcall.calls ) );
+   memcpy( hcall.prev_tb, hcall.tb, sizeof( hcall.tb ) );
+
+   hcall.rate = calls / delta_t;
+   hcall.time_msec = 1000.0 * tb / timebase / delta_t;
+
+   strcpy( hcall.top_names, "" );
+   for (i = 0, len = 0;  (i < hcall_top) && (hcall.top_slot[i] >= 0);  i++)
+   {
+      hname = my_hcall_name( hcall.top_slot[i], name, sizeof( name ) );
+
+/* only whole names */
+      if (len + (i ? 1 : 0) + strlen( hname ) >= MAX_G_STRING_SIZE)
+         break;
+
+      len += snprintf( hcall.top_names + len, MAX_G_STRING_SIZE - len, "%s%s", i ? "," : "", hname );
+   }
+}
+
+
+
+g_val_t
+hcall_rate_func( void )
+{
+   g_val_t val;
+
+
+   if (hcall_enabled)
+      hcall_update();
+
+   val.f = hcall.rate;
+
+   return( val );
+}
+
+
+
+g_val_t
+hcall_time_func( void )
+{
+   g_val_t val;
+
+
+   if (hcall_enabled)
+      hcall_update();
+
+   val.f = hcall.time_msec;
+
+   return( val );
+}
+
+
+
+g_val_t
+hcall_top_func( void )
+{
+   g_val_t val;
+
+
+   if (hcall_enabled)
+   {
+      hcall_update();
+      strcpy( val.str, hcall.top_names[0] ? hcall.top_names : "none" );
+   }
+   else
+      strcpy( val.str, "hcall_stats not enabled" );
+
+   return( val );
+}
+
+
+
+/* time per second of the hcall of rank rank+1 of the last round */
+static g_val_t
+hcall_top_time_func( int rank )
+{
+   g_val_t val;
+
+
+   hcall_update();
+
+   val.f = (hcall.top_slot[rank] >= 0) ? hcall.top_msec[rank] : 0.0;
+
+   return( val );
+}
+
+
+
+/*
+ * Hardware counters.  With "param perf_counters" one perf_event_open()
+ * group is opened per online CPU at init, counting the whole partition:
+ * cycles, instructions, cache references and cache misses, plus CPU
+ * migrations.  If the hardware events cannot be opened (no PMU in a VM or
+ * container) a group of software events is used instead, so only the
+ * migrations are counted, and if neither can be opened the counters are
+ * disabled.  Counting other than our own processes needs CAP_PERFMON or
+ * kernel.perf_event_paranoid <= 0.
+ *
+ * Every round (at most once per second) reads each group with a single
+ * read() of PERF_FORMAT_GROUP.  The values are scaled by the time the
+ * group was enabled vs. running, in case the PMU is multiplexed.  CPUs
+ * coming online later get their group when the CPU topology changes.
+ */
+#define PERF_EVENTS     5
+
+enum { PERF_MODE_OFF, PERF_MODE_SOFTWARE, PERF_MODE_HARDWARE };
+enum { PE_CYCLES, PE_INSTRUCTIONS, PE_CACHE_REFS, PE_CACHE_MISSES, PE_MIGRATIONS };
+
+static int perf_enabled = FALSE;     /* param perf_counters */
+
+typedef struct
+{
+   unsigned int type;
+   unsigned long long config;        /* ~0ULL = not counted */
+} my_perf_event;
+
+static const my_perf_event perf_hw_events[PERF_EVENTS] =
+{
+   { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+   { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+   { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+   { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+   { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS }
+}, perf_sw_events[PERF_EVENTS] =
+{
+   { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK },    /* group leader only */
+   { PERF_TYPE_SOFTWARE, ~0ULL },
+   { PERF_TYPE_SOFTWARE, ~0ULL },
+   { PERF_TYPE_SOFTWARE, ~0ULL },
+   { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS }
+};
+
+typedef struct
+{
+   int fd[PERF_EVENTS];              /* fd[0] is the group leader, -1 = none */
+   int primed;
+   unsigned long long enabled, running;
+   unsigned long long value[PERF_EVENTS];
+} my_perf_cpu;
+
+static struct
+{
+   int mode;
+   int have[PERF_EVENTS];            /* events in the groups, in this order */
+   int nevents;
+   unsigned int topo_generation;
+   int ncpus;                        /* my_possible_cpus() */
+   my_perf_cpu *cpus;                /* [ncpus] */
+   time_t last_read;
+   double prev_time;
+
+/* results of the last round */
+   double cpi;
+   double ips;
+   double cache_mpki;
+   double cache_miss_pct;
+   double migrations;
+} perf;
+
+
+
+static int
+my_perf_event_open( unsigned int type, unsigned long long config, int cpu, int group_fd )
+{
+   struct perf_event_attr attr;
+   unsigned long flags = 0;
+
+
+   memset( &attr, 0, sizeof( attr ) );
+   attr.size = sizeof( attr );
+   attr.type = type;
+   attr.config = config;
+   attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                      PERF_FORMAT_TOTAL_TIME_RUNNING;
+   attr.disabled = (group_fd < 0);
+   attr.exclude_hv = 1;
+
+#ifdef PERF_FLAG_FD_CLOEXEC
+   flags = PERF_FLAG_FD_CLOEXEC;
+#endif
+
+   return( (int) syscall( __NR_perf_event_open, &attr, -1, cpu, group_fd, flags ) );
+}
+
+
+
+static void
+perf_close_cpu( my_perf_cpu *c )
+{
+   int i;
+
+
+   for (i = PERF_EVENTS - 1;  i >= 0;  i--)
+   {
+      if (c->fd[i] >= 0)
+         close( c->fd[i] );
+      c->fd[i] = -1;
+   }
+
+   c->primed = FALSE;
+}
+
+
+
+/*
+ * Open the group of one CPU.  The first CPU decides which events there
+ * are (perf.have), the others must open the same ones.
+ */
+static int
+perf_open_cpu( int cpu, int first )
+{
+   my_perf_cpu *c = &perf.cpus[cpu];
+   const my_perf_event *ev;
+   int i;
+
+
+   ev = (perf.mode == PERF_MODE_HARDWARE) ? perf_hw_events : perf_sw_events;
+
+   c->fd[0] = my_perf_event_open( ev[0].type, ev[0].config, cpu, -1 );
+   if (c->fd[0] < 0)
+      return( FALSE );
+
+   if (first)
+      perf.have[0] = TRUE;
+
+   for (i = 1;  i < PERF_EVENTS;  i++)
+   {
+      if ((ev[i].config == ~0ULL) || ((! first) && (! perf.have[i])))
+         continue;
+
+      c->fd[i] = my_perf_event_open( ev[i].type, ev[i].config, cpu, c->fd[0] );
+
+      if (first)
+         perf.have[i] = (c->fd[i] >= 0);
+      else if (c->fd[i] < 0)
+      {
+         perf_close_cpu( c );
+         return( FALSE );
+      }
+   }
+
+   ioctl( c->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+
+   return( TRUE );
+}
+
+
+
+/* open the groups of CPUs which came online */
+static void
+perf_online_cpus( void )
+{
+   int cpu;
+
+
+   cpu_topo_update();
+
+   if ((perf.topo_generation == cpu_topo.generation) || (! cpu_topo.valid))
+      return;
+
+   perf.topo_generation = cpu_topo.generation;
+
+   for (cpu = 0;  cpu < perf.ncpus;  cpu++)
+      if (my_cpu_online( cpu ) && (perf.cpus[cpu].fd[0] < 0))
+         perf_open_cpu( cpu, FALSE );
+}
+
+
+
+static void
+perf_init( void )
+{
+   int cpu, first, i, err;
+
+
+   if (! perf_enabled)
+      return;
+
+   perf.ncpus = my_possible_cpus();
+   perf.cpus = calloc( perf.ncpus, sizeof( my_perf_cpu ) );
+
+   if (perf.cpus == NULL)
+   {
+      err_msg( "perf_init() is out of memory, disabling the counters" );
+      perf.ncpus = 0;
+      return;
+   }
+
+   for (cpu = 0;  cpu < perf.ncpus;  cpu++)
+      for (i = 0;  i < PERF_EVENTS;  i++)
+         perf.cpus[cpu].fd[i] = -1;
+
+   cpu_topo_update();
+   perf.topo_generation = cpu_topo.generation;
+
+   if (! cpu_topo.valid)
+   {
+      err_msg( "perf_init() cannot read the online CPUs, disabling the counters" );
+      return;
+   }
+
+   for (first = -1, cpu = 0;  (cpu < perf.ncpus) && (first < 0);  cpu++)
+      if (my_cpu_online( cpu ))
+         first = cpu;
+
+   if (first < 0)
+      return;
+
+/* hardware events if there is a PMU, software events otherwise */
+   perf.mode = PERF_MODE_HARDWARE;
+   if (! perf_open_cpu( first, TRUE ))
+   {
+      err = errno;
+      perf.mode = PERF_MODE_SOFTWARE;
+
+      if (! perf_open_cpu( first, TRUE ))
+      {
+         err_msg( "perf_init() cannot open perf events (%s), disabling the counters, "
+                  "see kernel.perf_event_paranoid", strerror( errno ) );
+         perf.mode = PERF_MODE_OFF;
+         return;
+      }
+
+      err_msg( "perf_init() has no hardware events (%s), counting software events only",
+               strerror( err ) );
+   }
+
+   for (perf.nevents = 0, i = 0;  i < PERF_EVENTS;  i++)
+      if (perf.have[i])
+         perf.nevents++;
+
+   for (cpu = first + 1;  cpu < perf.ncpus;  cpu++)
+      if (my_cpu_online( cpu ))
+         perf_open_cpu( cpu, FALSE );
+}
+
+
+
+static void
+perf_cleanup( void )
+{
+   int cpu;
+
+
+   for (cpu = 0;  cpu < perf.ncpus;  cpu++)
+      perf_close_cpu( &perf.cpus[cpu] );
+
+   free( perf.cpus );
+   perf.cpus = NULL;
+   perf.ncpus = 0;
+
+   perf.mode = PERF_MODE_OFF;
+}
+
+
+
+static void
+perf_update( void )
+{
+   my_perf_cpu *c;
+   unsigned long long buf[3 + PERF_EVENTS], sum[PERF_EVENTS], d_enabled, d_running;
+   double now, delta_t, scale;
+   time_t t;
+   int cpu, i, n;
+
+
+   t = time( NULL );
+   if ((perf.mode == PERF_MODE_OFF) || (t == perf.last_read))
+      return;
+   perf.last_read = t;
+
+   perf_online_cpus();
+
+   memset( sum, 0, sizeof( sum ) );
+
+   for (cpu = 0;  cpu < perf.ncpus;  cpu++)
+   {
+      c = &perf.cpus[cpu];
+      if (c->fd[0] < 0)
+         continue;
+
+/* nr, time_enabled, time_running and the values of the group, one read() */
+      if (read( c->fd[0], buf, sizeof( buf ) ) < (ssize_t) ((3 + perf.nevents) * sizeof( buf[0] )))
+         continue;
+
+      if ((int) buf[0] != perf.nevents)
+         continue;
+
+      d_enabled = buf[1] - c->enabled;
+      d_running = buf[2] - c->running;
+      scale = (d_running > 0ULL) ? (double) d_enabled / d_running : 0.0;
+
+      for (i = 0, n = 0;  i < PERF_EVENTS;  i++)
+      {
+         if (! perf.have[i])
+            continue;
+
+         if (c->primed && (buf[3+n] >= c->value[i]))
+            sum[i] += (unsigned long long) ((buf[3+n] - c->value[i]) * scale);
+
+         c->value[i] = buf[3+n];
+         n++;
+      }
+
+      c->enabled = buf[1];
+      c->running = buf[2];
+      c->primed = TRUE;
+   }
+
+   now = my_time_now();
+   delta_t = now - perf.prev_time;
+   perf.prev_time = now;
+
+   if (delta_t <= 0.0)
+      return;
+
+   perf.migrations = sum[PE_MIGRATIONS] / delta_t;
+
+   if (perf.mode != PERF_MODE_HARDWARE)
+      return;
+
+   perf.cpi = (sum[PE_INSTRUCTIONS] > 0ULL) ? (double) sum[PE_CYCLES] / sum[PE_INSTRUCTIONS] : 0.0;
+   perf.ips = sum[PE_INSTRUCTIONS] / delta_t;
+   perf.cache_mpki = (sum[PE_INSTRUCTIONS] > 0ULL) ?
+                        1000.0 * sum[PE_CACHE_MISSES] / sum[PE_INSTRUCTIONS] : 0.0;
+   perf.cache_miss_pct = (sum[PE_CACHE_REFS] > 0ULL) ?
+                            100.0 * sum[PE_CACHE_MISSES] / sum[PE_CACHE_REFS] : 0.0;
+}
+
+
+
+g_val_t
+perf_mode_func( void )
+{
+   g_val_t val;
+
+
+   switch (perf.mode)
+   {
+      case PERF_MODE_HARDWARE: strcpy( val.str, "hardware" ); break;
+      case PERF_MODE_SOFTWARE: strcpy( val.str, "software" ); break;
+      default:
+         strcpy( val.str, perf_enabled ? "unavailable" : "perf_counters not enabled" );
+   }
+
+   return( val );
+}
+
+
+
+g_val_t
+cpi_func( void )
+{
+   g_val_t val;
+
+
+   perf_update();
+
+   val.f = perf.cpi;
+
+   return( val );
+}
+
+
+
+g_val_t
+ips_func( void )
+{
+   g_val_t val;
+
+
+   perf_update();
+
+   val.d = perf.ips;
+
+   return( val );
+}
+
+
+
+g_val_t
+cache_mpki_func( void )
+{
+   g_val_t val;
+
+
+   perf_update();
+
+   val.f = perf.cache_mpki;
+
+   return( val );
+}
+
+
+
+g_val_t
+cache_miss_pct_func( void )
+{
+   g_val_t val;
+
+
+   perf_update();
+
+   val.f = perf.cache_miss_pct;
+
+   return( val );
+}
+
+
+
+g_val_t
+cpu_migrations_func( void )
+{
+   g_val_t val;
+
+
+   perf_update();
+
+   val.f = perf.migrations;
+
+   return( val );
+}
+
+
+
+/*
+ * Interrupt load per CPU from /proc/interrupts.  With "param
+ * interrupt_stats" the file is read at most once per second through a
+ * descriptor which stays open.  With many CPUs it is megabytes of text,
+ * so it is scanned in place: a row is its label and one count per column,
+ * the description after the counts is skipped.  The last counts of every
+ * row and column are kept in one array of unsigned int, the width of the
+ * kernel's counters, so their wrap needs no special case.
+ *
+ * The header line maps the columns to CPU numbers.  It is parsed again
+ * only when the CPU topology changed or its length did.  A row whose label
+ * differs from the last round (an IRQ was added or freed) only sets its
+ * baseline, as do all rows after a change of the columns.  Rows with
+ * fewer counts than columns (ERR, MIS) are not counted.
+ *
+ * irq_rate counts all interrupts.  The hottest CPU and the imbalance only
+ * count device interrupts (numeric labels), the per CPU timer and other
+ * architecture interrupts are spread evenly and would hide a storm.
+ */
+#define IRQ_FILE        "/proc/interrupts"
+#define IRQ_LABEL       16
+
+static int irq_enabled = FALSE;     /* param interrupt_stats */
+
+typedef struct
+{
+   char label[IRQ_LABEL];
+   int primed;
+   int full;                        /* a count for every column */
+   int device;                      /* numeric label */
+} my_irq_row;
+
+static struct
+{
+   int fd;
+   my_buffer buf;
+   unsigned int topo_generation;
+   char *header;                    /* the last header line */
+   size_t header_len;
+   int ncols;
+   int *col_cpu;                    /* CPU number of each column */
+   int nrows, rows_size;
+   my_irq_row *rows;
+   unsigned int *prev;              /* rows_size x ncols last counts */
+   unsigned long long *dev;         /* device interrupts of the round per column */
+   time_t last_read;
+   double prev_time;
+
+/* results of the last round */
+   double rate;
+   double cpu_max;
+   double imbalance;
+   int hot_cpu;
+} irq = { -1 };
+
+
+
+/* the columns of the header line "   CPU0   CPU1 ..." */
+static int
+irq_parse_header( const char *line, size_t len )
+{
+   const char *p;
+   char *h;
+   int *cols, n;
+
+
+/* scanned in the copy, strstr() must not run into the rows */
+   h = realloc( irq.header, len + 1 );
+   if (h == NULL)
+      return( FALSE );
+   irq.header = h;
+   memcpy( irq.header, line, len );
+   irq.header[len] = '\0';
+   irq.header_len = len;
+
+   for (n = 0, p = irq.header;  (p = strstr( p, "CPU" ));  p += 3)
+      n++;
+
+   cols = realloc( irq.col_cpu, (n ? n : 1) * sizeof( int ) );
+   if (cols == NULL)
+      return( FALSE );
+   irq.col_cpu = cols;
+
+   for (n = 0, p = irq.header;  (p = strstr( p, "CPU" ));  n++)
+   {
+      p += 3;
+      irq.col_cpu[n] = atoi( p );
+   }
+
+/* new columns, every row starts again */
+   free( irq.prev );
+   free( irq.dev );
+   irq.prev = NULL;
+   irq.rows_size = irq.nrows = 0;
+   irq.ncols = n;
+
+   irq.dev = calloc( n ? n : 1, sizeof( unsigned long long ) );
+
+   return( irq.dev != NULL );
+}
+
+
+
+/* the row r, the arrays grow as needed */
+static my_irq_row *
+irq_row( int r )
+{
+   my_irq_row *rows;
+   unsigned int *prev;
+   int size;
+
+
+   if (r >= irq.rows_size)
+   {
+      size = irq.rows_size ? 2 * irq.rows_size : 64;
+
+      rows = realloc( irq.rows, size * sizeof( my_irq_row ) );
+      if (rows == NULL)
+         return( (my_irq_row *) NULL );
+      irq.rows = rows;
+
+      prev = realloc( irq.prev, (size_t) size * irq.ncols * sizeof( unsigned int ) );
+      if (prev == NULL)
+         return( (my_irq_row *) NULL );
+      irq.prev = prev;
+
+      irq.rows_size = size;
+   }
+
+   if (r >= irq.nrows)
+   {
+      irq.rows[r].label[0] = '\0';
+      irq.rows[r].primed = FALSE;
+      irq.nrows = r + 1;
+   }
+
+   return( &irq.rows[r] );
+}
+
+
+
+static void
+irq_init( void )
+{
+   if (! irq_enabled)
+      return;
+
+   irq.fd = open( IRQ_FILE, O_RDONLY | O_CLOEXEC );
+   if (irq.fd < 0)
+   {
+      err_msg( "irq_init() cannot open %s, disabling it", IRQ_FILE );
+      irq_enabled = FALSE;
+      return;
+   }
+
+   irq.hot_cpu = -1;
+
+/* make the first round compare the header */
+   irq.topo_generation = cpu_topo.generation - 1;
+}
+
+
+
+static void
+irq_cleanup( void )
+{
+   if (irq.fd >= 0)
+      close( irq.fd );
+   irq.fd = -1;
+
+   free( irq.buf.data );
+   free( irq.header );
+   free( irq.col_cpu );
+   free( irq.rows );
+   free( irq.prev );
+   free( irq.dev );
+
+   irq.buf.data = irq.header = NULL;
+   irq.buf.size = irq.buf.len = irq.header_len = 0;
+   irq.col_cpu = NULL;
+   irq.rows = NULL;
+   irq.prev = NULL;
+   irq.dev = NULL;
+   irq.ncols = irq.nrows = irq.rows_size = 0;
+}
+
+
+
+static void
+irq_update( void )
+{
+   my_irq_row *row;
+   unsigned int *prev, v;
+   unsigned long long total = 0ULL, max = 0ULL, sum = 0ULL;
+   char *buf, *p, *label, *eol;
+   size_t len;
+   double now, delta_t;
+   time_t t;
+   int r, c, same, hot = -1;
+
+
+   t = time( NULL );
+   if (t == irq.last_read)
+      return;
+   irq.last_read = t;
+
+   buf = my_pread_file( irq.fd, &irq.buf );
+   if (buf == NULL)
+      return;
+
+   eol = strchr( buf, '\n' );
+   if (eol == NULL)
+      return;
+   len = eol - buf;
+
+   cpu_topo_update();
+
+   if ((irq.topo_generation != cpu_topo.generation) || (len != irq.header_len) || (irq.dev == NULL))
+   {
+      irq.topo_generation = cpu_topo.generation;
+
+      if ((irq.dev == NULL) || (len != irq.header_len) || memcmp( buf, irq.header, len ))
+         if (! irq_parse_header( buf, len ))
+         {
+            free( irq.dev );
+            irq.dev = NULL;
+            return;
+         }
+   }
+
+   memset( irq.dev, 0, irq.ncols * sizeof( unsigned long long ) );
+
+   for (r = 0, p = eol + 1;  *p;  r++)
+   {
+      while (*p == ' ')
+         p++;
+
+      for (label = p;  *p && (*p != ':') && (*p != '\n');  p++)
+         ;
+
+      if (*p != ':')
+      {
+         r--;
+         p += (*p == '\n');
+         continue;
+      }
+
+      row = irq_row( r );
+      if (row == NULL)
+         return;
+
+      len = p - label;
+      if (len >= IRQ_LABEL)
+         len = IRQ_LABEL - 1;
+
+      same = row->primed && (! strncmp( row->label, label, len )) && (row->label[len] == '\0');
+      if (! same)
+      {
+         memcpy( row->label, label, len );
+         row->label[len] = '\0';
+         row->device = (unsigned) (label[0] - '0') < 10;
+      }
+
+      prev = irq.prev + (size_t) r * irq.ncols;
+      p++;
+
+      for (c = 0;  c < irq.ncols;  c++)
+      {
+         while (*p == ' ')
+            p++;
+         if ((unsigned) (*p - '0') >= 10)
+            break;
+
+         v = (unsigned int) my_parse_ull( &p );
+
+         if (same && row->full)
+         {
+            total += v - prev[c];
+            if (row->device)
+               irq.dev[c] += v - prev[c];
+         }
+
+         prev[c] = v;
+      }
+
+      if (! same)
+      {
+         row->full = (c == irq.ncols);
+         row->primed = TRUE;
+      }
+
+/* the description */
+      while (*p && (*p != '\n'))
+         p++;
+      p += (*p == '\n');
+   }
+
+   now = my_time_now();
+   delta_t = now - irq.prev_time;
+   irq.prev_time = now;
+
+   if ((delta_t <= 0.0) || (irq.ncols == 0))
+      return;
+
+   for (c = 0;  c < irq.ncols;  c++)
+   {
+      sum += irq.dev[c];
+      if (irq.dev[c] > max)
+      {
+         max = irq.dev[c];
+         hot = irq.col_cpu[c];
+      }
+   }
+
+   irq.rate = total / delta_t;
+   irq.cpu_max = max / delta_t;
+   irq.hot_cpu = hot;
+
+/* 1.0 when spread evenly, the number of CPUs when all on one */
+   irq.imbalance = (sum > 0ULL) ? (double) max * irq.ncols / sum : 0.0;
+}
+
+
+
+g_val_t
+irq_rate_func( void )
+{
+   g_val_t val;
+
+
+   if (irq_enabled)
+      irq_update();
+
+   val.f = irq.rate;
+
+   return( val );
+}
+
+
+
+g_val_t
+irq_cpu_max_func( void )
+{
+   g_val_t val;
+
+
+   if (irq_enabled)
+      irq_update();
+
+   val.f = irq.cpu_max;
+
+   return( val );
+}
+
+
+
+g_val_t
+irq_hot_cpu_func( void )
+{
+   g_val_t val;
+
+
+   if (irq_enabled)
+   {
+      irq_update();
+      if (irq.hot_cpu >= 0)
+         snprintf( val.str, MAX_G_STRING_SIZE, "cpu%d", irq.hot_cpu );
+      else
+         strcpy( val.str, "none" );
+   }
+   else
+      strcpy( val.str, "interrupt_stats not enabled" );
+
+   return( val );
+}
+
+
+
+g_val_t
+irq_imbalance_func( void )
+{
+   g_val_t val;
+
+
+   if (irq_enabled)
+      irq_update();
+
+   val.f = irq.imbalance;
+
+   return( val );
+}
+
+
+
+/*
+ * Physical cores used per cgroup.  "param cgroups" lists cgroup v2 paths
+ * relative to the cgroup2 mount, separated by blanks or commas.  Each
+ * listed cgroup becomes a metric cgroup_<path>_physc (cgroup_metric_id()),
+ * the OpenMetrics family cgroup_fixed_physc.  A path whose last
+ * component is "*" stands for all child cgroups of its parent, e.g. the
+ * containers below system.slice.  These come and go, so they are summed
+ * up in cgroup_count, cgroup_physc and cgroup_top instead.
+ *
+ * The usage_usec of cpu.stat is logical CPU time.  Its share of the busy
+ * logical time of the partition, from the root cgroup's cpu.stat (or from
+ * /proc/stat on older kernels), is scaled by the physical cores used in
+ * the same window.  For that the collector has its own libibmpower
+ * context, which is sampled right before the cgroups are read.
+ *
+ * The cpu.stat files stay open and only their first line is read, so a
+ * round is one pread() per cgroup.  The child cgroups are listed again
+ * every CGROUP_RESCAN seconds; known ones keep their descriptor, new ones
+ * start from a baseline and removed ones are closed.
+ */
+#define CGROUP_ROOT     "/sys/fs/cgroup"
+#define CGROUP_RESCAN   30      /* seconds */
+#define CGROUP_TOP      5
+
+static const char *cgroups_param = NULL;   /* param cgroups */
+
+typedef struct
+{
+   char *path;                      /* relative to CGROUP_ROOT */
+   char *name;                      /* shown in cgroup_top */
+   int fd;                          /* cpu.stat, -1 = not open, -2 = removed */
+   int primed;
+   int seen;
+   unsigned long long usage;        /* usec */
+   double physc;
+} my_cgroup;
+
+static struct
+{
+   int enabled;
+   ibmpower_ctx *ctx;
+   ibmpower_rates rates;
+   long clk_tck;
+
+   my_cgroup root;
+   my_cgroup *fixed;                /* the listed cgroups */
+   int nfixed;
+   char **parents;                  /* paths whose children are read */
+   int nparents;
+   my_cgroup *kids;                 /* children of the parents, sorted by path */
+   int nkids, kids_size;
+
+   time_t last_read;
+   time_t last_scan;
+
+/* results of the last round */
+   int count;
+   double physc;
+   char top[MAX_G_STRING_SIZE];
+} cgroup = { FALSE, NULL, IBMPOWER_RATES_INIT };
+
+
+
+/* "docker-<64 hex digits>.scope" --> "docker-<12 hex digits>" */
+static char *
+my_cgroup_name( const char *path )
+{
+   const char *p;
+   char *name, *q;
+   size_t len;
+   int hex;
+
+
+   p = strrchr( path, '/' );
+   p = p ? p+1 : path;
+
+   name = strdup( p );
+   if (name == NULL)
+      return( (char *) NULL );
+
+   len = strlen( name );
+   if ((len > 6) && ((! strcmp( name + len - 6, ".scope" )) || (! strcmp( name + len - 6, ".slice" ))))
+      name[len - 6] = '\0';
+
+   for (hex = 0, p = q = name;  *p;  p++)
+   {
+      hex = isxdigit( (unsigned char) *p ) ? hex + 1 : 0;
+      if (hex <= 12)
+         *q++ = *p;
+   }
+   *q = '\0';
+
+   return( name );
+}
+
+
+
+static int
+my_cgroup_cmp( const void *a, const void *b )
+{
+   return( strcmp( ((const my_cgroup *) a)->path, ((const my_cgroup *) b)->path ) );
+}
+
+
+
+static void
+my_cgroup_close( my_cgroup *c )
+{
+   if (c->fd >= 0)
+      close( c->fd );
+   c->fd = -1;
+
+   free( c->path );
+   free( c->name );
+   c->path = c->name = NULL;
+}
+
+
+
+/* usage_usec of the cgroup, FALSE if it cannot be read (any more) */
+static int
+my_cgroup_usage( my_cgroup *c, unsigned long long *usage )
+{
+   char buf[128], path[512], *p;
+   ssize_t rval;
+
+
+   if (c->fd == -2)
+      return( FALSE );
+
+   if (c->fd < 0)
+   {
+      snprintf( path, sizeof( path ), CGROUP_ROOT "/%s%scpu.stat", c->path, c->path[0] ? "/" : "" );
+      c->fd = open( path, O_RDONLY | O_CLOEXEC );
+      if (c->fd < 0)
+      {
+         c->fd = -2;
+         return( FALSE );
+      }
+   }
+
+/* usage_usec is the first line */
+   rval = pread( c->fd, buf, sizeof( buf ) - 1, 0 );
+   if (rval <= 0)
+   {
+      close( c->fd );
+      c->fd = -2;
+      return( FALSE );
+   }
+   buf[rval] = '\0';
+
+   if (strncmp( buf, "usage_usec ", 11 ) != 0)
+      return( FALSE );
+
+   p = buf + 11;
+   *usage = my_parse_ull( &p );
+
+   return( TRUE );
+}
+
+
+
+/* list the children of the parents again, keeping the known ones */
+static void
+cgroup_scan( void )
+{
+   DIR *dir;
+   struct dirent *de;
+   my_cgroup key, *c, *kids;
+   char path[512];
+   int i, n, old;
+
+
+   for (i = 0;  i < cgroup.nkids;  i++)
+      cgroup.kids[i].seen = FALSE;
+
+   old = cgroup.nkids;
+
+   for (i = 0;  i < cgroup.nparents;  i++)
+   {
+      snprintf( path, sizeof( path ), CGROUP_ROOT "/%s", cgroup.parents[i] );
+
+      dir = opendir( path );
+      if (dir == NULL)
+         continue;
+
+      while ((de = readdir( dir )))
+      {
+         if ((de->d_name[0] == '.') || (de->d_type != DT_DIR))
+            continue;
+
+         snprintf( path, sizeof( path ), "%s%s%s", cgroup.parents[i],
+                   cgroup.parents[i][0] ? "/" : "", de->d_name );
+
+         key.path = path;
+         c = bsearch( &key, cgroup.kids, old, sizeof( my_cgroup ), my_cgroup_cmp );
+         if (c)
+         {
+/* open it again, it may have been removed and created again */
+            if (c->fd == -2)
+               c->fd = -1;
+            c->seen = TRUE;
+            continue;
+         }
+
+         if (cgroup.nkids == cgroup.kids_size)
+         {
+            n = cgroup.kids_size ? 2 * cgroup.kids_size : 64;
+            kids = realloc( cgroup.kids, n * sizeof( my_cgroup ) );
+            if (kids == NULL)
+               break;
+            cgroup.kids = kids;
+            cgroup.kids_size = n;
+         }
+
+         c = &cgroup.kids[cgroup.nkids];
+         memset( c, 0, sizeof( *c ) );
+         c->fd = -1;
+         c->seen = TRUE;
+         c->path = strdup( path );
+         c->name = my_cgroup_name( path );
+         if ((c->path == NULL) || (c->name == NULL))
+         {
+            my_cgroup_close( c );
+            break;
+         }
+         cgroup.nkids++;
+      }
+
+      closedir( dir );
+   }
+
+/* drop the removed ones */
+   for (i = n = 0;  i < cgroup.nkids;  i++)
+   {
+      if (cgroup.kids[i].seen)
+         cgroup.kids[n++] = cgroup.kids[i];
+      else
+         my_cgroup_close( &cgroup.kids[i] );
+   }
+   cgroup.nkids = n;
+
+   qsort( cgroup.kids, cgroup.nkids, sizeof( my_cgroup ), my_cgroup_cmp );
+}
+
+
+
+static void
+cgroup_init( void )
+{
+   char *list, *tok, *save, *p;
+   size_t len;
+
+
+   if ((cgroups_param == NULL) || (*cgroups_param == '\0'))
+      return;
+
+   if (! my_fileexists( CGROUP_ROOT "/cgroup.controllers" ))
+   {
+      err_msg( "cgroup_init() found no cgroup v2 hierarchy at %s, disabling it", CGROUP_ROOT );
+      return;
+   }
+
+   list = strdup( cgroups_param );
+   if (list == NULL)
+      return;
+
+   len = strlen( list ) / 2 + 1;
+   cgroup.fixed = calloc( len, sizeof( my_cgroup ) );
+   cgroup.parents = calloc( len, sizeof( char * ) );
+   if ((cgroup.fixed == NULL) || (cgroup.parents == NULL))
+   {
+      free( list );
+      return;
+   }
+
+   for (tok = strtok_r( list, " ,\t", &save );  tok;  tok = strtok_r( NULL, " ,\t", &save ))
+   {
+      while (*tok == '/')
+         tok++;
+
+      len = strlen( tok );
+      while ((len > 0) && (tok[len-1] == '/'))
+         tok[--len] = '\0';
+
+/* last component "*", all children of the parent */
+      if ((len > 0) && (tok[len-1] == '*'))
+      {
+         tok[--len] = '\0';
+         while ((len > 0) && (tok[len-1] == '/'))
+            tok[--len] = '\0';
+         if ((p = strdup( tok )))
+            cgroup.parents[cgroup.nparents++] = p;
+      }
+      else if (len > 0)
+      {
+         cgroup.fixed[cgroup.nfixed].fd = -1;
+         cgroup.fixed[cgroup.nfixed].path = strdup( tok );
+         cgroup.fixed[cgroup.nfixed].name = my_cgroup_name( tok );
+         if (cgroup.fixed[cgroup.nfixed].path && cgroup.fixed[cgroup.nfixed].name)
+            cgroup.nfixed++;
+         else
+            my_cgroup_close( &cgroup.fixed[cgroup.nfixed] );
+      }
+   }
+
+   free( list );
+
+   cgroup.root.path = strdup( "" );
+   cgroup.root.fd = -1;
+
+   cgroup.ctx = ibmpower_open();
+   if ((cgroup.ctx == NULL) || (cgroup.root.path == NULL))
+   {
+      err_msg( "cgroup_init() cannot create the libibmpower context" );
+      return;
+   }
+
+   cgroup.clk_tck = sysconf( _SC_CLK_TCK );
+   if (cgroup.clk_tck <= 0)
+      cgroup.clk_tck = 100;
+
+   cgroup.enabled = TRUE;
+}
+
+
+
+static void
+cgroup_cleanup( void )
+{
+   int i;
+
+
+   for (i = 0;  i < cgroup.nfixed;  i++)
+      my_cgroup_close( &cgroup.fixed[i] );
+   for (i = 0;  i < cgroup.nkids;  i++)
+      my_cgroup_close( &cgroup.kids[i] );
+   for (i = 0;  i < cgroup.nparents;  i++)
+      free( cgroup.parents[i] );
+   my_cgroup_close( &cgroup.root );
+
+   free( cgroup.fixed );
+   free( cgroup.kids );
+   free( cgroup.parents );
+   cgroup.fixed = cgroup.kids = NULL;
+   cgroup.parents = NULL;
+   cgroup.nfixed = cgroup.nkids = cgroup.kids_size = cgroup.nparents = 0;
+
+   ibmpower_close( cgroup.ctx );
+   cgroup.ctx = NULL;
+   cgroup.enabled = FALSE;
+}
+
+
+
+/* the physical cores of one cgroup from its share of the busy time */
+static void
+cgroup_update_one( my_cgroup *c, double busy_usec, double physc )
+{
+   unsigned long long usage;
+   double share;
+
+
+   if (! my_cgroup_usage( c, &usage ))
+   {
+      c->physc = 0.0;
+      c->primed = FALSE;
+      return;
+   }
+
+   if (c->primed && (usage >= c->usage) && (busy_usec > 0.0))
+   {
+      share = (usage - c->usage) / busy_usec;
+      c->physc = (share < 1.0 ? share : 1.0) * physc;
+   }
+   else
+      c->physc = 0.0;
+
+   c->usage = usage;
+   c->primed = TRUE;
+}
+
+
+
+static void
+cgroup_update( void )
+{
+   ibmpower_snapshot snap, prev;
+   unsigned long long root_usage, busy;
+   double busy_usec = 0.0, physc;
+   char entry[MAX_G_STRING_SIZE];
+   int top[CGROUP_TOP], ntop, i, j;
+   size_t len;
+   time_t t;
+
+
+   t = time( NULL );
+   if ((! cgroup.enabled) || (t == cgroup.last_read))
+      return;
+   cgroup.last_read = t;
+
+   if ((cgroup.nparents > 0) && (t - cgroup.last_scan >= CGROUP_RESCAN))
+   {
+      cgroup_scan();
+      cgroup.last_scan = t;
+   }
+
+/* the physical cores used right before the cgroups are read */
+   prev = cgroup.rates.last;
+   ibmpower_sample( cgroup.ctx, IBMPOWER_SAMPLE_LPAR | IBMPOWER_SAMPLE_CPU, &snap );
+   ibmpower_rates_update( cgroup.ctx, &cgroup.rates, &snap );
+   physc = (cgroup.rates.interval > 0.0) ? cgroup.rates.physc : 0.0;
+
+/* busy logical time, /proc/stat jiffies without the root cgroup's cpu.stat */
+   if (my_cgroup_usage( &cgroup.root, &root_usage ))
+   {
+      if (cgroup.root.primed && (root_usage >= cgroup.root.usage))
+         busy_usec = (double) (root_usage - cgroup.root.usage);
+      cgroup.root.usage = root_usage;
+      cgroup.root.primed = TRUE;
+   }
+   else if ((snap.valid & prev.valid & IBMPOWER_SAMPLE_CPU) && (snap.cpu_total >= prev.cpu_total))
+   {
+      busy = (snap.cpu_total - prev.cpu_total) -
+             (snap.cpu_idle - prev.cpu_idle) - (snap.cpu_steal - prev.cpu_steal);
+      if ((long long) busy > 0LL)
+         busy_usec = 1000000.0 * busy / cgroup.clk_tck;
+   }
+
+   for (i = 0;  i < cgroup.nfixed;  i++)
+      cgroup_update_one( &cgroup.fixed[i], busy_usec, physc );
+
+   cgroup.count = 0;
+   cgroup.physc = 0.0;
+
+   for (ntop = 0, i = 0;  i < cgroup.nkids;  i++)
+   {
+      cgroup_update_one( &cgroup.kids[i], busy_usec, physc );
+
+      if (cgroup.kids[i].fd < 0)
+         continue;
+
+      cgroup.count++;
+      cgroup.physc += cgroup.kids[i].physc;
+
+      if (cgroup.kids[i].physc <= 0.0)
+         continue;
+
+/* insert into the top list, highest first */
+      if ((ntop == CGROUP_TOP) && (cgroup.kids[top[ntop-1]].physc >= cgroup.kids[i].physc))
+         continue;
+      if (ntop < CGROUP_TOP)
+         ntop++;
+
+      for (j = ntop - 1;  (j > 0) && (cgroup.kids[top[j-1]].physc < cgroup.kids[i].physc);  j--)
+         top[j] = top[j-1];
+      top[j] = i;
+   }
+
+   cgroup.top[0] = '\0';
+
+   for (len = 0, i = 0;  i < ntop;  i++)
+   {
+      snprintf( entry, sizeof( entry ), "%s%s=%.2f", i ? "," : "",
+                cgroup.kids[top[i]].name, cgroup.kids[top[i]].physc );
+
+/* only whole entries */
+      if (len + strlen( entry ) >= MAX_G_STRING_SIZE)
+         break;
+
+      strcpy( cgroup.top + len, entry );
+      len += strlen( entry );
+   }
+}
+
+
+
+g_val_t
+cgroup_count_func( void )
+{
+   g_val_t val;
+
+
+   cgroup_update();
+
+   val.uint32 = cgroup.count;
+
+   return( val );
+}
+
+
+
+g_val_t
+cgroup_physc_func( void )
+{
+   g_val_t val;
+
+
+   cgroup_update();
+
+   val.f = cgroup.physc;
+
+   return( val );
+}
+
+
+
+g_val_t
+cgroup_top_func( void )
+{
+   g_val_t val;
+
+
+   if (cgroup.enabled)
+   {
+      cgroup_update();
+      strcpy( val.str, cgroup.top[0] ? cgroup.top : "none" );
+   }
+   else
+      strcpy( val.str, "cgroups not configured" );
+
+   return( val );
+}
+
+
+
+/*
+ * The part of the metric name cgroup_<id>_physc for a listed cgroup, path
+ * with every character but letters and digits turned into '_'.  A path
+ * which does not fit into len, or with hashed set, is cut and gets the
+ * FNV-1a hash of the whole path appended, so two paths which only differ
+ * in the cut off part or in the replaced characters keep apart.
+ */
+static void
+cgroup_metric_id( char *id, size_t len, const char *path, int hashed )
+{
+   unsigned int hash = 2166136261u;
+   const char *q;
+   size_t i, n;
+
+
+   for (q = path;  *q;  q++)
+      hash = (hash ^ (unsigned char) *q) * 16777619u;
+
+   n = strlen( path );
+   if (n >= len)
+      hashed = TRUE;
+
+/* room for "_" and 8 hex digits */
+   if (hashed && (n > len - 10))
+      n = len - 10;
+
+   for (i = 0;  i < n;  i++)
+      id[i] = isalnum( (unsigned char) path[i] ) ? path[i] : '_';
+   id[n] = '\0';
+
+   if (hashed)
+      snprintf( id + n, len - n, "_%08x", hash );
+}
+
+
+
+/* physical cores used by the listed cgroup n */
+static g_val_t
+cgroup_fixed_physc_func( int n )
+{
+   g_val_t val;
+
+
+   cgroup_update();
+
+   val.f = cgroup.fixed[n].physc;
+
+   return( val );
+}
+
+
+
+/* number of CPU add/remove/online/offline events seen since gmond started */
+g_val_t
+dlpar_cpu_events_func( void )
+{
+   g_val_t val;
+
+
+   cpu_topo_update();
+
+   val.uint32 = cpu_topo.events;
+
+   return( val );
+}
+
+
+
+/*
+ * NUMA placement from /sys/devices/system/node.  It is only determined
+ * again when the CPU topology cache has seen a hotplug event or the LPAR
+ * has been moved to another system (serial_number in lparcfg changed).
+ *
+ * The spread is the effective number of nodes 1 / sum(share^2), i.e. 1.0
+ * if everything is on one node and n if it is spread evenly over n nodes.
+ */
+#define MAX_NUMA_NODES 256
+
+static struct
+{
+   int valid;
+   unsigned int generation;
+   char serial[MAX_G_STRING_SIZE];
+   int nodes;
+   int cpu_nodes;
+   int mem_nodes;
+   float cpu_spread;
+   float mem_spread;
+   char cpus[MAX_G_STRING_SIZE];
+   char memory[MAX_G_STRING_SIZE];
+} numa;
+
+
+
+static int
+numa_lpar_migrated( void )
+{
+   char serial[MAX_G_STRING_SIZE], *p;
+   int len;
+
+
+   p = my_lparcfg_find( "serial_number=" );
+   if (p == NULL)
+      return( FALSE );
+
+   len = strcspn( p, "\n" );
+   if (len > MAX_G_STRING_SIZE - 1)
+      len = MAX_G_STRING_SIZE - 1;
+   strncpy( serial, p, len );
+   serial[len] = '\0';
+
+   if (! strcmp( serial, numa.serial ))
+      return( FALSE );
+
+   strcpy( numa.serial, serial );
+
+   return( TRUE );
+}
+
+
+
+static void
+numa_scan( void )
+{
+   static int cpus[MAX_NUMA_NODES];
+   static double mem_kb[MAX_NUMA_NODES];
+   char map[MAX_NUMA_NODES], buf[4096], path[128], *p;
+   double cpu_total, mem_total, cpu_sum, mem_sum;
+   int n, len_c, len_m;
+
+
+   numa.valid = FALSE;
+   numa.nodes = numa.cpu_nodes = numa.mem_nodes = 0;
+   numa.cpu_spread = numa.mem_spread = 0.0;
+   strcpy( numa.cpus, "" );
+   strcpy( numa.memory, "" );
+
+   if (! my_read_line( "/sys/devices/system/node/online", buf, sizeof( buf ) ))
+      return;
+
+   numa.nodes = my_parse_cpu_list( buf, map, MAX_NUMA_NODES );
+
+   cpu_total = mem_total = 0.0;
+
+   for (n = 0;  n < MAX_NUMA_NODES;  n++)
+   {
+      cpus[n] = 0;
+      mem_kb[n] = 0.0;
+
+      if (! map[n])
+         continue;
+
+      snprintf( path, sizeof( path ), "/sys/devices/system/node/node%d/cpulist", n );
+      if (my_read_line( path, buf, sizeof( buf ) ))
+         cpus[n] = my_count_cpu_list( buf );
+
+/* first line is "Node <n> MemTotal:       <kb> kB" */
+      snprintf( path, sizeof( path ), "/sys/devices/system/node/node%d/meminfo", n );
+      if (my_read_line( path, buf, sizeof( buf ) ) && (p = strstr( buf, "MemTotal:" )))
+         mem_kb[n] = strtod( p+9, (char **) NULL );
+
+      cpu_total += cpus[n];
+      mem_total += mem_kb[n];
+   }
+
+   cpu_sum = mem_sum = 0.0;
+   len_c = len_m = 0;
+
+   for (n = 0;  n < MAX_NUMA_NODES;  n++)
+   {
+      if (cpus[n] > 0)
+      {
+         numa.cpu_nodes++;
+         cpu_sum += (cpus[n] / cpu_total) * (cpus[n] / cpu_total);
+
+         if (len_c < MAX_G_STRING_SIZE)
+            len_c += snprintf( numa.cpus + len_c, MAX_G_STRING_SIZE - len_c, "%s%d:%d",
+                               len_c ? " " : "", n, cpus[n] );
+      }
+
+      if (mem_kb[n] > 0.0)
+      {
+         numa.mem_nodes++;
+         mem_sum += (mem_kb[n] / mem_total) * (mem_kb[n] / mem_total);
+
+         if (len_m < MAX_G_STRING_SIZE)
+            len_m += snprintf( numa.memory + len_m, MAX_G_STRING_SIZE - len_m, "%s%d:%.0fG",
+                               len_m ? " " : "", n, mem_kb[n] / 1024.0 / 1024.0 );
+      }
+   }
+
+   numa.cpu_spread = cpu_sum > 0.0 ? 1.0 / cpu_sum : 0.0;
+   numa.mem_spread = mem_sum > 0.0 ? 1.0 / mem_sum : 0.0;
+   numa.valid = TRUE;
+}
+
+
+
+static void
+numa_update( void )
+{
+   cpu_topo_update();
+
+   if ((! numa.valid) || (numa.generation != cpu_topo.generation) || numa_lpar_migrated())
+   {
+      numa_scan();
+      numa.generation = cpu_topo.generation;
+   }
+}
+
+
+
+g_val_t
+numa_nodes_func( void )
+{
+   g_val_t val;
+
+
+   numa_update();
+
+   val.int32 = numa.valid ? numa.nodes : -1;
+
+   return( val );
+}
+
+
+
+g_val_t
+numa_cpu_nodes_func( void )
+{
+   g_val_t val;
+
+
+   numa_update();
+
+   val.int32 = numa.valid ? numa.cpu_nodes : -1;
+
+   return( val );
+}
+
+
+
+g_val_t
+numa_mem_nodes_func( void )
+{
+   g_val_t val;
+
+
+   numa_update();
+
+   val.int32 = numa.valid ? numa.mem_nodes : -1;
+
+   return( val );
+}
+
+
+
+g_val_t
+numa_cpu_spread_func( void )
+{
+   g_val_t val;
+
+
+   numa_update();
+
+   val.f = numa.cpu_spread;
+
+   return( val );
+}
+
+
+
+g_val_t
+numa_mem_spread_func( void )
+{
+   g_val_t val;
+
+
+   numa_update();
+
+   val.f = numa.mem_spread;
+
+   return( val );
+}
+
+
+
+g_val_t
+numa_cpus_func( void )
+{
+   g_val_t val;
+
+
+   numa_update();
+
+   strcpy( val.str, numa.valid ? numa.cpus : "No NUMA information" );
+
+   return( val );
+}
+
+
+
+g_val_t
+numa_memory_func( void )
+{
+   g_val_t val;
+
+
+   numa_update();
+
+   strcpy( val.str, numa.valid ? numa.memory : "No NUMA information" );
+
+   return( val );
+}
+
+
+
+/*
+ * OCC sensors of a PowerNV (bare-metal OPAL) host.  The ibmpowernv resp.
+ * occ hwmon directories are searched once at init, the sensor files are
+ * kept open and all of them are re-read with pread() at most once per
+ * second.  Power is reported by hwmon in micro-Watts, temperatures in
+ * milli-degrees Celsius and frequencies in MHz.
+ */
+#define MAX_OCC_SENSORS 1024
+#define MAX_OCC_SOCKETS 16
+
+enum { OCC_SYSTEM_POWER, OCC_SOCKET_POWER, OCC_CORE_TEMP, OCC_FREQ };
+
+typedef struct
+{
+   int fd;
+   int kind;
+   int socket;
+} my_occ_sensor;
+
+static struct
+{
+   int nsensors;
+   my_occ_sensor sensor[MAX_OCC_SENSORS];
+   int socket_seen[MAX_OCC_SOCKETS];
+   int cpufreq_fd;          /* fallback if there are no freq sensors */
+   time_t last_read;
+
+   double system_power;
+   double socket_power[MAX_OCC_SOCKETS];
+   double core_temp_max;
+   double freq;
+} occ = { 0 };
+
+
+
+static int
+occ_sensor_kind( const char *type, const char *label, int *socket )
+{
+   const char *p;
+
+
+   *socket = -1;
+
+   if (! strcmp( type, "freq" ))
+      return( OCC_FREQ );
+
+   if (! strcmp( type, "temp" ))
+      return( strncmp( label, "Core", 4 ) == 0 ? OCC_CORE_TEMP : -1 );
+
+   if (strcmp( type, "power" ))
+      return( -1 );
+
+   if (strncmp( label, "System", 6 ) == 0)
+      return( OCC_SYSTEM_POWER );
+
+/* socket power is labeled "Proc <n>", "Chip <n>" or "Socket <n>" */
+   if ((strncmp( label, "Proc ", 5 ) == 0) || (strncmp( label, "Chip ", 5 ) == 0))
+      p = label + 5;
+   else if (strncmp( label, "Socket ", 7 ) == 0)
+      p = label + 7;
+   else
+      return( -1 );
+
+   if ((*p < '0') || (*p > '9') || (strchr( p, ' ' ) != NULL))
+      return( -1 );
+
+   *socket = atoi( p );
+
+   return( *socket < MAX_OCC_SOCKETS ? OCC_SOCKET_POWER : -1 );
+}
+
+
+
+static void
+occ_scan_hwmon( const char *dir )
+{
+   DIR *d;
+   struct dirent *de;
+   char path[PATH_MAX], label[128], type[16];
+   int n, kind, socket, fd;
+
+
+   d = opendir( dir );
+   if (d == NULL)
+      return;
+
+   while ((de = readdir( d )) && (occ.nsensors < MAX_OCC_SENSORS))
+   {
+      if ((sscanf( de->d_name, "%15[a-z]%d_input", type, &n ) != 2) ||
+          (strstr( de->d_name, "_input" ) == NULL))
+         continue;
+
+      if (! my_path( path, sizeof( path ), "%s/%s%d_label", dir, type, n ))
+         continue;
+      if (! my_read_line( path, label, sizeof( label ) ))
+         strcpy( label, "" );
+
+      kind = occ_sensor_kind( type, label, &socket );
+      if (kind < 0)
+         continue;
+
+      if (! my_path( path, sizeof( path ), "%s/%s", dir, de->d_name ))
+         continue;
+      fd = open( path, O_RDONLY | O_CLOEXEC );
+      if (fd < 0)
+         continue;
+
+      occ.sensor[occ.nsensors].fd = fd;
+      occ.sensor[occ.nsensors].kind = kind;
+      occ.sensor[occ.nsensors].socket = socket;
+      occ.nsensors++;
+
+      if (kind == OCC_SOCKET_POWER)
+         occ.socket_seen[socket] = TRUE;
+   }
+
+   closedir( d );
+}
+
+
+
+static void
+occ_init( void )
+{
+   DIR *d;
+   struct dirent *de;
+   char path[PATH_MAX], name[64];
+   int i, have_freq;
+
+
+   occ.cpufreq_fd = -1;
+
+   if (KVM_Mode != 2)
+      return;
+
+   d = opendir( "/sys/class/hwmon" );
+   if (d == NULL)
+      return;
+
+   while ((de = readdir( d )))
+   {
+      if (de->d_name[0] == '.')
+         continue;
+
+      if ((! my_path( path, sizeof( path ), "/sys/class/hwmon/%s/name", de->d_name )) ||
+          (! my_read_line( path, name, sizeof( name ) )))
+         continue;
+
+      if (((strcmp( name, "ibmpowernv" ) == 0) || (strstr( name, "occ" ) != NULL)) &&
+          my_path( path, sizeof( path ), "/sys/class/hwmon/%s", de->d_name ))
+         occ_scan_hwmon( path );
+   }
+
+   closedir( d );
+
+   for (i = 0, have_freq = FALSE;  i < occ.nsensors;  i++)
+      if (occ.sensor[i].kind == OCC_FREQ)
+         have_freq = TRUE;
+
+   if (! have_freq)
+      occ.cpufreq_fd = open( "/sys/devices/system/cpu/cpufreq/policy0/scaling_cur_freq", O_RDONLY | O_CLOEXEC );
+}
+
+
+
+static void
+occ_cleanup( void )
+{
+   int i;
+
+
+   for (i = 0;  i < occ.nsensors;  i++)
+      close( occ.sensor[i].fd );
+
+   occ.nsensors = 0;
+
+   if (occ.cpufreq_fd >= 0)
+      close( occ.cpufreq_fd );
+
+   occ.cpufreq_fd = -1;
+}
+
+
+
+static double
+occ_read_fd( int fd )
+{
+   char buf[32];
+   ssize_t len;
+
+
+   len = pread( fd, buf, sizeof( buf ) - 1, 0 );
+   if (len <= 0)
+      return( -1.0 );
+
+   buf[len] = '\0';
+
+   return( strtod( buf, (char **) NULL ) );
+}
+
+
+
+static void
+occ_update( void )
+{
+   my_occ_sensor *s;
+   double v, freq_sum;
+   time_t now;
+   int i, freq_count;
+
+
+   now = time( NULL );
+   if (now == occ.last_read)
+      return;
+   occ.last_read = now;
+
+   occ.system_power = occ.core_temp_max = occ.freq = 0.0;
+   for (i = 0;  i < MAX_OCC_SOCKETS;  i++)
+      occ.socket_power[i] = 0.0;
+
+   freq_sum = 0.0;
+   freq_count = 0;
+
+   for (i = 0;  i < occ.nsensors;  i++)
+   {
+      s = &occ.sensor[i];
+
+      v = occ_read_fd( s->fd );
+      if (v < 0.0)
+         continue;
+
+      switch (s->kind)
+      {
+         case OCC_SYSTEM_POWER:
+            occ.system_power += v / 1000000.0;
+            break;
+         case OCC_SOCKET_POWER:
+            occ.socket_power[s->socket] += v / 1000000.0;
+            break;
+         case OCC_CORE_TEMP:
+            if (v / 1000.0 > occ.core_temp_max)
+               occ.core_temp_max = v / 1000.0;
+            break;
+         case OCC_FREQ:
+            if (v > 0.0)
+            {
+               freq_sum += v;
+               freq_count++;
+            }
+            break;
+      }
+   }
+
+   if (freq_count > 0)
+      occ.freq = freq_sum / freq_count;
+   else if (occ.cpufreq_fd >= 0)
+   {
+/* cpufreq reports kHz */
+      v = occ_read_fd( occ.cpufreq_fd );
+      occ.freq = v > 0.0 ? v / 1000.0 : 0.0;
+   }
+}
+
+
+
+g_val_t
+occ_system_power_func( void )
+{
+   g_val_t val;
+
+
+   occ_update();
+
+   val.f = occ.system_power;
+
+   return( val );
+}
+
+
+
+g_val_t
+occ_core_temp_max_func( void )
+{
+   g_val_t val;
+
+
+   occ_update();
+
+   val.f = occ.core_temp_max;
+
+   return( val );
+}
+
+
+
+g_val_t
+occ_freq_func( void )
+{
+   g_val_t val;
+
+
+   occ_update();
+
+   val.f = occ.freq;
+
+   return( val );
+}
+
+
+
+/* power of one socket, one metric per socket found at init */
+static g_val_t
+occ_socket_power_func( int socket )
+{
+   g_val_t val;
+
+
+   occ_update();
+
+   val.f = occ.socket_power[socket];
+
+   return( val );
+}
+
+
+
+/*
+ * Virtual network adapters: ibmveth (virtual Ethernet), ibmvnic (vNIC) and
+ * SR-IOV logical ports (VFs).  The interfaces are enumerated once at init,
+ * their statistics files are kept open and the driver statistics are
+ * fetched with one ETHTOOL_GSTATS ioctl per interface, all at most once
+ * per second.  The interesting ethtool counters are looked up by name at
+ * init:
+ *   ibmveth: rx_no_buffer, replenish_add_buff_failure, replenish_no_mem
+ *   ibmvnic: tx<n>_dropped_packets of every queue
+ */
+#define MAX_VNET_IFS     64
+#define MAX_VNET_QUEUES  64
+
+enum { VNET_IBMVETH, VNET_IBMVNIC, VNET_SRIOV };
+enum { VNET_RX_BYTES, VNET_TX_BYTES, VNET_RX_DROPS, VNET_TX_DROPS, VNET_FILES };
+
+static const char *vnet_files[VNET_FILES] =
+   { "rx_bytes", "tx_bytes", "rx_dropped", "tx_dropped" };
+
+typedef struct
+{
+   char name[IFNAMSIZ];
+   int type;
+   int fd[VNET_FILES];
+   struct ethtool_stats *estats;
+   int idx_no_buffer;
+   int idx_replenish_failure;
+   int idx_replenish_no_mem;
+   int nqueues;
+   int idx_queue_drops[MAX_VNET_QUEUES];
+} my_vnet_if;
+
+static struct
+{
+   int nifs;
+   my_vnet_if ifs[MAX_VNET_IFS];
+   int sock;
+   int pool_buffers;
+   time_t last_read;
+
+/* sums over all interfaces of the last round */
+   long long total[VNET_FILES];
+   long long no_buffer;
+   long long replenish_failures;
+   long long queue_drops;
+} vnet = { 0 };
+
+
+
+static int
+vnet_driver_type( const char *ifname )
+{
+   char path[256], link[256], *drv;
+   ssize_t len;
+
+
+   snprintf( path, sizeof( path ), "/sys/class/net/%s/device/driver", ifname );
+
+   len = readlink( path, link, sizeof( link ) - 1 );
+   if (len <= 0)
+      return( -1 );
+   link[len] = '\0';
+
+   drv = strrchr( link, '/' );
+   drv = drv ? drv + 1 : link;
+
+   if (! strcmp( drv, "ibmveth" ))
+      return( VNET_IBMVETH );
+
+   if (! strcmp( drv, "ibmvnic" ))
+      return( VNET_IBMVNIC );
+
+/* an SR-IOV logical port is a virtual function of some PCI adapter */
+   snprintf( path, sizeof( path ), "/sys/class/net/%s/device/physfn", ifname );
+   len = strlen( drv );
+   if (my_fileexists( path ) || ((len > 2) && (! strcmp( drv + len - 2, "vf" ))))
+      return( VNET_SRIOV );
+
+   return( -1 );
+}
+
+
+
+/* look up the ethtool counters of interest by name */
+static void
+vnet_init_ethtool( my_vnet_if *vi )
+{
+   struct ethtool_drvinfo drvinfo;
+   struct ethtool_gstrings *strings;
+   struct ifreq ifr;
+   char *name;
+   unsigned int i;
+   int q;
+
+
+   vi->estats = NULL;
+   vi->idx_no_buffer = vi->idx_replenish_failure = vi->idx_replenish_no_mem = -1;
+   vi->nqueues = 0;
+
+   if (vnet.sock < 0)
+      return;
+
+   memset( &ifr, 0, sizeof( ifr ) );
+   strncpy( ifr.ifr_name, vi->name, IFNAMSIZ - 1 );
+
+   memset( &drvinfo, 0, sizeof( drvinfo ) );
+   drvinfo.cmd = ETHTOOL_GDRVINFO;
+   ifr.ifr_data = (void *) &drvinfo;
+
+   if ((ioctl( vnet.sock, SIOCETHTOOL, &ifr ) < 0) || (drvinfo.n_stats == 0))
+      return;
+
+   strings = calloc( 1, sizeof( *strings ) + drvinfo.n_stats * ETH_GSTRING_LEN );
+   if (strings == NULL)
+      return;
+
+   strings->cmd = ETHTOOL_GSTRINGS;
+   strings->string_set = ETH_SS_STATS;
+   strings->len = drvinfo.n_stats;
+   ifr.ifr_data = (void *) strings;
+
+   if (ioctl( vnet.sock, SIOCETHTOOL, &ifr ) == 0)
+   {
+      for (i = 0;  i < strings->len;  i++)
+      {
+         name = (char *) strings->data + i * ETH_GSTRING_LEN;
+         name[ETH_GSTRING_LEN - 1] = '\0';
+
+         if (! strcmp( name, "rx_no_buffer" ))
+            vi->idx_no_buffer = i;
+         else if (! strcmp( name, "replenish_add_buff_failure" ))
+            vi->idx_replenish_failure = i;
+         else if (! strcmp( name, "replenish_no_mem" ))
+            vi->idx_replenish_no_mem = i;
+         else if ((sscanf( name, "tx%d_dropped_packets", &q ) == 1) &&
+                  (vi->nqueues < MAX_VNET_QUEUES))
+            vi->idx_queue_drops[vi->nqueues++] = i;
+      }
+
+      if ((vi->idx_no_buffer >= 0) || (vi->idx_replenish_failure >= 0) ||
+          (vi->idx_replenish_no_mem >= 0) || (vi->nqueues > 0))
+      {
+         vi->estats = calloc( 1, sizeof( *vi->estats ) + strings->len * sizeof( __u64 ) );
+         if (vi->estats)
+         {
+            vi->estats->cmd = ETHTOOL_GSTATS;
+            vi->estats->n_stats = strings->len;
+         }
+      }
+   }
+
+   free( strings );
+}
+
+
+
+/* sum of the buffers of all active ibmveth receive buffer pools */
+static int
+vnet_veth_pool_buffers( const char *ifname )
+{
+   char path[256], buf[32];
+   int pool, buffers = 0;
+
+
+   for (pool = 0;  pool < 8;  pool++)
+   {
+      snprintf( path, sizeof( path ), "/sys/class/net/%s/device/pool%d/active", ifname, pool );
+      if (! my_read_line( path, buf, sizeof( buf ) ))
+         break;
+
+      if (atoi( buf ) != 1)
+         continue;
+
+      snprintf( path, sizeof( path ), "/sys/class/net/%s/device/pool%d/num", ifname, pool );
+      if (my_read_line( path, buf, sizeof( buf ) ))
+         buffers += atoi( buf );
+   }
+
+   return( buffers );
+}
+
+
+
+static void
+vnet_init( void )
+{
+   DIR *d;
+   struct dirent *de;
+   my_vnet_if *vi;
+   char path[256];
+   int i, type;
+
+
+   vnet.sock = socket( AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+
+   d = opendir( "/sys/class/net" );
+   if (d == NULL)
+      return;
+
+   while ((de = readdir( d )) && (vnet.nifs < MAX_VNET_IFS))
+   {
+      if ((de->d_name[0] == '.') || (strlen( de->d_name ) >= IFNAMSIZ))
+         continue;
+
+      type = vnet_driver_type( de->d_name );
+      if (type < 0)
+         continue;
+
+      vi = &vnet.ifs[vnet.nifs++];
+      strcpy( vi->name, de->d_name );
+      vi->type = type;
+
+      for (i = 0;  i < VNET_FILES;  i++)
+      {
+         snprintf( path, sizeof( path ), "/sys/class/net/%s/statistics/%s", vi->name, vnet_files[i] );
+         vi->fd[i] = open( path, O_RDONLY | O_CLOEXEC );
+      }
+
+      if (type != VNET_SRIOV)
+         vnet_init_ethtool( vi );
+
+      if (type == VNET_IBMVETH)
+         vnet.pool_buffers += vnet_veth_pool_buffers( vi->name );
+   }
+
+   closedir( d );
+}
+
+
+
+static void
+vnet_cleanup( void )
+{
+   int n, i;
+
+
+   for (n = 0;  n < vnet.nifs;  n++)
+   {
+      for (i = 0;  i < VNET_FILES;  i++)
+         if (vnet.ifs[n].fd[i] >= 0)
+            close( vnet.ifs[n].fd[i] );
+
+      free( vnet.ifs[n].estats );
+   }
+
+   vnet.nifs = 0;
+
+   if (vnet.sock >= 0)
+      close( vnet.sock );
+
+   vnet.sock = -1;
+}
+
+
+
+static void
+vnet_update( void )
+{
+   my_vnet_if *vi;
+   struct ifreq ifr;
+   __u64 *data;
+   char buf[32];
+   ssize_t len;
+   time_t now;
+   int n, i;
+
+
+   now = time( NULL );
+   if (now == vnet.last_read)
+      return;
+   vnet.last_read = now;
+
+   memset( vnet.total, 0, sizeof( vnet.total ) );
+   vnet.no_buffer = vnet.replenish_failures = vnet.queue_drops = 0LL;
+
+   for (n = 0;  n < vnet.nifs;  n++)
+   {
+      vi = &vnet.ifs[n];
+
+      for (i = 0;  i < VNET_FILES;  i++)
+      {
+         if (vi->fd[i] < 0)
+            continue;
+
+         len = pread( vi->fd[i], buf, sizeof( buf ) - 1, 0 );
+         if (len > 0)
+         {
+            buf[len] = '\0';
+            vnet.total[i] += strtoll( buf, (char **) NULL, 10 );
+         }
+      }
+
+      if (vi->estats == NULL)
+         continue;
+
+      memset( &ifr, 0, sizeof( ifr ) );
+      strncpy( ifr.ifr_name, vi->name, IFNAMSIZ - 1 );
+      ifr.ifr_data = (void *) vi->estats;
+
+      if (ioctl( vnet.sock, SIOCETHTOOL, &ifr ) < 0)
+         continue;
+
+      data = vi->estats->data;
+
+      if (vi->idx_no_buffer >= 0)
+         vnet.no_buffer += data[vi->idx_no_buffer];
+      if (vi->idx_replenish_failure >= 0)
+         vnet.replenish_failures += data[vi->idx_replenish_failure];
+      if (vi->idx_replenish_no_mem >= 0)
+         vnet.replenish_failures += data[vi->idx_replenish_no_mem];
+
+      for (i = 0;  i < vi->nqueues;  i++)
+         vnet.queue_drops += data[vi->idx_queue_drops[i]];
+   }
+}
+
+
+
+static ibmpower_counter vnet_rate[VNET_FILES];
+
+static g_val_t
+vnet_rate_func( int which )
+{
+   g_val_t val;
+
+
+   vnet_update();
+
+   val.d = vnet.nifs ? ibmpower_counter_rate( &vnet_rate[which], vnet.total[which], my_time_now() ) : 0.0;
+
+   return( val );
+}
+
+
+
+g_val_t
+vnet_interfaces_func( void )
+{
+   g_val_t val;
+
+
+   val.int32 = vnet.nifs;
+
+   return( val );
+}
+
+
+
+g_val_t
+vnet_rx_bytes_func( void )
+{
+   return( vnet_rate_func( VNET_RX_BYTES ) );
+}
+
+
+
+g_val_t
+vnet_tx_bytes_func( void )
+{
+   return( vnet_rate_func( VNET_TX_BYTES ) );
+}
+
+
+
+g_val_t
+vnet_rx_drops_func( void )
+{
+   return( vnet_rate_func( VNET_RX_DROPS ) );
+}
+
+
+
+g_val_t
+vnet_tx_drops_func( void )
+{
+   return( vnet_rate_func( VNET_TX_DROPS ) );
+}
+
+
+
+g_val_t
+veth_pool_buffers_func( void )
+{
+   g_val_t val;
+
+
+   val.int32 = vnet.pool_buffers;
+
+   return( val );
+}
+
+
+
+static ibmpower_counter veth_no_buffer_rate = IBMPOWER_COUNTER_INIT;
+
+g_val_t
+veth_rx_no_buffer_func( void )
+{
+   g_val_t val;
+
+
+   vnet_update();
+
+   val.f = ibmpower_counter_rate( &veth_no_buffer_rate, vnet.no_buffer, my_time_now() );
+
+   return( val );
+}
+
+
+
+static ibmpower_counter veth_replenish_rate = IBMPOWER_COUNTER_INIT;
+
+g_val_t
+veth_replenish_failures_func( void )
+{
+   g_val_t val;
+
+
+   vnet_update();
+
+   val.f = ibmpower_counter_rate( &veth_replenish_rate, vnet.replenish_failures, my_time_now() );
+
+   return( val );
+}
+
+
+
+static ibmpower_counter vnic_queue_drop_rate = IBMPOWER_COUNTER_INIT;
+
+g_val_t
+vnic_tx_queue_drops_func( void )
+{
+   g_val_t val;
+
+
+   vnet_update();
+
+   val.f = ibmpower_counter_rate( &vnic_queue_drop_rate, vnet.queue_drops, my_time_now() );
+
+   return( val );
+}
+
+
+
+/*
+ * Virtual SCSI (ibmvscsi) and virtual Fibre Channel (ibmvfc, NPIV) host
+ * adapters.  The scsi_host entries are found once at init.  For each
+ * host the command queue depth (can_queue) and the commands outstanding
+ * (host_busy) are reported, and the I/O completions, timeouts and errors
+ * of its child devices are summed up.  Every command timeout makes the
+ * SCSI error handler abort the command and, if that fails, reset the
+ * device, target or host, so the timeouts show the aborts and resets.
+ *
+ * The per-device counters are kept open and re-read with pread().  LUNs
+ * come and go, so the device list is rebuilt every VSCSI_RESCAN_INTERVAL
+ * seconds; only the increments of each device are added to the totals of
+ * its host, so a vanishing or new LUN does not disturb the rates.
+ */
+#define MAX_VSCSI_HOSTS        64
+#define MAX_VSCSI_DEVS       1024
+#define VSCSI_RESCAN_INTERVAL (60.0)
+
+enum { VSCSI_IODONE, VSCSI_IOTMO, VSCSI_IOERR, VSCSI_DEV_FILES };
+
+static const char *vscsi_dev_files[VSCSI_DEV_FILES] =
+   { "iodone_cnt", "iotmo_cnt", "ioerr_cnt" };
+
+typedef struct
+{
+   int host;                          /* SCSI host number */
+   int vfc;                           /* ibmvfc rather than ibmvscsi */
+   int busy_fd;
+   int can_queue;
+   int busy;
+   long long total[VSCSI_DEV_FILES];  /* increments of the child devices */
+   ibmpower_counter rate[VSCSI_DEV_FILES];
+} my_vscsi_host;
+
+typedef struct
+{
+   char name[32];                     /* H:C:T:L */
+   int hidx;                          /* index into vscsi.hosts */
+   int fd[VSCSI_DEV_FILES];
+   long long last[VSCSI_DEV_FILES];
+} my_vscsi_dev;
+
+static struct
+{
+   int nhosts;
+   my_vscsi_host hosts[MAX_VSCSI_HOSTS];
+   int ndevs;
+   my_vscsi_dev devs[MAX_VSCSI_DEVS];
+   double last_scan;
+   time_t last_read;
+} vscsi = { 0 };
+
+
+
+static long long
+vscsi_read_fd( int fd )
+{
+   char buf[32];
+   ssize_t len;
+
+
+   len = pread( fd, buf, sizeof( buf ) - 1, 0 );
+   if (len <= 0)
+      return( -1LL );
+   buf[len] = '\0';
+
+/* the scsi_device counters are hexadecimal ("0x1a2b"), host_busy is decimal */
+   return( strtoll( buf, (char **) NULL, 0 ) );
+}
+
+
+
+static int
+vscsi_host_index( int host )
+{
+   int i;
+
+
+   for (i = 0;  i < vscsi.nhosts;  i++)
+      if (vscsi.hosts[i].host == host)
+         return( i );
+
+   return( -1 );
+}
+
+
+
+static void
+vscsi_close_devs( my_vscsi_dev *devs, int ndevs )
+{
+   int n, i;
+
+
+   for (n = 0;  n < ndevs;  n++)
+      for (i = 0;  i < VSCSI_DEV_FILES;  i++)
+         if (devs[n].fd[i] >= 0)
+            close( devs[n].fd[i] );
+}
+
+
+
+/* rebuild the device list, keeping the last counter values of known devices */
+static void
+vscsi_scan_devs( void )
+{
+   static my_vscsi_dev old[MAX_VSCSI_DEVS];
+   DIR *d;
+   struct dirent *de;
+   my_vscsi_dev *dv;
+   char path[PATH_MAX];
+   int nold, hidx, host, n, i;
+
+
+   vscsi.last_scan = my_time_now();
+
+   nold = vscsi.ndevs;
+   memcpy( old, vscsi.devs, nold * sizeof( my_vscsi_dev ) );
+   vscsi.ndevs = 0;
+
+   d = opendir( "/sys/class/scsi_device" );
+   if (d)
+   {
+      while ((de = readdir( d )) && (vscsi.ndevs < MAX_VSCSI_DEVS))
+      {
+         if ((sscanf( de->d_name, "%d:", &host ) != 1) ||
+             (strlen( de->d_name ) >= sizeof( dv->name )))
+            continue;
+
+         hidx = vscsi_host_index( host );
+         if (hidx < 0)
+            continue;
+
+         dv = &vscsi.devs[vscsi.ndevs++];
+         strcpy( dv->name, de->d_name );
+         dv->hidx = hidx;
+
+/* readdir() usually returns the same order, so try the same slot first */
+         n = vscsi.ndevs - 1;
+         if ((n >= nold) || strcmp( old[n].name, dv->name ))
+            for (n = 0;  (n < nold) && strcmp( old[n].name, dv->name );  n++)
+               ;
+
+         if (n < nold)
+         {
+            memcpy( dv->fd, old[n].fd, sizeof( dv->fd ) );
+            memcpy( dv->last, old[n].last, sizeof( dv->last ) );
+            old[n].name[0] = '\0';
+            for (i = 0;  i < VSCSI_DEV_FILES;  i++)
+               old[n].fd[i] = -1;
+            continue;
+         }
+
+         for (i = 0;  i < VSCSI_DEV_FILES;  i++)
+         {
+            if (my_path( path, sizeof( path ), "/sys/class/scsi_device/%s/device/%s",
+                         dv->name, vscsi_dev_files[i] ))
+               dv->fd[i] = open( path, O_RDONLY | O_CLOEXEC );
+            else
+               dv->fd[i] = -1;
+            dv->last[i] = (dv->fd[i] >= 0) ? vscsi_read_fd( dv->fd[i] ) : -1LL;
+         }
+      }
+
+      closedir( d );
+   }
+
+/* devices which have gone away */
+   vscsi_close_devs( old, nold );
+}
+
+
+
+static void
+vscsi_init( void )
+{
+   DIR *d;
+   struct dirent *de;
+   my_vscsi_host *vh;
+   char path[PATH_MAX], busy[PATH_MAX], buf[64];
+   int host, vfc;
+
+
+   d = opendir( "/sys/class/scsi_host" );
+   if (d == NULL)
+      return;
+
+   while ((de = readdir( d )) && (vscsi.nhosts < MAX_VSCSI_HOSTS))
+   {
+      if (sscanf( de->d_name, "host%d", &host ) != 1)
+         continue;
+
+/* an entry whose file names do not fit is skipped as a whole */
+      if ((! my_path( path, sizeof( path ), "/sys/class/scsi_host/%s/proc_name", de->d_name )) ||
+          (! my_path( busy, sizeof( busy ), "/sys/class/scsi_host/%s/host_busy", de->d_name )))
+         continue;
+
+      if (! my_read_line( path, buf, sizeof( buf ) ))
+         continue;
+
+      if (! strcmp( buf, "ibmvscsi" ))
+         vfc = FALSE;
+      else if (! strcmp( buf, "ibmvfc" ))
+         vfc = TRUE;
+      else
+         continue;
+
+      vh = &vscsi.hosts[vscsi.nhosts++];
+      memset( vh, 0, sizeof( *vh ) );
+      vh->host = host;
+      vh->vfc = vfc;
+
+      if (my_path( path, sizeof( path ), "/sys/class/scsi_host/%s/can_queue", de->d_name ) &&
+          my_read_line( path, buf, sizeof( buf ) ))
+         vh->can_queue = atoi( buf );
+
+/* host_busy exists since Linux 2.6.x, without it outstanding stays 0 */
+      vh->busy_fd = open( busy, O_RDONLY | O_CLOEXEC );
+   }
+
+   closedir( d );
+
+   if (vscsi.nhosts > 0)
+      vscsi_scan_devs();
+}
+
+
+
+static void
+vscsi_cleanup( void )
+{
+   int n;
+
+
+   vscsi_close_devs( vscsi.devs, vscsi.ndevs );
+   vscsi.ndevs = 0;
+
+   for (n = 0;  n < vscsi.nhosts;  n++)
+      if (vscsi.hosts[n].busy_fd >= 0)
+         close( vscsi.hosts[n].busy_fd );
+
+   vscsi.nhosts = 0;
+}
+
+
+
+static void
+vscsi_update( void )
+{
+   my_vscsi_host *vh;
+   my_vscsi_dev *dv;
+   long long value;
+   time_t now;
+   int n, i;
+
+
+   if (vscsi.nhosts == 0)
+      return;
+
+   now = time( NULL );
+   if (now == vscsi.last_read)
+      return;
+   vscsi.last_read = now;
+
+   if (my_time_now() - vscsi.last_scan >= VSCSI_RESCAN_INTERVAL)
+      vscsi_scan_devs();
+
+   for (n = 0;  n < vscsi.nhosts;  n++)
+   {
+      vh = &vscsi.hosts[n];
+
+      if (vh->busy_fd >= 0)
+      {
+         value = vscsi_read_fd( vh->busy_fd );
+         vh->busy = (value > 0LL) ? (int) value : 0;
+      }
+   }
+
+   for (n = 0;  n < vscsi.ndevs;  n++)
+   {
+      dv = &vscsi.devs[n];
+      vh = &vscsi.hosts[dv->hidx];
+
+      for (i = 0;  i < VSCSI_DEV_FILES;  i++)
+      {
+         if (dv->fd[i] < 0)
+            continue;
+
+         value = vscsi_read_fd( dv->fd[i] );
+         if (value < 0LL)
+            continue;
+
+/* the counters are 32 bits wide and wrap, a device reset may clear them */
+         if ((dv->last[i] >= 0LL) && (value >= dv->last[i]))
+            vh->total[i] += value - dv->last[i];
+         else if ((dv->last[i] >= 0LL) && (dv->last[i] - value > 0x80000000LL))
+            vh->total[i] += value + 0x100000000LL - dv->last[i];
+
+         dv->last[i] = value;
+      }
+   }
+}
+
+
+
+static ibmpower_counter vscsi_rate[VSCSI_DEV_FILES];
+
+static double
+vscsi_rate_value( int hidx, int which )
+{
+   long long total = 0LL;
+   int n;
+
+
+   vscsi_update();
+
+   if (vscsi.nhosts == 0)
+      return( 0.0 );
+
+   if (hidx >= 0)
+      return( ibmpower_counter_rate( &vscsi.hosts[hidx].rate[which], vscsi.hosts[hidx].total[which], my_time_now() ) );
+
+   for (n = 0;  n < vscsi.nhosts;  n++)
+      total += vscsi.hosts[n].total[which];
+
+   return( ibmpower_counter_rate( &vscsi_rate[which], total, my_time_now() ) );
+}
+
+
+
+g_val_t
+vscsi_hosts_func( void )
+{
+   g_val_t val;
+
+
+   val.uint32 = vscsi.nhosts;
+
+   return( val );
+}
+
+
+
+g_val_t
+vscsi_queue_depth_func( void )
+{
+   g_val_t val;
+   int n;
+
+
+   val.uint32 = 0;
+   for (n = 0;  n < vscsi.nhosts;  n++)
+      val.uint32 += vscsi.hosts[n].can_queue;
+
+   return( val );
+}
+
+
+
+g_val_t
+vscsi_outstanding_func( void )
+{
+   g_val_t val;
+   int n;
+
+
+   vscsi_update();
+
+   val.uint32 = 0;
+   for (n = 0;  n < vscsi.nhosts;  n++)
+      val.uint32 += vscsi.hosts[n].busy;
+
+   return( val );
+}
+
+
+
+/* the fullest adapter queue tells a saturated adapter from a slow LUN */
+g_val_t
+vscsi_busy_max_pct_func( void )
+{
+   g_val_t val;
+   double pct;
+   int n;
+
+
+   vscsi_update();
+
+   val.f = 0.0;
+   for (n = 0;  n < vscsi.nhosts;  n++)
+   {
+      if (vscsi.hosts[n].can_queue <= 0)
+         continue;
+
+      pct = 100.0 * vscsi.hosts[n].busy / vscsi.hosts[n].can_queue;
+      if (pct > val.f)
+         val.f = pct;
+   }
+
+   return( val );
+}
+
+
+
+g_val_t
+vscsi_iops_func( void )
+{
+   g_val_t val;
+
+
+   val.d = vscsi_rate_value( -1, VSCSI_IODONE );
+
+   return( val );
+}
+
+
+
+g_val_t
+vscsi_timeouts_func( void )
+{
+   g_val_t val;
+
+
+   val.f = vscsi_rate_value( -1, VSCSI_IOTMO );
+
+   return( val );
+}
+
+
+
+g_val_t
+vscsi_errors_func( void )
+{
+   g_val_t val;
+
+
+   val.f = vscsi_rate_value( -1, VSCSI_IOERR );
+
+   return( val );
+}
+
+
+
+/* per host metrics, the argument is the index into vscsi.hosts */
+static g_val_t
+vscsi_host_queue_depth_func( int hidx )
+{
+   g_val_t val;
+
+
+   val.uint32 = vscsi.hosts[hidx].can_queue;
+
+   return( val );
+}
+
+
+
+static g_val_t
+vscsi_host_outstanding_func( int hidx )
+{
+   g_val_t val;
+
+
+   vscsi_update();
+
+   val.uint32 = vscsi.hosts[hidx].busy;
+
+   return( val );
+}
+
+
+
+static g_val_t
+vscsi_host_iops_func( int hidx )
+{
+   g_val_t val;
+
+
+   val.d = vscsi_rate_value( hidx, VSCSI_IODONE );
+
+   return( val );
+}
+
+
+
+static g_val_t
+vscsi_host_timeouts_func( int hidx )
+{
+   g_val_t val;
+
+
+   val.f = vscsi_rate_value( hidx, VSCSI_IOTMO );
+
+   return( val );
+}
+
+
+
+static g_val_t
+vscsi_host_errors_func( int hidx )
+{
+   g_val_t val;
+
+
+   val.f = vscsi_rate_value( hidx, VSCSI_IOERR );
+
+   return( val );
+}
+
+
+
+/*
+ * Run queue sampler.  gmond calls us only once per collection interval,
+ * which would miss short bursts of runnable threads, so a helper thread
+ * samples procs_running and procs_blocked from /proc/stat every
+ * runq_sample_msec milliseconds (module parameter, default 1000) and sums
+ * them up.  The metrics return the average over the samples taken since
+ * their last call.  The thread has a libibmpower context of its own,
+ * because my_update_file() and the core context are not thread safe.
+ * With runq_sample_msec = 0 or if the thread cannot be started one sample
+ * is taken per call.
+ */
+#define RUNQ_SAMPLE_MSEC 1000
+
+static int runq_sample_msec = RUNQ_SAMPLE_MSEC;    /* param runq_sample_msec */
+
+static pthread_mutex_t runq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct
+{
+   pthread_t thread;
+   int started;
+   volatile int stop;
+   ibmpower_ctx *ctx;
+
+/* protected by runq_lock */
+   long long samples;
+   long long sum_running;
+   long long sum_blocked;
+} runq = { 0 };
+
+
+
+static void
+runq_sample( void )
+{
+   ibmpower_snapshot snap;
+   long long running, blocked;
+
+
+   if ((runq.ctx == NULL) || (ibmpower_sample( runq.ctx, IBMPOWER_SAMPLE_CPU, &snap ) != 0))
+      return;
+
+   if ((snap.procs_running < 0LL) || (snap.procs_blocked < 0LL))
+      return;
+
+/* we are running ourselves while reading /proc/stat */
+   running = snap.procs_running - 1;
+   blocked = snap.procs_blocked;
+
+   pthread_mutex_lock( &runq_lock );
+   runq.samples++;
+   runq.sum_running += (running > 0LL) ? running : 0LL;
+   runq.sum_blocked += blocked;
+   pthread_mutex_unlock( &runq_lock );
+}
+
+
+
+static void *
+runq_thread( void *arg )
+{
+   struct timespec ts;
+
+
+   ts.tv_sec = runq_sample_msec / 1000;
+   ts.tv_nsec = (runq_sample_msec % 1000) * 1000000L;
+
+   while (! runq.stop)
+   {
+      runq_sample();
+      nanosleep( &ts, (struct timespec *) NULL );
+   }
+
+   return( arg );
+}
+
+
+
+static void
+runq_init( void )
+{
+   runq.ctx = ibmpower_open();
+   if (runq.ctx == NULL)
+   {
+      err_msg( "runq_init() cannot create a libibmpower context, disabling the run queue metrics" );
+      return;
+   }
+
+   runq_sample();
+
+   if (runq_sample_msec <= 0)
+      return;
+
+   if (pthread_create( &runq.thread, (pthread_attr_t *) NULL, runq_thread, NULL ) == 0)
+      runq.started = TRUE;
+   else
+      err_msg( "runq_init() cannot start the sampler thread, sampling once per call" );
+}
+
+
+
+static void
+runq_cleanup( void )
+{
+   if (runq.started)
+   {
+      runq.stop = TRUE;
+      pthread_join( runq.thread, (void **) NULL );
+      runq.started = FALSE;
+   }
+
+   ibmpower_close( runq.ctx );
+   runq.ctx = NULL;
+}
+
+
+
+/* average number of running (or blocked) threads since the last call */
+static double
+runq_average( ibmpower_ratio *rc, int blocked )
+{
+   long long sum, samples;
+
+
+   if (! runq.started)
+      runq_sample();
+
+   pthread_mutex_lock( &runq_lock );
+   sum = blocked ? runq.sum_blocked : runq.sum_running;
+   samples = runq.samples;
+   pthread_mutex_unlock( &runq_lock );
+
+   return( ibmpower_ratio_update( rc, sum, samples ) );
+}
+
+
+
+static ibmpower_ratio runq_ec_ratio = IBMPOWER_RATIO_INIT;
+
+g_val_t
+runq_per_ec_func( void )
+{
+   g_val_t val;
+   double running, ec;
+
+
+   running = runq_average( &runq_ec_ratio, FALSE );
+   ec = cpu_entitlement_func().f;
+
+   val.f = (ec > 0.0) ? running / ec : 0.0;
+
+   return( val );
+}
+
+
+
+static ibmpower_ratio runq_vcpu_ratio = IBMPOWER_RATIO_INIT;
+
+g_val_t
+runq_per_vcpu_func( void )
+{
+   g_val_t val;
+   double running;
+   int vcpus;
+
+
+   running = runq_average( &runq_vcpu_ratio, FALSE );
+   vcpus = cpu_in_lpar_func().int32;
+
+   val.f = (vcpus > 0) ? running / vcpus : 0.0;
+
+   return( val );
+}
+
+
+
+static ibmpower_ratio runq_blocked_ratio = IBMPOWER_RATIO_INIT;
+
+g_val_t
+runq_blocked_func( void )
+{
+   g_val_t val;
+
+
+   val.f = runq_average( &runq_blocked_ratio, TRUE );
+
+   return( val );
+}
+
+
+
+/*
+ * Flight recorder.  With the module parameter flight_recorder set to a
+ * file a thread samples the libibmpower counters once per second with a
+ * context of its own and appends one record per second to the ring file
+ * (see ibmpower_recorder_open()), which keeps the last
+ * flight_recorder_hours hours (default 24, 36 bytes per second).  The
+ * file is continued across restarts of gmond, ibmpowerdump prints it.
+ */
+#define FR_HOURS 24
+
+static const char *fr_file = NULL;    /* param flight_recorder */
+static int fr_hours = FR_HOURS;       /* param flight_recorder_hours */
+
+static struct
+{
+   pthread_t thread;
+   int started;
+   volatile int stop;
+   ibmpower_ctx *ctx;
+   ibmpower_recorder *rec;
+} fr = { 0 };
+
+
+
+static void *
+fr_thread( void *arg )
+{
+   ibmpower_snapshot snap;
+   ibmpower_rates rates = IBMPOWER_RATES_INIT;
+   struct timespec ts, now;
+
+
+/* absolute wake ups, so the records do not drift */
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+
+   while (! fr.stop)
+   {
+      ibmpower_sample( fr.ctx, IBMPOWER_SAMPLE_ALL, &snap );
+      ibmpower_rates_update( fr.ctx, &rates, &snap );
+      ibmpower_recorder_write( fr.rec, &rates );
+
+/* do not catch up on seconds missed while the system was stalled */
+      ts.tv_sec++;
+      clock_gettime( CLOCK_MONOTONIC, &now );
+      if (now.tv_sec > ts.tv_sec)
+         ts = now;
+
+      while ((clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, (struct timespec *) NULL ) == EINTR) &&
+             (! fr.stop))
+         ;
+   }
+
+   return( arg );
+}
+
+
+
+static void
+fr_init( void )
+{
+   if ((fr_file == NULL) || (*fr_file == '\0'))
+      return;
+
+   if (fr_hours <= 0)
+      fr_hours = FR_HOURS;
+
+   fr.rec = ibmpower_recorder_open( fr_file, (unsigned int) fr_hours * 3600u );
+   if (fr.rec == NULL)
+   {
+      err_msg( "fr_init() cannot open the flight recorder file %s: %s", fr_file, strerror( errno ) );
+      return;
+   }
+
+   fr.ctx = ibmpower_open();
+   if ((fr.ctx == NULL) ||
+       (pthread_create( &fr.thread, (pthread_attr_t *) NULL, fr_thread, NULL ) != 0))
+   {
+      err_msg( "fr_init() cannot start the flight recorder" );
+      ibmpower_close( fr.ctx );
+      ibmpower_recorder_close( fr.rec );
+      fr.ctx = NULL;
+      fr.rec = NULL;
+      return;
+   }
+
+   fr.started = TRUE;
+}
+
+
+
+static void
+fr_cleanup( void )
+{
+   if (fr.started)
+   {
+      fr.stop = TRUE;
+      pthread_join( fr.thread, (void **) NULL );
+      fr.started = FALSE;
+   }
+
+   ibmpower_close( fr.ctx );
+   ibmpower_recorder_close( fr.rec );
+   fr.ctx = NULL;
+   fr.rec = NULL;
+}
+
+
+
+/*
+ * Adaptive sampler, only with adaptive_sampling = yes.  A thread samples
+ * the libibmpower counters every adaptive_slow_msec milliseconds (default
+ * 5000) with a context of its own.  It switches to every adaptive_fast_msec milliseconds (default 250)
+ * when one of the triggers fires:
+ *
+ *    - %entc is above adaptive_entc_pct (default 100)
+ *    - the shared pool has less than adaptive_pool_idle idle cores
+ *      (default 0.1), if the LPAR may see the pool
+ *    - the disk await is above adaptive_await_msec (default 20) and three
+ *      times its average while quiet
+ *
+ * After ADAPT_HOLD_SEC seconds without a trigger the interval doubles with
+ * every sample until it is the slow one again.  The peaks, the time spent
+ * sampling fast and the number of bursts are summed up for the burst
+ * metrics, each of which returns the values since its last call.  With
+ * adaptive_sampling = no, the default, the peak metrics return the
+ * averages since their last call instead.
+ */
+#define ADAPT_SLOW_MSEC   5000
+#define ADAPT_FAST_MSEC    250
+#define ADAPT_HOLD_SEC    30.0
+#define ADAPT_AWAIT_MSEC  20.0
+#define ADAPT_AWAIT_JUMP   3.0
+#define ADAPT_AWAIT_DECAY  0.1    /* weight of a new quiet await */
+
+static int adapt_enabled = FALSE;                 /* param adaptive_sampling */
+static int adapt_slow_msec = ADAPT_SLOW_MSEC;     /* param adaptive_slow_msec */
+static int adapt_fast_msec = ADAPT_FAST_MSEC;     /* param adaptive_fast_msec */
+static double adapt_entc_pct = 100.0;             /* param adaptive_entc_pct */
+static double adapt_pool_idle = 0.1;              /* param adaptive_pool_idle */
+static double adapt_await_msec = ADAPT_AWAIT_MSEC;   /* param adaptive_await_msec */
+
+enum { ADAPT_PEAK_ENTC, ADAPT_PEAK_PHYSC, ADAPT_MIN_POOL_IDLE, ADAPT_PEAK_AWAIT, ADAPT_PEAKS };
+
+static pthread_mutex_t adapt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct
+{
+   pthread_t thread;
+   int started;
+   volatile int stop;
+   ibmpower_ctx *ctx;
+   double quiet_await;
+
+/* protected by adapt_lock */
+   int interval_msec;                   /* current */
+   long long total_msec;                /* time sampled */
+   long long fast_msec;                 /* time sampled faster than slow */
+   long long bursts;                    /* switches to fast */
+   double peak[ADAPT_PEAKS];            /* since the last call of the metric */
+   int have_peak[ADAPT_PEAKS];
+} adapt = { 0 };
+
+
+
+static void
+my_adapt_peak( int i, double v, int lower )
+{
+   if ((! adapt.have_peak[i]) || (lower ? v < adapt.peak[i] : v > adapt.peak[i]))
+      adapt.peak[i] = v;
+
+   adapt.have_peak[i] = TRUE;
+}
+
+
+
+/* TRUE if the interval of r is worth a closer look */
+static int
+adapt_triggered( const ibmpower_rates *r )
+{
+   const ibmpower_snapshot *s = &r->last;
+   int await_jump;
+
+
+   if (r->entc_pct > adapt_entc_pct)
+      return( TRUE );
+
+/* pool_idle_time stays 0 without "Allow performance information collection" */
+   if ((s->valid & IBMPOWER_SAMPLE_LPAR) && (s->shared_processor_mode > 0LL) &&
+       (s->pool_idle_time > 0LL) && (r->pool_idle < adapt_pool_idle))
+      return( TRUE );
+
+   await_jump = (adapt.quiet_await <= 0.0) ||
+                (r->disk_await > ADAPT_AWAIT_JUMP * adapt.quiet_await);
+
+   return( (r->disk_await > adapt_await_msec) && await_jump );
+}
+
+
+
+static void *
+adapt_thread( void *arg )
+{
+   ibmpower_snapshot snap;
+   ibmpower_rates rates = IBMPOWER_RATES_INIT;
+   struct timespec ts;
+   double last_trigger = 0.0;
+   int interval, msec;
+
+
+   interval = adapt_slow_msec;
+
+   while (! adapt.stop)
+   {
+      ibmpower_sample( adapt.ctx, IBMPOWER_SAMPLE_ALL, &snap );
+      ibmpower_rates_update( adapt.ctx, &rates, &snap );
+
+      msec = (int) (rates.interval * 1000.0 + 0.5);
+
+      if (msec > 0)
+      {
+         if (adapt_triggered( &rates ))
+            last_trigger = snap.time;
+         else if (interval >= adapt_slow_msec)
+            adapt.quiet_await += ADAPT_AWAIT_DECAY * (rates.disk_await - adapt.quiet_await);
+
+         pthread_mutex_lock( &adapt_lock );
+
+         adapt.total_msec += msec;
+         if (interval < adapt_slow_msec)
+            adapt.fast_msec += msec;
+
+         my_adapt_peak( ADAPT_PEAK_ENTC, rates.entc_pct, FALSE );
+         my_adapt_peak( ADAPT_PEAK_PHYSC, rates.physc, FALSE );
+         my_adapt_peak( ADAPT_MIN_POOL_IDLE, rates.pool_idle, TRUE );
+         my_adapt_peak( ADAPT_PEAK_AWAIT, rates.disk_await, FALSE );
+
+/* fast while triggered and for a while after, then decay back */
+         if (last_trigger == snap.time)
+         {
+            if (interval >= adapt_slow_msec)
+               adapt.bursts++;
+            interval = adapt_fast_msec;
+         }
+         else if ((interval < adapt_slow_msec) && (snap.time - last_trigger > ADAPT_HOLD_SEC))
+         {
+            interval *= 2;
+            if (interval > adapt_slow_msec)
+               interval = adapt_slow_msec;
+         }
+
+         adapt.interval_msec = interval;
+
+         pthread_mutex_unlock( &adapt_lock );
+      }
+
+      ts.tv_sec = interval / 1000;
+      ts.tv_nsec = (interval % 1000) * 1000000L;
+      nanosleep( &ts, (struct timespec *) NULL );
+   }
+
+   return( arg );
+}
+
+
+
+static void
+adapt_init( void )
+{
+   if (! adapt_enabled)
+      return;
+
+   if (adapt_slow_msec <= 0)
+      adapt_slow_msec = ADAPT_SLOW_MSEC;
+   if ((adapt_fast_msec <= 0) || (adapt_fast_msec > adapt_slow_msec))
+      adapt_fast_msec = (ADAPT_FAST_MSEC < adapt_slow_msec) ? ADAPT_FAST_MSEC : adapt_slow_msec;
+
+   adapt.interval_msec = adapt_slow_msec;
+
+   adapt.ctx = ibmpower_open();
+   if ((adapt.ctx == NULL) ||
+       (pthread_create( &adapt.thread, (pthread_attr_t *) NULL, adapt_thread, NULL ) != 0))
+   {
+      err_msg( "adapt_init() cannot start the adaptive sampler" );
+      ibmpower_close( adapt.ctx );
+      adapt.ctx = NULL;
+      adapt.interval_msec = 0;
+      return;
+   }
+
+   adapt.started = TRUE;
+}
+
+
+
+static void
+adapt_cleanup( void )
+{
+   if (adapt.started)
+   {
+      adapt.stop = TRUE;
+      pthread_join( adapt.thread, (void **) NULL );
+      adapt.started = FALSE;
+   }
+
+   ibmpower_close( adapt.ctx );
+   adapt.ctx = NULL;
+}
+
+
+
+/* peak (or minimum) since the last call, FALSE if nothing was sampled */
+static int
+adapt_take_peak( int i, double *v )
+{
+   int have;
+
+
+   pthread_mutex_lock( &adapt_lock );
+   have = adapt.have_peak[i];
+   *v = adapt.peak[i];
+   adapt.have_peak[i] = FALSE;
+   pthread_mutex_unlock( &adapt_lock );
+
+   return( have );
+}
+
+
+
+g_val_t
+sample_interval_func( void )
+{
+   g_val_t val;
+
+
+   pthread_mutex_lock( &adapt_lock );
+   val.uint32 = (uint32_t) adapt.interval_msec;
+   pthread_mutex_unlock( &adapt_lock );
+
+   return( val );
+}
+
+
+
+static ibmpower_ratio burst_ratio = IBMPOWER_RATIO_INIT;
+
+g_val_t
+burst_pct_func( void )
+{
+   g_val_t val;
+   long long fast, total;
+
+
+   pthread_mutex_lock( &adapt_lock );
+   fast = adapt.fast_msec;
+   total = adapt.total_msec;
+   pthread_mutex_unlock( &adapt_lock );
+
+   val.f = 100.0 * ibmpower_ratio_update( &burst_ratio, fast, total );
+
+   return( val );
+}
+
+
+
+g_val_t
+bursts_func( void )
+{
+   static long long last_bursts = 0LL;
+   g_val_t val;
+   long long bursts;
+
+
+   pthread_mutex_lock( &adapt_lock );
+   bursts = adapt.bursts;
+   pthread_mutex_unlock( &adapt_lock );
+
+   val.uint32 = (uint32_t) (bursts - last_bursts);
+   last_bursts = bursts;
+
+   return( val );
+}
+
+
+
+static ibmpower_rates ec_peak_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+cpu_ec_peak_func( void )
+{
+   g_val_t val;
+   double v;
+
+
+   if (! adapt_take_peak( ADAPT_PEAK_ENTC, &v ))
+   {
+      my_core_update( &ec_peak_rates, IBMPOWER_SAMPLE_LPAR | IBMPOWER_SAMPLE_CPU );
+      v = ec_peak_rates.entc_pct;
+   }
+
+   val.f = v;
+
+   return( val );
+}
+
+
+
+static ibmpower_rates used_peak_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+cpu_used_peak_func( void )
+{
+   g_val_t val;
+   double v;
+
+
+   if (! adapt_take_peak( ADAPT_PEAK_PHYSC, &v ))
+   {
+      my_core_update( &used_peak_rates, IBMPOWER_SAMPLE_LPAR | IBMPOWER_SAMPLE_CPU );
+      v = used_peak_rates.physc;
+   }
+
+   val.f = v;
+
+   return( val );
+}
+
+
+
+static ibmpower_rates pool_idle_min_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+cpu_pool_idle_min_func( void )
+{
+   g_val_t val;
+   double v;
+
+
+   if (! adapt_take_peak( ADAPT_MIN_POOL_IDLE, &v ))
+   {
+      my_core_update( &pool_idle_min_rates, IBMPOWER_SAMPLE_LPAR );
+      v = pool_idle_min_rates.pool_idle;
+   }
+
+   val.f = v;
+
+   return( val );
+}
+
+
+
+static ibmpower_rates await_peak_rates = IBMPOWER_RATES_INIT;
+
+g_val_t
+disk_await_peak_func( void )
+{
+   g_val_t val;
+   double v;
+
+
+   if (! adapt_take_peak( ADAPT_PEAK_AWAIT, &v ))
+   {
+      my_core_update( &await_peak_rates, IBMPOWER_SAMPLE_DISK );
+      v = await_peak_rates.disk_await;
+   }
+
+   val.f = v;
+
+   return( val );
+}
+
+
+
+static int
+Running_as_KVM_Guest( void )
+{
+   char buf[128];
+
+
+   if (my_lparcfg_string( "system_type=", buf, sizeof( buf ) ) &&
+       (! strcmp( buf, "IBM pSeries (emulated by qemu)" )))
+      return( TRUE );
+
+   return( FALSE );
+}
+
+
+
+static int
+Running_as_SPLPAR( void )
+{
+   char *p;
+   int i;
+
+
+   p = my_lparcfg_find( "shared_processor_mode=" );
+
+   if (p)
+      i = strtol( p, (char **) NULL, 10 ) > 0;
+   else
+      i = FALSE;
+
+   return( i );
+}
+
+
+
+/*
+ * Declare ourselves so the configuration routines can find and know us.
+ * We'll fill it in at the end of the module.
+ */
+extern mmodule ibmpower_module;
+
+
+/*
+ * The static metrics of Linux and their functions.  The definitions are
+ * shared with AIX in ibmpower_metrics.c, which also gives the order.
+ */
+static const ibmpower_metric_func ibmpower_metric_funcs[] =
+{
+   { "capped",                  capped_func },
+   { "cpu_ec",                  cpu_ec_func },
+   { "cpu_entitlement",         cpu_entitlement_func },
+   { "cpu_in_lpar",             cpu_in_lpar_func },
+   { "cpu_in_machine",          cpu_in_machine_func },
+   { "cpu_in_pool",             cpu_in_pool_func },
+   { "cpu_in_syspool",          cpu_in_syspool_func },
+   { "cpu_pool_id",             cpu_pool_id_func },
+   { "cpu_pool_idle",           cpu_pool_idle_func },
+   { "cpu_used",                cpu_used_func },
+   { "disk_iops",               disk_iops_func },
+   { "disk_read",               disk_read_func },
+   { "disk_write",              disk_write_func },
+   { "fwversion",               fwversion_func },
+   { "kernel64bit",             kernel64bit_func },
+   { "lpar",                    lpar_func },
+   { "lpar_name",               lpar_name_func },
+   { "lpar_num",                lpar_num_func },
+   { "model_name",              model_name_func },
+   { "oslevel",                 oslevel_func },
+   { "serial_num",              serial_num_func },
+   { "smt",                     smt_func },
+   { "splpar",                  splpar_func },
+   { "weight",                  weight_func },
+   { "kvm_guest",               kvm_guest_func },
+   { "cpu_type",                cpu_type_func },
+   { "cpu_dispatches",          cpu_dispatches_func },
+   { "cpu_dispersions",         cpu_dispersions_func },
+   { "cpu_dispersion_pct",      cpu_dispersion_pct_func },
+   { "dispatch_wheel",          dispatch_wheel_func },
+   { "cpu_steal",               cpu_steal_func },
+   { "cpu_steal_pct",           cpu_steal_pct_func },
+   { "cmo_enabled",             cmo_enabled_func },
+   { "cmo_entitled_memory",     cmo_entitled_memory_func },
+   { "cmo_memory_weight",       cmo_memory_weight_func },
+   { "cmo_backing_memory",      cmo_backing_memory_func },
+   { "cmo_page_size",           cmo_page_size_func },
+   { "cmo_faults",              cmo_faults_func },
+   { "cmo_fault_time",          cmo_fault_time_func },
+   { "cmo_fault_latency",       cmo_fault_latency_func },
+   { "vcpu_disp_same_core",     vcpu_disp_same_core_func },
+   { "vcpu_disp_same_chip",     vcpu_disp_same_chip_func },
+   { "vcpu_disp_other_chip",    vcpu_disp_other_chip_func },
+   { "vcpu_disp_remote_node",   vcpu_disp_remote_node_func },
+   { "vcpu_disp_worst_pct",     vcpu_disp_worst_pct_func },
+   { "vcpu_disp_worst",         vcpu_disp_worst_func },
+   { "smt_threads",             smt_threads_func },
+   { "dlpar_cpu_events",        dlpar_cpu_events_func },
+   { "numa_nodes",              numa_nodes_func },
+   { "numa_cpu_nodes",          numa_cpu_nodes_func },
+   { "numa_mem_nodes",          numa_mem_nodes_func },
+   { "numa_cpu_spread",         numa_cpu_spread_func },
+   { "numa_mem_spread",         numa_mem_spread_func },
+   { "numa_cpus",               numa_cpus_func },
+   { "numa_memory",             numa_memory_func },
+   { "occ_system_power",        occ_system_power_func },
+   { "occ_core_temp_max",       occ_core_temp_max_func },
+   { "occ_freq",                occ_freq_func },
+   { "vnet_interfaces",         vnet_interfaces_func },
+   { "vnet_rx_bytes",           vnet_rx_bytes_func },
+   { "vnet_tx_bytes",           vnet_tx_bytes_func },
+   { "vnet_rx_drops",           vnet_rx_drops_func },
+   { "vnet_tx_drops",           vnet_tx_drops_func },
+   { "veth_pool_buffers",       veth_pool_buffers_func },
+   { "veth_rx_no_buffer",       veth_rx_no_buffer_func },
+   { "veth_replenish_failures", veth_replenish_failures_func },
+   { "vnic_tx_queue_drops",     vnic_tx_queue_drops_func },
+   { "vscsi_hosts",             vscsi_hosts_func },
+   { "vscsi_queue_depth",       vscsi_queue_depth_func },
+   { "vscsi_outstanding",       vscsi_outstanding_func },
+   { "vscsi_busy_max_pct",      vscsi_busy_max_pct_func },
+   { "vscsi_iops",              vscsi_iops_func },
+   { "vscsi_timeouts",          vscsi_timeouts_func },
+   { "vscsi_errors",            vscsi_errors_func },
+   { "runq_per_ec",             runq_per_ec_func },
+   { "runq_per_vcpu",           runq_per_vcpu_func },
+   { "runq_blocked",            runq_blocked_func },
+   { "read_timeouts",           read_timeouts_func },
+   { "read_stale",              read_stale_func },
+   { "disk_await",              disk_await_func },
+   { "sample_interval",         sample_interval_func },
+   { "burst_pct",               burst_pct_func },
+   { "bursts",                  bursts_func },
+   { "cpu_ec_peak",             cpu_ec_peak_func },
+   { "cpu_used_peak",           cpu_used_peak_func },
+   { "cpu_pool_idle_min",       cpu_pool_idle_min_func },
+   { "disk_await_peak",         disk_await_peak_func },
+   { "hcall_rate",              hcall_rate_func },
+   { "hcall_time",              hcall_time_func },
+   { "hcall_top",               hcall_top_func },
+   { "perf_mode",               perf_mode_func },
+   { "cpi",                     cpi_func },
+   { "ips",                     ips_func },
+   { "cache_mpki",              cache_mpki_func },
+   { "cache_miss_pct",          cache_miss_pct_func },
+   { "cpu_migrations",          cpu_migrations_func },
+   { "irq_rate",                irq_rate_func },
+   { "irq_cpu_max",             irq_cpu_max_func },
+   { "irq_hot_cpu",             irq_hot_cpu_func },
+   { "irq_imbalance",           irq_imbalance_func },
+   { "cgroup_count",            cgroup_count_func },
+   { "cgroup_physc",            cgroup_physc_func },
+   { "cgroup_top",              cgroup_top_func },
+   { NULL, NULL }
+};
+
+
+/*
+ * Metrics which only exist at run time, e.g. one per CPU, are appended to
+ * the static metric table in ibmpower_metric_init().  Their handler gets
+ * the per-metric argument, e.g. the CPU number.
+ */
+typedef struct
+{
+   g_val_t (*func)( int arg );
+   int arg;
+   const char *family;     /* OpenMetrics family, labels and help text */
+   const char *labels;
+   const char *help;
+} my_dynamic_metric;
+
+static apr_array_header_t *metric_info = NULL;
+static apr_array_header_t *dynamic_metrics = NULL;
+static int dynamic_metric_base = 0;
+
+
+/* module parameters from the "param" blocks in ibmpower.conf */
+static int per_cpu_steal = FALSE;
+static int openmetrics_port = 0;    /* 0 = no OpenMetrics endpoint */
+
+
+
+static int
+my_param_bool( const char *value )
+{
+   return( value && ((! strcasecmp( value, "yes" )) ||
+                     (! strcasecmp( value, "true" )) ||
+                     (! strcmp( value, "1" ))) );
+}
+
+
+
+static void
+ibmpower_read_params( void )
+{
+   mmparam *params;
+   int i;
+
+
+   if (ibmpower_module.module_params_list == NULL)
+      return;
+
+   params = (mmparam *) ibmpower_module.module_params_list->elts;
+
+   for (i = 0;  i < ibmpower_module.module_params_list->nelts;  i++)
+   {
+      if (! strcasecmp( params[i].name, "per_cpu_steal" ))
+         per_cpu_steal = my_param_bool( params[i].value );
+      else if (! strcasecmp( params[i].name, "vcpudispatch_stats" ))
+         vcpu_disp_enabled = my_param_bool( params[i].value );
+      else if (! strcasecmp( params[i].name, "runq_sample_msec" ))
+         runq_sample_msec = atoi( params[i].value );
+      else if (! strcasecmp( params[i].name, "openmetrics_port" ))
+         openmetrics_port = atoi( params[i].value );
+      else if (! strcasecmp( params[i].name, "read_timeout_msec" ))
+         read_timeout_msec = atoi( params[i].value );
+      else if (! strcasecmp( params[i].name, "flight_recorder" ))
+         fr_file = params[i].value;
+      else if (! strcasecmp( params[i].name, "flight_recorder_hours" ))
+         fr_hours = atoi( params[i].value );
+      else if (! strcasecmp( params[i].name, "adaptive_sampling" ))
+         adapt_enabled = my_param_bool( params[i].value );
+      else if (! strcasecmp( params[i].name, "adaptive_slow_msec" ))
+         adapt_slow_msec = atoi( params[i].value );
+      else if (! strcasecmp( params[i].name, "adaptive_fast_msec" ))
+         adapt_fast_msec = atoi( params[i].value );
+      else if (! strcasecmp( params[i].name, "adaptive_entc_pct" ))
+         adapt_entc_pct = strtod( params[i].value, (char **) NULL );
+      else if (! strcasecmp( params[i].name, "adaptive_pool_idle" ))
+         adapt_pool_idle = strtod( params[i].value, (char **) NULL );
+      else if (! strcasecmp( params[i].name, "adaptive_await_msec" ))
+         adapt_await_msec = strtod( params[i].value, (char **) NULL );
+      else if (! strcasecmp( params[i].name, "hcall_stats" ))
+         hcall_enabled = my_param_bool( params[i].value );
+      else if (! strcasecmp( params[i].name, "hcall_top" ))
+         hcall_top = atoi( params[i].value );
+      else if (! strcasecmp( params[i].name, "perf_counters" ))
+         perf_enabled = my_param_bool( params[i].value );
+      else if (! strcasecmp( params[i].name, "interrupt_stats" ))
+         irq_enabled = my_param_bool( params[i].value );
+      else if (! strcasecmp( params[i].name, "cgroups" ))
+         cgroups_param = params[i].value;
+   }
+}
+
+
+
+/*
+ * Add a run time metric which looks like the static metric "tmpl".  For
+ * the OpenMetrics endpoint it is a series of "family" with the given labels.
+ */
+static void
+my_add_dynamic_metric( apr_pool_t *p, const char *tmpl, const char *name,
+                       const char *desc, g_val_t (*func)( int ), int arg,
+                       const char *family, const char *help, const char *labels )
+{
+   Ganglia_25metric *gmi;
+   my_dynamic_metric *dm;
+   int i;
+
+
+   for (i = 0;  i < metric_info->nelts;  i++)
+   {
+      gmi = (Ganglia_25metric *) metric_info->elts + i;
+      if (gmi->name && (! strcmp( gmi->name, tmpl )))
+         break;
+   }
+
+   if (i == metric_info->nelts)
+   {
+      err_msg( "my_add_dynamic_metric() found no template metric %s", tmpl );
+      return;
+   }
+
+   gmi = (Ganglia_25metric *) apr_array_push( metric_info );
+   *gmi = ((Ganglia_25metric *) metric_info->elts)[i];
+   gmi->name = apr_pstrdup( p, name );
+   gmi->desc = apr_pstrdup( p, desc );
+
+   dm = (my_dynamic_metric *) apr_array_push( dynamic_metrics );
+   dm->func = func;
+   dm->arg = arg;
+   dm->family = family;
+   dm->help = help;
+   dm->labels = apr_pstrdup( p, labels );
+}
+
+
+
+static char *
+om_append( char *p, char *end, const char *fmt, ... )
+{
+   va_list ap;
+   int len;
+
+
+   if (p >= end)
+      return( end );
+
+   va_start( ap, fmt );
+   len = vsnprintf( p, end - p, fmt, ap );
+   va_end( ap );
+
+   return( ((len < 0) || (len >= end - p)) ? end : p + len );
+}
+
+
+
+/* label values must have backslash, double quote and newline escaped */
+static char *
+om_append_escaped( char *p, char *end, const char *s )
+{
+   for (;  *s && (p < end - 2);  s++)
+   {
+      if ((*s == '\\') || (*s == '"'))
+         *p++ = '\\';
+      else if (*s == '\n')
+      {
+         *p++ = '\\';
+         *p++ = 'n';
+         continue;
+      }
+      *p++ = *s;
+   }
+
+   return( p );
+}
+
+
+
+static void
+ibmpower_build_metric_info( apr_pool_t *p )
+{
+   Ganglia_25metric *gmi;
+   my_vscsi_host *vh;
+   ibmpower_snapshot snap;
+   const char *prefix, *driver;
+   char name[64], desc[128], labels[256], *l;
+   char id[sizeof( name ) - sizeof( "cgroup__physc" ) + 1];
+   int i, j, n;
+
+
+   metric_info = apr_array_make( p, 128, sizeof( Ganglia_25metric ) );
+   dynamic_metrics = apr_array_make( p, 16, sizeof( my_dynamic_metric ) );
+
+   dynamic_metric_base = ibmpower_metrics_build( p, ibmpower_metric_funcs, metric_info );
+
+   if (per_cpu_steal && core)
+   {
+      ibmpower_sample( core, IBMPOWER_SAMPLE_CPU, &snap );
+
+/* room for the CPUs which can come online later */
+      n = ibmpower_cpu_times( core, (ibmpower_cpu *) NULL, 0 );
+      if (n < my_possible_cpus())
+         n = my_possible_cpus();
+
+      steal_ncpus = n;
+      steal_cpus = apr_pcalloc( p, n * sizeof( ibmpower_cpu ) );
+      steal_windows = apr_pcalloc( p, n * sizeof( my_steal_window ) );
+
+      my_steal_cpus_update();
+
+      for (i = 0;  i < steal_ncpus;  i++)
+      {
+         if (! steal_cpus[i].online)
+            continue;
+
+         snprintf( name, sizeof( name ), "cpu_steal_cpu%d", i );
+         snprintf( desc, sizeof( desc ), "Percentage of CPU %d time stolen by the hypervisor", i );
+         snprintf( labels, sizeof( labels ), "cpu=\"%d\"", i );
+         my_add_dynamic_metric( p, "cpu_steal_pct", name, desc, cpu_steal_cpu_func, i,
+                                "cpu_steal_cpu_pct", "Percentage of the time of a CPU stolen by the hypervisor", labels );
+      }
+   }
+
+   for (i = 0;  i < MAX_OCC_SOCKETS;  i++)
+   {
+      if (! occ.socket_seen[i])
+         continue;
+
+      snprintf( name, sizeof( name ), "occ_power_socket%d", i );
+      snprintf( desc, sizeof( desc ), "Power consumption of processor socket %d", i );
+      snprintf( labels, sizeof( labels ), "socket=\"%d\"", i );
+      my_add_dynamic_metric( p, "occ_system_power", name, desc, occ_socket_power_func, i,
+                             "occ_socket_power", "Power consumption of a processor socket reported by the OCC", labels );
+   }
+
+   for (i = 0;  i < cgroup.nfixed;  i++)
+   {
+/* "system.slice/db.service" --> cgroup_system_slice_db_service_physc */
+      cgroup_metric_id( id, sizeof( id ), cgroup.fixed[i].path, FALSE );
+      snprintf( name, sizeof( name ), "cgroup_%s_physc", id );
+
+/* "a.b" and "a_b" would both be cgroup_a_b_physc */
+      for (j = 0;  j < metric_info->nelts;  j++)
+      {
+         gmi = (Ganglia_25metric *) metric_info->elts + j;
+         if (gmi->name && (! strcmp( gmi->name, name )))
+            break;
+      }
+
+      if (j < metric_info->nelts)
+      {
+         cgroup_metric_id( id, sizeof( id ), cgroup.fixed[i].path, TRUE );
+         snprintf( name, sizeof( name ), "cgroup_%s_physc", id );
+      }
+
+      snprintf( desc, sizeof( desc ), "Physical cores used by cgroup %s", cgroup.fixed[i].path );
+/* the path comes from the configuration, room is left for the closing quote */
+      l = om_append( labels, labels + sizeof( labels ), "cgroup=\"" );
+      l = om_append_escaped( l, labels + sizeof( labels ) - 1, cgroup.fixed[i].path );
+      om_append( l, labels + sizeof( labels ), "\"" );
+      my_add_dynamic_metric( p, "cgroup_physc", name, desc, cgroup_fixed_physc_func, i,
+                             "cgroup_fixed_physc", "Physical cores used by a listed cgroup", labels );
+   }
 
+   if (hcall_enabled)
+   {
+      for (i = 0;  i < hcall_top;  i++)
+      {
+         snprintf( name, sizeof( name ), "hcall_top%d_time", i+1 );
+         snprintf( desc, sizeof( desc ), "Time per second spent in the hcall ranked %d by time", i+1 );
+         snprintf( labels, sizeof( labels ), "rank=\"%d\"", i+1 );
+         my_add_dynamic_metric( p, "hcall_time", name, desc, hcall_top_time_func, i,
+                                "hcall_top_time", "Time per second spent in the hcalls ranked by time, see hcall_top for their names", labels );
+      }
+   }
 
-   if (firstTime)
+   for (i = 0;  i < vscsi.nhosts;  i++)
    {
-      val = oslevel_func_CALLED_ONCE();
-      firstTime = FALSE;
+      vh = &vscsi.hosts[i];
+      prefix = vh->vfc ? "vfc" : "vscsi";
+      driver = vh->vfc ? "ibmvfc" : "ibmvscsi";
+      snprintf( labels, sizeof( labels ), "host=\"%d\",driver=\"%s\"", vh->host, driver );
+
+      snprintf( name, sizeof( name ), "%s_host%d_queue_depth", prefix, vh->host );
+      snprintf( desc, sizeof( desc ), "Command queue depth of %s host %d", driver, vh->host );
+      my_add_dynamic_metric( p, "vscsi_queue_depth", name, desc, vscsi_host_queue_depth_func, i,
+                             "vscsi_host_queue_depth", "Command queue depth of a virtual SCSI/FC host adapter", labels );
+
+      snprintf( name, sizeof( name ), "%s_host%d_outstanding", prefix, vh->host );
+      snprintf( desc, sizeof( desc ), "Commands outstanding on %s host %d", driver, vh->host );
+      my_add_dynamic_metric( p, "vscsi_outstanding", name, desc, vscsi_host_outstanding_func, i,
+                             "vscsi_host_outstanding", "Commands outstanding on a virtual SCSI/FC host adapter", labels );
+
+      snprintf( name, sizeof( name ), "%s_host%d_iops", prefix, vh->host );
+      snprintf( desc, sizeof( desc ), "I/O operations per second of the devices on %s host %d", driver, vh->host );
+      my_add_dynamic_metric( p, "vscsi_iops", name, desc, vscsi_host_iops_func, i,
+                             "vscsi_host_iops", "I/O operations per second of the devices on a virtual SCSI/FC host adapter", labels );
+
+      snprintf( name, sizeof( name ), "%s_host%d_timeouts", prefix, vh->host );
+      snprintf( desc, sizeof( desc ), "Command timeouts (aborts) on %s host %d", driver, vh->host );
+      my_add_dynamic_metric( p, "vscsi_timeouts", name, desc, vscsi_host_timeouts_func, i,
+                             "vscsi_host_timeouts", "Command timeouts (aborts) on a virtual SCSI/FC host adapter", labels );
+
+      snprintf( name, sizeof( name ), "%s_host%d_errors", prefix, vh->host );
+      snprintf( desc, sizeof( desc ), "Commands completed with an error on %s host %d", driver, vh->host );
+      my_add_dynamic_metric( p, "vscsi_errors", name, desc, vscsi_host_errors_func, i,
+                             "vscsi_host_errors", "Commands completed with an error on a virtual SCSI/FC host adapter", labels );
    }
 
-   return( val );
+/* terminate the table */
+   gmi = (Ganglia_25metric *) apr_array_push( metric_info );
+   memset( gmi, 0, sizeof( *gmi ) );
+
+   ibmpower_module.metrics_info = (Ganglia_25metric *) metric_info->elts;
 }
 
 
 
-g_val_t
-serial_num_func( void )
+/*
+ * Optional OpenMetrics (Prometheus) text endpoint on the loopback interface,
+ * switched on with the module parameter openmetrics_port.  Every value
+ * gmond collects through ibmpower_metric_handler() is kept in a snapshot,
+ * and a scrape renders the snapshot into a buffer which is allocated once
+ * at init.  So a scrape neither reads procfs nor allocates memory, and it
+ * sees the values of the last collection.  The static metrics become
+ * "ibmpower_<name>", the run time ones are grouped into labelled families,
+ * e.g. ibmpower_cpu_steal_cpu_pct{cpu="3"}.  String metrics become info
+ * metrics with the string as label "value".
+ */
+#define OM_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+static pthread_mutex_t om_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct
 {
-   g_val_t val;
-   FILE *f;
-   char  buf[128],
-         *p;
-   int len;
+   int enabled;
+   int sock;
+   pthread_t thread;
+   volatile int stop;
+   int nmetrics;
+   g_val_t *values;       /* protected by om_lock */
+   char *valid;
+   int *order;            /* dynamic metrics grouped by family */
+   char *buf;
+   size_t size;
+} om = { FALSE, -1 };
 
 
-   strcpy( val.str, "serial number not found" );
 
-   if (KVM_Guest)
-   {
-      f = fopen( "/proc/device-tree/host-serial", "r" );
+/* remember the value gmond just collected */
+static void
+om_record( int metric_index, const g_val_t *val )
+{
+   if ((metric_index < 0) || (metric_index >= om.nmetrics))
+      return;
 
-      if (f)
-      {
-         if (fgets( buf, 128, f ) )
-         {
-            if (strlen( buf ) > MAX_G_STRING_SIZE - 1)
-               buf[MAX_G_STRING_SIZE - 1] = '\0';
+   pthread_mutex_lock( &om_lock );
+   om.values[metric_index] = *val;
+   om.valid[metric_index] = TRUE;
+   pthread_mutex_unlock( &om_lock );
+}
 
-            strcpy( val.str, buf );
-         }
 
-         fclose( f );
-      }
+
+static char *
+om_append_value( char *p, char *end, const Ganglia_25metric *gmi,
+                 const g_val_t *val, const char *family, const char *labels )
+{
+   if (gmi->type == GANGLIA_VALUE_STRING)
+   {
+      p = om_append( p, end, "ibmpower_%s_info{%s%svalue=\"", family,
+                     labels ? labels : "", labels ? "," : "" );
+      p = om_append_escaped( p, end, val->str );
+      return( om_append( p, end, "\"} 1\n" ) );
    }
+
+   if (labels)
+      p = om_append( p, end, "ibmpower_%s{%s} ", family, labels );
    else
-   {
-      f = fopen( "/proc/device-tree/system-id", "r" );
+      p = om_append( p, end, "ibmpower_%s ", family );
 
-      if (f)
-      {
-         if (fgets( buf, 128, f ) )
-         {
-            if (strlen( buf ) > MAX_G_STRING_SIZE - 1)
-               buf[MAX_G_STRING_SIZE - 1] = '\0';
+   switch (gmi->type)
+   {
+      case GANGLIA_VALUE_UNSIGNED_SHORT: return( om_append( p, end, "%u\n", val->uint16 ) );
+      case GANGLIA_VALUE_SHORT:          return( om_append( p, end, "%d\n", val->int16 ) );
+      case GANGLIA_VALUE_UNSIGNED_INT:   return( om_append( p, end, "%u\n", val->uint32 ) );
+      case GANGLIA_VALUE_INT:            return( om_append( p, end, "%d\n", val->int32 ) );
+      case GANGLIA_VALUE_FLOAT:          return( om_append( p, end, "%.7g\n", val->f ) );
+      case GANGLIA_VALUE_DOUBLE:         return( om_append( p, end, "%.15g\n", val->d ) );
+      default:                           return( om_append( p, end, "NaN\n" ) );
+   }
+}
 
-            strcpy( val.str, buf );
-         }
 
-         fclose( f );
-      }
-      else
-         if (LPARcfgExists)
-         {
-            p = strstr( my_update_file( &proc_ppc64_lparcfg), "serial_number=" );
 
-            if (p)
-            {
-               len = strchr( p+14, '\n' ) - (p+14);
-               if (len > MAX_G_STRING_SIZE - 1)
-                  len = MAX_G_STRING_SIZE - 1;
-               strncpy( val.str, p+14, len );
-               val.str[len] = '\0';
-            }
-         }
-   }
+static char *
+om_append_header( char *p, char *end, const Ganglia_25metric *gmi,
+                  const char *family, const char *help )
+{
+   p = om_append( p, end, "# TYPE ibmpower_%s %s\n", family,
+                  gmi->type == GANGLIA_VALUE_STRING ? "info" : "gauge" );
 
-   return( val );
+   return( om_append( p, end, "# HELP ibmpower_%s %s\n", family, help ) );
 }
 
 
 
-g_val_t
-smt_func( void )
+/* render the snapshot into om.buf, returns the length */
+static size_t
+om_render( void )
 {
-   g_val_t val;
-   char *p;
-   int i, virtCPUcount;
+   Ganglia_25metric *gmi = ibmpower_module.metrics_info;
+   my_dynamic_metric *dm;
+   char *p = om.buf, *end = om.buf + om.size - sizeof( "# EOF\n" );
+   const char *family = NULL;
+   int i, n;
 
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "shared_processor_mode=" );
-   else
-      p = (char *) NULL;
+   pthread_mutex_lock( &om_lock );
 
-   if (p)
+   for (i = 0;  i < dynamic_metric_base;  i++)
+   {
+      if (! om.valid[i])
+         continue;
+
+      p = om_append_header( p, end, &gmi[i], gmi[i].name, gmi[i].desc );
+      p = om_append_value( p, end, &gmi[i], &om.values[i], gmi[i].name, NULL );
+   }
+
+   for (n = 0;  n < dynamic_metrics->nelts;  n++)
    {
-      i = strtol( p+22, (char **) NULL, 10 );
+      dm = (my_dynamic_metric *) dynamic_metrics->elts + om.order[n];
+      i = dynamic_metric_base + om.order[n];
 
-      if (i > 0)
+      if (! om.valid[i])
+         continue;
+
+      if ((family == NULL) || strcmp( family, dm->family ))
       {
+         family = dm->family;
+         p = om_append_header( p, end, &gmi[i], family, dm->help );
       }
+
+      p = om_append_value( p, end, &gmi[i], &om.values[i], family, dm->labels );
    }
-   else
-      strcpy( val.str, "No SPLPAR-capable system" );
 
+   pthread_mutex_unlock( &om_lock );
 
-   p = my_update_file( &proc_stat );
+   strcpy( p, "# EOF\n" );
 
-/* Skip initial "cpu" token and find first real cpu "cpu0" */
-   p = strstr( p+3, "cpu");
+   return( p - om.buf + 6 );
+}
 
-   i = 1;
-   while ((p = strstr( p+3, "cpu" )))
-      i++;
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "partition_active_processors=" );
-   else
-      p = (char *) NULL;
 
-   if (p)
+static void
+om_write_all( int fd, const char *p, size_t len )
+{
+   ssize_t n;
+
+
+   while (len > 0)
    {
-      virtCPUcount = strtol( p+28, (char **) NULL, 10 );
-      if (i > virtCPUcount)
-         snprintf( val.str, MAX_G_STRING_SIZE, "yes (SMT=%d)", i / virtCPUcount );
-      else
-         strcpy( val.str, "no (SMT=1)" );
+      n = send( fd, p, len, MSG_NOSIGNAL );
+      if (n <= 0)
+         return;
+      p += n;
+      len -= n;
    }
-   else
-      strcpy( val.str, "No SMT-capable system" );
-
-   return( val );
 }
 
 
 
-g_val_t
-splpar_func( void )
+static void
+om_serve( int fd )
 {
-   g_val_t val;
-   char *p;
+   struct timeval tv = { 2, 0 };
+   char req[1024], hdr[256];
+   ssize_t n;
+   size_t len = 0;
+   int hlen;
 
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "shared_processor_mode=" );
-   else
-      p = (char *) NULL;
+   setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+   setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof( tv ) );
 
-   if (p)
-      strcpy( val.str, strtol( p+22, (char **) NULL, 10 ) == 1 ? "yes" : "no" );
-   else
-      strcpy( val.str, "No SPLPAR-capable system" );
+/* we only need the request line, but read up to the end of the headers */
+   while (len < sizeof( req ) - 1)
+   {
+      n = recv( fd, req + len, sizeof( req ) - 1 - len, 0 );
+      if (n <= 0)
+         break;
+      len += n;
+      req[len] = '\0';
+      if (strstr( req, "\r\n\r\n" ))
+         break;
+   }
+   req[len] = '\0';
 
-   return( val );
+   if (strncmp( req, "GET ", 4 ))
+   {
+      hlen = snprintf( hdr, sizeof( hdr ), "HTTP/1.0 405 Method Not Allowed\r\nAllow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n" );
+      om_write_all( fd, hdr, hlen );
+      return;
+   }
+
+   if (strncmp( req+4, "/metrics ", 9 ) && strncmp( req+4, "/ ", 2 ))
+   {
+      hlen = snprintf( hdr, sizeof( hdr ), "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n" );
+      om_write_all( fd, hdr, hlen );
+      return;
+   }
+
+   len = om_render();
+
+   hlen = snprintf( hdr, sizeof( hdr ), "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+                    OM_CONTENT_TYPE, (unsigned long) len );
+   om_write_all( fd, hdr, hlen );
+   om_write_all( fd, om.buf, len );
 }
 
 
 
-g_val_t
-weight_func( void )
+static void *
+om_thread( void *arg )
 {
-   g_val_t val;
-   char *p;
+   struct pollfd pfd;
+   int fd;
 
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "unallocated_capacity_weight=" );
-   else
-      p = (char *) NULL;
+   pfd.fd = om.sock;
+   pfd.events = POLLIN;
 
-   if (p)
+   while (! om.stop)
    {
-      p = strstr( p+29, "capacity_weight=" );
+/* wake up every second to notice om.stop */
+      if (poll( &pfd, 1, 1000 ) <= 0)
+         continue;
 
-      if (p)
-         val.int32 = strtol( p+16, (char **) NULL, 10 );
-      else
-         val.int32 = -1;
+      fd = accept( om.sock, (struct sockaddr *) NULL, (socklen_t *) NULL );
+      if (fd < 0)
+         continue;
+
+      om_serve( fd );
+      close( fd );
    }
-   else
-      val.int32 = -1;
 
-   return( val );
+   return( arg );
 }
 
 
 
-g_val_t
-kvm_guest_func( void )
+static int
+om_family_cmp( const void *a, const void *b )
 {
-   g_val_t val;
+   const my_dynamic_metric *dm = (const my_dynamic_metric *) dynamic_metrics->elts;
+   int ia = *(const int *) a, ib = *(const int *) b, c;
 
 
-   if (KVM_Guest)
-      strcpy( val.str, "yes" );    
-   else
-      strcpy( val.str, "no" );    
+   c = strcmp( dm[ia].family, dm[ib].family );
 
-   return( val );
+   return( c ? c : ia - ib );
 }
 
 
 
-g_val_t
-cpu_type_func( void )
+/* the snapshot and the buffer of om_render(), for the final metric table */
+static void
+om_prepare( apr_pool_t *p )
 {
-   g_val_t  val;
-   char    *p, *q;
-   long long l;
-
-
-   strcpy( val.str, "Unknown" );
+   Ganglia_25metric *gmi = ibmpower_module.metrics_info;
+   int i;
 
-   if (KVM_Guest)
-   {
-      p = strstr( my_update_file( &proc_cpuinfo ), "model" );
-      if (p) p = strchr( p+1, ':' );
-      if (p) p = skip_whitespace( p+1 );
-      if (p) q = strchr( p, '\n' );
-      if (p && q)
-      {
-         l = q - p;
-         if (l > MAX_G_STRING_SIZE - 1)
-            l = MAX_G_STRING_SIZE - 1;
 
-         strncpy( val.str, p, l );
-         val.str[l] = '\0';
-      }
-   }
-   else
-   {
-      p = strstr( my_update_file( &proc_cpuinfo ), "cpu" );
-      if (p) p = strchr( p+1, ':' );
-      if (p) p = skip_whitespace( p+1 );
-      if (p) q = strchr( p, '\n' );
-      if (p && q)
-      {
-         l = q - p;
-         if (l > MAX_G_STRING_SIZE - 1)
-            l = MAX_G_STRING_SIZE - 1;
+   om.nmetrics = metric_info->nelts - 1;    /* without the terminator */
+   om.values = apr_pcalloc( p, om.nmetrics * sizeof( g_val_t ) );
+   om.valid = apr_pcalloc( p, om.nmetrics );
 
-         strncpy( val.str, p, l );
-         val.str[l] = '\0';
-      }
-   }
+/* OpenMetrics wants all series of a family together */
+   om.order = apr_pcalloc( p, (dynamic_metrics->nelts + 1) * sizeof( int ) );
+   for (i = 0;  i < dynamic_metrics->nelts;  i++)
+      om.order[i] = i;
+   qsort( om.order, dynamic_metrics->nelts, sizeof( int ), om_family_cmp );
 
-   return( val );
+/* worst case size of every metric: header, labels and an escaped string */
+   om.size = 64;
+   for (i = 0;  i < om.nmetrics;  i++)
+      om.size += 3 * strlen( gmi[i].name ) + strlen( gmi[i].desc ) + 2 * MAX_G_STRING_SIZE + 256;
+   om.buf = apr_palloc( p, om.size );
 }
 
 
 
-static int
-Running_as_KVM_Guest( void )
+static void
+om_init( apr_pool_t *p )
 {
-   char *p,
-         buf[128];
-   int len;
+   struct sockaddr_in addr;
+   int one = 1;
 
 
-   if (LPARcfgExists)
-   {
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "system_type=" );
+   if (openmetrics_port <= 0)
+      return;
 
-      strcpy( buf, "" );
-      if (p)
-      {
-         len = strchr( p+12, '\n' ) - (p+12);
-         if (len > 127)
-            len = 127;
-         strncpy( buf, p+12, len );
-         buf[len] = '\0';
-      }
+   om_prepare( p );
 
-      if (! strcmp( buf, "IBM pSeries (emulated by qemu)" ) )
-         return( TRUE );
+   om.sock = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+   if (om.sock < 0)
+   {
+      err_msg( "om_init() cannot create the OpenMetrics socket" );
+      return;
    }
 
-   return( FALSE );
-}
+   setsockopt( om.sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
 
+   memset( &addr, 0, sizeof( addr ) );
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons( openmetrics_port );
+   addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
 
+   if ((bind( om.sock, (struct sockaddr *) &addr, sizeof( addr ) ) < 0) ||
+       (listen( om.sock, 8 ) < 0))
+   {
+      err_msg( "om_init() cannot listen on 127.0.0.1:%d", openmetrics_port );
+      close( om.sock );
+      om.sock = -1;
+      return;
+   }
 
-static int
-Running_as_SPLPAR( void )
-{
-   char *p;
-   int i;
+   if (pthread_create( &om.thread, (pthread_attr_t *) NULL, om_thread, NULL ))
+   {
+      err_msg( "om_init() cannot start the OpenMetrics thread" );
+      close( om.sock );
+      om.sock = -1;
+      return;
+   }
 
+   om.enabled = TRUE;
+}
 
-   if (LPARcfgExists)
-      p = strstr( my_update_file( &proc_ppc64_lparcfg ), "shared_processor_mode=" );
-   else
-      p = (char *) NULL;
 
-   if (p)
-      i = strtol( p+22, (char **) NULL, 10 ) > 0;
-   else
-      i = FALSE;
 
-   return( i );
-}
+static void
+om_cleanup( void )
+{
+   if (om.enabled)
+   {
+      om.stop = TRUE;
+      pthread_join( om.thread, (void **) NULL );
+      om.enabled = FALSE;
+   }
 
+   if (om.sock >= 0)
+      close( om.sock );
 
+   om.sock = -1;
+}
 
-/*
- * Declare ourselves so the configuration routines can find and know us.
- * We'll fill it in at the end of the module.
- */
-extern mmodule ibmpower_module;
 
 
 static int
@@ -1803,14 +7867,24 @@ ibmpower_metric_init ( apr_pool_t *p )
    g_val_t val;
 
 
-   for (i = 0;  ibmpower_module.metrics_info[i].name != NULL;  i++)
+   ibmpower_read_params();
+
+
+   guard_init();
+
+/* before the first time stamp, my_time_now() counts from the boot time */
+   core = ibmpower_open();
+   if (core)
    {
-      /* Initialize the metadata storage for each of the metrics and then
-       *  store one or more key/value pairs.  The define MGROUPS defines
-       *  the key for the grouping attribute. */
-      MMETRIC_INIT_METADATA( &(ibmpower_module.metrics_info[i]), p );
-      MMETRIC_ADD_METADATA( &(ibmpower_module.metrics_info[i]), MGROUP, "ibmpower" );
+      ibmpower_set_max_age( core, 1.0 );
+      boottime = (time_t) ibmpower_boot_time( core );
+
+      if (ibmpower_set_read_timeout( core, (read_timeout_msec > 0) ? read_timeout_msec :
+                                           READ_DEADLINE_PROCFS ) != 0)
+         err_msg( "ibmpower_metric_init() reads the LPAR, CPU and disk counters without a deadline" );
    }
+   else
+      err_msg( "ibmpower_metric_init() cannot create the libibmpower context" );
 
 
 /* determine if we are running in OPAL or pHyp mode, KVM guest or not etc. */
@@ -1829,19 +7903,92 @@ ibmpower_metric_init ( apr_pool_t *p )
 
    SPLPAR_Mode = Running_as_SPLPAR();
 
+   cpu_topo_open_uevents();
+   cpu_topo_scan();
+
+   occ_init();
+
+   vnet_init();
+
+   vscsi_init();
+   hcall_init();
+   perf_init();
+   irq_init();
+   cgroup_init();
 
-/* initialize the routines which require a time interval */
 
-   boottime = boottime_func_CALLED_ONCE();
+   ibmpower_build_metric_info( p );
 
-   CheckPURRusability();
+   for (i = 0;  ibmpower_module.metrics_info[i].name != NULL;  i++)
+   {
+      /* Initialize the metadata storage for each of the metrics and then
+       *  store one or more key/value pairs.  The define MGROUPS defines
+       *  the key for the grouping attribute. */
+      MMETRIC_INIT_METADATA( &(ibmpower_module.metrics_info[i]), p );
+      MMETRIC_ADD_METADATA( &(ibmpower_module.metrics_info[i]), MGROUP, "ibmpower" );
+   }
+
+
+/* initialize the routines which require a time interval */
 
    val = oslevel_func();
    val = cpu_pool_idle_func();
    val = cpu_used_func();
+   val = cpu_dispatches_func();
+   val = cpu_dispersions_func();
+   val = cpu_dispersion_pct_func();
+   val = cpu_steal_func();
+   val = cpu_steal_pct_func();
+   val = cmo_faults_func();
+   val = cmo_fault_time_func();
+   val = cmo_fault_latency_func();
+   val = vnet_rx_bytes_func();
+   val = vnet_tx_bytes_func();
+   val = vnet_rx_drops_func();
+   val = vnet_tx_drops_func();
+   val = veth_rx_no_buffer_func();
+   val = veth_replenish_failures_func();
+   val = vnic_tx_queue_drops_func();
+   val = vscsi_iops_func();
+   val = vscsi_timeouts_func();
+   val = vscsi_errors_func();
+
+   vcpu_disp_init();
+   val = vcpu_disp_same_core_func();
+   val = vcpu_disp_same_chip_func();
+   val = vcpu_disp_other_chip_func();
+   val = vcpu_disp_remote_node_func();
+   val = vcpu_disp_worst_pct_func();
+
+   if (hcall_enabled)
+      hcall_update();
+
+   perf_update();
+
+   if (irq_enabled)
+      irq_update();
+
+   cgroup_update();
+
+   runq_init();
+   val = runq_per_ec_func();
+   val = runq_per_vcpu_func();
+   val = runq_blocked_func();
+
+   om_init( p );
+   fr_init();
+   adapt_init();
+
    val = disk_iops_func();
    val = disk_read_func();
    val = disk_write_func();
+   val = disk_await_func();
+   val = burst_pct_func();
+   val = bursts_func();
+   val = cpu_ec_peak_func();
+   val = cpu_used_peak_func();
+   val = cpu_pool_idle_min_func();
+   val = disk_await_peak_func();
 
 
 /* return SUCCESS */
@@ -1854,6 +8001,42 @@ ibmpower_metric_init ( apr_pool_t *p )
 static void
 ibmpower_metric_cleanup ( void )
 {
+   ibmpower_close( core );
+   core = NULL;
+
+   vcpu_disp_cleanup();
+   hcall_cleanup();
+   perf_cleanup();
+   irq_cleanup();
+   cgroup_cleanup();
+   cpu_topo_cleanup();
+   occ_cleanup();
+   vnet_cleanup();
+   vscsi_cleanup();
+   runq_cleanup();
+   fr_cleanup();
+   adapt_cleanup();
+   om_cleanup();
+   guard_cleanup();
+}
+
+
+
+static g_val_t
+ibmpower_metric_value ( int metric_index )
+{
+   my_dynamic_metric *dm;
+
+
+/* run time metrics follow the static ones */
+   if ((metric_index >= dynamic_metric_base) &&
+       (metric_index - dynamic_metric_base < dynamic_metrics->nelts))
+   {
+      dm = (my_dynamic_metric *) dynamic_metrics->elts + (metric_index - dynamic_metric_base);
+      return( dm->func( dm->arg ) );
+   }
+
+   return( ibmpower_metrics_value( metric_index ) );
 }
 
 
@@ -1863,73 +8046,20 @@ ibmpower_metric_handler ( int metric_index )
 {
    g_val_t val;
 
-/* The metric_index corresponds to the order in which
-   the metrics appear in the metric_info array
-*/
-   switch (metric_index)
-   {
-      case 0:  return( capped_func() );
-      case 1:  return( cpu_ec_func() );
-      case 2:  return( cpu_entitlement_func() );
-      case 3:  return( cpu_in_lpar_func() );
-      case 4:  return( cpu_in_machine_func() );
-      case 5:  return( cpu_in_pool_func() );
-      case 6:  return( cpu_in_syspool_func() );
-      case 7:  return( cpu_pool_id_func() );
-      case 8:  return( cpu_pool_idle_func() );
-      case 9:  return( cpu_used_func() );
-      case 10: return( disk_iops_func() );
-      case 11: return( disk_read_func() );
-      case 12: return( disk_write_func() );
-      case 13: return( fwversion_func() );
-      case 14: return( kernel64bit_func() );
-      case 15: return( lpar_func() );
-      case 16: return( lpar_name_func() );
-      case 17: return( lpar_num_func() );
-      case 18: return( model_name_func() );
-      case 19: return( oslevel_func() );
-      case 20: return( serial_num_func() );
-      case 21: return( smt_func() );
-      case 22: return( splpar_func() );
-      case 23: return( weight_func() );
-      case 24: return( kvm_guest_func() );
-      case 25: return( cpu_type_func() );
-      default: val.uint32 = 0; /* default fallback */
-   }
-
-   return( val );
-}
-
-
-
-static Ganglia_25metric ibmpower_metric_info[] = 
-{
-   {0, "capped",           180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is this SPLPAR running in capped mode?"},
-   {0, "cpu_ec",            15, GANGLIA_VALUE_FLOAT,        "%",    "both", "%.2f", UDP_HEADER_SIZE+8,  "Ratio of physical cores used vs. entitlement"},
-   {0, "cpu_entitlement",  180, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.2f", UDP_HEADER_SIZE+8,  "Capacity entitlement in units of physical cores"},
-   {0, "cpu_in_lpar",      180, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Number of CPUs the OS sees in the system"},
-   {0, "cpu_in_machine",  1200, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Total number of physical cores in the whole system"},
-   {0, "cpu_in_pool",      180, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Number of physical cores in the shared processor pool"},
-   {0, "cpu_in_syspool",   180, GANGLIA_VALUE_UNSIGNED_INT, "CPUs", "both", "%d",   UDP_HEADER_SIZE+8,  "Number of physical cores in the global shared processor pool"},
-   {0, "cpu_pool_id",      180, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Shared processor pool ID of this LPAR"},
-   {0, "cpu_pool_idle",     15, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.4f", UDP_HEADER_SIZE+8,  "Number of idle cores in the shared processor pool"},
-   {0, "cpu_used",          15, GANGLIA_VALUE_FLOAT,        "CPUs", "both", "%.4f", UDP_HEADER_SIZE+8,  "Number of physical cores used"},
-   {0, "disk_iops",        180, GANGLIA_VALUE_DOUBLE,     "IO/sec", "both", "%.3f", UDP_HEADER_SIZE+16, "Total number of I/O operations per second"},
-   {0, "disk_read",        180, GANGLIA_VALUE_DOUBLE,  "bytes/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Total number of bytes read I/O of the system"},
-   {0, "disk_write",       180, GANGLIA_VALUE_DOUBLE,  "bytes/sec", "both", "%.2f", UDP_HEADER_SIZE+16, "Total number of bytes write I/O of the system"},
-   {0, "fwversion",       1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Firmware Version"},
-   {0, "kernel64bit",     1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is the kernel running in 64-bit mode?"},
-   {0, "lpar",            1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is the system an LPAR or not?"},
-   {0, "lpar_name",        180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Name of the LPAR as defined on the HMC"},
-   {0, "lpar_num",        1200, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Partition ID of the LPAR as defined on the HMC"},
-   {0, "model_name",      1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Machine Model Name"},
-   {0, "oslevel",          180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Exact Linux version"},
-   {0, "serial_num",      1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Serial number of the hardware system"},
-   {0, "smt",              180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is SMT enabled or not?"},
-   {0, "splpar",          1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is this a shared processor LPAR or not?"},
-   {0, "weight",           180, GANGLIA_VALUE_UNSIGNED_INT, "",     "both", "%d",   UDP_HEADER_SIZE+8,  "Capacity weight of the LPAR"},
-   {0, "kvm_guest",       1200, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "Is this a KVM guest VM or not?"},
-   {0, "cpu_type",         180, GANGLIA_VALUE_STRING,       "",     "both", "%s",   UDP_HEADER_SIZE+64, "CPU model name"},
+
+   val = ibmpower_metric_value( metric_index );
+
+   if (om.enabled)
+      om_record( metric_index, &val );
+
+   return( val );
+}
+
+
+
+/* until ibmpower_metric_init() has built the table */
+static Ganglia_25metric ibmpower_metric_info[] =
+{
    {0, NULL}
 };
 
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *
+ *  fake_perfstat.c - libperfstat on counters set by the test, for make check
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.0, Oct 18, 2026
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#include <string.h>
+#include <sys/systemcfg.h>
+
+#include "fake_perfstat.h"
+
+
+/* a 512 MHz timebase, 1000 ns per 512 ticks */
+struct system_configuration _system_configuration = { 1000, 512 };
+
+fake_perfstat_state fake_perfstat;
+
+
+
+int
+perfstat_partition_total( perfstat_id_t *name, perfstat_partition_total_t *buf, int size, int nr )
+{
+   (void) name;
+   (void) nr;
+
+   fake_perfstat.partition_calls++;
+   if (fake_perfstat.fail)
+      return( -1 );
+
+   memcpy( buf, &fake_perfstat.partition, size );
+
+   return( 1 );
+}
+
+
+
+int
+perfstat_cpu_total( perfstat_id_t *name, perfstat_cpu_total_t *buf, int size, int nr )
+{
+   (void) name;
+   (void) nr;
+
+   fake_perfstat.cpu_calls++;
+   if (fake_perfstat.fail)
+      return( -1 );
+
+   memcpy( buf, &fake_perfstat.cpu, size );
+
+   return( 1 );
+}
+
+
+
+int
+perfstat_disk_total( perfstat_id_t *name, perfstat_disk_total_t *buf, int size, int nr )
+{
+   (void) name;
+   (void) nr;
+
+   fake_perfstat.disk_calls++;
+   if (fake_perfstat.fail)
+      return( -1 );
+
+   memcpy( buf, &fake_perfstat.disk, size );
+
+   return( 1 );
+}
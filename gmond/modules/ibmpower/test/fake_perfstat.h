@@ -0,0 +1,28 @@
+/*
+ * fake_perfstat.h - counters behind the fake libperfstat of make check
+ *
+ * The perfstat_*_total() functions of fake_perfstat.c copy these structs
+ * and count their calls, or return -1 while fail is set.
+ */
+
+#ifndef FAKE_PERFSTAT_H
+#define FAKE_PERFSTAT_H
+
+#include <libperfstat.h>
+
+
+typedef struct
+{
+   perfstat_partition_total_t partition;
+   perfstat_cpu_total_t cpu;
+   perfstat_disk_total_t disk;
+
+   int fail;
+   int partition_calls;
+   int cpu_calls;
+   int disk_calls;
+} fake_perfstat_state;
+
+extern fake_perfstat_state fake_perfstat;
+
+#endif /* FAKE_PERFSTAT_H */
@@ -0,0 +1,94 @@
+/******************************************************************************
+ *
+ *  libperfstat.h - stand-in for the AIX header, for make check
+ *
+ *  Only the types, fields and functions ibmpower_perfstat.c uses, so the
+ *  perfstat backend builds on any system.  fake_perfstat.c implements the
+ *  functions on counters the test sets.  Field types follow AIX 7.2.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.0, Oct 18, 2026
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#ifndef LIBPERFSTAT_H_STUB
+#define LIBPERFSTAT_H_STUB
+
+typedef long long longlong_t;
+typedef unsigned long long u_longlong_t;
+
+
+typedef struct
+{
+   char name[64];
+} perfstat_id_t;
+
+
+typedef struct
+{
+   char name[64];
+   int lpar_id;
+   union
+   {
+      unsigned int w;
+      struct
+      {
+         unsigned smt_capable :1;
+         unsigned smt_enabled :1;
+         unsigned lpar_capable :1;
+         unsigned lpar_enabled :1;
+         unsigned shared_capable :1;
+         unsigned shared_enabled :1;
+         unsigned dlpar_capable :1;
+         unsigned capped :1;
+         unsigned kernel_is_64 :1;
+         unsigned pool_util_authority :1;
+         unsigned donate_capable :1;
+         unsigned donate_enabled :1;
+         unsigned ams_capable :1;
+         unsigned ams_enabled :1;
+      } b;
+   } type;
+   int online_cpus;
+   int entitled_proc_capacity;
+   int var_proc_capacity_weight;
+   int phys_cpus_pool;
+   int pool_id;
+   u_longlong_t puser;
+   u_longlong_t psys;
+   u_longlong_t pidle;
+   u_longlong_t pwait;
+   u_longlong_t pool_idle_time;     /* nanoseconds */
+} perfstat_partition_total_t;
+
+
+typedef struct
+{
+   int ncpus;
+   int ncpus_cfg;
+   u_longlong_t user;
+   u_longlong_t sys;
+   u_longlong_t idle;
+   u_longlong_t wait;
+} perfstat_cpu_total_t;
+
+
+typedef struct
+{
+   int number;
+   u_longlong_t xfers;
+   u_longlong_t rblks;              /* 512 byte blocks */
+   u_longlong_t wblks;
+} perfstat_disk_total_t;
+
+
+int perfstat_partition_total( perfstat_id_t *name, perfstat_partition_total_t *buf,
+                              int size, int nr );
+int perfstat_cpu_total( perfstat_id_t *name, perfstat_cpu_total_t *buf, int size, int nr );
+int perfstat_disk_total( perfstat_id_t *name, perfstat_disk_total_t *buf, int size, int nr );
+
+#endif /* LIBPERFSTAT_H_STUB */
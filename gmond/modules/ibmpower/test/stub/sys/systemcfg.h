@@ -0,0 +1,21 @@
+/*
+ * sys/systemcfg.h - stand-in for the AIX header, for make check
+ *
+ * Xint/Xfrac convert timebase ticks into nanoseconds, set by
+ * fake_perfstat.c to a 512 MHz timebase.
+ */
+
+#ifndef SYS_SYSTEMCFG_H_STUB
+#define SYS_SYSTEMCFG_H_STUB
+
+struct system_configuration
+{
+   int Xint;
+   int Xfrac;
+};
+
+extern struct system_configuration _system_configuration;
+
+#define __LPAR() 1
+
+#endif /* SYS_SYSTEMCFG_H_STUB */
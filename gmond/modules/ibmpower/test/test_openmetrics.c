@@ -0,0 +1,186 @@
+/******************************************************************************
+ *
+ *  test_openmetrics.c - make check of the OpenMetrics text of the module
+ *
+ *  Includes mod_ibmpower-linux.c, builds the metric table with the run
+ *  time metrics of a made up set of OCC sockets, cgroups and virtual SCSI
+ *  hosts, records a few values the way ibmpower_metric_handler() does and
+ *  compares om_render() with test/openmetrics.expected: the families
+ *  grouped, string metrics as info metrics and the cgroup paths as labels
+ *  with the label value escaped,
+ *  metrics without a value left out and the "# EOF" at the end.  No socket
+ *  is opened and no procfs file is read.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.0, Oct 18, 2026
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#include "mod_ibmpower-linux.c"
+
+#include <apr_general.h>
+#include <apr_pools.h>
+
+
+static int failed = 0;
+
+#define CHECK( cond ) \
+   do { \
+      if (! (cond)) \
+      { \
+         fprintf( stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #cond ); \
+         failed++; \
+      } \
+   } while (0)
+
+
+
+static int
+metric_index( const char *name )
+{
+   int i;
+
+
+   for (i = 0;  ibmpower_module.metrics_info[i].name != NULL;  i++)
+      if (! strcmp( ibmpower_module.metrics_info[i].name, name ))
+         return( i );
+
+   fprintf( stderr, "test_openmetrics: no metric %s\n", name );
+   failed++;
+
+   return( -1 );
+}
+
+
+
+static void
+record_float( const char *name, float f )
+{
+   g_val_t val;
+
+
+   val.f = f;
+   om_record( metric_index( name ), &val );
+}
+
+
+
+static void
+record_uint( const char *name, uint32_t u )
+{
+   g_val_t val;
+
+
+   val.uint32 = u;
+   om_record( metric_index( name ), &val );
+}
+
+
+
+static void
+record_double( const char *name, double d )
+{
+   g_val_t val;
+
+
+   val.d = d;
+   om_record( metric_index( name ), &val );
+}
+
+
+
+static void
+record_string( const char *name, const char *s )
+{
+   g_val_t val;
+
+
+   snprintf( val.str, sizeof( val.str ), "%s", s );
+   om_record( metric_index( name ), &val );
+}
+
+
+
+int
+main( void )
+{
+   const char *srcdir = getenv( "srcdir" );
+   apr_pool_t *pool;
+   my_cgroup db[2];
+   char path[PATH_MAX], *expected = NULL;
+   size_t len;
+   int n;
+
+
+   apr_initialize();
+   apr_pool_create( &pool, (apr_pool_t *) NULL );
+
+/*
+ * What the init functions would have found: two OCC sockets, two listed
+ * cgroups, one with a path which needs escaping in a label, and two
+ * virtual SCSI/FC hosts.  The five families of a host are
+ * added host by host, so their series are not in family order.
+ */
+   occ.socket_seen[0] = occ.socket_seen[1] = TRUE;
+
+   memset( db, 0, sizeof( db ) );
+   db[0].path = "system.slice/db.service";
+   db[1].path = "user.slice/a\"b\\c";
+   cgroup.fixed = db;
+   cgroup.nfixed = 2;
+
+   vscsi.nhosts = 2;
+   vscsi.hosts[0].host = 0;
+   vscsi.hosts[1].host = 2;
+   vscsi.hosts[1].vfc = TRUE;
+
+   ibmpower_build_metric_info( pool );
+   om_prepare( pool );
+
+   CHECK( om.nmetrics == dynamic_metric_base + 2 + 2 + 2 * 5 );
+
+/* nothing collected yet */
+   len = om_render();
+   CHECK( (len == 6) && (! strcmp( om.buf, "# EOF\n" )) );
+
+/* occ_power_socket0 and most of the vscsi series have no value */
+   record_uint( "cpu_in_lpar", 8 );
+   record_float( "cpu_used", 1.25 );
+   record_double( "disk_iops", 1234.5 );
+   record_string( "lpar_name", "db \"prod\"\\1\n" );
+   record_uint( "vfc_host2_queue_depth", 128 );
+   record_float( "occ_power_socket1", 180.5 );
+   record_float( "vfc_host2_errors", 0.25 );
+   record_float( "cgroup_system_slice_db_service_physc", 0.75 );
+   record_float( "cgroup_user_slice_a_b_c_physc", 0.5 );
+   record_uint( "vscsi_host0_queue_depth", 64 );
+
+   snprintf( path, sizeof( path ), "%s/test/openmetrics.expected", srcdir ? srcdir : "." );
+   n = slurpfile( path, &expected, 8192 );
+   CHECK( n > 0 );
+
+   len = om_render();
+   CHECK( len == strlen( om.buf ) );
+
+   if ((n > 0) && strcmp( om.buf, expected ))
+   {
+      fprintf( stderr, "test_openmetrics: om_render() differs from %s:\n%s", path, om.buf );
+      failed++;
+   }
+
+   cgroup.fixed = (my_cgroup *) NULL;
+   cgroup.nfixed = 0;
+
+   free( expected );
+   apr_pool_destroy( pool );
+   apr_terminate();
+
+   if (failed)
+      fprintf( stderr, "test_openmetrics: %d checks failed\n", failed );
+
+   return( failed ? 1 : 0 );
+}
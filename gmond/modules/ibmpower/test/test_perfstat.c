@@ -0,0 +1,215 @@
+/******************************************************************************
+ *
+ *  test_perfstat.c - make check of the perfstat backend on the fake libperfstat
+ *
+ *  Built with -DAIX against test/stub, so it runs on any system.  Checks
+ *  that the metrics of one collection round share one
+ *  perfstat_partition_total() snapshot (ibmpower_partition_total() and the
+ *  backend) and one perfstat_disk_total() (the libibmpower source cache),
+ *  that a new round reads again, the conversions of the backend and the
+ *  rates over two rounds, which cpu_used and cpu_pool_idle report.  Takes about 2 seconds, the snapshot age.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.0, Oct 18, 2026
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "libibmpower.h"
+#include "ibmpower_perfstat.h"
+#include "fake_perfstat.h"
+
+
+/* a little more than IBMPOWER_PERFSTAT_MAX_AGE, the next collection round */
+#define NEXT_ROUND_USEC 1100000
+
+
+static int failed = 0;
+
+#define CHECK( cond ) \
+   do { \
+      if (! (cond)) \
+      { \
+         fprintf( stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #cond ); \
+         failed++; \
+      } \
+   } while (0)
+
+
+
+static void
+set_counters( unsigned long long n )
+{
+   perfstat_partition_total_t *p = &fake_perfstat.partition;
+
+
+   p->type.b.shared_enabled = 1;
+   p->type.b.capped = 0;
+   p->online_cpus = 8;
+   p->entitled_proc_capacity = 150;
+   p->var_proc_capacity_weight = 128;
+   p->phys_cpus_pool = 16;
+   p->pool_id = 3;
+   p->puser = 1000ULL * n;
+   p->psys = 100ULL * n;
+   p->pidle = 10ULL * n;
+   p->pwait = n;
+   p->pool_idle_time = 1000000000ULL * n;    /* ns */
+
+   fake_perfstat.cpu.ncpus = 8;
+   fake_perfstat.cpu.user = 300ULL * n;
+   fake_perfstat.cpu.sys = 100ULL * n;
+   fake_perfstat.cpu.idle = 500ULL * n;
+   fake_perfstat.cpu.wait = 100ULL * n;
+
+   fake_perfstat.disk.xfers = 50ULL * n;
+   fake_perfstat.disk.rblks = 200ULL * n;
+   fake_perfstat.disk.wblks = 400ULL * n;
+}
+
+
+
+static void
+test_partition_total( void )
+{
+   perfstat_partition_total_t *p, *q;
+   double t1 = 0.0, t2 = 0.0;
+
+
+   set_counters( 1 );
+
+/* the metric functions of one round */
+   p = ibmpower_partition_total( &t1 );
+   q = ibmpower_partition_total( &t2 );
+
+   CHECK( p != NULL );
+   CHECK( p == q );
+   CHECK( t1 > 0.0 );
+   CHECK( t1 == t2 );
+   CHECK( fake_perfstat.partition_calls == 1 );
+   CHECK( p && (p->online_cpus == 8) );
+
+/* the next round reads again, with a later time */
+   set_counters( 2 );
+   usleep( NEXT_ROUND_USEC );
+
+   p = ibmpower_partition_total( &t2 );
+
+   CHECK( fake_perfstat.partition_calls == 2 );
+   CHECK( p && (p->puser == 2000ULL) );
+   CHECK( t2 - t1 >= 1.0 );
+
+/* a failed call is not retried within the round */
+   fake_perfstat.fail = 1;
+   usleep( NEXT_ROUND_USEC );
+
+   CHECK( ibmpower_partition_total( &t1 ) == NULL );
+   CHECK( ibmpower_partition_total( &t1 ) == NULL );
+   CHECK( fake_perfstat.partition_calls == 3 );
+
+   fake_perfstat.fail = 0;
+}
+
+
+
+static void
+test_backend( void )
+{
+   ibmpower_ctx *ctx;
+   ibmpower_snapshot snap;
+   ibmpower_rates r = IBMPOWER_RATES_INIT;
+   double lpar_time, disk_time, dt;
+   int calls;
+
+
+   ctx = ibmpower_open_backend( "perfstat", (const char *) NULL );
+   CHECK( ctx != NULL );
+   if (ctx == NULL)
+      return;
+
+   ibmpower_set_max_age( ctx, 1.0 );
+
+   CHECK( ibmpower_timebase( ctx ) == 512000000LL );
+   CHECK( ibmpower_has_lparcfg( ctx ) );
+
+   set_counters( 10 );
+   usleep( NEXT_ROUND_USEC );
+
+   calls = fake_perfstat.partition_calls;
+   fake_perfstat.disk_calls = 0;
+
+/* the module and the core within one round */
+   ibmpower_partition_total( (double *) NULL );
+   CHECK( ibmpower_sample( ctx, IBMPOWER_SAMPLE_DISK, &snap ) == 0 );
+   CHECK( ibmpower_sample( ctx, IBMPOWER_SAMPLE_DISK, &snap ) == 0 );
+   CHECK( ibmpower_sample( ctx, IBMPOWER_SAMPLE_ALL, &snap ) == 0 );
+   ibmpower_rates_update( ctx, &r, &snap );
+
+   CHECK( fake_perfstat.partition_calls == calls + 1 );
+   CHECK( fake_perfstat.disk_calls == 1 );
+
+   lpar_time = snap.lpar_time;
+   disk_time = snap.disk_time;
+
+   CHECK( snap.valid == IBMPOWER_SAMPLE_ALL );
+   CHECK( snap.entitled_capacity == 150LL );
+   CHECK( snap.active_processors == 8LL );
+   CHECK( snap.pool_id == 3LL );
+   CHECK( snap.shared_processor_mode == 1LL );
+   CHECK( snap.capped == 0LL );
+   CHECK( snap.purr == 11110LL );
+   CHECK( snap.pool_idle_time == 10LL * 512000000LL );
+   CHECK( snap.dispatches == -1LL );
+   CHECK( snap.online_cpus == 8 );
+   CHECK( snap.cpu_total == 10000ULL );
+   CHECK( snap.cpu_idle == 5000ULL );
+   CHECK( snap.disk_ios == 500ULL );
+   CHECK( snap.disk_read_bytes == 2000ULL * 512ULL );
+   CHECK( snap.disk_write_bytes == 4000ULL * 512ULL );
+
+/* one second later in counters, a little more on the clock */
+   set_counters( 11 );
+   usleep( NEXT_ROUND_USEC );
+
+   CHECK( ibmpower_sample( ctx, IBMPOWER_SAMPLE_ALL, &snap ) == 0 );
+   ibmpower_rates_update( ctx, &r, &snap );
+
+   CHECK( fake_perfstat.disk_calls == 2 );
+   CHECK( r.interval >= 1.0 );
+
+/* every rate over the time between the two reads of its source */
+   dt = snap.disk_time - disk_time;
+   CHECK( fabs( r.disk_iops * dt - 50.0 ) < 0.001 );
+   CHECK( fabs( r.disk_read * dt - 200.0 * 512.0 ) < 0.1 );
+   CHECK( fabs( r.disk_write * dt - 400.0 * 512.0 ) < 0.1 );
+
+   dt = snap.lpar_time - lpar_time;
+   CHECK( fabs( r.pool_idle * dt - 1.0 ) < 0.001 );
+
+/* cpu_used on AIX, the PURR ticks of the partition over the timebase */
+   CHECK( fabs( r.physc * dt * 512000000.0 - 1111.0 ) < 0.001 );
+   CHECK( fabs( r.entitlement - 1.5 ) < 0.001 );
+
+   ibmpower_close( ctx );
+}
+
+
+
+int
+main( void )
+{
+   test_partition_total();
+   test_backend();
+
+   if (failed)
+      fprintf( stderr, "test_perfstat: %d checks failed\n", failed );
+
+   return( failed ? 1 : 0 );
+}
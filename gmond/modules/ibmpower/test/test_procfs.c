@@ -0,0 +1,255 @@
+/******************************************************************************
+ *
+ *  test_procfs.c - make check of the procfs parsers on fixture files
+ *
+ *  test/procfs/1 and test/procfs/2 are two states of /proc of a shared
+ *  LPAR.  The procfs backend is opened on a symlink in a temporary
+ *  directory, which points to the first state and then to the second, so
+ *  the state the backend keeps between two passes over /proc/diskstats is
+ *  the same as on a live system.  Checks the keys of lparcfg, the totals,
+ *  the single CPUs and the run queue of /proc/stat and the sums of
+ *  /proc/diskstats: dm- and md devices, the old partition lines and a new
+ *  device do not count.  Also checks the reset rule of the rate and ratio
+ *  of single counters.
+ *
+ *  Written by Michael Perzl (michael@perzl.org)
+ *
+ *  Version 1.1, Oct 18, 2026
+ *
+ *  Version 1.1:  Oct 18, 2026
+ *                - added the rate and ratio of single counters
+ *                  (--> test_counters() )
+ *
+ *  Version 1.0:  Oct 18, 2026
+ *                - initial release
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "libibmpower.h"
+
+
+static int failed = 0;
+
+#define CHECK( cond ) \
+   do { \
+      if (! (cond)) \
+      { \
+         fprintf( stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #cond ); \
+         failed++; \
+      } \
+   } while (0)
+
+
+static char fixtures[PATH_MAX];    /* absolute path of test/procfs */
+static char tmpdir[] = "/tmp/test_procfs.XXXXXX";
+static char root[sizeof( tmpdir ) + 8];
+
+
+
+/* point the root of the backend to the state n of the fixtures, 0 on success */
+static int
+use_state( int n )
+{
+   char target[PATH_MAX + 8];
+
+
+   snprintf( target, sizeof( target ), "%s/%d", fixtures, n );
+
+   unlink( root );
+   if (symlink( target, root ))
+   {
+      perror( root );
+      return( -1 );
+   }
+
+   return( 0 );
+}
+
+
+
+static void
+test_first_state( ibmpower_ctx *ctx, ibmpower_snapshot *snap )
+{
+   ibmpower_cpu cpus[8];
+
+
+   CHECK( ibmpower_has_lparcfg( ctx ) );
+   CHECK( ibmpower_timebase( ctx ) == 512000000LL );
+   CHECK( ibmpower_boot_time( ctx ) == 1790000000LL );
+   CHECK( ibmpower_purr_usable( ctx ) );
+   CHECK( ! ibmpower_kvm_guest( ctx ) );
+
+   CHECK( ibmpower_sample( ctx, IBMPOWER_SAMPLE_ALL, snap ) == 0 );
+   CHECK( snap->valid == IBMPOWER_SAMPLE_ALL );
+
+/* lparcfg, "pool" must not match pool_capacity, pool_idle_time or pool_num_procs */
+   CHECK( snap->entitled_capacity == 150LL );
+   CHECK( snap->active_processors == 4LL );
+   CHECK( snap->pool_id == 3LL );
+   CHECK( snap->pool_num_procs == 16LL );
+   CHECK( snap->shared_processor_mode == 1LL );
+   CHECK( snap->capped == 0LL );
+   CHECK( snap->weight == 128LL );
+   CHECK( snap->purr == 1024000000LL );
+   CHECK( snap->pool_idle_time == 5120000000LL );
+   CHECK( snap->dispatches == 1000LL );
+   CHECK( snap->dispersions == 10LL );
+
+/* /proc/stat, the first 8 fields of the "cpu" line, guest is part of user */
+   CHECK( snap->cpu_total == 9640ULL );
+   CHECK( snap->cpu_idle == 8000ULL );
+   CHECK( snap->cpu_steal == 20ULL );
+   CHECK( snap->online_cpus == 3 );
+   CHECK( snap->procs_running == 3LL );
+   CHECK( snap->procs_blocked == 1LL );
+
+/* cpu2 is offline */
+   CHECK( ibmpower_cpu_times( ctx, cpus, 8 ) == 4 );
+   CHECK( cpus[0].online && (cpus[0].total == 3669ULL) && (cpus[0].idle == 3000ULL) );
+   CHECK( cpus[0].steal == 10ULL );
+   CHECK( cpus[1].online && (cpus[1].total == 2989ULL) );
+   CHECK( ! cpus[2].online );
+   CHECK( cpus[3].online && (cpus[3].total == 2982ULL) );
+   CHECK( ! cpus[4].online );
+
+/* the first pass over /proc/diskstats only sets the baselines */
+   CHECK( snap->disk_ios == 0ULL );
+   CHECK( snap->disk_read_bytes == 0ULL );
+   CHECK( snap->disk_write_bytes == 0ULL );
+   CHECK( snap->disk_io_msec == 0ULL );
+}
+
+
+
+static void
+test_second_state( ibmpower_ctx *ctx, ibmpower_snapshot *snap )
+{
+   ibmpower_cpu cpus[8];
+
+
+   CHECK( ibmpower_sample( ctx, IBMPOWER_SAMPLE_ALL, snap ) == 0 );
+   CHECK( snap->valid == IBMPOWER_SAMPLE_ALL );
+
+   CHECK( snap->purr == 1536000000LL );
+   CHECK( snap->pool_idle_time == 7680000000LL );
+   CHECK( snap->dispatches == 1500LL );
+
+/* cpu2 back online and cpu3 gone, the array shrinks again */
+   CHECK( snap->online_cpus == 3 );
+   CHECK( snap->cpu_total == 10300ULL );
+   CHECK( snap->procs_running == 2LL );
+   CHECK( snap->procs_blocked == 0LL );
+   CHECK( ibmpower_cpu_times( ctx, cpus, 8 ) == 3 );
+   CHECK( cpus[2].online && (cpus[2].total == 2982ULL) );
+   CHECK( ! cpus[3].online );
+
+/*
+ * sda (20 fields) 110 ios, 400 + 400 sectors, 60 ms and sdb 7 ios,
+ * 16 + 40 sectors, 3 ms.  sda1, dm-0 and md0 are left out, sdc is new.
+ */
+   CHECK( snap->disk_ios == 117ULL );
+   CHECK( snap->disk_read_bytes == 416ULL * 512ULL );
+   CHECK( snap->disk_write_bytes == 440ULL * 512ULL );
+   CHECK( snap->disk_io_msec == 63ULL );
+}
+
+
+
+static void
+test_counters( void )
+{
+   ibmpower_counter c = IBMPOWER_COUNTER_INIT;
+   ibmpower_ratio r = IBMPOWER_RATIO_INIT;
+
+
+   CHECK( ibmpower_counter_rate( &c, 100LL, 10.0 ) == 0.0 );
+   CHECK( ibmpower_counter_rate( &c, 300LL, 12.0 ) == 100.0 );
+   CHECK( ibmpower_counter_rate( &c, 900LL, 12.0 ) == 100.0 );    /* same time */
+   CHECK( ibmpower_counter_rate( &c, 50LL, 14.0 ) == 100.0 );     /* reset */
+   CHECK( ibmpower_counter_rate( &c, 250LL, 16.0 ) == 100.0 );
+   CHECK( ibmpower_counter_rate( &c, -1LL, 18.0 ) == 0.0 );
+
+   CHECK( ibmpower_ratio_update( &r, 1000LL, 10LL ) == 0.0 );
+   CHECK( ibmpower_ratio_update( &r, 1500LL, 12LL ) == 250.0 );
+   CHECK( ibmpower_ratio_update( &r, 1500LL, 12LL ) == 0.0 );     /* no new events */
+   CHECK( ibmpower_ratio_update( &r, 2100LL, 14LL ) == 300.0 );
+   CHECK( ibmpower_ratio_update( &r, 100LL, 1LL ) == 300.0 );     /* reset */
+   CHECK( ibmpower_ratio_update( &r, 300LL, 3LL ) == 100.0 );
+}
+
+
+
+int
+main( void )
+{
+   const char *srcdir = getenv( "srcdir" );
+   ibmpower_ctx *ctx;
+   ibmpower_snapshot first, second;
+   ibmpower_rates r = IBMPOWER_RATES_INIT;
+   char path[PATH_MAX];
+   double dt;
+
+
+/* automake runs the tests with srcdir set, by hand it is the current directory */
+   snprintf( path, sizeof( path ), "%s/test/procfs", srcdir ? srcdir : "." );
+   if (realpath( path, fixtures ) == NULL)
+   {
+      perror( path );
+      return( 1 );
+   }
+
+   if (mkdtemp( tmpdir ) == NULL)
+   {
+      perror( tmpdir );
+      return( 1 );
+   }
+   snprintf( root, sizeof( root ), "%s/root", tmpdir );
+
+   if (use_state( 1 ))
+      return( 1 );
+
+   ctx = ibmpower_open_backend( "procfs", root );
+   CHECK( ctx != NULL );
+
+   if (ctx)
+   {
+      ibmpower_set_max_age( ctx, 0.0 );
+
+      test_first_state( ctx, &first );
+      ibmpower_rates_update( ctx, &r, &first );
+
+/* long enough that the rates stay below the sanity limits of libibmpower.c */
+      usleep( 100000 );
+
+      if (use_state( 2 ) == 0)
+      {
+         test_second_state( ctx, &second );
+         ibmpower_rates_update( ctx, &r, &second );
+
+/* 512000000 PURR ticks are one core for one second of the timebase */
+         dt = second.lpar_time - first.lpar_time;
+         CHECK( fabs( r.physc * dt - 1.0 ) < 0.001 );
+         CHECK( fabs( r.pool_idle * dt - 5.0 ) < 0.001 );
+         CHECK( fabs( r.steal_pct - 1000.0 / 660.0 ) < 0.001 );
+      }
+
+      ibmpower_close( ctx );
+   }
+
+   test_counters();
+
+   unlink( root );
+   rmdir( tmpdir );
+
+   if (failed)
+      fprintf( stderr, "test_procfs: %d checks failed\n", failed );
+
+   return( failed ? 1 : 0 );
+}